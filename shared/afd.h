@@ -70,15 +70,19 @@ struct AfDWithIOCP
    HANDLE iocp;
 };
 
-inline AfDWithIOCP CreateAfdAndIOCP(
+// Opens a \Device\Afd handle and associates it with the supplied IOCP. Each
+// handle can have its own poll pending so more than one can share an IOCP.
+
+inline HANDLE CreateAfd(
+   const HANDLE hIOCP,
    const LPCWSTR deviceName,
    const UCHAR flags = FILE_SKIP_SET_EVENT_ON_HANDLE)
 {
    const auto deviceNameLengthInBytes = static_cast<USHORT>(wcslen(deviceName) * sizeof(wchar_t));
 
-   static const UNICODE_STRING deviceNameUString { deviceNameLengthInBytes, deviceNameLengthInBytes, const_cast<LPWSTR>(deviceName) };
+   const UNICODE_STRING deviceNameUString { deviceNameLengthInBytes, deviceNameLengthInBytes, const_cast<LPWSTR>(deviceName) };
 
-   static OBJECT_ATTRIBUTES attributes = {
+   OBJECT_ATTRIBUTES attributes = {
       sizeof(OBJECT_ATTRIBUTES),
       nullptr,
       const_cast<UNICODE_STRING *>(&deviceNameUString),
@@ -120,10 +124,6 @@ inline AfDWithIOCP CreateAfdAndIOCP(
       ErrorExit("NtCreateFile");
    }
 
-   // Create an IOCP for notifications...
-
-   const HANDLE hIOCP = CreateIOCP();
-
    // Associate the AFD handle with the IOCP...
 
    if (nullptr == CreateIoCompletionPort(hAFD, hIOCP, 0, 0))
@@ -136,6 +136,19 @@ inline AfDWithIOCP CreateAfdAndIOCP(
       ErrorExit("SetFileCompletionNotificationModes");
    }
 
+   return hAFD;
+}
+
+inline AfDWithIOCP CreateAfdAndIOCP(
+   const LPCWSTR deviceName,
+   const UCHAR flags = FILE_SKIP_SET_EVENT_ON_HANDLE)
+{
+   // Create an IOCP for notifications...
+
+   const HANDLE hIOCP = CreateIOCP();
+
+   const HANDLE hAFD = CreateAfd(hIOCP, deviceName, flags);
+
    return AfDWithIOCP{ hAFD, hIOCP};
 }
 
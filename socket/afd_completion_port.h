@@ -0,0 +1,61 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_completion_port.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+
+// The part of an I/O completion port that the worker pool needs. On Windows
+// this is an IOCP and the contexts are the OVERLAPPED pointers that were given
+// to the poll IOCTLs, elsewhere it's a completion_queue, which lets the
+// threading be tested without AFD.
+// A null context is never a completion, the worker pool uses it to tell a
+// thread to exit.
+
+class afd_completion_port
+{
+   public :
+
+      static constexpr uint32_t infinite = UINT32_MAX;
+
+      // returns false if nothing completed within the timeout
+
+      virtual bool get(
+         void *&pContext,
+         uint32_t timeout_ms) = 0;
+
+      virtual void post(
+         void *pContext) = 0;
+
+   protected :
+
+      ~afd_completion_port() = default;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_completion_port.h
+///////////////////////////////////////////////////////////////////////////////
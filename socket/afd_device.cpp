@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_device.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#include <WinSock2.h>
+
+#include "afd_device.h"
+#include "afd_poll_set.h"
+
+#include "../shared/afd.h"
+
+#include <cstddef>
+#include <exception>
+
+static_assert(sizeof(afd_poll_handle_info) == sizeof(AFD_POLL_HANDLE_INFO));
+static_assert(offsetof(afd_poll_handle_info, events) == offsetof(AFD_POLL_HANDLE_INFO, Events));
+static_assert(offsetof(afd_poll_handle_info, status) == offsetof(AFD_POLL_HANDLE_INFO, Status));
+
+static_assert(sizeof(afd_poll_info) == sizeof(AFD_POLL_INFO));
+static_assert(offsetof(afd_poll_info, number_of_handles) == offsetof(AFD_POLL_INFO, NumberOfHandles));
+static_assert(offsetof(afd_poll_info, exclusive) == offsetof(AFD_POLL_INFO, Exclusive));
+static_assert(offsetof(afd_poll_info, handles) == offsetof(AFD_POLL_INFO, Handles));
+
+afd_device::afd_device(
+   HANDLE hAfd)
+   :  hAfd(hAfd),
+      statusBlocks{}
+{
+}
+
+IO_STATUS_BLOCK &afd_device::status_block(
+   const uint32_t buffer)
+{
+   if (buffer >= afd_poll_set::poll_buffers)
+   {
+      throw std::exception("invalid poll buffer");
+   }
+
+   return statusBlocks[buffer];
+}
+
+bool afd_device::poll(
+   const uint32_t buffer,
+   afd_poll_info &in,
+   const uint32_t in_size,
+   afd_poll_info &out,
+   const uint32_t out_size,
+   void *pContext)
+{
+   IO_STATUS_BLOCK &statusBlock = status_block(buffer);
+
+   memset(&statusBlock, 0, sizeof statusBlock);
+
+   return SetupPollForSocketEventsX(
+      hAfd,
+      &in,
+      in_size,
+      statusBlock,
+      &out,
+      out_size,
+      pContext);
+}
+
+void afd_device::cancel(
+   const uint32_t buffer)
+{
+   // the status block identifies the poll, if it has already completed there's
+   // nothing to cancel
+
+   if (!CancelIoEx(hAfd, reinterpret_cast<LPOVERLAPPED>(&status_block(buffer))))
+   {
+      const DWORD lastError = GetLastError();
+
+      if (lastError != ERROR_NOT_FOUND)
+      {
+         ErrorExit("CancelIoEx");
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_device.cpp
+///////////////////////////////////////////////////////////////////////////////
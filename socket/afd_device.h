@@ -0,0 +1,73 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_device.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#include <WinSock2.h>
+
+#include "shared/afd.h"
+
+#include "afd_poll_device.h"
+#include "afd_poll_set.h"
+
+// An afd_poll_device that issues IOCTL_AFD_POLL on a \Device\Afd handle. Each of
+// the poll set's buffers has its own status block, which identifies the poll
+// that is pending on it when it's cancelled.
+
+class afd_device : public afd_poll_device
+{
+   public :
+
+      explicit afd_device(
+         HANDLE hAfd);
+
+      bool poll(
+         uint32_t buffer,
+         afd_poll_info &in,
+         uint32_t in_size,
+         afd_poll_info &out,
+         uint32_t out_size,
+         void *pContext) override;
+
+      void cancel(
+         uint32_t buffer) override;
+
+   private :
+
+      IO_STATUS_BLOCK &status_block(
+         uint32_t buffer);
+
+      HANDLE hAfd;
+
+      IO_STATUS_BLOCK statusBlocks[afd_poll_set::poll_buffers];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_device.h
+///////////////////////////////////////////////////////////////////////////////
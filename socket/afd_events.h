@@ -27,17 +27,22 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-class afd_events
+#include "reactor.h"
+
+// The events interface predates the reactor, it is the same thing.
+
+using afd_events = reactor_events;
+
+class afd_timer_events
 {
    public :
 
-      virtual ULONG handle_events(
-         ULONG eventsToHandle,
-         NTSTATUS status) = 0;
+      virtual void on_timer(
+         uint64_t id) = 0;
 
    protected :
 
-      virtual ~afd_events() = default;
+      virtual ~afd_timer_events() = default;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -26,24 +26,26 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-#define _WINSOCK_DEPRECATED_NO_WARNINGS
-
-#include <WinSock2.h>
-
 #include "afd_handle.h"
-#include "afd_system.h"
 
 afd_handle::afd_handle(
-   afd_system &afd,
-   const DWORD slot)
+   reactor &afd)
+   :  afd(afd),
+      slot(afd.allocate_slot())
+{
+}
+
+afd_handle::afd_handle(
+   reactor &afd,
+   const uint32_t slot)
    :  afd(afd),
       slot(slot)
 {
 }
 
 void afd_handle::associate_socket(
-   SOCKET s,
-   afd_events &events) const
+   reactor_socket s,
+   reactor_events &events) const
 {
    afd.associate_socket(slot, s, events);
 }
@@ -53,8 +55,36 @@ void afd_handle::disassociate_socket() const
    afd.disassociate_socket(slot);
 }
 
+void afd_handle::closing_socket(
+   const bool poll_pending) const
+{
+   afd.closing_socket(slot, poll_pending);
+}
+
+void afd_handle::deferred(
+   const uint32_t events) const
+{
+   afd.deferred(slot, events);
+}
+
+bool afd_handle::after_dispatch() const
+{
+   return afd.after_dispatch(slot);
+}
+
+bool afd_handle::set_timer(
+   const uint32_t timeout_ms) const
+{
+   return afd.set_timer(slot, timeout_ms);
+}
+
+void afd_handle::cancel_timer() const
+{
+   afd.cancel_timer(slot);
+}
+
 bool afd_handle::poll(
-   ULONG events) const
+   uint32_t events) const
 {
    return afd.poll(slot, events);
 }
@@ -27,29 +27,44 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-class afd_system;
-class afd_events;
+#include "reactor.h"
 
 class afd_handle
 {
    public :
 
+   explicit afd_handle(
+      reactor &afd);
+
    afd_handle(
-      afd_system &afd,
-      const DWORD slot);
+      reactor &afd,
+      const uint32_t slot);
 
    void associate_socket(
-      SOCKET s,
-      afd_events &events) const;
+      reactor_socket s,
+      reactor_events &events) const;
 
    void disassociate_socket() const;
 
+   void closing_socket(
+      bool poll_pending) const;
+
+   void deferred(
+      uint32_t events) const;
+
+   bool after_dispatch() const;
+
+   bool set_timer(
+      uint32_t timeout_ms) const;
+
+   void cancel_timer() const;
+
    bool poll(
-      ULONG events) const;
+      uint32_t events) const;
 
-   afd_system &afd;
+   reactor &afd;
 
-   const DWORD slot;
+   const uint32_t slot;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
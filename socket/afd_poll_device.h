@@ -0,0 +1,69 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_poll_device.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+
+struct afd_poll_info;
+
+// The seam between the code that decides what to poll for and the thing that
+// actually does the polling. On Windows this is an IOCTL_AFD_POLL issued on a
+// \Device\Afd handle, in tests it can be anything that can hold on to the buffers
+// until it decides to complete the poll.
+
+class afd_poll_device
+{
+   public :
+
+      // Returns true if the poll completed immediately, in which case the output
+      // buffer is valid now, otherwise the completion is delivered later with
+      // pContext as the completion context. A poll can be pending on each of the
+      // poll set's buffers at the same time, buffer says which one this is.
+
+      virtual bool poll(
+         uint32_t buffer,
+         afd_poll_info &in,
+         uint32_t in_size,
+         afd_poll_info &out,
+         uint32_t out_size,
+         void *pContext) = 0;
+
+      // Asks for the poll pending on the buffer to complete early. It still
+      // completes through the normal completion path, possibly with no results.
+
+      virtual void cancel(
+         uint32_t buffer) = 0;
+
+   protected :
+
+      virtual ~afd_poll_device() = default;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_poll_device.h
+///////////////////////////////////////////////////////////////////////////////
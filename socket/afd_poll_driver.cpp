@@ -0,0 +1,405 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_poll_driver.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#include <WinSock2.h>
+
+#include "afd_handle.h"
+#include "afd_poll_driver.h"
+#include "afd_events.h"
+
+#include "../shared/afd.h"
+
+#include <stdexcept>
+
+afd_poll_driver::afd_poll_driver(
+   HANDLE hAfd,
+   const int num_slots,
+   const afd_poll_set::submission_mode mode,
+   const threading threads)
+   :  threads(threads),
+      owned_device(std::make_unique<afd_device>(hAfd)),
+      device(*owned_device),
+      poll_set(num_slots, mode),
+      slot_events(poll_set.capacity(), nullptr),
+      timers(poll_set, GetTickCount64()),
+      slot_timers(timers),
+      expiring_timers(false),
+      completing_dispatch(false),
+      completions{ { *this, 0 } }
+{
+}
+
+afd_poll_driver::afd_poll_driver(
+   afd_poll_device &device,
+   const int num_slots,
+   const afd_poll_set::submission_mode mode,
+   const threading threads)
+   :  threads(threads),
+      device(device),
+      poll_set(num_slots, mode),
+      slot_events(poll_set.capacity(), nullptr),
+      timers(poll_set, GetTickCount64()),
+      slot_timers(timers),
+      expiring_timers(false),
+      completing_dispatch(false),
+      completions{ { *this, 0 } }
+{
+}
+
+uint32_t afd_poll_driver::allocate_slot()
+{
+   const auto guard = lock_if_shared();
+
+   const uint32_t slot = poll_set.allocate_slot();
+
+   slot_events.resize(poll_set.capacity(), nullptr);
+
+   return slot;
+}
+
+void afd_poll_driver::associate_socket(
+   uint32_t slot,
+   reactor_socket s,
+   reactor_events &events)
+{
+   const auto guard = lock_if_shared();
+
+   // the poll set validates the slot for us
+
+   poll_set.associate(slot, static_cast<uintptr_t>(GetBaseSocket(s)));
+
+   slot_events[slot] = &events;
+}
+
+void afd_poll_driver::disassociate_socket(
+   uint32_t slot)
+{
+   const auto guard = lock_if_shared();
+
+   slot_timers.cancel_timer(slot);
+
+   poll_set.disassociate(slot);
+
+   slot_events[slot] = nullptr;
+
+   // the poll set may have compacted
+
+   slot_events.resize(poll_set.capacity(), nullptr);
+}
+
+bool afd_poll_driver::poll(
+   uint32_t slot,
+   uint32_t events)
+{
+   const auto guard = lock_if_shared();
+
+   poll_set.set_events(slot, events);
+
+   if (poll_set.dispatching() || expiring_timers || completing_dispatch)
+   {
+      // staged, the poll is issued once the dispatch pass is complete
+
+      return false;
+   }
+
+   if (!poll_set.needs_submission())
+   {
+      // the pending poll already covers this interest
+
+      return false;
+   }
+
+   return submit();
+}
+
+bool afd_poll_driver::submit()
+{
+   // called with the lock held
+
+   // in active_slots mode the submission only contains the slots that have a
+   // handle and some interest, possibly nothing at all...
+
+   timers.prepare_submission(GetTickCount64());
+
+   if (!poll_set.build_submission())
+   {
+      // if a poll is pending it's cancelled, the changes are submitted once it
+      // has completed
+
+      const ULONG pending = poll_set.cancel_buffer();
+
+      if (pending != afd_poll_set::no_buffer)
+      {
+         device.cancel(pending);
+      }
+
+      return false;
+   }
+
+   const ULONG size = poll_set.submission_size();
+
+   const ULONG buffer = poll_set.submission_buffer();
+
+   const bool completed = device.poll(
+      buffer,
+      poll_set.poll_info_in(),
+      size,
+      poll_set.poll_info_out(),
+      size,
+      static_cast<afd_system_events *>(&completions[buffer]));
+
+   return completed;
+}
+
+void afd_poll_driver::handle_events(
+   const ULONG buffer)
+{
+   // one thread dispatches at a time, other threads that complete a poll for
+   // this system, or that poll, wait until the pass is done
+
+   const auto guard = lock_if_shared();
+
+   poll_set.dispatch(buffer, [this](const uint32_t slot, const uint32_t events, const int32_t status) -> uint32_t
+   {
+      reactor_events *pEvents = slot_events[slot];
+
+      if (!pEvents)
+      {
+         return 0;
+      }
+
+      return pEvents->handle_events(events, RtlNtStatusToDosError(status));
+   });
+
+   // the poll may have completed because it timed out
+
+   expire_timers(GetTickCount64());
+
+   complete_dispatch();
+
+   // one poll for all of the interest changes made during the pass
+
+   if (poll_set.needs_submission())
+   {
+      submit();
+   }
+}
+
+bool afd_poll_driver::after_dispatch(
+   const uint32_t slot)
+{
+   const auto guard = lock_if_shared();
+
+   if (!poll_set.dispatching() && !expiring_timers)
+   {
+      return false;
+   }
+
+   completing.emplace_back(slot, poll_set.generation(slot));
+
+   return true;
+}
+
+void afd_poll_driver::complete_dispatch()
+{
+   // called with the lock held, once the pass's events and timers have been
+   // dispatched; a socket that writes now sends, the polls it makes are staged
+
+   if (completing.empty())
+   {
+      return;
+   }
+
+   std::vector<std::pair<uint32_t, uint32_t>> complete;
+
+   complete.swap(completing);
+
+   completing_dispatch = true;
+
+   try
+   {
+      for (const auto &[slot, generation] : complete)
+      {
+         // the socket may have been closed during the pass
+
+         reactor_events *pEvents = slot < slot_events.size() ? slot_events[slot] : nullptr;
+
+         if (pEvents && poll_set.generation(slot) == generation)
+         {
+            pEvents->dispatch_complete();
+         }
+      }
+   }
+   catch (...)
+   {
+      completing_dispatch = false;
+
+      throw;
+   }
+
+   completing_dispatch = false;
+}
+
+bool afd_poll_driver::set_timer(
+   const uint32_t slot,
+   const uint32_t timeout_ms)
+{
+   const auto guard = lock_if_shared();
+
+   reactor_events *pEvents = slot < slot_events.size() ? slot_events[slot] : nullptr;
+
+   if (!pEvents)
+   {
+      throw std::runtime_error("slot is not associated");
+   }
+
+   slot_timers.set_timer(GetTickCount64(), slot, timeout_ms, *pEvents);
+
+   submit_for_timer();
+
+   return true;
+}
+
+void afd_poll_driver::cancel_timer(
+   const uint32_t slot)
+{
+   const auto guard = lock_if_shared();
+
+   slot_timers.cancel_timer(slot);
+}
+
+afd_poll_timers::timer_id afd_poll_driver::set_afd_timer(
+   const ULONG timeout,
+   afd_timer_events &events)
+{
+   const auto guard = lock_if_shared();
+
+   const afd_poll_timers::timer_id id = timers.set_timer(GetTickCount64(), timeout, reinterpret_cast<uintptr_t>(&events));
+
+   submit_for_timer();
+
+   return id;
+}
+
+void afd_poll_driver::submit_for_timer()
+{
+   // called with the lock held
+
+   // if the pending poll would time out too late then it's replaced, unless
+   // we're in the middle of a pass, in which case the poll at the end of the
+   // pass will have the right timeout
+
+   if (!poll_set.dispatching() && !expiring_timers && !completing_dispatch && poll_set.needs_submission())
+   {
+      submit();
+   }
+}
+
+bool afd_poll_driver::cancel_afd_timer(
+   const afd_poll_timers::timer_id id)
+{
+   const auto guard = lock_if_shared();
+
+   return timers.cancel_timer(id);
+}
+
+ULONG afd_poll_driver::timer_wait_timeout() const
+{
+   const auto guard = lock_if_shared();
+
+   const uint32_t timeout = timers.wait_timeout(GetTickCount64());
+
+   return timeout == afd_poll_timers::infinite ? INFINITE : timeout;
+}
+
+ULONG afd_poll_driver::expire_timers()
+{
+   const auto guard = lock_if_shared();
+
+   const ULONG expired = expire_timers(GetTickCount64());
+
+   complete_dispatch();
+
+   if (poll_set.needs_submission())
+   {
+      submit();
+   }
+
+   return expired;
+}
+
+afd_poll_set::statistics afd_poll_driver::stats() const
+{
+   const auto guard = lock_if_shared();
+
+   return poll_set.stats();
+}
+
+std::unique_lock<std::recursive_mutex> afd_poll_driver::lock_if_shared() const
+{
+   if (threads == threading::locked)
+   {
+      return std::unique_lock<std::recursive_mutex>(lock);
+   }
+
+   return std::unique_lock<std::recursive_mutex>(lock, std::defer_lock);
+}
+
+ULONG afd_poll_driver::expire_timers(
+   const ULONGLONG now)
+{
+   // called with the lock held, polls made by the handlers are staged
+
+   expiring_timers = true;
+
+   ULONG expired = 0;
+
+   try
+   {
+      expired = static_cast<ULONG>(timers.expire(now, [](const afd_poll_timers::timer_id id, const uintptr_t context)
+      {
+         reinterpret_cast<afd_timer_events *>(context)->on_timer(id);
+      }));
+   }
+   catch (...)
+   {
+      expiring_timers = false;
+
+      throw;
+   }
+
+   expiring_timers = false;
+
+   return expired;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_poll_driver.cpp
+///////////////////////////////////////////////////////////////////////////////
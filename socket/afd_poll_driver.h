@@ -0,0 +1,177 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_poll_driver.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#include <WinSock2.h>
+
+#include "shared/afd.h"
+
+#include "afd_system.h"
+#include "afd_poll_set.h"
+#include "afd_poll_timers.h"
+#include "afd_reactor_timers.h"
+#include "afd_device.h"
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// The afd_system that drives one afd_poll_set on one device. The sockets'
+// interest is submitted as a single poll, its results are dispatched to the
+// sockets, and the polls that they make during a pass are coalesced into one
+// at the end of it. Each poll times out when the next timer is due. Used from
+// one thread, or, with threading::locked, from any thread, with completions
+// handled on several threads one at a time.
+
+class afd_poll_driver : public afd_system
+{
+   public :
+
+      enum class threading
+      {
+         single_thread,
+         locked
+      };
+
+      uint32_t allocate_slot() override;
+
+      void associate_socket(
+         uint32_t slot,
+         reactor_socket s,
+         reactor_events &events) override;
+
+      void disassociate_socket(
+         uint32_t slot) override;
+
+      bool poll(
+         uint32_t slot,
+         uint32_t events) override;
+
+      // Timers are expired on the thread that handles the completions, each
+      // poll times out when the next timer is due.
+
+      bool set_timer(
+         uint32_t slot,
+         uint32_t timeout_ms) override;
+
+      void cancel_timer(
+         uint32_t slot) override;
+
+      // A socket that asks during a pass has dispatch_complete() called once
+      // the pass's events and timers have been dispatched, the polls that it
+      // makes then are part of the poll issued at the end of the pass.
+
+      bool after_dispatch(
+         uint32_t slot) override;
+
+      void handle_events(
+         ULONG buffer);
+
+      // Timers that aren't tied to a socket, returns the id that is passed to
+      // on_timer().
+
+      afd_poll_timers::timer_id set_afd_timer(
+         ULONG timeout,
+         afd_timer_events &events);
+
+      bool cancel_afd_timer(
+         afd_poll_timers::timer_id id);
+
+      // If there are no sockets to poll then nothing wakes us for the timers,
+      // wait for completions for no longer than this and then expire them.
+
+      ULONG timer_wait_timeout() const;
+
+      ULONG expire_timers();
+
+      // submissions / completions gives the IOCTLs issued per completion
+
+      afd_poll_set::statistics stats() const;
+
+   protected :
+
+      afd_poll_driver(
+         HANDLE hAfd,
+         int num_slots,
+         afd_poll_set::submission_mode mode,
+         threading threads);
+
+      afd_poll_driver(
+         afd_poll_device &device,
+         int num_slots,
+         afd_poll_set::submission_mode mode,
+         threading threads);
+
+      ~afd_poll_driver() override = default;
+
+   private :
+
+      std::unique_lock<std::recursive_mutex> lock_if_shared() const;
+
+      bool submit();
+
+      void submit_for_timer();
+
+      void complete_dispatch();
+
+      ULONG expire_timers(
+         ULONGLONG now);
+
+      const threading threads;
+
+      // recursive, as the handlers that we call whilst dispatching usually poll
+
+      mutable std::recursive_mutex lock;
+
+      std::unique_ptr<afd_device> owned_device;
+
+      afd_poll_device &device;
+
+      afd_poll_set poll_set;
+
+      std::vector<reactor_events *> slot_events;
+
+      afd_poll_timers timers;
+
+      afd_reactor_timers slot_timers;
+
+      bool expiring_timers;
+
+      bool completing_dispatch;
+
+      std::vector<std::pair<uint32_t, uint32_t>> completing;   // slot, generation
+
+      afd_buffer_events<afd_poll_driver> completions[afd_poll_set::poll_buffers];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_poll_driver.h
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,545 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_poll_set.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_poll_set.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static uint32_t validate_slots(
+   const uint32_t slots)
+{
+   if (slots < 1)
+   {
+      throw std::runtime_error("slots must be at least 1");
+   }
+
+   return slots;
+}
+
+afd_poll_set::afd_poll_set(
+   const uint32_t num_slots,
+   const submission_mode mode)
+   :  submit_mode(mode),
+      min_slots(validate_slots(num_slots)),
+      slots(num_slots, afd_poll_handle_info{}),
+      generations(num_slots, 0),
+      taken(num_slots, 0),
+      taken_count(0),
+      next_unused(0),
+      slots_used(0),
+      active_index(num_slots, no_slot),
+      in(afd_poll_info_size(num_slots)),
+      buffers{
+         { std::vector<std::byte>(afd_poll_info_size(num_slots)), num_slots, false, false } },
+      cancel(no_buffer),
+      submitted_size(0),
+      poll_timeout(no_timeout),
+      changed(false),
+      in_dispatch(false),
+      counters{}
+{
+   active.reserve(num_slots);
+}
+
+void afd_poll_set::validate_slot(
+   const uint32_t slot) const
+{
+   if (slot >= slots.size())
+   {
+      throw std::runtime_error("invalid slot");
+   }
+}
+
+uint32_t afd_poll_set::allocate_slot()
+{
+   while (!free_slots.empty())
+   {
+      const uint32_t slot = free_slots.back();
+
+      free_slots.pop_back();
+
+      if (slot < next_unused && !taken[slot])
+      {
+         take_slot(slot);
+
+         return slot;
+      }
+   }
+
+   while (next_unused < slots.size() && taken[next_unused])
+   {
+      ++next_unused;
+   }
+
+   if (next_unused == slots.size())
+   {
+      // grow geometrically, this only touches our bookkeeping, the poll buffers
+      // are resized when we next build a submission
+
+      resize_slots(capacity() * 2);
+   }
+
+   const uint32_t slot = next_unused;
+
+   take_slot(slot);
+
+   return slot;
+}
+
+void afd_poll_set::take_slot(
+   const uint32_t slot)
+{
+   if (taken[slot])
+   {
+      return;
+   }
+
+   if (slot >= next_unused)
+   {
+      // anything we skip over becomes free
+
+      for (uint32_t i = next_unused; i < slot; ++i)
+      {
+         if (!taken[i])
+         {
+            free_slots.push_back(i);
+         }
+      }
+
+      next_unused = slot + 1;
+   }
+
+   taken[slot] = 1;
+
+   ++taken_count;
+}
+
+void afd_poll_set::release_slot(
+   const uint32_t slot)
+{
+   validate_slot(slot);
+
+   if (slots[slot].handle)
+   {
+      throw std::runtime_error("slot is still associated");
+   }
+
+   if (!taken[slot])
+   {
+      return;
+   }
+
+   taken[slot] = 0;
+
+   --taken_count;
+
+   if (slot + 1 == next_unused)
+   {
+      // trim the free slots off the top, any of them that are on the free list
+      // become stale and are skipped when popped
+
+      while (next_unused && !taken[next_unused - 1])
+      {
+         --next_unused;
+      }
+   }
+   else
+   {
+      free_slots.push_back(slot);
+   }
+
+   if (!in_dispatch)
+   {
+      compact();
+   }
+}
+
+void afd_poll_set::compact()
+{
+   // compact when we're using less than a quarter of the slots, hysteresis
+   // stops us thrashing between sizes
+
+   uint32_t new_capacity = capacity();
+
+   while (new_capacity / 2 >= min_slots && next_unused <= new_capacity / 4)
+   {
+      new_capacity /= 2;
+   }
+
+   if (new_capacity != capacity())
+   {
+      resize_slots(new_capacity);
+   }
+   else if (free_slots.size() > slots.size())
+   {
+      rebuild_free_slots();
+   }
+}
+
+void afd_poll_set::resize_slots(
+   const uint32_t new_capacity)
+{
+   slots.resize(new_capacity, afd_poll_handle_info{});
+   generations.resize(new_capacity, 0);
+   taken.resize(new_capacity, 0);
+   active_index.resize(new_capacity, no_slot);
+
+   if (free_slots.size() > next_unused)
+   {
+      rebuild_free_slots();
+   }
+}
+
+void afd_poll_set::rebuild_free_slots()
+{
+   free_slots.clear();
+
+   for (uint32_t slot = next_unused; slot > 0; --slot)
+   {
+      if (!taken[slot - 1])
+      {
+         free_slots.push_back(slot - 1);
+      }
+   }
+}
+
+void afd_poll_set::associate(
+   const uint32_t slot,
+   const uintptr_t handle)
+{
+   validate_slot(slot);
+
+   if (slots[slot].handle)
+   {
+      throw std::runtime_error("slot already associated");
+   }
+
+   if (!handle_to_slot.emplace(handle, slot).second)
+   {
+      throw std::runtime_error("handle already associated");
+   }
+
+   take_slot(slot);
+
+   slots[slot].handle = handle;
+   slots[slot].status = 0;
+
+   if (slot >= slots_used)
+   {
+      slots_used = slot + 1;
+   }
+
+   if (slots[slot].events)
+   {
+      activate(slot);
+
+      changed = true;
+   }
+}
+
+void afd_poll_set::disassociate(
+   const uint32_t slot)
+{
+   validate_slot(slot);
+
+   if (slots[slot].handle)
+   {
+      handle_to_slot.erase(slots[slot].handle);
+   }
+
+   deactivate(slot);
+
+   slots[slot] = afd_poll_handle_info{};
+
+   ++generations[slot];
+
+   if (slot + 1 == slots_used)
+   {
+      while (slots_used && !slots[slots_used - 1].handle)
+      {
+         --slots_used;
+      }
+   }
+
+   release_slot(slot);
+}
+
+void afd_poll_set::set_events(
+   const uint32_t slot,
+   const uint32_t events)
+{
+   validate_slot(slot);
+
+   slots[slot].status = 0;
+
+   if (slots[slot].events != events)
+   {
+      const bool added = (events & ~slots[slot].events) != 0;
+
+      slots[slot].events = events;
+
+      if (slots[slot].handle && added)
+      {
+         changed = true;
+
+         if (in_dispatch)
+         {
+            ++counters.staged_changes;
+         }
+      }
+   }
+
+   if (events && slots[slot].handle)
+   {
+      activate(slot);
+   }
+   else
+   {
+      deactivate(slot);
+   }
+}
+
+uint32_t afd_poll_set::get_events(
+   const uint32_t slot) const
+{
+   validate_slot(slot);
+
+   return slots[slot].events;
+}
+
+const afd_poll_handle_info &afd_poll_set::slot_info(
+   const uint32_t slot) const
+{
+   validate_slot(slot);
+
+   return slots[slot];
+}
+
+uint32_t afd_poll_set::slot_for_handle(
+   const uintptr_t handle) const
+{
+   const auto it = handle_to_slot.find(handle);
+
+   if (it == handle_to_slot.end())
+   {
+      return no_slot;
+   }
+
+   return it->second;
+}
+
+void afd_poll_set::activate(
+   const uint32_t slot)
+{
+   if (active_index[slot] == no_slot)
+   {
+      active_index[slot] = static_cast<uint32_t>(active.size());
+
+      active.push_back(slot);
+   }
+}
+
+void afd_poll_set::deactivate(
+   const uint32_t slot)
+{
+   const uint32_t index = active_index[slot];
+
+   if (index != no_slot)
+   {
+      // swap the last active slot into the gap
+
+      const uint32_t last = active.back();
+
+      active[index] = last;
+      active_index[last] = index;
+
+      active.pop_back();
+
+      active_index[slot] = no_slot;
+   }
+}
+
+bool afd_poll_set::in_flight(
+   const uint32_t buffer) const
+{
+   if (buffer >= poll_buffers)
+   {
+      throw std::runtime_error("invalid poll buffer");
+   }
+
+   return buffers[buffer].in_flight;
+}
+
+afd_poll_info &afd_poll_set::poll_info_out(
+   const uint32_t buffer)
+{
+   if (buffer >= poll_buffers)
+   {
+      throw std::runtime_error("invalid poll buffer");
+   }
+
+   return *reinterpret_cast<afd_poll_info *>(buffers[buffer].out.data());
+}
+
+void afd_poll_set::resize_buffer(
+   poll_buffer &buffer,
+   const uint32_t number_of_handles)
+{
+   uint32_t new_handles = buffer.handles;
+
+   if (number_of_handles > buffer.handles)
+   {
+      new_handles = std::max(number_of_handles, buffer.handles * 2);
+   }
+   else if (number_of_handles < buffer.handles / 4)
+   {
+      new_handles = std::max(min_slots, number_of_handles * 2);
+   }
+
+   if (new_handles != buffer.handles)
+   {
+      buffer.out.assign(afd_poll_info_size(new_handles), std::byte{});
+
+      buffer.handles = new_handles;
+   }
+
+   // the input buffer is copied by the kernel when the poll is issued so the
+   // next poll can be built in it whilst this one is pending
+
+   if (in.size() != buffer.out.size())
+   {
+      in.assign(buffer.out.size(), std::byte{});
+   }
+}
+
+bool afd_poll_set::completed(
+   const uint32_t buffer)
+{
+   if (buffer >= poll_buffers)
+   {
+      throw std::runtime_error("invalid poll buffer");
+   }
+
+   if (!buffers[buffer].in_flight)
+   {
+      return false;
+   }
+
+   buffers[buffer].in_flight = false;
+
+   buffers[buffer].cancelled = false;
+
+   ++counters.completions;
+
+   return true;
+}
+
+uint32_t afd_poll_set::build_submission()
+{
+   const uint32_t number_of_handles = (submit_mode == submission_mode::all_slots) ?
+      slots_used :
+      static_cast<uint32_t>(active.size());
+
+   cancel = no_buffer;
+
+   if (!number_of_handles)
+   {
+      changed = false;
+
+      return 0;
+   }
+
+   const uint32_t next = submission_buffer();
+
+   poll_buffer &buffer = buffers[next];
+
+   if (buffer.in_flight)
+   {
+      // the changes stay staged, the pending poll is asked to complete, once,
+      // and they're picked up when it has...
+
+      if (!buffer.cancelled)
+      {
+         buffer.cancelled = true;
+
+         cancel = next;
+
+         ++counters.cancelled;
+      }
+
+      return 0;
+   }
+
+   resize_buffer(buffer, number_of_handles);
+
+   afd_poll_info &pollInfoIn = poll_info_in();
+
+   pollInfoIn.exclusive = 0;
+   pollInfoIn.timeout = poll_timeout;
+   pollInfoIn.number_of_handles = number_of_handles;
+
+   if (submit_mode == submission_mode::all_slots)
+   {
+      // the original behaviour, every slot up to the highest slot in use,
+      // whether it has a handle and interest or not...
+
+      memcpy(pollInfoIn.handles, slots.data(), number_of_handles * sizeof(afd_poll_handle_info));
+   }
+   else
+   {
+      uint32_t i = 0;
+
+      for (const uint32_t slot : active)
+      {
+         pollInfoIn.handles[i++] = slots[slot];
+      }
+   }
+
+   submitted_size = afd_poll_info_size(number_of_handles);
+
+   // the kernel only writes back the handles that have events, so the output
+   // buffer only needs to be cleared as far as we're going to look at it
+
+   memset(buffer.out.data(), 0, submitted_size);
+
+   buffer.in_flight = true;
+
+   changed = false;
+
+   ++counters.submissions;
+
+   counters.handles_submitted += number_of_handles;
+
+   return number_of_handles;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_poll_set.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,456 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_poll_set.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Platform neutral versions of the wepoll AFD_POLL_HANDLE_INFO and AFD_POLL_INFO
+// structures. These are layout compatible with the Windows structures so that the
+// buffers that we build here can be passed directly to IOCTL_AFD_POLL...
+
+struct afd_poll_handle_info
+{
+   uintptr_t handle;
+   uint32_t events;
+   int32_t status;
+};
+
+struct afd_poll_info
+{
+   int64_t timeout;
+   uint32_t number_of_handles;
+   uint32_t exclusive;
+   afd_poll_handle_info handles[1];
+};
+
+constexpr uint32_t afd_poll_info_size(
+   const uint32_t number_of_handles)
+{
+   return static_cast<uint32_t>(sizeof(afd_poll_info) + ((number_of_handles ? number_of_handles - 1 : 0) * sizeof(afd_poll_handle_info)));
+}
+
+class afd_poll_set
+{
+   public :
+
+      enum class submission_mode
+      {
+         all_slots,           // submit every slot up to the highest slot in use
+         active_slots         // submit only slots with a handle and non-zero interest
+      };
+
+      static constexpr uint32_t no_slot = UINT32_MAX;
+
+      // The output buffer of a poll belongs to the kernel until the poll
+      // completes. Interest can be changed whilst a poll is pending, but AFD
+      // doesn't complete a second poll for a socket that has one pending for
+      // other events, see understand.cpp, so rather than issue a new poll
+      // alongside the pending one the changes are staged, the pending poll is
+      // cancelled, and they're submitted once it completes. So there's only
+      // ever one poll pending, and one buffer for it to use.
+
+      static constexpr uint32_t poll_buffers = 1;
+
+      static constexpr uint32_t no_buffer = UINT32_MAX;
+
+      afd_poll_set(
+         uint32_t num_slots,
+         submission_mode mode = submission_mode::all_slots);
+
+      afd_poll_set(const afd_poll_set &) = delete;
+      afd_poll_set(afd_poll_set &&) = delete;
+
+      afd_poll_set& operator=(const afd_poll_set &) = delete;
+      afd_poll_set& operator=(afd_poll_set &&) = delete;
+
+      // Hands out a free slot, growing the set if there are none. Slots are
+      // returned by disassociate(), or release_slot() if they were never
+      // associated. The set shrinks when few slots are in use, but not whilst
+      // a dispatch pass is in progress.
+
+      uint32_t allocate_slot();
+
+      void release_slot(
+         uint32_t slot);
+
+      // Associating a slot that was not allocated takes it, so callers that
+      // choose their own slots can't be handed the same slot by allocate_slot().
+      // Disassociating always releases the slot.
+
+      void associate(
+         uint32_t slot,
+         uintptr_t handle);
+
+      void disassociate(
+         uint32_t slot);
+
+      void set_events(
+         uint32_t slot,
+         uint32_t events);
+
+      uint32_t get_events(
+         uint32_t slot) const;
+
+      const afd_poll_handle_info &slot_info(
+         uint32_t slot) const;
+
+      uint32_t slot_for_handle(
+         uintptr_t handle) const;
+
+      uint32_t active_slots() const
+      {
+         return static_cast<uint32_t>(active.size());
+      }
+
+      uint32_t slots_in_use() const
+      {
+         return taken_count;
+      }
+
+      uint32_t capacity() const
+      {
+         return static_cast<uint32_t>(slots.size());
+      }
+
+      uint32_t buffer_capacity() const
+      {
+         return buffers[0].handles;
+      }
+
+      submission_mode mode() const
+      {
+         return submit_mode;
+      }
+
+      struct statistics
+      {
+         uint64_t submissions;               // polls built for issue to the device
+         uint64_t completions;               // polls whose results have been dispatched
+         uint64_t handles_submitted;
+         uint64_t staged_changes;            // interest changes made during a dispatch pass
+         uint64_t cancelled;                 // pending polls cancelled so that changes could be submitted
+      };
+
+      const statistics &stats() const
+      {
+         return counters;
+      }
+
+      // True whilst dispatch() is calling the handler. Interest changes made
+      // then are staged and should be submitted once the pass is complete,
+      // rather than each causing a new poll.
+
+      bool dispatching() const
+      {
+         return in_dispatch;
+      }
+
+      // Changes each time the slot is disassociated, so that something noted
+      // against a slot can be checked against the socket that now holds it.
+
+      uint32_t generation(
+         const uint32_t slot) const
+      {
+         return slot < generations.size() ? generations[slot] : 0;
+      }
+
+      // True if a poll should be issued; either interest has been added since
+      // the last submission or the last poll has completed, and there's some
+      // interest to poll for. Removing interest doesn't need a new poll, events
+      // that are no longer wanted are filtered out when the results are
+      // dispatched.
+
+      bool needs_submission() const
+      {
+         return !active.empty() && (changed || !buffers[0].in_flight);
+      }
+
+      // The Timeout written into the polls that are built from now on, AFD
+      // completes a poll with no handles when it expires. Negative values are
+      // relative, in 100ns units, no_timeout is the default.
+
+      static constexpr int64_t no_timeout = INT64_MAX;
+
+      void set_timeout(
+         const int64_t timeout)
+      {
+         poll_timeout = timeout;
+      }
+
+      int64_t get_timeout() const
+      {
+         return poll_timeout;
+      }
+
+      // Makes needs_submission() true, if there's anything to poll for, so that
+      // a poll with an earlier timeout can replace the one that is pending.
+
+      void require_submission()
+      {
+         changed = true;
+      }
+
+      // Builds the input buffer for the next poll and clears the output buffer
+      // that the poll will use. Returns the number of handles that will be
+      // submitted, zero means that there is nothing to poll for, or that a poll
+      // is pending, in which case the changes stay staged until it completes.
+
+      uint32_t build_submission();
+
+      // The buffer that the last submission was built for.
+
+      uint32_t submission_buffer() const
+      {
+         return 0;
+      }
+
+      // After a build_submission() that staged the changes because a poll is
+      // pending, the buffer of that poll, which should be cancelled so that it
+      // completes and the changes can be submitted. no_buffer if there's
+      // nothing to cancel, or it was cancelled by an earlier submission.
+
+      uint32_t cancel_buffer() const
+      {
+         return cancel;
+      }
+
+      bool in_flight(
+         uint32_t buffer) const;
+
+      afd_poll_info &poll_info_in()
+      {
+         return *reinterpret_cast<afd_poll_info *>(in.data());
+      }
+
+      afd_poll_info &poll_info_out()
+      {
+         return poll_info_out(submission_buffer());
+      }
+
+      afd_poll_info &poll_info_out(
+         uint32_t buffer);
+
+      uint32_t submission_size() const
+      {
+         return submitted_size;
+      }
+
+      // Walks the handles in the output buffer of a completed poll, maps each one
+      // back to its slot and calls handler(slot, events, status). Events that the
+      // slot is no longer interested in are not reported. The value returned by
+      // the handler becomes the new interest for the slot, unless the handler
+      // disassociated the slot.
+
+      template <typename handler>
+      uint32_t dispatch(
+         const uint32_t buffer,
+         handler &&handle_events)
+      {
+         if (!completed(buffer))
+         {
+            return 0;
+         }
+
+         const afd_poll_info &results = poll_info_out(buffer);
+
+         uint32_t dispatched = 0;
+
+         dispatch_pass pass(*this);
+
+         for (uint32_t i = 0; i < results.number_of_handles; ++i)
+         {
+            const afd_poll_handle_info &result = results.handles[i];
+
+            const uint32_t slot = slot_for_handle(result.handle);
+
+            if (slot != no_slot)
+            {
+               // the poll may have been built before the interest changed
+
+               const uint32_t events = result.events & slots[slot].events;
+
+               if (events || (result.status && slots[slot].events))
+               {
+                  const uint32_t generation = generations[slot];
+
+                  const uint32_t new_events = handle_events(slot, events, result.status);
+
+                  // the handler may have closed the socket, and the slot may
+                  // now belong to a socket that it has opened since
+
+                  if (generations[slot] == generation)
+                  {
+                     set_events(slot, new_events);
+                  }
+
+                  ++dispatched;
+               }
+            }
+         }
+
+         return dispatched;
+      }
+
+      // Dispatches the results of the last poll submitted, for callers that only
+      // have one poll pending at a time.
+
+      template <typename handler>
+      uint32_t dispatch(
+         handler &&handle_events)
+      {
+         return dispatch(submission_buffer(), std::forward<handler>(handle_events));
+      }
+
+   private :
+
+      // Slots that are released by the handler stay where they are until the
+      // pass is complete, the results that are still to be dispatched refer to
+      // them, so the set is only compacted once the pass is over.
+
+      class dispatch_pass
+      {
+         public :
+
+            explicit dispatch_pass(
+               afd_poll_set &set)
+               :  set(set)
+            {
+               set.in_dispatch = true;
+            }
+
+            dispatch_pass(const dispatch_pass &) = delete;
+            dispatch_pass& operator=(const dispatch_pass &) = delete;
+
+            ~dispatch_pass()
+            {
+               set.in_dispatch = false;
+
+               set.compact();
+            }
+
+         private :
+
+            afd_poll_set &set;
+      };
+
+      void validate_slot(
+         uint32_t slot) const;
+
+      void take_slot(
+         uint32_t slot);
+
+      void compact();
+
+      void resize_slots(
+         uint32_t new_capacity);
+
+      void rebuild_free_slots();
+
+      struct poll_buffer
+      {
+         std::vector<std::byte> out;
+
+         uint32_t handles;
+
+         bool in_flight;
+
+         bool cancelled;
+      };
+
+      void resize_buffer(
+         poll_buffer &buffer,
+         uint32_t number_of_handles);
+
+      bool completed(
+         uint32_t buffer);
+
+      void activate(
+         uint32_t slot);
+
+      void deactivate(
+         uint32_t slot);
+
+      const submission_mode submit_mode;
+
+      const uint32_t min_slots;
+
+      std::vector<afd_poll_handle_info> slots;
+
+      std::vector<uint32_t> generations;     // bumped when a slot is disassociated
+
+      // slot allocation; every taken slot is below next_unused, free slots below
+      // next_unused live on the free list, which may contain stale entries that
+      // are skipped when popped
+
+      std::vector<uint8_t> taken;
+
+      uint32_t taken_count;
+
+      uint32_t next_unused;
+
+      std::vector<uint32_t> free_slots;
+
+      uint32_t slots_used;                   // highest associated slot + 1
+
+      // dense set of slots that have a handle and non-zero interest, along with
+      // the position of each slot within it so that removal is O(1)
+
+      std::vector<uint32_t> active;
+
+      std::vector<uint32_t> active_index;
+
+      std::unordered_map<uintptr_t, uint32_t> handle_to_slot;
+
+      // IOCTL_AFD_POLL is METHOD_BUFFERED, the input is copied when the poll is
+      // issued but the output buffer is written when the poll completes, so an
+      // output buffer is never touched whilst a poll is pending on it
+
+      std::vector<std::byte> in;
+
+      poll_buffer buffers[poll_buffers];
+
+      uint32_t cancel;                       // buffer of a pending poll to cancel, see cancel_buffer()
+
+      uint32_t submitted_size;
+
+      int64_t poll_timeout;
+
+      bool changed;                          // interest added, or an earlier timeout, since the last submission
+
+      bool in_dispatch;
+
+      statistics counters;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_poll_set.h
+///////////////////////////////////////////////////////////////////////////////
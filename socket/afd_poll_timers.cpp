@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_poll_timers.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_poll_timers.h"
+
+#include <limits>
+
+afd_poll_timers::afd_poll_timers(
+   afd_poll_set &poll_set,
+   const uint64_t now)
+   :  poll_set(poll_set),
+      wheel(now),
+      poll_deadline(timer_wheel::no_deadline)
+{
+}
+
+timer_wheel::timer_id afd_poll_timers::set_timer(
+   const uint64_t now,
+   const uint32_t timeout,
+   const uintptr_t context)
+{
+   const uint64_t deadline = now + timeout;
+
+   const timer_id id = wheel.arm(deadline, context);
+
+   if (deadline < poll_deadline)
+   {
+      // the pending poll won't wake us in time
+
+      poll_set.require_submission();
+   }
+
+   return id;
+}
+
+bool afd_poll_timers::cancel_timer(
+   const timer_id id)
+{
+   // if this was the next timer to expire then the poll will time out early
+   // and the next poll will be built with a later timeout; that's cheaper than
+   // replacing the pending poll
+
+   return wheel.cancel(id);
+}
+
+void afd_poll_timers::prepare_submission(
+   const uint64_t now)
+{
+   poll_deadline = wheel.next_expiry();
+
+   if (poll_deadline == timer_wheel::no_deadline)
+   {
+      poll_set.set_timeout(afd_poll_set::no_timeout);
+   }
+   else
+   {
+      poll_set.set_timeout(to_poll_timeout(poll_deadline > now ? poll_deadline - now : 0));
+   }
+}
+
+uint32_t afd_poll_timers::wait_timeout(
+   const uint64_t now) const
+{
+   const uint64_t deadline = wheel.next_expiry();
+
+   if (deadline == timer_wheel::no_deadline)
+   {
+      return infinite;
+   }
+
+   if (deadline <= now)
+   {
+      return 0;
+   }
+
+   const uint64_t timeout = deadline - now;
+
+   return timeout < infinite ? static_cast<uint32_t>(timeout) : infinite - 1;
+}
+
+int64_t afd_poll_timers::to_poll_timeout(
+   const uint64_t milliseconds)
+{
+   // relative timeouts are negative, in 100ns units
+
+   static constexpr uint64_t max_milliseconds = std::numeric_limits<int64_t>::max() / 10000;
+
+   if (milliseconds >= max_milliseconds)
+   {
+      return afd_poll_set::no_timeout;
+   }
+
+   // zero would be an absolute time, and -1 is the shortest relative one
+
+   return milliseconds ? -static_cast<int64_t>(milliseconds * 10000) : -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_poll_timers.cpp
+///////////////////////////////////////////////////////////////////////////////
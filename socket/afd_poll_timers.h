@@ -0,0 +1,116 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_poll_timers.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_poll_set.h"
+#include "timer_wheel.h"
+
+#include <cstdint>
+
+// Timers that are expired on the thread that handles the poll completions. The
+// nearest deadline is written into the Timeout of each poll that's built, so
+// AFD completes the poll, with no handles, when the first timer is due and the
+// timers cost no extra threads or wakeups. Arming a timer that's due before
+// the pending poll's timeout requires a new poll, which replaces the pending
+// one. If there's nothing to poll for then the owner should wait for
+// completions for no longer than wait_timeout().
+// Times are in milliseconds from whatever clock the owner uses. Not thread
+// safe, the owner locks.
+
+class afd_poll_timers
+{
+   public :
+
+      using timer_id = timer_wheel::timer_id;
+
+      static constexpr uint32_t infinite = UINT32_MAX;
+
+      afd_poll_timers(
+         afd_poll_set &poll_set,
+         uint64_t now);
+
+      afd_poll_timers(const afd_poll_timers &) = delete;
+      afd_poll_timers(afd_poll_timers &&) = delete;
+
+      afd_poll_timers& operator=(const afd_poll_timers &) = delete;
+      afd_poll_timers& operator=(afd_poll_timers &&) = delete;
+
+      timer_id set_timer(
+         uint64_t now,
+         uint32_t timeout,
+         uintptr_t context);
+
+      bool cancel_timer(
+         timer_id id);
+
+      // Sets the timeout of the poll set for the next timer to expire. Call
+      // this before building each submission.
+
+      void prepare_submission(
+         uint64_t now);
+
+      // Calls handler(id, context) for each timer that is due.
+
+      template <typename handler>
+      size_t expire(
+         const uint64_t now,
+         handler &&on_timer)
+      {
+         return wheel.advance(now, std::forward<handler>(on_timer));
+      }
+
+      // How long to wait for a completion before expiring timers, for when
+      // there's no poll pending to wake us.
+
+      uint32_t wait_timeout(
+         uint64_t now) const;
+
+      size_t timers() const
+      {
+         return wheel.size();
+      }
+
+      // Converts a time until the deadline into a relative AFD poll Timeout.
+
+      static int64_t to_poll_timeout(
+         uint64_t milliseconds);
+
+   private :
+
+      afd_poll_set &poll_set;
+
+      timer_wheel wheel;
+
+      // the deadline that the last poll we built will time out at
+
+      uint64_t poll_deadline;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_poll_timers.h
+///////////////////////////////////////////////////////////////////////////////
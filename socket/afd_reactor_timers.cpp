@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_reactor_timers.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_reactor_timers.h"
+
+afd_reactor_timers::afd_reactor_timers(
+   afd_poll_timers &timers)
+   :  timers(timers)
+{
+}
+
+void afd_reactor_timers::set_timer(
+   const uint64_t now,
+   const uint32_t slot,
+   const uint32_t timeout,
+   reactor_events &events)
+{
+   if (slot >= slots.size())
+   {
+      slots.resize(slot + 1);
+   }
+
+   if (!slots[slot])
+   {
+      slots[slot] = std::make_unique<slot_timer>();
+   }
+
+   slot_timer &timer = *slots[slot];
+
+   timers.cancel_timer(timer.current);
+
+   timer.pEvents = &events;
+
+   timer.current = timers.set_timer(now, timeout, reinterpret_cast<uintptr_t>(static_cast<afd_timer_events *>(&timer)));
+}
+
+void afd_reactor_timers::cancel_timer(
+   const uint32_t slot)
+{
+   if (slot < slots.size() && slots[slot])
+   {
+      slot_timer &timer = *slots[slot];
+
+      timers.cancel_timer(timer.current);
+
+      timer.current = timer_wheel::no_timer;
+
+      timer.pEvents = nullptr;
+   }
+}
+
+bool afd_reactor_timers::armed(
+   const uint32_t slot) const
+{
+   return slot < slots.size() && slots[slot] && slots[slot]->current != timer_wheel::no_timer;
+}
+
+void afd_reactor_timers::slot_timer::on_timer(
+   const uint64_t id)
+{
+   // the timer may have been replaced by one that expires in the same pass
+
+   if (id == current && pEvents)
+   {
+      reactor_events &events = *pEvents;
+
+      current = timer_wheel::no_timer;
+
+      pEvents = nullptr;
+
+      events.timer_expired();
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_reactor_timers.cpp
+///////////////////////////////////////////////////////////////////////////////
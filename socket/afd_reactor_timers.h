@@ -0,0 +1,94 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_reactor_timers.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_events.h"
+#include "afd_poll_timers.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// The timers of reactor::set_timer() for an AFD system, one for each slot,
+// held in the system's afd_poll_timers alongside any others that it has. Each
+// slot's timer is an afd_timer_events, so the system expires them as it does
+// the rest, and timer_expired() is called for the slot's socket. Not thread
+// safe, the owner locks.
+
+class afd_reactor_timers
+{
+   public :
+
+      explicit afd_reactor_timers(
+         afd_poll_timers &timers);
+
+      afd_reactor_timers(const afd_reactor_timers &) = delete;
+      afd_reactor_timers(afd_reactor_timers &&) = delete;
+
+      afd_reactor_timers& operator=(const afd_reactor_timers &) = delete;
+      afd_reactor_timers& operator=(afd_reactor_timers &&) = delete;
+
+      // Replaces the slot's timer, if it has one.
+
+      void set_timer(
+         uint64_t now,
+         uint32_t slot,
+         uint32_t timeout,
+         reactor_events &events);
+
+      void cancel_timer(
+         uint32_t slot);
+
+      bool armed(
+         uint32_t slot) const;
+
+   private :
+
+      class slot_timer : public afd_timer_events
+      {
+         public :
+
+            void on_timer(
+               uint64_t id) override;
+
+            afd_poll_timers::timer_id current = timer_wheel::no_timer;
+
+            reactor_events *pEvents = nullptr;
+      };
+
+      afd_poll_timers &timers;
+
+      // the wheel holds a pointer to each slot's timer, so they don't move
+      // when the vector grows
+
+      std::vector<std::unique_ptr<slot_timer>> slots;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_reactor_timers.h
+///////////////////////////////////////////////////////////////////////////////
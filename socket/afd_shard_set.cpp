@@ -0,0 +1,861 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_shard_set.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_shard_set.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+thread_local afd_shard_set::dispatch_pass afd_shard_set::pass{ nullptr, no_slot, {}, {}, false, {} };
+
+static uint32_t validate_shard_size(
+   const uint32_t max_shard_size)
+{
+   if (max_shard_size < 1)
+   {
+      throw std::runtime_error("max shard size must be at least 1");
+   }
+
+   return max_shard_size;
+}
+
+afd_shard_set::shard_data::shard_data(
+   const uint32_t initial_slots,
+   const afd_poll_set::submission_mode mode,
+   const afd_shard_binding &binding)
+   :  poll_set(initial_slots, mode),
+      device(binding.device),
+      pContexts(binding.pContexts),
+      local_to_global(poll_set.capacity(), no_slot),
+      size(0)
+{
+}
+
+afd_shard_set::dispatch_scope::dispatch_scope(
+   const afd_shard_set &set,
+   const uint32_t shard,
+   const bool completes)
+   :  exceptions(std::uncaught_exceptions())
+{
+   if (pass.pSet)
+   {
+      throw std::runtime_error("dispatch is already in progress on this thread");
+   }
+
+   pass.pSet = &set;
+   pass.shard = shard;
+   pass.completes = completes;
+}
+
+afd_shard_set::dispatch_scope::~dispatch_scope()
+{
+   pass.pSet = nullptr;
+   pass.shard = no_slot;
+   pass.completes = false;
+
+   // if the handler failed then those that asked to be completed aren't, as
+   // with anything else that the pass would have done
+
+   pass.completing.clear();
+
+   if (std::uncaught_exceptions() != exceptions)
+   {
+      // the handler failed, anything it staged is picked up by the next pass
+      // or poll for the shards concerned
+
+      pass.staged.clear();
+      pass.deferred.clear();
+   }
+}
+
+afd_shard_set::afd_shard_set(
+   const uint32_t max_shard_size,
+   shard_factory factory,
+   const afd_poll_set::submission_mode mode,
+   timer_clock clock)
+   :  max_size(validate_shard_size(max_shard_size)),
+      mode(mode),
+      factory(std::move(factory)),
+      clock(std::move(clock))
+{
+}
+
+afd_shard_set::shard_data &afd_shard_set::get_shard(
+   const uint32_t shard) const
+{
+   std::lock_guard<std::mutex> lock(structure_lock);
+
+   if (shard >= shard_list.size())
+   {
+      throw std::runtime_error("invalid shard");
+   }
+
+   return *shard_list[shard];
+}
+
+afd_shard_set::location afd_shard_set::get_location(
+   const uint32_t slot) const
+{
+   // called with the structure lock held
+
+   if (slot >= locations.size() || locations[slot].shard == no_slot)
+   {
+      throw std::runtime_error("invalid slot");
+   }
+
+   return locations[slot];
+}
+
+afd_shard_set::shard_data &afd_shard_set::lock_shard_of(
+   const uint32_t slot,
+   std::unique_lock<std::recursive_mutex> &lock,
+   location &where) const
+{
+   for (;;)
+   {
+      shard_data *pData = nullptr;
+
+      {
+         std::lock_guard<std::mutex> structure(structure_lock);
+
+         where = get_location(slot);
+
+         pData = shard_list[where.shard].get();
+      }
+
+      lock = std::unique_lock<std::recursive_mutex>(pData->lock);
+
+      {
+         std::lock_guard<std::mutex> structure(structure_lock);
+
+         const location now = get_location(slot);
+
+         if (now.shard == where.shard && now.local_slot == where.local_slot)
+         {
+            return *pData;
+         }
+      }
+
+      // moved whilst we were waiting, try again
+
+      lock.unlock();
+   }
+}
+
+uint32_t afd_shard_set::allocate_slot()
+{
+   shard_data *pData = nullptr;
+
+   uint32_t shard = no_slot;
+
+   uint32_t slot = no_slot;
+
+   {
+      std::lock_guard<std::mutex> lock(structure_lock);
+
+      // the number of shards is the number of sockets divided by the shard
+      // size so a linear scan is cheap compared to the cost of the polls
+
+      uint32_t smallest = max_size;
+
+      for (uint32_t i = 0; i < shard_list.size(); ++i)
+      {
+         const uint32_t size = shard_list[i]->size;
+
+         if (size < smallest)
+         {
+            smallest = size;
+
+            shard = i;
+         }
+      }
+
+      if (shard == no_slot)
+      {
+         shard = static_cast<uint32_t>(shard_list.size());
+
+         shard_list.push_back(std::make_unique<shard_data>(std::min(max_size, 16u), mode, factory(shard)));
+      }
+
+      pData = shard_list[shard].get();
+
+      // reserve our place in the shard so that concurrent allocations don't
+      // over fill it
+
+      ++pData->size;
+
+      if (free_slots.empty())
+      {
+         slot = static_cast<uint32_t>(locations.size());
+
+         locations.push_back(location{ no_slot, no_slot });
+      }
+      else
+      {
+         slot = free_slots.back();
+
+         free_slots.pop_back();
+      }
+   }
+
+   uint32_t local_slot = no_slot;
+
+   {
+      std::lock_guard<std::recursive_mutex> lock(pData->lock);
+
+      local_slot = place_in(*pData, slot);
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(structure_lock);
+
+      locations[slot] = location{ shard, local_slot };
+   }
+
+   return slot;
+}
+
+uint32_t afd_shard_set::place_in(
+   shard_data &data,
+   const uint32_t slot)
+{
+   // called with the shard locked
+
+   const uint32_t local_slot = data.poll_set.allocate_slot();
+
+   data.local_to_global.resize(data.poll_set.capacity(), no_slot);
+
+   data.local_to_global[local_slot] = slot;
+
+   return local_slot;
+}
+
+void afd_shard_set::remove(
+   shard_data &data,
+   const location &where,
+   const uint32_t slot)
+{
+   // called with the shard locked
+
+   disarm(data, where.local_slot);
+
+   data.local_to_global[where.local_slot] = no_slot;
+
+   data.local_to_global.resize(data.poll_set.capacity(), no_slot);
+
+   --data.size;
+
+   std::lock_guard<std::mutex> lock(structure_lock);
+
+   locations[slot] = location{ no_slot, no_slot };
+
+   free_slots.push_back(slot);
+}
+
+void afd_shard_set::release_slot(
+   const uint32_t slot)
+{
+   std::unique_lock<std::recursive_mutex> lock;
+
+   location where{};
+
+   shard_data &data = lock_shard_of(slot, lock, where);
+
+   data.poll_set.release_slot(where.local_slot);
+
+   remove(data, where, slot);
+}
+
+void afd_shard_set::associate(
+   const uint32_t slot,
+   const uintptr_t handle)
+{
+   std::unique_lock<std::recursive_mutex> lock;
+
+   location where{};
+
+   shard_data &data = lock_shard_of(slot, lock, where);
+
+   data.poll_set.associate(where.local_slot, handle);
+}
+
+void afd_shard_set::disassociate(
+   const uint32_t slot)
+{
+   std::unique_lock<std::recursive_mutex> lock;
+
+   location where{};
+
+   shard_data &data = lock_shard_of(slot, lock, where);
+
+   // disassociating also releases the slot in the shard's poll set
+
+   data.poll_set.disassociate(where.local_slot);
+
+   remove(data, where, slot);
+}
+
+void afd_shard_set::set_events(
+   const uint32_t slot,
+   const uint32_t events)
+{
+   std::unique_lock<std::recursive_mutex> lock;
+
+   location where{};
+
+   shard_data &data = lock_shard_of(slot, lock, where);
+
+   data.poll_set.set_events(where.local_slot, events);
+}
+
+uint32_t afd_shard_set::get_events(
+   const uint32_t slot) const
+{
+   std::unique_lock<std::recursive_mutex> lock;
+
+   location where{};
+
+   const shard_data &data = lock_shard_of(slot, lock, where);
+
+   return data.poll_set.get_events(where.local_slot);
+}
+
+bool afd_shard_set::poll(
+   const uint32_t slot,
+   const uint32_t events)
+{
+   const bool dispatching = (pass.pSet == this);
+
+   if (dispatching)
+   {
+      bool other_shard = false;
+
+      {
+         std::lock_guard<std::mutex> structure(structure_lock);
+
+         other_shard = (get_location(slot).shard != pass.shard);
+      }
+
+      if (other_shard)
+      {
+         // we don't wait for another shard's lock whilst we hold this one
+
+         pass.deferred.emplace_back(slot, events);
+
+         return false;
+      }
+   }
+
+   std::unique_lock<std::recursive_mutex> lock;
+
+   location where{};
+
+   shard_data &data = lock_shard_of(slot, lock, where);
+
+   data.poll_set.set_events(where.local_slot, events);
+
+   if (dispatching)
+   {
+      stage(where.shard);
+
+      return false;
+   }
+
+   // a pending poll already covers the interest unless some was added
+
+   if (!data.poll_set.needs_submission())
+   {
+      return false;
+   }
+
+   return submit(data);
+}
+
+void afd_shard_set::stage(
+   const uint32_t shard)
+{
+   if (std::find(pass.staged.begin(), pass.staged.end(), shard) == pass.staged.end())
+   {
+      pass.staged.push_back(shard);
+   }
+}
+
+void afd_shard_set::apply_deferred()
+{
+   std::vector<std::pair<uint32_t, uint32_t>> deferred;
+
+   deferred.swap(pass.deferred);
+
+   for (const auto &change : deferred)
+   {
+      {
+         std::lock_guard<std::mutex> structure(structure_lock);
+
+         if (change.first >= locations.size() || locations[change.first].shard == no_slot)
+         {
+            // released since the change was made
+
+            continue;
+         }
+      }
+
+      std::unique_lock<std::recursive_mutex> lock;
+
+      location where{};
+
+      shard_data &data = lock_shard_of(change.first, lock, where);
+
+      data.poll_set.set_events(where.local_slot, change.second);
+
+      stage(where.shard);
+   }
+}
+
+void afd_shard_set::submit_staged()
+{
+   apply_deferred();
+
+   std::vector<uint32_t> staged;
+
+   staged.swap(pass.staged);
+
+   for (const uint32_t shard : staged)
+   {
+      shard_data &data = get_shard(shard);
+
+      std::lock_guard<std::recursive_mutex> lock(data.lock);
+
+      if (data.poll_set.needs_submission())
+      {
+         submit(data);
+      }
+   }
+}
+
+bool afd_shard_set::submit(
+   const uint32_t shard)
+{
+   shard_data &data = get_shard(shard);
+
+   std::lock_guard<std::recursive_mutex> lock(data.lock);
+
+   return submit(data);
+}
+
+bool afd_shard_set::submit(
+   shard_data &data)
+{
+   // called with the shard locked
+
+   if (data.timers)
+   {
+      data.timers->prepare_submission(clock());
+   }
+
+   if (!data.poll_set.build_submission())
+   {
+      // if a poll is pending it's cancelled, the changes are submitted once it
+      // has completed
+
+      const uint32_t pending = data.poll_set.cancel_buffer();
+
+      if (pending != afd_poll_set::no_buffer)
+      {
+         data.device.cancel(pending);
+      }
+
+      return false;
+   }
+
+   const uint32_t size = data.poll_set.submission_size();
+
+   const uint32_t buffer = data.poll_set.submission_buffer();
+
+   const bool completed = data.device.poll(
+      buffer,
+      data.poll_set.poll_info_in(),
+      size,
+      data.poll_set.poll_info_out(),
+      size,
+      data.pContexts[buffer]);
+
+   return completed;
+}
+
+void afd_shard_set::set_timer(
+   const uint32_t slot,
+   const uint32_t timeout_ms)
+{
+   if (!clock)
+   {
+      throw std::runtime_error("timers need a clock");
+   }
+
+   std::unique_lock<std::recursive_mutex> lock;
+
+   location where{};
+
+   shard_data &data = lock_shard_of(slot, lock, where);
+
+   const uint64_t now = clock();
+
+   arm(data, where.local_slot, now, now + timeout_ms);
+
+   if (pass.pSet == this)
+   {
+      // the poll at the end of the pass will have the right timeout
+
+      stage(where.shard);
+
+      return;
+   }
+
+   // if the pending poll would time out too late then it's replaced
+
+   if (data.poll_set.needs_submission())
+   {
+      submit(data);
+   }
+}
+
+bool afd_shard_set::after_dispatch(
+   const uint32_t slot)
+{
+   if (pass.pSet != this || !pass.completes)
+   {
+      return false;
+   }
+
+   location where{};
+
+   {
+      std::lock_guard<std::mutex> structure(structure_lock);
+
+      where = get_location(slot);
+   }
+
+   if (where.shard != pass.shard)
+   {
+      // written from a handler in another shard, it isn't completed with
+      // this one
+
+      return false;
+   }
+
+   // we hold the shard's lock, it's being dispatched
+
+   const shard_data &data = get_shard(where.shard);
+
+   pass.completing.emplace_back(where.local_slot, data.poll_set.generation(where.local_slot));
+
+   return true;
+}
+
+void afd_shard_set::cancel_timer(
+   const uint32_t slot)
+{
+   std::unique_lock<std::recursive_mutex> lock;
+
+   location where{};
+
+   shard_data &data = lock_shard_of(slot, lock, where);
+
+   disarm(data, where.local_slot);
+}
+
+uint32_t afd_shard_set::timer_wait_timeout() const
+{
+   uint32_t timeout = afd_poll_timers::infinite;
+
+   const uint32_t count = shards();
+
+   for (uint32_t i = 0; i < count; ++i)
+   {
+      const shard_data &data = get_shard(i);
+
+      std::lock_guard<std::recursive_mutex> lock(data.lock);
+
+      if (data.timers)
+      {
+         timeout = std::min(timeout, data.timers->wait_timeout(clock()));
+      }
+   }
+
+   return timeout;
+}
+
+void afd_shard_set::arm(
+   shard_data &data,
+   const uint32_t local_slot,
+   const uint64_t now,
+   const uint64_t deadline)
+{
+   // called with the shard locked
+
+   if (!data.timers)
+   {
+      data.timers = std::make_unique<afd_poll_timers>(data.poll_set, now);
+   }
+
+   if (local_slot >= data.local_timers.size())
+   {
+      data.local_timers.resize(local_slot + 1, local_timer{ timer_wheel::no_timer, 0 });
+   }
+
+   local_timer &timer = data.local_timers[local_slot];
+
+   data.timers->cancel_timer(timer.id);
+
+   // the deadline fits, it was set with a 32 bit timeout
+
+   timer.id = data.timers->set_timer(now, static_cast<uint32_t>(deadline > now ? deadline - now : 0), local_slot);
+
+   timer.deadline = deadline;
+}
+
+uint64_t afd_shard_set::disarm(
+   shard_data &data,
+   const uint32_t local_slot)
+{
+   // called with the shard locked, returns the deadline of the timer that was
+   // cancelled, if there was one
+
+   if (local_slot >= data.local_timers.size() || data.local_timers[local_slot].id == timer_wheel::no_timer)
+   {
+      return timer_wheel::no_deadline;
+   }
+
+   local_timer &timer = data.local_timers[local_slot];
+
+   data.timers->cancel_timer(timer.id);
+
+   timer.id = timer_wheel::no_timer;
+
+   return timer.deadline;
+}
+
+uint32_t afd_shard_set::shard_of(
+   const uint32_t slot) const
+{
+   std::lock_guard<std::mutex> lock(structure_lock);
+
+   return get_location(slot).shard;
+}
+
+uint32_t afd_shard_set::shards() const
+{
+   std::lock_guard<std::mutex> lock(structure_lock);
+
+   return static_cast<uint32_t>(shard_list.size());
+}
+
+uint32_t afd_shard_set::shard_size(
+   const uint32_t shard) const
+{
+   const shard_data &data = get_shard(shard);
+
+   std::lock_guard<std::recursive_mutex> lock(data.lock);
+
+   return data.poll_set.slots_in_use();
+}
+
+void afd_shard_set::move(
+   const uint32_t slot,
+   const location &where,
+   const uint32_t to_shard)
+{
+   // called with both shards locked
+
+   shard_data &from = *shard_list[where.shard];
+
+   const afd_poll_handle_info &info = from.poll_set.slot_info(where.local_slot);
+
+   const uintptr_t handle = info.handle;
+
+   const uint32_t events = info.events;
+
+   const uint64_t deadline = disarm(from, where.local_slot);
+
+   // AFD lets a socket be polled via any \Device\Afd handle, so we can simply
+   // stop polling for it in one shard and start in another. If the old shard
+   // has a poll pending then any results for the socket are ignored when it
+   // completes, as the handle is no longer known to that shard, but polls are
+   // level triggered so the new shard will report the same state.
+
+   if (handle)
+   {
+      from.poll_set.disassociate(where.local_slot);
+   }
+   else
+   {
+      from.poll_set.release_slot(where.local_slot);
+   }
+
+   from.local_to_global[where.local_slot] = no_slot;
+
+   from.local_to_global.resize(from.poll_set.capacity(), no_slot);
+
+   --from.size;
+
+   shard_data &to = *shard_list[to_shard];
+
+   const uint32_t local_slot = place_in(to, slot);
+
+   ++to.size;
+
+   if (handle)
+   {
+      to.poll_set.associate(local_slot, handle);
+   }
+
+   to.poll_set.set_events(local_slot, events);
+
+   if (deadline != timer_wheel::no_deadline)
+   {
+      arm(to, local_slot, clock(), deadline);
+   }
+
+   std::lock_guard<std::mutex> lock(structure_lock);
+
+   locations[slot] = location{ to_shard, local_slot };
+}
+
+afd_poll_set::statistics afd_shard_set::stats() const
+{
+   afd_poll_set::statistics total{};
+
+   const uint32_t count = shards();
+
+   for (uint32_t i = 0; i < count; ++i)
+   {
+      const shard_data &data = get_shard(i);
+
+      std::lock_guard<std::recursive_mutex> lock(data.lock);
+
+      const afd_poll_set::statistics &shard = data.poll_set.stats();
+
+      total.submissions += shard.submissions;
+      total.completions += shard.completions;
+      total.handles_submitted += shard.handles_submitted;
+      total.staged_changes += shard.staged_changes;
+      total.cancelled += shard.cancelled;
+   }
+
+   return total;
+}
+
+uint32_t afd_shard_set::rebalance(
+   const uint32_t max_moves)
+{
+   if (pass.pSet)
+   {
+      throw std::runtime_error("rebalance can't be called from within a dispatch");
+   }
+
+   const uint32_t tolerance = std::max(1u, max_size / 4);
+
+   const uint32_t count = shards();
+
+   std::vector<uint8_t> gained(count, 0);
+
+   uint32_t moved = 0;
+
+   while (moved < max_moves && count > 1)
+   {
+      uint32_t largest = 0;
+      uint32_t smallest = 0;
+
+      for (uint32_t i = 1; i < count; ++i)
+      {
+         const uint32_t size = get_shard(i).size;
+
+         if (size > get_shard(largest).size)
+         {
+            largest = i;
+         }
+
+         if (size < get_shard(smallest).size)
+         {
+            smallest = i;
+         }
+      }
+
+      shard_data &from = get_shard(largest);
+      shard_data &to = get_shard(smallest);
+
+      std::scoped_lock locks(from.lock, to.lock);
+
+      // the sizes may have changed whilst we waited for the locks
+
+      const uint32_t largest_size = from.size;
+      const uint32_t smallest_size = to.size;
+
+      if (largest_size <= smallest_size || largest_size - smallest_size <= tolerance)
+      {
+         break;
+      }
+
+      // move the socket in the highest local slot so that the shard we take
+      // it from can compact
+
+      uint32_t local_slot = static_cast<uint32_t>(from.local_to_global.size());
+
+      while (local_slot && from.local_to_global[local_slot - 1] == no_slot)
+      {
+         --local_slot;
+      }
+
+      if (!local_slot)
+      {
+         // the slots counted in the size are still being placed
+
+         break;
+      }
+
+      move(from.local_to_global[local_slot - 1], location{ largest, local_slot - 1 }, smallest);
+
+      gained[smallest] = 1;
+
+      ++moved;
+   }
+
+   for (uint32_t i = 0; i < gained.size(); ++i)
+   {
+      if (gained[i])
+      {
+         submit(i);
+      }
+   }
+
+   return moved;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_shard_set.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,575 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_shard_set.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_poll_set.h"
+#include "afd_poll_timers.h"
+#include "afd_poll_device.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Spreads sockets across a number of shards, each with its own afd_poll_set and
+// afd_poll_device, so that the cost of re-arming a poll is bounded by the size
+// of the shard rather than by the total number of sockets. On Windows each shard
+// is a separate \Device\Afd handle.
+//
+// Slots handed out by the shard set are global, they are mapped to a shard and
+// a slot within that shard's poll set.
+//
+// Each shard has its own lock so several threads can dispatch different shards
+// at the same time and a busy shard doesn't hold up the others. A socket belongs
+// to its shard; whilst dispatching, a handler should only disassociate sockets,
+// or set their timers, from the shard being dispatched, any thread that isn't
+// dispatching can do anything. rebalance() must not be called from within a
+// dispatch.
+
+struct afd_shard_binding
+{
+   afd_poll_device &device;
+
+   // passed with each poll of the shard, one for each of the poll buffers so
+   // that a completion can be matched with the buffer it was written to
+
+   std::array<void *, afd_poll_set::poll_buffers> pContexts;
+};
+
+class afd_shard_set
+{
+   public :
+
+      using shard_factory = std::function<afd_shard_binding(uint32_t shard)>;
+
+      // The time in milliseconds, from whatever clock the owner uses. A set
+      // without a clock has no timers.
+
+      using timer_clock = std::function<uint64_t()>;
+
+      static constexpr uint32_t no_slot = afd_poll_set::no_slot;
+
+      afd_shard_set(
+         uint32_t max_shard_size,
+         shard_factory factory,
+         afd_poll_set::submission_mode mode = afd_poll_set::submission_mode::active_slots,
+         timer_clock clock = timer_clock());
+
+      afd_shard_set(const afd_shard_set &) = delete;
+      afd_shard_set(afd_shard_set &&) = delete;
+
+      afd_shard_set& operator=(const afd_shard_set &) = delete;
+      afd_shard_set& operator=(afd_shard_set &&) = delete;
+
+      // New slots are placed in the least loaded shard that has space, a new
+      // shard is created when they are all full.
+
+      uint32_t allocate_slot();
+
+      void release_slot(
+         uint32_t slot);
+
+      void associate(
+         uint32_t slot,
+         uintptr_t handle);
+
+      void disassociate(
+         uint32_t slot);
+
+      void set_events(
+         uint32_t slot,
+         uint32_t events);
+
+      uint32_t get_events(
+         uint32_t slot) const;
+
+      // Sets the interest for the slot and re-arms the shard that it lives in,
+      // and only that shard. During a dispatch pass the change is staged and
+      // the shard is re-armed once, when the pass completes.
+
+      bool poll(
+         uint32_t slot,
+         uint32_t events);
+
+      bool submit(
+         uint32_t shard);
+
+      // Each slot can have a timer, which lives in the slot's shard, whose
+      // polls time out when its next timer is due. Timers are expired with
+      // their shard locked, as its events are dispatched, so a timer handler
+      // is in the same position as an event handler. Setting the timer again
+      // replaces it, and it's cancelled when the slot is released or moved to
+      // another shard, where it's set again.
+
+      void set_timer(
+         uint32_t slot,
+         uint32_t timeout_ms);
+
+      void cancel_timer(
+         uint32_t slot);
+
+      // Whilst this thread is dispatching the slot's shard, and was given an
+      // on_complete handler, notes that on_complete(slot) should be called once
+      // the shard's events and timers have been dispatched. Returns false
+      // otherwise, and the caller should do now what it would have done then.
+
+      bool after_dispatch(
+         uint32_t slot);
+
+      // A shard that has nothing to poll for has no poll to time out, so the
+      // owner should wait for completions for no longer than this, and then
+      // call expire_timers(). afd_poll_timers::infinite if there are no timers.
+
+      uint32_t timer_wait_timeout() const;
+
+      // Calls handler(slot) for each timer, in any shard, that is due.
+
+      template <typename timer_handler>
+      uint32_t expire_timers(
+         timer_handler &&on_timer)
+      {
+         return expire_timers(on_timer, nullptr);
+      }
+
+      // As above, and then calls on_complete(slot) for each slot that asked
+      // for it with after_dispatch() whilst its shard's timers were expired.
+
+      template <typename timer_handler, typename complete_handler>
+      uint32_t expire_timers(
+         timer_handler &&on_timer,
+         complete_handler &&on_complete)
+      {
+         uint32_t expired = 0;
+
+         const uint32_t count = shards();
+
+         for (uint32_t shard = 0; shard < count; ++shard)
+         {
+            shard_data &data = get_shard(shard);
+
+            {
+               std::lock_guard<std::recursive_mutex> lock(data.lock);
+
+               const dispatch_scope scope(*this, shard, completes(on_complete));
+
+               expired += expire(data, on_timer);
+
+               complete(data, on_complete);
+
+               stage(shard);
+            }
+
+            submit_staged();
+         }
+
+         return expired;
+      }
+
+      uint32_t shard_of(
+         uint32_t slot) const;
+
+      uint32_t shards() const;
+
+      uint32_t shard_size(
+         uint32_t shard) const;
+
+      uint32_t max_shard_size() const
+      {
+         return max_size;
+      }
+
+      // The statistics for all of the shards combined.
+
+      afd_poll_set::statistics stats() const;
+
+      // Moves sockets from the most loaded shards to the least loaded ones until
+      // they are within a quarter of a shard of each other, or max_moves sockets
+      // have been moved. Shards that gain sockets are re-armed so that they
+      // include them. Returns the number of sockets moved.
+
+      uint32_t rebalance(
+         uint32_t max_moves);
+
+      // Dispatches the results of a completed poll on the given shard and buffer,
+      // calling handler(slot, events, status) with the global slot. The value
+      // returned becomes the new interest for the slot. Once all of the results
+      // have been handled the shard, and any other shard whose interest was
+      // changed by the handler, is re-armed with a single poll if it needs it.
+      // The shard is locked whilst the handler is called.
+
+      template <typename handler>
+      uint32_t dispatch(
+         const uint32_t shard,
+         const uint32_t buffer,
+         handler &&handle_events)
+      {
+         return dispatch_shard(shard, buffer, handle_events, [](shard_data &)
+         {
+         },
+         nullptr);
+      }
+
+      // As above, and then calls on_timer(slot) for each of the shard's timers
+      // that is due, as the poll may have completed because it timed out. Sets
+      // with timers should be dispatched with this.
+
+      template <typename handler, typename timer_handler>
+      uint32_t dispatch(
+         const uint32_t shard,
+         const uint32_t buffer,
+         handler &&handle_events,
+         timer_handler &&on_timer)
+      {
+         return dispatch_shard(shard, buffer, handle_events, [&](shard_data &data)
+         {
+            expire(data, on_timer);
+         },
+         nullptr);
+      }
+
+      // As above, and then calls on_complete(slot) for each slot that asked
+      // for it with after_dispatch() during the pass. The polls that it makes
+      // are part of the shard's poll at the end of the pass.
+
+      template <typename handler, typename timer_handler, typename complete_handler>
+      uint32_t dispatch(
+         const uint32_t shard,
+         const uint32_t buffer,
+         handler &&handle_events,
+         timer_handler &&on_timer,
+         complete_handler &&on_complete)
+      {
+         return dispatch_shard(shard, buffer, handle_events, [&](shard_data &data)
+         {
+            expire(data, on_timer);
+         },
+         on_complete);
+      }
+
+      // Dispatches the results of the last poll submitted for the shard.
+
+      template <typename handler>
+      uint32_t dispatch(
+         const uint32_t shard,
+         handler &&handle_events)
+      {
+         uint32_t buffer = 0;
+
+         {
+            shard_data &data = get_shard(shard);
+
+            std::lock_guard<std::recursive_mutex> lock(data.lock);
+
+            buffer = data.poll_set.submission_buffer();
+         }
+
+         return dispatch(shard, buffer, std::forward<handler>(handle_events));
+      }
+
+   private :
+
+      struct local_timer
+      {
+         afd_poll_timers::timer_id id;
+
+         uint64_t deadline;                  // so that the timer can move with its slot
+      };
+
+      struct shard_data
+      {
+         shard_data(
+            uint32_t initial_slots,
+            afd_poll_set::submission_mode mode,
+            const afd_shard_binding &binding);
+
+         // recursive as handlers poll for the sockets in the shard that is
+         // being dispatched
+
+         mutable std::recursive_mutex lock;
+
+         afd_poll_set poll_set;
+
+         afd_poll_device &device;
+
+         std::array<void *, afd_poll_set::poll_buffers> pContexts;
+
+         std::vector<uint32_t> local_to_global;
+
+         std::atomic<uint32_t> size;         // slots placed in the shard, for placement without the lock
+
+         // created when the first timer is set in the shard, the context of
+         // each timer is its local slot
+
+         std::unique_ptr<afd_poll_timers> timers;
+
+         std::vector<local_timer> local_timers;
+      };
+
+      struct location
+      {
+         uint32_t shard;
+
+         uint32_t local_slot;
+      };
+
+      // Each thread that is dispatching tracks the shards that its handlers have
+      // changed so that they can be re-armed at the end of the pass. Changes to
+      // sockets in other shards are deferred until the shard being dispatched
+      // has been unlocked, so that a thread never waits for one shard's lock
+      // whilst holding another's.
+
+      struct dispatch_pass
+      {
+         const afd_shard_set *pSet;
+
+         uint32_t shard;
+
+         std::vector<uint32_t> staged;
+
+         std::vector<std::pair<uint32_t, uint32_t>> deferred;     // slot, events
+
+         bool completes;                     // the dispatch has an on_complete handler
+
+         std::vector<std::pair<uint32_t, uint32_t>> completing;   // local slot, generation
+      };
+
+      class dispatch_scope
+      {
+         public :
+
+            dispatch_scope(
+               const afd_shard_set &set,
+               uint32_t shard,
+               bool completes);
+
+            dispatch_scope(const dispatch_scope &) = delete;
+            dispatch_scope& operator=(const dispatch_scope &) = delete;
+
+            ~dispatch_scope();
+
+         private :
+
+            const int exceptions;
+      };
+
+      static thread_local dispatch_pass pass;
+
+      shard_data &get_shard(
+         uint32_t shard) const;
+
+      location get_location(
+         uint32_t slot) const;
+
+      // Locks the shard that the slot lives in, coping with the slot being moved
+      // by rebalance() whilst we wait for the lock.
+
+      shard_data &lock_shard_of(
+         uint32_t slot,
+         std::unique_lock<std::recursive_mutex> &lock,
+         location &where) const;
+
+      uint32_t place_in(
+         shard_data &data,
+         uint32_t slot);
+
+      void remove(
+         shard_data &data,
+         const location &where,
+         uint32_t slot);
+
+      void move(
+         uint32_t slot,
+         const location &where,
+         uint32_t to_shard);
+
+      bool submit(
+         shard_data &data);
+
+      void arm(
+         shard_data &data,
+         uint32_t local_slot,
+         uint64_t now,
+         uint64_t deadline);
+
+      uint64_t disarm(
+         shard_data &data,
+         uint32_t local_slot);
+
+      template <typename handler, typename expire_function, typename complete_handler>
+      uint32_t dispatch_shard(
+         const uint32_t shard,
+         const uint32_t buffer,
+         handler &handle_events,
+         expire_function &&expire_due,
+         complete_handler &&on_complete)
+      {
+         shard_data &data = get_shard(shard);
+
+         uint32_t dispatched = 0;
+
+         {
+            std::lock_guard<std::recursive_mutex> lock(data.lock);
+
+            const dispatch_scope scope(*this, shard, completes(on_complete));
+
+            dispatched = data.poll_set.dispatch(buffer, [&](const uint32_t local_slot, const uint32_t events, const int32_t status)
+            {
+               return handle_events(data.local_to_global[local_slot], events, status);
+            });
+
+            // the poll set doesn't compact until the pass is over, so neither
+            // does the mapping from its slots
+
+            data.local_to_global.resize(data.poll_set.capacity(), no_slot);
+
+            expire_due(data);
+
+            complete(data, on_complete);
+
+            stage(shard);
+         }
+
+         submit_staged();
+
+         return dispatched;
+      }
+
+      template <typename timer_handler>
+      uint32_t expire(
+         shard_data &data,
+         timer_handler &on_timer)
+      {
+         // called with the shard locked, whilst it's being dispatched
+
+         if (!data.timers)
+         {
+            return 0;
+         }
+
+         uint32_t expired = 0;
+
+         data.timers->expire(clock(), [&](const afd_poll_timers::timer_id id, const uintptr_t context)
+         {
+            const uint32_t local_slot = static_cast<uint32_t>(context);
+
+            local_timer &timer = data.local_timers[local_slot];
+
+            if (timer.id == id)
+            {
+               timer.id = timer_wheel::no_timer;
+
+               ++expired;
+
+               on_timer(data.local_to_global[local_slot]);
+            }
+         });
+
+         return expired;
+      }
+
+      template <typename complete_handler>
+      static bool completes(
+         const complete_handler &)
+      {
+         return true;
+      }
+
+      static bool completes(
+         std::nullptr_t)
+      {
+         return false;
+      }
+
+      static void complete(
+         shard_data &,
+         std::nullptr_t)
+      {
+      }
+
+      template <typename complete_handler>
+      void complete(
+         shard_data &data,
+         complete_handler &on_complete)
+      {
+         // called with the shard locked, once its events and timers have been
+         // dispatched; the slots can write now, the polls they make are staged
+
+         std::vector<std::pair<uint32_t, uint32_t>> completing;
+
+         completing.swap(pass.completing);
+
+         pass.completes = false;
+
+         for (const auto &[local_slot, generation] : completing)
+         {
+            // the socket may have been closed during the pass
+
+            if (local_slot < data.local_to_global.size() &&
+                data.local_to_global[local_slot] != no_slot &&
+                data.poll_set.generation(local_slot) == generation)
+            {
+               on_complete(data.local_to_global[local_slot]);
+            }
+         }
+      }
+
+      void stage(
+         uint32_t shard);
+
+      void apply_deferred();
+
+      void submit_staged();
+
+      const uint32_t max_size;
+
+      const afd_poll_set::submission_mode mode;
+
+      const shard_factory factory;
+
+      const timer_clock clock;
+
+      // the structure lock protects the mapping of slots to shards and the list
+      // of shards, it's never held whilst waiting for a shard's lock
+
+      mutable std::mutex structure_lock;
+
+      std::vector<std::unique_ptr<shard_data>> shard_list;
+
+      std::vector<location> locations;
+
+      std::vector<uint32_t> free_slots;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_shard_set.h
+///////////////////////////////////////////////////////////////////////////////
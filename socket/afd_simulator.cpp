@@ -0,0 +1,580 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_simulator.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_simulator.h"
+#include "reactor.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+// Sockets are given handles that look like Windows handles, multiples of 4,
+// and are never reused so a stale handle is always detected.
+
+static constexpr uintptr_t handle_step = 4;
+
+static constexpr uint32_t header_size = static_cast<uint32_t>(offsetof(afd_poll_info, handles));
+
+bool afd_simulator::device::poll(
+   const uint32_t buffer,
+   afd_poll_info &in,
+   const uint32_t in_size,
+   afd_poll_info &out,
+   const uint32_t out_size,
+   void *pContext)
+{
+   return simulator.poll(*this, buffer, in, in_size, out, out_size, pContext);
+}
+
+void afd_simulator::device::cancel(
+   const uint32_t buffer)
+{
+   simulator.cancel(*this, buffer);
+}
+
+bool afd_simulator::device::pending_on(
+   const uint32_t buffer) const
+{
+   return buffer < device::buffers && pending[buffer] != no_poll;
+}
+
+afd_simulator::afd_simulator(
+   const bool skip_completion_port_on_success)
+   :  skip_on_success(skip_completion_port_on_success),
+      current_time(0),
+      sequence(0),
+      polls_pending(0)
+{
+}
+
+afd_simulator::~afd_simulator() = default;
+
+afd_simulator::device &afd_simulator::create_device()
+{
+   devices.push_back(std::make_unique<device>(*this));
+
+   return *devices.back();
+}
+
+uintptr_t afd_simulator::create_socket()
+{
+   sockets.emplace_back();
+
+   return sockets.size() * handle_step;
+}
+
+afd_simulator::socket_state &afd_simulator::get_socket(
+   const uintptr_t handle)
+{
+   const size_t index = (handle / handle_step) - 1;
+
+   if (handle % handle_step || index >= sockets.size() || !sockets[index].open)
+   {
+      throw std::runtime_error("afd_simulator - invalid handle");
+   }
+
+   return sockets[index];
+}
+
+const afd_simulator::socket_state *afd_simulator::find_socket(
+   const uintptr_t handle) const
+{
+   const size_t index = (handle / handle_step) - 1;
+
+   if (handle % handle_step || index >= sockets.size())
+   {
+      return nullptr;
+   }
+
+   return &sockets[index];
+}
+
+void afd_simulator::close_socket(
+   const uintptr_t handle)
+{
+   socket_state &socket = get_socket(handle);
+
+   // polls that want to know complete, the others stay pending and simply
+   // never report the handle
+
+   socket.open = false;
+   socket.events = reactor_event::local_close;
+   socket.status = status_success;
+
+   changed(socket);
+}
+
+void afd_simulator::set_events(
+   const uintptr_t handle,
+   const uint32_t events,
+   const int32_t status)
+{
+   socket_state &socket = get_socket(handle);
+
+   socket.events |= events;
+   socket.status = status;
+
+   ++counters.state_changes;
+
+   changed(socket);
+}
+
+void afd_simulator::clear_events(
+   const uintptr_t handle,
+   const uint32_t events)
+{
+   socket_state &socket = get_socket(handle);
+
+   socket.events &= ~events;
+
+   ++counters.state_changes;
+}
+
+uint32_t afd_simulator::get_events(
+   const uintptr_t handle) const
+{
+   const socket_state *pSocket = find_socket(handle);
+
+   return pSocket ? pSocket->events : 0;
+}
+
+void afd_simulator::schedule(
+   const uint64_t at,
+   const uintptr_t handle,
+   const uint32_t set,
+   const uint32_t clear,
+   const int32_t status)
+{
+   get_socket(handle);
+
+   changes.push(scheduled_change{ std::max(at, current_time), sequence++, handle, set, clear, status });
+}
+
+bool afd_simulator::poll(
+   device &owner,
+   const uint32_t buffer,
+   afd_poll_info &in,
+   const uint32_t in_size,
+   afd_poll_info &out,
+   const uint32_t out_size,
+   void *pContext)
+{
+   if (buffer >= device::buffers)
+   {
+      throw std::runtime_error("afd_simulator - invalid poll buffer");
+   }
+
+   if (owner.pending[buffer] != no_poll)
+   {
+      throw std::runtime_error("afd_simulator - poll already pending on buffer");
+   }
+
+   if (in_size < afd_poll_info_size(in.number_of_handles))
+   {
+      throw std::runtime_error("afd_simulator - input too small");
+   }
+
+   // AFD fails a poll whose output is smaller than its input, it doesn't
+   // matter if the output is larger
+
+   if (out_size < in_size)
+   {
+      throw std::runtime_error("afd_simulator - output too small");
+   }
+
+   for (uint32_t i = 0; i < in.number_of_handles; ++i)
+   {
+      get_socket(in.handles[i].handle);
+   }
+
+   ++counters.polls;
+
+   // an exclusive poll replaces any earlier exclusive poll for the same
+   // sockets, which completes successfully but reports nothing
+
+   if (in.exclusive)
+   {
+      for (uint32_t i = 0; i < in.number_of_handles; ++i)
+      {
+         socket_state &socket = get_socket(in.handles[i].handle);
+
+         for (size_t j = 0; j < socket.watchers.size(); )
+         {
+            const uint32_t index = socket.watchers[j].poll;
+
+            if (polls[index].exclusive)
+            {
+               ++counters.exclusive_replaced;
+
+               completions.push_back(complete(index, status_success, false));
+            }
+            else
+            {
+               ++j;
+            }
+         }
+      }
+   }
+
+   uint32_t index = no_poll;
+
+   if (free_polls.empty())
+   {
+      index = static_cast<uint32_t>(polls.size());
+
+      polls.emplace_back();
+   }
+   else
+   {
+      index = free_polls.back();
+
+      free_polls.pop_back();
+   }
+
+   pending_poll &pending = polls[index];
+
+   pending.pDevice = &owner;
+   pending.buffer = buffer;
+   pending.pOut = &out;
+   pending.pContext = pContext;
+   pending.exclusive = in.exclusive != 0;
+
+   // the input is copied, the caller is free to reuse it as soon as we return
+
+   pending.handles.assign(in.handles, in.handles + in.number_of_handles);
+
+   for (const afd_poll_handle_info &info : pending.handles)
+   {
+      std::vector<watcher> &watchers = get_socket(info.handle).watchers;
+
+      auto it = std::find_if(watchers.begin(), watchers.end(), [index](const watcher &w) { return w.poll == index; });
+
+      if (it == watchers.end())
+      {
+         watchers.push_back(watcher{ index, info.events });
+      }
+      else
+      {
+         it->events |= info.events;
+      }
+   }
+
+   owner.pending[buffer] = index;
+
+   ++polls_pending;
+
+   if (ready(pending))
+   {
+      ++counters.completed_immediately;
+
+      const completion result = complete(index, status_success, true);
+
+      if (!skip_on_success)
+      {
+         completions.push_back(result);
+      }
+
+      return true;
+   }
+
+   // Timeout is an absolute time, or relative if it's negative, INT64_MAX
+   // means that there isn't one
+
+   if (in.timeout != INT64_MAX)
+   {
+      const uint64_t at = in.timeout < 0 ?
+         current_time + static_cast<uint64_t>(-in.timeout) :
+         std::max(static_cast<uint64_t>(in.timeout), current_time);
+
+      timeouts.push(poll_timeout{ at, index, pending.generation });
+   }
+
+   return false;
+}
+
+void afd_simulator::cancel(
+   device &owner,
+   const uint32_t buffer)
+{
+   if (buffer >= device::buffers)
+   {
+      throw std::runtime_error("afd_simulator - invalid poll buffer");
+   }
+
+   const uint32_t index = owner.pending[buffer];
+
+   if (index == no_poll)
+   {
+      // already completed, CancelIoEx fails with ERROR_NOT_FOUND
+
+      return;
+   }
+
+   ++counters.cancelled;
+
+   completions.push_back(complete(index, status_cancelled, false));
+}
+
+void afd_simulator::changed(
+   socket_state &socket)
+{
+   // completing a poll removes it from the socket's watchers
+
+   for (size_t i = 0; i < socket.watchers.size(); )
+   {
+      const watcher &w = socket.watchers[i];
+
+      if (w.events & socket.events)
+      {
+         completions.push_back(complete(w.poll, status_success, true));
+      }
+      else
+      {
+         ++i;
+      }
+   }
+}
+
+bool afd_simulator::ready(
+   const pending_poll &pending) const
+{
+   for (const afd_poll_handle_info &info : pending.handles)
+   {
+      if (sockets[(info.handle / handle_step) - 1].events & info.events)
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+afd_simulator::completion afd_simulator::complete(
+   const uint32_t index,
+   const int32_t status,
+   const bool report)
+{
+   pending_poll &pending = polls[index];
+
+   // the state of each socket as it is now, only for the handles that have
+   // some of the events that were asked for
+
+   uint32_t reported = 0;
+
+   for (const afd_poll_handle_info &info : pending.handles)
+   {
+      socket_state &socket = sockets[(info.handle / handle_step) - 1];
+
+      auto it = std::find_if(socket.watchers.begin(), socket.watchers.end(), [index](const watcher &w) { return w.poll == index; });
+
+      if (it != socket.watchers.end())
+      {
+         *it = socket.watchers.back();
+
+         socket.watchers.pop_back();
+      }
+
+      const uint32_t events = report ? (socket.events & info.events) : 0;
+
+      if (events)
+      {
+         pending.pOut->handles[reported++] = afd_poll_handle_info{ info.handle, events, socket.status };
+      }
+   }
+
+   pending.pOut->number_of_handles = reported;
+
+   const completion result{ pending.pContext, status, header_size + reported * static_cast<uint32_t>(sizeof(afd_poll_handle_info)) };
+
+   pending.pDevice->pending[pending.buffer] = no_poll;
+   pending.pDevice = nullptr;
+   pending.pOut = nullptr;
+   pending.pContext = nullptr;
+   pending.handles.clear();
+
+   ++pending.generation;
+
+   free_polls.push_back(index);
+
+   --polls_pending;
+
+   ++counters.completions;
+
+   return result;
+}
+
+void afd_simulator::discard_stale_timeouts()
+{
+   while (!timeouts.empty() && timeouts.top().generation != polls[timeouts.top().poll].generation)
+   {
+      timeouts.pop();
+   }
+}
+
+uint64_t afd_simulator::next_event_time()
+{
+   discard_stale_timeouts();
+
+   uint64_t next = UINT64_MAX;
+
+   if (!changes.empty())
+   {
+      next = changes.top().at;
+   }
+
+   if (!timeouts.empty())
+   {
+      next = std::min(next, timeouts.top().at);
+   }
+
+   return next;
+}
+
+void afd_simulator::advance(
+   const uint64_t ticks)
+{
+   run_until(current_time + ticks);
+}
+
+void afd_simulator::run_until(
+   const uint64_t time)
+{
+   for (;;)
+   {
+      discard_stale_timeouts();
+
+      const bool change_due = !changes.empty() && changes.top().at <= time;
+
+      const bool timeout_due = !timeouts.empty() && timeouts.top().at <= time;
+
+      if (!change_due && !timeout_due)
+      {
+         break;
+      }
+
+      // a change that's due at the same time as a timeout gets in first, so
+      // the poll reports it rather than timing out
+
+      if (change_due && (!timeout_due || changes.top().at <= timeouts.top().at))
+      {
+         const scheduled_change change = changes.top();
+
+         changes.pop();
+
+         current_time = std::max(current_time, change.at);
+
+         socket_state &socket = sockets[(change.handle / handle_step) - 1];
+
+         if (socket.open)
+         {
+            socket.events = (socket.events & ~change.clear) | change.set;
+
+            if (change.set)
+            {
+               socket.status = change.status;
+            }
+
+            ++counters.state_changes;
+
+            changed(socket);
+         }
+      }
+      else
+      {
+         const poll_timeout timeout = timeouts.top();
+
+         timeouts.pop();
+
+         current_time = std::max(current_time, timeout.at);
+
+         ++counters.timed_out;
+
+         completions.push_back(complete(timeout.poll, status_timeout, false));
+      }
+   }
+
+   current_time = std::max(current_time, time);
+}
+
+bool afd_simulator::get(
+   completion &result,
+   const uint32_t timeout_ms)
+{
+   const uint64_t deadline = timeout_ms == infinite ?
+      UINT64_MAX :
+      current_time + (static_cast<uint64_t>(timeout_ms) * ticks_per_ms);
+
+   while (completions.empty())
+   {
+      const uint64_t next = next_event_time();
+
+      if (next == UINT64_MAX || next > deadline)
+      {
+         if (deadline != UINT64_MAX)
+         {
+            current_time = deadline;
+         }
+
+         return false;
+      }
+
+      run_until(next);
+   }
+
+   result = completions.front();
+
+   completions.pop_front();
+
+   return true;
+}
+
+bool afd_simulator::get(
+   void *&pContext,
+   const uint32_t timeout_ms)
+{
+   completion result{};
+
+   if (!get(result, timeout_ms))
+   {
+      return false;
+   }
+
+   pContext = result.pContext;
+
+   return true;
+}
+
+void afd_simulator::post(
+   void *pContext)
+{
+   completions.push_back(completion{ pContext, status_success, 0 });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_simulator.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,380 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_simulator.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_completion_port.h"
+#include "afd_poll_device.h"
+#include "afd_poll_set.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+
+// An in-process stand-in for \Device\Afd and an I/O completion port, so that
+// the code that builds, submits and dispatches polls can be driven without a
+// Windows kernel. Time is virtual, in the 100ns units of the AFD Timeout, and
+// only moves when advance() is called or when get() has nothing to return, so
+// a run is deterministic and isn't slowed down by waiting.
+//
+// The behaviour follows what the tests in understand.cpp and explore.cpp show
+// the real thing doing:
+//
+//  - polls are one shot and level triggered; a poll for events that a socket
+//    already has completes straight away and reports them again and again.
+//  - a poll reports the state of the sockets when it completes, not when it
+//    was issued, and only the handles that have some of the events asked for.
+//  - a poll that completes straight away still queues a completion to the
+//    port unless skip_completion_port_on_success is set, which is the same as
+//    FILE_SKIP_COMPLETION_PORT_ON_SUCCESS.
+//  - polls are independent, two pending polls for the same handle both
+//    complete, and cancelling completes a poll with STATUS_CANCELLED and no
+//    handles.
+//  - an Exclusive poll completes any earlier Exclusive poll that includes one
+//    of the same handles, with success and no handles.
+//  - a poll that reaches its Timeout completes with STATUS_TIMEOUT and no
+//    handles.
+//  - closing a socket reports AFD_POLL_LOCAL_CLOSE to the polls that want it
+//    and polling a closed socket is an error.
+//
+// The input is copied when the poll is issued, as AFD does, but the output
+// buffer belongs to the simulator until the poll completes. The second poll
+// for a socket with different events never completing, which one of the
+// understand tests shows, isn't modelled; nothing here polls like that.
+//
+// One thread drives the simulator; nothing is locked.
+
+class afd_simulator : public afd_completion_port
+{
+   public :
+
+      static constexpr int32_t status_success = 0;
+
+      static constexpr int32_t status_timeout = 0x00000102;
+
+      static constexpr int32_t status_cancelled = static_cast<int32_t>(0xC0000120);
+
+      static constexpr int32_t status_connection_refused = static_cast<int32_t>(0xC0000236);
+
+      static constexpr uint64_t ticks_per_ms = 10000;
+
+      struct completion
+      {
+         void *pContext;
+
+         int32_t status;
+
+         uint32_t information;      // bytes written to the output buffer
+      };
+
+      struct statistics
+      {
+         uint64_t polls = 0;
+         uint64_t completed_immediately = 0;
+         uint64_t completions = 0;
+         uint64_t cancelled = 0;
+         uint64_t timed_out = 0;
+         uint64_t exclusive_replaced = 0;
+         uint64_t state_changes = 0;
+      };
+
+      // The simulated \Device\Afd handle, polls issued through one complete to
+      // the simulator's completion port. A poll can be pending on each buffer,
+      // there are more than a poll set uses so that, as in understand.cpp, a
+      // test can have more than one poll pending on a handle.
+
+      class device : public afd_poll_device
+      {
+         public :
+
+            static constexpr uint32_t buffers = 2;
+
+            device(
+               afd_simulator &simulator)
+               :  simulator(simulator),
+                  pending{ no_poll, no_poll }
+            {
+            }
+
+            bool poll(
+               uint32_t buffer,
+               afd_poll_info &in,
+               uint32_t in_size,
+               afd_poll_info &out,
+               uint32_t out_size,
+               void *pContext) override;
+
+            void cancel(
+               uint32_t buffer) override;
+
+            bool pending_on(
+               uint32_t buffer) const;
+
+         private :
+
+            friend class afd_simulator;
+
+            afd_simulator &simulator;
+
+            uint32_t pending[buffers];
+      };
+
+      explicit afd_simulator(
+         bool skip_completion_port_on_success = false);
+
+      afd_simulator(const afd_simulator &) = delete;
+      afd_simulator(afd_simulator &&) = delete;
+
+      afd_simulator& operator=(const afd_simulator &) = delete;
+      afd_simulator& operator=(afd_simulator &&) = delete;
+
+      ~afd_simulator();
+
+      device &create_device();
+
+      // Sockets are identified by the handle that is passed to the polls,
+      // handles are never reused.
+
+      uintptr_t create_socket();
+
+      void close_socket(
+         uintptr_t handle);
+
+      // Changes the state of a socket now, any pending polls that want the new
+      // events complete. The status is reported with the socket's events, as
+      // it is for AFD_POLL_CONNECT_FAIL.
+
+      void set_events(
+         uintptr_t handle,
+         uint32_t events,
+         int32_t status = status_success);
+
+      void clear_events(
+         uintptr_t handle,
+         uint32_t events);
+
+      uint32_t get_events(
+         uintptr_t handle) const;
+
+      // Changes the state of a socket when virtual time reaches 'at'. Changes
+      // that are due at the same time are made in the order they were
+      // scheduled.
+
+      void schedule(
+         uint64_t at,
+         uintptr_t handle,
+         uint32_t set,
+         uint32_t clear,
+         int32_t status = status_success);
+
+      uint64_t now() const
+      {
+         return current_time;
+      }
+
+      // Moves virtual time forward, making scheduled changes and timing out
+      // polls as it goes.
+
+      void advance(
+         uint64_t ticks);
+
+      void run_until(
+         uint64_t time);
+
+      // The time at which something next happens, UINT64_MAX if nothing will.
+
+      uint64_t next_event_time();
+
+      // Returns the oldest completion. If there isn't one then virtual time is
+      // moved on to the next scheduled change or poll timeout, until something
+      // completes or the timeout is reached. An infinite wait with nothing left
+      // to happen returns false rather than blocking forever.
+
+      bool get(
+         completion &result,
+         uint32_t timeout_ms);
+
+      bool get(
+         void *&pContext,
+         uint32_t timeout_ms) override;
+
+      void post(
+         void *pContext) override;
+
+      size_t queued() const
+      {
+         return completions.size();
+      }
+
+      size_t pending_polls() const
+      {
+         return polls_pending;
+      }
+
+      const statistics &stats() const
+      {
+         return counters;
+      }
+
+   private :
+
+      static constexpr uint32_t no_poll = UINT32_MAX;
+
+      struct watcher
+      {
+         uint32_t poll;
+
+         uint32_t events;           // all that the poll wants from the socket
+      };
+
+      struct socket_state
+      {
+         uint32_t events = 0;
+
+         int32_t status = status_success;
+
+         bool open = true;
+
+         std::vector<watcher> watchers;      // pending polls that include the socket
+      };
+
+      struct pending_poll
+      {
+         device *pDevice = nullptr;
+
+         uint32_t buffer = 0;
+
+         afd_poll_info *pOut = nullptr;
+
+         void *pContext = nullptr;
+
+         bool exclusive = false;
+
+         uint32_t generation = 0;
+
+         std::vector<afd_poll_handle_info> handles;
+      };
+
+      struct scheduled_change
+      {
+         uint64_t at;
+
+         uint64_t sequence;
+
+         uintptr_t handle;
+
+         uint32_t set;
+
+         uint32_t clear;
+
+         int32_t status;
+
+         bool operator>(
+            const scheduled_change &rhs) const
+         {
+            return at != rhs.at ? at > rhs.at : sequence > rhs.sequence;
+         }
+      };
+
+      struct poll_timeout
+      {
+         uint64_t at;
+
+         uint32_t poll;
+
+         uint32_t generation;
+
+         bool operator>(
+            const poll_timeout &rhs) const
+         {
+            return at != rhs.at ? at > rhs.at : poll > rhs.poll;
+         }
+      };
+
+      bool poll(
+         device &owner,
+         uint32_t buffer,
+         afd_poll_info &in,
+         uint32_t in_size,
+         afd_poll_info &out,
+         uint32_t out_size,
+         void *pContext);
+
+      void cancel(
+         device &owner,
+         uint32_t buffer);
+
+      socket_state &get_socket(
+         uintptr_t handle);
+
+      const socket_state *find_socket(
+         uintptr_t handle) const;
+
+      void changed(
+         socket_state &socket);
+
+      bool ready(
+         const pending_poll &poll) const;
+
+      completion complete(
+         uint32_t index,
+         int32_t status,
+         bool report);
+
+      void discard_stale_timeouts();
+
+      const bool skip_on_success;
+
+      uint64_t current_time;
+
+      uint64_t sequence;
+
+      std::vector<std::unique_ptr<device>> devices;
+
+      std::vector<socket_state> sockets;
+
+      std::vector<pending_poll> polls;
+
+      std::vector<uint32_t> free_polls;
+
+      size_t polls_pending;
+
+      std::priority_queue<scheduled_change, std::vector<scheduled_change>, std::greater<scheduled_change>> changes;
+
+      std::priority_queue<poll_timeout, std::vector<poll_timeout>, std::greater<poll_timeout>> timeouts;
+
+      std::deque<completion> completions;
+
+      statistics counters;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_simulator.h
+///////////////////////////////////////////////////////////////////////////////
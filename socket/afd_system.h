@@ -33,6 +33,8 @@
 
 #include "../shared/afd.h"
 
+#include "reactor.h"
+
 class afd_system_events
 {
    public :
@@ -44,25 +46,43 @@ class afd_system_events
       virtual ~afd_system_events() = default;
 };
 
-class afd_system
+// The completion context for polls that use one of an afd_poll_set's output
+// buffers, the completion is passed back to the owner along with the buffer so
+// that the right results are dispatched.
+
+template <class owner>
+class afd_buffer_events : public afd_system_events
 {
    public :
 
-      virtual void associate_socket(
-         ULONG slot,
-         SOCKET s,
-         afd_events &events) = 0;
+      afd_buffer_events(
+         owner &system,
+         const ULONG buffer)
+         :  system(system),
+            buffer(buffer)
+      {
+      }
 
-      virtual void disassociate_socket(
-         ULONG slot) = 0;
+      void handle_events() override
+      {
+         system.handle_events(buffer);
+      }
 
-      virtual bool poll(
-         ULONG slot,
-         ULONG events) = 0;
+   private :
 
+      owner &system;
+
+      const ULONG buffer;
+};
+
+// The reactor implementations that use \Device\Afd. Events are passed through
+// as the AFD_POLL_xxx flags and the status is the Win32 error for the socket.
+
+class afd_system : public reactor
+{
    protected :
 
-      virtual ~afd_system() = default;
+      ~afd_system() override = default;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
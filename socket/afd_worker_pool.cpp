@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_worker_pool.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_worker_pool.h"
+
+#include <stdexcept>
+
+afd_worker_pool::afd_worker_pool(
+   afd_completion_port &port,
+   const uint32_t num_threads,
+   completion_handler handler)
+   :  port(port),
+      handler(std::move(handler))
+{
+   if (num_threads < 1)
+   {
+      throw std::runtime_error("a worker pool needs at least 1 thread");
+   }
+
+   workers.reserve(num_threads);
+
+   try
+   {
+      for (uint32_t i = 0; i < num_threads; ++i)
+      {
+         workers.emplace_back([this]() { run(); });
+      }
+   }
+   catch (...)
+   {
+      stop();
+
+      throw;
+   }
+}
+
+afd_worker_pool::~afd_worker_pool()
+{
+   try
+   {
+      stop();
+   }
+   catch (...)
+   {
+   }
+}
+
+void afd_worker_pool::stop()
+{
+   // one exit per thread, queued behind anything that is already waiting
+
+   for (size_t i = 0; i < workers.size(); ++i)
+   {
+      port.post(nullptr);
+   }
+
+   for (auto &worker : workers)
+   {
+      worker.join();
+   }
+
+   workers.clear();
+
+   std::exception_ptr rethrow;
+
+   {
+      std::lock_guard<std::mutex> guard(lock);
+
+      rethrow = failure;
+
+      failure = nullptr;
+   }
+
+   if (rethrow)
+   {
+      std::rethrow_exception(rethrow);
+   }
+}
+
+void afd_worker_pool::run()
+{
+   try
+   {
+      for (;;)
+      {
+         void *pContext = nullptr;
+
+         if (port.get(pContext, afd_completion_port::infinite))
+         {
+            if (!pContext)
+            {
+               break;
+            }
+
+            handler(pContext);
+         }
+      }
+   }
+   catch (...)
+   {
+      std::lock_guard<std::mutex> guard(lock);
+
+      if (!failure)
+      {
+         failure = std::current_exception();
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_worker_pool.cpp
+///////////////////////////////////////////////////////////////////////////////
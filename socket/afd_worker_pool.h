@@ -0,0 +1,93 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: afd_worker_pool.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_completion_port.h"
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A number of threads that all wait on the same completion port and pass each
+// completion to the handler. The handler is called on several threads at once,
+// an afd_system that is driven by the pool must lock; sharded_afd_system locks
+// per shard so a shard that is slow to dispatch only holds up the threads that
+// complete polls for it.
+// If the handler throws then the thread exits and the first exception is
+// rethrown by stop().
+
+class afd_worker_pool
+{
+   public :
+
+      using completion_handler = std::function<void(void *pContext)>;
+
+      afd_worker_pool(
+         afd_completion_port &port,
+         uint32_t num_threads,
+         completion_handler handler);
+
+      afd_worker_pool(const afd_worker_pool &) = delete;
+      afd_worker_pool(afd_worker_pool &&) = delete;
+
+      afd_worker_pool& operator=(const afd_worker_pool &) = delete;
+      afd_worker_pool& operator=(afd_worker_pool &&) = delete;
+
+      ~afd_worker_pool();
+
+      uint32_t threads() const
+      {
+         return static_cast<uint32_t>(workers.size());
+      }
+
+      // completions that were posted before stop() are processed before the
+      // threads exit
+
+      void stop();
+
+   private :
+
+      void run();
+
+      afd_completion_port &port;
+
+      const completion_handler handler;
+
+      std::mutex lock;
+
+      std::exception_ptr failure;
+
+      std::vector<std::thread> workers;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: afd_worker_pool.h
+///////////////////////////////////////////////////////////////////////////////
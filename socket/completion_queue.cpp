@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: completion_queue.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "completion_queue.h"
+
+#include <chrono>
+
+bool completion_queue::get(
+   void *&pContext,
+   const uint32_t timeout_ms)
+{
+   std::unique_lock<std::mutex> guard(lock);
+
+   const auto ready = [this]() { return !completions.empty(); };
+
+   if (timeout_ms == infinite)
+   {
+      available.wait(guard, ready);
+   }
+   else if (!available.wait_for(guard, std::chrono::milliseconds(timeout_ms), ready))
+   {
+      return false;
+   }
+
+   pContext = completions.front();
+
+   completions.pop_front();
+
+   return true;
+}
+
+void completion_queue::post(
+   void *pContext)
+{
+   {
+      std::lock_guard<std::mutex> guard(lock);
+
+      completions.push_back(pContext);
+   }
+
+   available.notify_one();
+}
+
+size_t completion_queue::size() const
+{
+   std::lock_guard<std::mutex> guard(lock);
+
+   return completions.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: completion_queue.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,71 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: completion_queue.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_completion_port.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// A portable stand-in for an I/O completion port. Contexts are returned in
+// the order that they were posted, to any of the threads that are waiting.
+
+class completion_queue : public afd_completion_port
+{
+   public :
+
+      completion_queue() = default;
+
+      completion_queue(const completion_queue &) = delete;
+      completion_queue(completion_queue &&) = delete;
+
+      completion_queue& operator=(const completion_queue &) = delete;
+      completion_queue& operator=(completion_queue &&) = delete;
+
+      bool get(
+         void *&pContext,
+         uint32_t timeout_ms) override;
+
+      void post(
+         void *pContext) override;
+
+      size_t size() const;
+
+   private :
+
+      mutable std::mutex lock;
+
+      std::condition_variable available;
+
+      std::deque<void *> completions;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: completion_queue.h
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,362 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: connect_race.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "connect_race.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+static uint64_t now_ms()
+{
+   return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// a millisecond more, as part of the current one has already passed, so that
+// at least as long as we were asked for has passed when we say that it has
+
+static uint64_t after(
+   const uint32_t milliseconds)
+{
+   return now_ms() + milliseconds + 1;
+}
+
+connect_race::connect_race(
+   afd_handle owner_afd,
+   reactor_events &owner,
+   const std::span<const socket_address> candidates,
+   const uint32_t timeout_ms,
+   const uint32_t stagger_ms)
+   :  owner_afd(owner_afd),
+      owner(owner),
+      deadline(after(timeout_ms)),
+      stagger_ms(stagger_ms),
+      next_start(0),
+      next_address(0),
+      pending(0),
+      last_error(0),
+      winner(invalid_socket),
+      finished(false)
+{
+   if (candidates.empty())
+   {
+      throw std::runtime_error("no addresses to connect to");
+   }
+
+   // the first address's family, then the other, in turn, each in the order
+   // that they were given
+
+   std::vector<socket_address> first;
+
+   std::vector<socket_address> others;
+
+   for (const socket_address &address : candidates)
+   {
+      (address.family() == candidates[0].family() ? first : others).push_back(address);
+   }
+
+   addresses.reserve(candidates.size());
+
+   for (size_t i = 0; i < std::max(first.size(), others.size()); ++i)
+   {
+      if (i < first.size())
+      {
+         addresses.push_back(first[i]);
+      }
+
+      if (i < others.size())
+      {
+         addresses.push_back(others[i]);
+      }
+   }
+}
+
+connect_race::~connect_race()
+{
+   cancel();
+
+   if (winner != invalid_socket)
+   {
+      close_socket(winner);
+   }
+}
+
+socket_result<void> connect_race::start()
+{
+   if (!start_next())
+   {
+      finished = true;
+
+      return socket_result<void>::failure(last_error);
+   }
+
+   if (!set_timer())
+   {
+      cancel();
+
+      throw std::runtime_error("a connect with a deadline needs a reactor with timers");
+   }
+
+   return socket_result<void>::success();
+}
+
+void connect_race::timer_expired()
+{
+   if (finished)
+   {
+      return;
+   }
+
+   const uint64_t now = now_ms();
+
+   if (now >= deadline)
+   {
+      report(reactor_event::connect_fail, socket_timed_out);
+
+      return;
+   }
+
+   if (now >= next_start)
+   {
+      start_next();
+   }
+
+   if (!pending)
+   {
+      report(reactor_event::connect_fail, last_error);
+
+      return;
+   }
+
+   set_timer();
+}
+
+void connect_race::cancel()
+{
+   finished = true;
+
+   for (const auto &pAttempt : attempts)
+   {
+      pAttempt->close();
+   }
+
+   pending = 0;
+
+   owner_afd.cancel_timer();
+}
+
+reactor_socket connect_race::take_winner()
+{
+   const reactor_socket s = winner;
+
+   winner = invalid_socket;
+
+   return s;
+}
+
+bool connect_race::start_next()
+{
+   while (next_address < addresses.size())
+   {
+      attempts.push_back(std::make_unique<attempt>(*this, owner_afd.afd));
+
+      const int error = attempts.back()->connect(addresses[next_address++]);
+
+      if (!error)
+      {
+         ++pending;
+
+         next_start = after(stagger_ms);
+
+         return true;
+      }
+
+      last_error = error;
+   }
+
+   return false;
+}
+
+void connect_race::attempt_complete(
+   attempt &completed,
+   const uint32_t events,
+   const int32_t status)
+{
+   if (finished)
+   {
+      return;
+   }
+
+   --pending;
+
+   if ((events & reactor_event::send) && !(events & reactor_event::connect_fail))
+   {
+      winner = completed.release();
+
+      report(reactor_event::send, 0);
+
+      return;
+   }
+
+   last_error = status ? status : socket_not_connected;
+
+   completed.close();
+
+   // a failure starts the next attempt now, rather than when the stagger
+   // passes
+
+   if (start_next())
+   {
+      set_timer();
+   }
+   else if (!pending)
+   {
+      report(reactor_event::connect_fail, last_error);
+   }
+}
+
+bool connect_race::set_timer()
+{
+   const uint64_t now = now_ms();
+
+   const uint64_t when = next_address < addresses.size() ? std::min(deadline, next_start) : deadline;
+
+   return owner_afd.set_timer(static_cast<uint32_t>(when > now ? when - now : 0));
+}
+
+void connect_race::report(
+   const uint32_t events,
+   const int32_t status)
+{
+   cancel();
+
+   // whatever the owner's callbacks want to poll for they poll for
+   // themselves, so the interest that it returns needn't be acted on
+
+   owner.handle_events(events, status);
+}
+
+connect_race::attempt::attempt(
+   connect_race &race,
+   reactor &afd)
+   :  race(race),
+      afd(afd),
+      s(invalid_socket),
+      released(false)
+{
+}
+
+connect_race::attempt::~attempt()
+{
+   close();
+}
+
+int connect_race::attempt::connect(
+   const socket_address &address)
+{
+   s = open_tcp_socket(address.family());
+
+   if (s == invalid_socket || !set_non_blocking(s))
+   {
+      const int error = last_socket_error();
+
+      close();
+
+      return error;
+   }
+
+   afd.associate_socket(s, *this);
+
+   if (socket_error == socket_connect(s, address.address(), address.length))
+   {
+      const int error = last_socket_error();
+
+      if (!is_connect_pending(error))
+      {
+         close();
+
+         return error;
+      }
+   }
+
+   afd.poll(
+      reactor_event::send |               // connected
+      reactor_event::connect_fail |
+      reactor_event::disconnect |
+      reactor_event::abort);
+
+   return 0;
+}
+
+void connect_race::attempt::close()
+{
+   if (s != invalid_socket)
+   {
+      afd.closing_socket(false);
+
+      close_socket(s);
+
+      s = invalid_socket;
+   }
+
+   release();
+}
+
+reactor_socket connect_race::attempt::release()
+{
+   // the slot is given back whether or not the socket was ever associated
+   // with it, and only once, it may be someone else's by the next call
+
+   if (!released)
+   {
+      afd.disassociate_socket();
+
+      released = true;
+   }
+
+   const reactor_socket connected = s;
+
+   s = invalid_socket;
+
+   return connected;
+}
+
+uint32_t connect_race::attempt::handle_events(
+   const uint32_t events,
+   const int32_t status)
+{
+   race.attempt_complete(*this, events, status);
+
+   // we've been closed, or given to the owner
+
+   return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: connect_race.cpp
+///////////////////////////////////////////////////////////////////////////////
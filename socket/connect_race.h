@@ -0,0 +1,171 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: connect_race.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_handle.h"
+#include "socket_api.h"
+#include "socket_result.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Connects to the first of a list of addresses that will have us, for a
+// tcp_socket that's given more than one, or a deadline. As happy eyeballs
+// (RFC 8305) does, the addresses alternate between families, starting with
+// the family of the first, and an attempt to connect to the next address is
+// started each time that the stagger passes without one succeeding, or as
+// soon as one fails. The first to connect wins and the others are closed.
+//
+// Each attempt is a socket of its own, in a slot of its own on the owner's
+// reactor. The race uses the owner's timer, and reports the result through
+// the owner's handle_events(), with send when it has won, when the owner
+// takes the connected socket with take_winner(), and with connect_fail and
+// the error when every address has failed, or socket_timed_out when the
+// deadline passes first.
+
+class connect_race
+{
+   public :
+
+      static constexpr uint32_t default_stagger_ms = 250;
+
+      connect_race(
+         afd_handle owner_afd,
+         reactor_events &owner,
+         std::span<const socket_address> addresses,
+         uint32_t timeout_ms,
+         uint32_t stagger_ms);
+
+      connect_race(const connect_race &) = delete;
+      connect_race(connect_race &&) = delete;
+
+      connect_race& operator=(const connect_race &) = delete;
+      connect_race& operator=(connect_race &&) = delete;
+
+      ~connect_race();
+
+      // Starts the first attempt. If every address fails straight away then
+      // nothing is reported and the error of the last is returned. Throws if
+      // the reactor has no timers.
+
+      socket_result<void> start();
+
+      void timer_expired();
+
+      // Closes the attempts that are still running, nothing is reported.
+
+      void cancel();
+
+      reactor_socket take_winner();
+
+      size_t attempts_started() const
+      {
+         return attempts.size();
+      }
+
+   private :
+
+      class attempt : public reactor_events
+      {
+         public :
+
+            attempt(
+               connect_race &race,
+               reactor &afd);
+
+            ~attempt() override;
+
+            int connect(
+               const socket_address &address);
+
+            void close();
+
+            reactor_socket release();
+
+         private :
+
+            uint32_t handle_events(
+               uint32_t events,
+               int32_t status) override;
+
+            connect_race &race;
+
+            const afd_handle afd;
+
+            reactor_socket s;
+
+            bool released;
+      };
+
+      bool start_next();
+
+      void attempt_complete(
+         attempt &completed,
+         uint32_t events,
+         int32_t status);
+
+      bool set_timer();
+
+      void report(
+         uint32_t events,
+         int32_t status);
+
+      const afd_handle owner_afd;
+
+      reactor_events &owner;
+
+      std::vector<socket_address> addresses;
+
+      const uint64_t deadline;
+
+      const uint32_t stagger_ms;
+
+      uint64_t next_start;
+
+      size_t next_address;
+
+      // attempts are kept until the race is destroyed, one that completes is
+      // still running its handle_events() when the race is decided
+
+      std::vector<std::unique_ptr<attempt>> attempts;
+
+      uint32_t pending;
+
+      int last_error;
+
+      reactor_socket winner;
+
+      bool finished;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: connect_race.h
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,298 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: connection_batch.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "connection_batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+// One of the batch's sockets, which counts its connect before the callbacks
+// hear about it, and passes everything else straight on.
+
+class connection_batch::connection : private tcp_socket_callbacks
+{
+   public :
+
+      connection(
+         connection_batch &batch,
+         reactor &afd,
+         const size_t send_queue_limit,
+         const size_t receive_ring_size)
+         :  batch(batch),
+            s(afd_handle(afd), *this, send_queue_limit, receive_ring_size)
+      {
+      }
+
+      tcp_socket &socket()
+      {
+         return s;
+      }
+
+      // the connect failed straight away if it returns an error
+
+      int connect(
+         const socket_address &address)
+      {
+         started = std::chrono::steady_clock::now();
+
+         const socket_result<void> result = s.try_connect(address.address(), address.length);
+
+         return result ? 0 : result.error();
+      }
+
+      uint32_t elapsed_us() const
+      {
+         return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+      }
+
+   private :
+
+      void on_connected(
+         tcp_socket &connected) override
+      {
+         batch.connect_complete(*this, true);
+
+         batch.callbacks.on_connected(connected);
+      }
+
+      void on_connection_failed(
+         tcp_socket &failed,
+         const uint32_t error) override
+      {
+         batch.connect_complete(*this, false);
+
+         batch.callbacks.on_connection_failed(failed, error);
+      }
+
+      void on_readable(
+         tcp_socket &readable) override
+      {
+         batch.callbacks.on_readable(readable);
+      }
+
+      void on_readable_oob(
+         tcp_socket &readable) override
+      {
+         batch.callbacks.on_readable_oob(readable);
+      }
+
+      void on_writable(
+         tcp_socket &writable) override
+      {
+         batch.callbacks.on_writable(writable);
+      }
+
+      void on_client_close(
+         tcp_socket &closed) override
+      {
+         batch.callbacks.on_client_close(closed);
+      }
+
+      void on_connection_reset(
+         tcp_socket &reset) override
+      {
+         batch.callbacks.on_connection_reset(reset);
+      }
+
+      void on_disconnected(
+         tcp_socket &disconnected) override
+      {
+         batch.callbacks.on_disconnected(disconnected);
+      }
+
+      void on_send_queue_high(
+         tcp_socket &high) override
+      {
+         batch.callbacks.on_send_queue_high(high);
+      }
+
+      void on_send_queue_drained(
+         tcp_socket &drained) override
+      {
+         batch.callbacks.on_send_queue_drained(drained);
+      }
+
+      connection_batch &batch;
+
+      tcp_socket s;
+
+      std::chrono::steady_clock::time_point started;
+};
+
+connection_batch::connection_batch(
+   reactor &afd,
+   tcp_socket_callbacks &callbacks,
+   const size_t send_queue_limit,
+   const size_t receive_ring_size)
+   :  afd(afd),
+      callbacks(callbacks),
+      send_queue_limit(send_queue_limit),
+      receive_ring_size(receive_ring_size),
+      pool(256),
+      address{},
+      next_to_start(0),
+      max_in_flight(0),
+      num_in_flight(0),
+      max_seen_in_flight(0),
+      num_connected(0),
+      num_failed(0)
+{
+}
+
+connection_batch::~connection_batch()
+{
+   for (connection *pConnection : connections)
+   {
+      pool.release(pConnection);
+   }
+}
+
+void connection_batch::connect(
+   const sockaddr &target,
+   const int address_length,
+   const size_t count,
+   const size_t max_connecting)
+{
+   if (!connections.empty())
+   {
+      throw std::runtime_error("the batch has already connected");
+   }
+
+   if (!count || !max_connecting)
+   {
+      throw std::runtime_error("a batch must connect at least one socket, at least one at a time");
+   }
+
+   address = make_socket_address(target, static_cast<socket_length>(address_length));
+
+   max_in_flight = max_connecting;
+
+   connections.reserve(count);
+
+   latencies_us.reserve(count);
+
+   // the sockets are all created up front, so that running out of them fails
+   // here rather than part way through
+
+   for (size_t i = 0; i < count; ++i)
+   {
+      connections.push_back(pool.acquire(*this, afd, send_queue_limit, receive_ring_size));
+   }
+
+   start_connects();
+}
+
+tcp_socket &connection_batch::socket(
+   const size_t index)
+{
+   if (index >= connections.size())
+   {
+      throw std::runtime_error("no such connection");
+   }
+
+   return connections[index]->socket();
+}
+
+connection_batch::latency connection_batch::connect_latency() const
+{
+   latency result {};
+
+   result.samples = latencies_us.size();
+
+   if (latencies_us.empty())
+   {
+      return result;
+   }
+
+   std::vector<uint32_t> sorted(latencies_us);
+
+   std::sort(sorted.begin(), sorted.end());
+
+   const auto percentile = [&](const size_t per_thousand)
+   {
+      return sorted[std::min(sorted.size() - 1, (sorted.size() * per_thousand) / 1000)];
+   };
+
+   result.p50_us = percentile(500);
+   result.p90_us = percentile(900);
+   result.p99_us = percentile(990);
+   result.p999_us = percentile(999);
+   result.max_us = sorted.back();
+
+   return result;
+}
+
+void connection_batch::start_connects()
+{
+   // a connect that fails straight away makes room for the next
+
+   while (num_in_flight < max_in_flight && next_to_start < connections.size())
+   {
+      connection &starting = *connections[next_to_start++];
+
+      const int error = starting.connect(address);
+
+      if (error)
+      {
+         ++num_failed;
+
+         callbacks.on_connection_failed(starting.socket(), static_cast<uint32_t>(error));
+      }
+      else
+      {
+         ++num_in_flight;
+
+         max_seen_in_flight = std::max(max_seen_in_flight, num_in_flight);
+      }
+   }
+}
+
+void connection_batch::connect_complete(
+   connection &completed,
+   const bool succeeded)
+{
+   --num_in_flight;
+
+   if (succeeded)
+   {
+      ++num_connected;
+
+      latencies_us.push_back(completed.elapsed_us());
+   }
+   else
+   {
+      ++num_failed;
+   }
+
+   start_connects();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: connection_batch.cpp
+///////////////////////////////////////////////////////////////////////////////
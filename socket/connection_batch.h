@@ -0,0 +1,164 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: connection_batch.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "connection_pool.h"
+#include "tcp_socket.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Many outbound connections to one address, for load generation. connect()
+// creates every socket, each associated with the reactor, and starts their
+// connects no more than max_in_flight at a time, so that a listener's SYN
+// backlog isn't overrun; as each connect completes, whether it succeeded or
+// not, the next is started. The time that each took is kept, from the start
+// of its connect to the callback, and connect_latency() reports percentiles
+// of those that succeeded.
+//
+// Every socket calls the same callbacks, which are told which socket it is,
+// on_connected() and on_connection_failed() are called once the batch has
+// counted the result. The sockets are constructed in a connection_pool and
+// are destroyed with the batch. Not thread safe, run by the thread that runs
+// the reactor.
+
+class connection_batch
+{
+   public :
+
+      connection_batch(
+         reactor &afd,
+         tcp_socket_callbacks &callbacks,
+         size_t send_queue_limit = 0,
+         size_t receive_ring_size = 0);
+
+      connection_batch(const connection_batch &) = delete;
+      connection_batch(connection_batch &&) = delete;
+
+      connection_batch& operator=(const connection_batch &) = delete;
+      connection_batch& operator=(connection_batch &&) = delete;
+
+      ~connection_batch();
+
+      void connect(
+         const sockaddr &address,
+         int address_length,
+         size_t count,
+         size_t max_in_flight);
+
+      size_t size() const
+      {
+         return connections.size();
+      }
+
+      tcp_socket &socket(
+         size_t index);
+
+      size_t connected() const
+      {
+         return num_connected;
+      }
+
+      size_t failed() const
+      {
+         return num_failed;
+      }
+
+      size_t in_flight() const
+      {
+         return num_in_flight;
+      }
+
+      size_t peak_in_flight() const
+      {
+         return max_seen_in_flight;
+      }
+
+      // every connect has succeeded or failed
+
+      bool complete() const
+      {
+         return num_connected + num_failed == connections.size();
+      }
+
+      struct latency
+      {
+         size_t samples;
+
+         uint64_t p50_us;
+         uint64_t p90_us;
+         uint64_t p99_us;
+         uint64_t p999_us;
+         uint64_t max_us;
+      };
+
+      latency connect_latency() const;
+
+   private :
+
+      class connection;
+
+      void start_connects();
+
+      void connect_complete(
+         connection &completed,
+         bool succeeded);
+
+      reactor &afd;
+
+      tcp_socket_callbacks &callbacks;
+
+      const size_t send_queue_limit;
+
+      const size_t receive_ring_size;
+
+      connection_pool<connection> pool;
+
+      std::vector<connection *> connections;
+
+      std::vector<uint32_t> latencies_us;
+
+      socket_address address;
+
+      size_t next_to_start;
+
+      size_t max_in_flight;
+
+      size_t num_in_flight;
+
+      size_t max_seen_in_flight;
+
+      size_t num_connected;
+
+      size_t num_failed;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: connection_batch.h
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,142 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: connection_pool.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "slab_allocator.h"
+
+#include <new>
+#include <utility>
+
+// Connection objects that are constructed in, and destroyed back into, the
+// slots of a slab_allocator, rather than being allocated with new and freed
+// with delete as each connection is accepted and closed. Construction and
+// destruction are the connection's own, only the memory is recycled.
+//
+// A thread that accepts, or closes, a lot of connections can give itself a
+// thread_cache, which only goes to the shared pool for batches of slots. A
+// connection can be released to any cache, or to the pool, whichever thread
+// acquired it.
+
+template <typename connection>
+class connection_pool
+{
+   public :
+
+      explicit connection_pool(
+         const size_t connections_per_slab = 64)
+         :  slabs(sizeof(connection), alignof(connection), connections_per_slab)
+      {
+      }
+
+      template <typename... args>
+      connection *acquire(
+         args &&...constructor_args)
+      {
+         return construct(slabs.allocate(), std::forward<args>(constructor_args)...);
+      }
+
+      void release(
+         connection *pConnection)
+      {
+         pConnection->~connection();
+
+         slabs.deallocate(pConnection);
+      }
+
+      class thread_cache
+      {
+         public :
+
+            thread_cache(
+               connection_pool &pool,
+               const size_t capacity = 32)
+               :  pool(pool),
+                  cache(pool.slabs, capacity)
+            {
+            }
+
+            // a slot that a connection fails to be constructed in goes back to
+            // the pool rather than to the cache
+
+            template <typename... args>
+            connection *acquire(
+               args &&...constructor_args)
+            {
+               return pool.construct(cache.allocate(), std::forward<args>(constructor_args)...);
+            }
+
+            void release(
+               connection *pConnection)
+            {
+               pConnection->~connection();
+
+               cache.deallocate(pConnection);
+            }
+
+            size_t cached() const
+            {
+               return cache.cached();
+            }
+
+         private :
+
+            connection_pool &pool;
+
+            slab_cache cache;
+      };
+
+      const slab_allocator &allocator() const
+      {
+         return slabs;
+      }
+
+   private :
+
+      template <typename... args>
+      connection *construct(
+         void *pSlot,
+         args &&...constructor_args)
+      {
+         try
+         {
+            return new (pSlot) connection(std::forward<args>(constructor_args)...);
+         }
+         catch (...)
+         {
+            slabs.deallocate(pSlot);
+
+            throw;
+         }
+      }
+
+      slab_allocator slabs;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: connection_pool.h
+///////////////////////////////////////////////////////////////////////////////
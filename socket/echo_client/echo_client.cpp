@@ -35,6 +35,7 @@
 #include "tcp_socket.h"
 #include "single_connection_afd_system.h"
 #include "afd_handle.h"
+#include "iocp_completion_port.h"
 
 class echo_client : private tcp_socket_callbacks
 {
@@ -43,7 +44,7 @@ class echo_client : private tcp_socket_callbacks
       echo_client(
          afd_handle afd,
          int number_of_messages)
-         : s(afd, *this),
+         : s(afd, *this, sizeof send_buffer * 4),
            is_done(false),
            bytes_read(0),
            number_of_messages(number_of_messages),
@@ -91,9 +92,11 @@ class echo_client : private tcp_socket_callbacks
       {
          if (number_of_messages_sent < number_of_messages)
          {
+            // the socket queues anything that it can't send straight away,
+            // we only ever have one message outstanding so it always fits
+
             if (sizeof send_buffer != s.write(send_buffer, sizeof send_buffer))
             {
-               // todo, handle partial sends
                throw std::exception("failed to send all data");
             }
 
@@ -148,7 +151,7 @@ class echo_client : private tcp_socket_callbacks
 
       void on_connection_failed(
          tcp_socket &s,
-         DWORD error) override
+         uint32_t error) override
       {
          (void)s;
          (void)error;
@@ -176,9 +179,9 @@ class echo_client : private tcp_socket_callbacks
       void on_writable(
          tcp_socket &s) override
       {
-         (void)s;
+         // a message that was queued has now been sent
 
-         throw std::exception("unexpected writable...");
+         (void)s;
       }
 
       void on_client_close(
@@ -244,15 +247,20 @@ int main(int argc, char **argv)
 
       client.connect(reinterpret_cast<const sockaddr &>(address), sizeof address);
 
+      // a poll that is cancelled, so that changed interest can be submitted,
+      // completes with an error and is handled like any other
+
+      iocp_completion_port port(handles.iocp);
+
+      void *pContext = nullptr;
+
       while (!client.done())
       {
          // process events
 
-         auto *pAfd = GetCompletionAs<afd_system_events>(handles.iocp, INFINITE);
-
-         if (pAfd)
+         if (port.get(pContext, iocp_completion_port::infinite))
          {
-            pAfd->handle_events();
+            static_cast<afd_system_events *>(pContext)->handle_events();
          }
          else
          {
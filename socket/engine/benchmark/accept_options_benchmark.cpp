@@ -0,0 +1,313 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: accept_options_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "epoll/epoll_reactor.h"
+#include "listening_socket/tcp_listening_socket.h"
+#include "socket_options.h"
+#include "tcp_socket.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Accepting with a profile of socket options: each round a batch of clients
+// connects and the server accepts them all and gives each to a tcp_socket,
+// which is timed. Every accepted socket is made non-blocking, and given
+// buffer sizes, TCP_NODELAY and SO_KEEPALIVE, either by setting each option on
+// each socket as it's accepted, with the tcp_socket making it non-blocking as
+// it always has, or by giving the listener the profile, so that the options
+// are inherited from it, accept4() makes the socket non-blocking and the
+// tcp_socket is told that it is. Reports the accept rate and the system calls
+// that each accept took, counted as they're made.
+
+class options_connection : private tcp_socket_callbacks
+{
+   public :
+
+      template <typename accepted_socket>
+      options_connection(
+         reactor &afd,
+         const accepted_socket accepted)
+         :  s(afd_handle(afd), accepted, *this)
+      {
+      }
+
+   private :
+
+      void on_connected(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_failed(
+         tcp_socket &,
+         uint32_t) override
+      {
+      }
+
+      void on_readable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_readable_oob(
+         tcp_socket &) override
+      {
+      }
+
+      void on_writable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_client_close(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_reset(
+         tcp_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_socket &) override
+      {
+      }
+
+      tcp_socket s;
+};
+
+class ignoring_listener_callbacks : public tcp_listening_socket_callbacks
+{
+   public :
+
+      void on_incoming_connections(
+         tcp_listening_socket &) override
+      {
+      }
+
+      void on_connection_reset(
+         tcp_listening_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_listening_socket &) override
+      {
+      }
+};
+
+static sockaddr_in available_loopback_address()
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socklen_t address_length = sizeof address;
+
+   if (s == -1 ||
+       0 != ::bind(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&address), &address_length))
+   {
+      throw std::runtime_error("failed to find a port");
+   }
+
+   ::close(s);
+
+   return address;
+}
+
+static void abort_connection(
+   const int s)
+{
+   linger abortive {};
+
+   abortive.l_onoff = 1;
+
+   ::setsockopt(s, SOL_SOCKET, SO_LINGER, &abortive, sizeof abortive);
+
+   ::close(s);
+}
+
+static void run(
+   const std::string &name,
+   const bool use_profile,
+   const uint32_t rounds,
+   const uint32_t batch_size)
+{
+   socket_options profile;
+
+   profile.non_blocking = true;
+   profile.receive_buffer = 65536;
+   profile.send_buffer = 65536;
+   profile.no_delay = true;
+   profile.keep_alive = true;
+
+   // what's set on each socket when there's no profile, the tcp_socket makes
+   // it non-blocking
+
+   socket_options per_socket = profile;
+
+   per_socket.non_blocking = false;
+
+   const sockaddr_in address = available_loopback_address();
+
+   epoll_reactor afd;
+
+   ignoring_listener_callbacks callbacks;
+
+   tcp_listening_socket listener(afd_handle(afd), reinterpret_cast<const sockaddr &>(address), sizeof address, callbacks);
+
+   if (use_profile)
+   {
+      listener.set_accepted_options(profile);
+   }
+
+   listener.listen(SOMAXCONN);
+
+   uint64_t accepts = 0;
+
+   uint64_t calls = 0;
+
+   double seconds = 0.0;
+
+   for (uint32_t round = 0; round < rounds; ++round)
+   {
+      std::vector<int> clients;
+
+      for (uint32_t i = 0; i < batch_size; ++i)
+      {
+         const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+         if (s == -1 ||
+             0 != ::connect(s, reinterpret_cast<const sockaddr *>(&address), sizeof address))
+         {
+            throw std::runtime_error("failed to connect");
+         }
+
+         clients.push_back(s);
+      }
+
+      std::vector<std::unique_ptr<options_connection>> connections;
+
+      connections.reserve(batch_size);
+
+      uint64_t option_calls = 0;
+
+      stopwatch timer;
+
+      while (connections.size() < batch_size)
+      {
+         sockaddr_storage client_address {};
+
+         socket_length address_length = sizeof client_address;
+
+         const reactor_socket accepted = listener.accept(reinterpret_cast<sockaddr &>(client_address), address_length);
+
+         ++calls;
+
+         if (accepted == invalid_socket)
+         {
+            continue;
+         }
+
+         if (use_profile)
+         {
+            connections.push_back(std::make_unique<options_connection>(afd, non_blocking_socket{ accepted }));
+         }
+         else
+         {
+            set_socket_options(accepted, per_socket, option_calls);
+
+            connections.push_back(std::make_unique<options_connection>(afd, accepted));
+
+            ++calls;
+         }
+      }
+
+      seconds += timer.elapsed_seconds();
+
+      calls += option_calls;
+
+      accepts += connections.size();
+
+      connections.clear();
+
+      for (const int s : clients)
+      {
+         abort_connection(s);
+      }
+   }
+
+   calls += listener.stats().option_calls;
+
+   report(name, accepts, seconds);
+
+   std::cout << "   system calls per accept: " << static_cast<double>(calls) / static_cast<double>(accepts) << std::endl;
+}
+
+void accept_options_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t rounds = std::max(200 / scale, 2u);
+
+   const uint32_t batch_size = 256;
+
+   run("options set on each socket", false, rounds, batch_size);
+
+   run("options inherited, accept4", true, rounds, batch_size);
+}
+
+#else
+
+void accept_options_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the accept options benchmark counts Linux system calls and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: accept_options_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
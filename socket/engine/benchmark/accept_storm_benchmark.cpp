@@ -0,0 +1,439 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: accept_storm_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "connection_pool.h"
+#include "epoll/epoll_reactor.h"
+#include "listening_socket/tcp_listening_socket.h"
+#include "tcp_socket.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A storm of connections arriving whilst established connections are busy: in
+// each round a burst of clients connects, so that the listener's accept queue
+// is full, and then each established connection sends a ping, which the
+// server echoes. The reactor is run, a pass at a time, until every ping has
+// been echoed and every connection accepted. The server either accepts every
+// connection that's waiting each time that the listener is reported, or
+// accepts a budget of them, one at a time or in batches, so that the
+// established connections get a turn in between. Reports the accept rate and
+// the percentiles of the time that the pings took.
+//
+// Everything runs on one thread, the clients between the reactor's passes, so
+// that the latency is what the server makes it, not how the threads happened
+// to be scheduled. The clients reset their connections so that the ports
+// aren't left in TIME_WAIT.
+
+class storm_connection : private tcp_socket_callbacks
+{
+   public :
+
+      storm_connection(
+         const reactor_socket accepted,
+         reactor &afd,
+         std::vector<storm_connection *> &retired)
+         :  retired(retired),
+            s(afd_handle(afd), accepted, *this)
+      {
+         echo();
+      }
+
+   private :
+
+      void echo()
+      {
+         int bytes = 0;
+
+         while ((bytes = s.read(buffer, sizeof buffer)) > 0)
+         {
+            s.write(buffer, bytes);
+         }
+      }
+
+      void on_connected(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_failed(
+         tcp_socket &,
+         uint32_t) override
+      {
+      }
+
+      void on_readable(
+         tcp_socket &) override
+      {
+         echo();
+      }
+
+      void on_readable_oob(
+         tcp_socket &) override
+      {
+      }
+
+      void on_writable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_client_close(
+         tcp_socket &) override
+      {
+         s.close();
+      }
+
+      void on_connection_reset(
+         tcp_socket &) override
+      {
+         s.close();
+      }
+
+      void on_disconnected(
+         tcp_socket &) override
+      {
+         retired.push_back(this);
+      }
+
+      std::vector<storm_connection *> &retired;
+
+      tcp_socket s;
+
+      uint8_t buffer[64];
+};
+
+enum class accepting
+{
+   one_at_a_time,
+   in_batches
+};
+
+class storm_server : private tcp_listening_socket_callbacks
+{
+   public :
+
+      storm_server(
+         epoll_reactor &afd,
+         const sockaddr_in &address,
+         const uint32_t budget,
+         const accepting how)
+         :  afd(afd),
+            how(how),
+            listener(afd_handle(afd), reinterpret_cast<const sockaddr &>(address), sizeof address, *this)
+      {
+         listener.set_accept_budget(budget);
+
+         listener.listen(SOMAXCONN);
+      }
+
+      ~storm_server()
+      {
+         release_retired();
+      }
+
+      void release_retired()
+      {
+         for (storm_connection *pConnection : retired)
+         {
+            connections.release(pConnection);
+
+            ++released;
+         }
+
+         retired.clear();
+      }
+
+      uint64_t accepted = 0;
+
+      uint64_t released = 0;
+
+   private :
+
+      void on_incoming_connections(
+         tcp_listening_socket &s) override
+      {
+         if (how == accepting::in_batches)
+         {
+            storm_connection *batch[tcp_listening_socket::max_accept_batch];
+
+            size_t batched = 0;
+
+            while ((batched = s.accept_batch(connections, batch, tcp_listening_socket::max_accept_batch, afd, retired)) != 0)
+            {
+               accepted += batched;
+            }
+         }
+         else
+         {
+            while (s.accept_into(connections, afd, retired))
+            {
+               ++accepted;
+            }
+         }
+      }
+
+      void on_connection_reset(
+         tcp_listening_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_listening_socket &) override
+      {
+      }
+
+      epoll_reactor &afd;
+
+      const accepting how;
+
+      connection_pool<storm_connection> connections;
+
+      std::vector<storm_connection *> retired;
+
+      tcp_listening_socket listener;
+};
+
+static sockaddr_in available_loopback_address()
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socklen_t address_length = sizeof address;
+
+   if (s == -1 ||
+       0 != ::bind(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&address), &address_length))
+   {
+      throw std::runtime_error("failed to find a port");
+   }
+
+   ::close(s);
+
+   return address;
+}
+
+static void abort_connection(
+   const int s)
+{
+   linger abortive {};
+
+   abortive.l_onoff = 1;
+
+   ::setsockopt(s, SOL_SOCKET, SO_LINGER, &abortive, sizeof abortive);
+
+   ::close(s);
+}
+
+static uint64_t microseconds_since(
+   const std::chrono::steady_clock::time_point start)
+{
+   return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+static void run(
+   const std::string &name,
+   const uint32_t budget,
+   const accepting how,
+   const uint32_t rounds,
+   const uint32_t storm_size,
+   const uint32_t num_established)
+{
+   const sockaddr_in address = available_loopback_address();
+
+   epoll_reactor afd;
+
+   storm_server server(afd, address, budget, how);
+
+   std::vector<int> established;
+
+   for (uint32_t i = 0; i < num_established; ++i)
+   {
+      const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+      if (s == -1 ||
+          0 != ::connect(s, reinterpret_cast<const sockaddr *>(&address), sizeof address))
+      {
+         throw std::runtime_error("failed to connect");
+      }
+
+      established.push_back(s);
+   }
+
+   while (server.accepted < num_established)
+   {
+      afd.run_once(10);
+   }
+
+   std::vector<uint64_t> ping_us;
+
+   std::vector<int> storm;
+
+   double accepting_seconds = 0.0;
+
+   uint64_t storm_accepted = 0;
+
+   for (uint32_t round = 0; round < rounds; ++round)
+   {
+      for (uint32_t i = 0; i < storm_size; ++i)
+      {
+         const int s = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+
+         if (s == -1 ||
+             (0 != ::connect(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) && errno != EINPROGRESS))
+         {
+            throw std::runtime_error("failed to start a connect");
+         }
+
+         storm.push_back(s);
+      }
+
+      const uint64_t accepted_before = server.accepted;
+
+      const auto start = std::chrono::steady_clock::now();
+
+      for (const int s : established)
+      {
+         if (1 != ::send(s, "p", 1, MSG_NOSIGNAL))
+         {
+            throw std::runtime_error("failed to send a ping");
+         }
+      }
+
+      std::vector<int> waiting(established);
+
+      stopwatch timer;
+
+      while (!waiting.empty() || server.accepted - accepted_before < storm_size)
+      {
+         afd.run_once(10);
+
+         for (size_t i = 0; i < waiting.size();)
+         {
+            char echoed;
+
+            if (1 == ::recv(waiting[i], &echoed, 1, MSG_DONTWAIT))
+            {
+               ping_us.push_back(microseconds_since(start));
+
+               waiting[i] = waiting.back();
+
+               waiting.pop_back();
+            }
+            else
+            {
+               ++i;
+            }
+         }
+      }
+
+      accepting_seconds += timer.elapsed_seconds();
+
+      storm_accepted += server.accepted - accepted_before;
+
+      for (const int s : storm)
+      {
+         abort_connection(s);
+      }
+
+      storm.clear();
+
+      // every reset is dealt with before the next storm
+
+      while (server.released < server.accepted - num_established)
+      {
+         afd.run_once(10);
+
+         server.release_retired();
+      }
+   }
+
+   for (const int s : established)
+   {
+      abort_connection(s);
+   }
+
+   std::sort(ping_us.begin(), ping_us.end());
+
+   const auto percentile = [&](const size_t per_thousand)
+   {
+      return ping_us[std::min(ping_us.size() - 1, (ping_us.size() * per_thousand) / 1000)];
+   };
+
+   report(name, storm_accepted, accepting_seconds);
+
+   std::cout << "   ping latency us - p50: " << percentile(500) << " p99: " << percentile(990) << " max: " << ping_us.back() << std::endl;
+}
+
+void accept_storm_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t rounds = std::max(50 / scale, 2u);
+
+   const uint32_t storm_size = 2000;
+
+   const uint32_t num_established = 64;
+
+   const std::string storm = std::to_string(storm_size) + " connection storm, ";
+
+   run(storm + "accept everything", 1u << 30, accepting::one_at_a_time, rounds, storm_size, num_established);
+   run(storm + "budget of 64", 64, accepting::one_at_a_time, rounds, storm_size, num_established);
+   run(storm + "budget of 16", 16, accepting::one_at_a_time, rounds, storm_size, num_established);
+   run(storm + "budget of 64, in batches", 64, accepting::in_batches, rounds, storm_size, num_established);
+}
+
+#else
+
+void accept_storm_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the accept storm benchmark uses the epoll reactor and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: accept_storm_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,160 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+
+// Every allocation is counted, the other forms of operator new all end up
+// here.
+
+static std::atomic<uint64_t> allocation_count{ 0 };
+
+void *operator new(
+   const size_t size)
+{
+   allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+   void *p = std::malloc(size ? size : 1);
+
+   if (!p)
+   {
+      throw std::bad_alloc();
+   }
+
+   return p;
+}
+
+void operator delete(
+   void *p) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(
+   void *p,
+   size_t /*size*/) noexcept
+{
+   std::free(p);
+}
+
+uint64_t allocations()
+{
+   return allocation_count.load(std::memory_order_relaxed);
+}
+
+// Runs all of the benchmarks, or just the ones named on the command line.
+// --quick runs each benchmark with a reduced number of iterations.
+
+struct benchmark_entry
+{
+   const char *pName;
+
+   void (*pFunction)(uint32_t);
+};
+
+static const benchmark_entry benchmarks[] =
+{
+   { "poll_set", poll_set_benchmark },
+   { "slot_churn", slot_churn_benchmark },
+   { "shard", shard_benchmark },
+   { "rearm", rearm_benchmark },
+   { "pool", pool_benchmark },
+   { "timer", timer_benchmark },
+   { "reactor", reactor_benchmark },
+   { "simulator", simulator_benchmark },
+   { "send_queue", send_queue_benchmark },
+   { "receive_ring", receive_ring_benchmark },
+   { "streaming", streaming_benchmark },
+   { "dispatch", dispatch_benchmark },
+   { "churn", churn_benchmark },
+   { "disconnect", disconnect_benchmark },
+   { "slow_reader", slow_reader_benchmark },
+   { "cork", cork_benchmark },
+   { "connect", connect_benchmark },
+   { "accept_storm", accept_storm_benchmark },
+   { "fan_out", fan_out_benchmark },
+   { "sharded_accept", sharded_accept_benchmark },
+   { "overload", overload_benchmark },
+   { "accept_options", accept_options_benchmark },
+};
+
+int main(int argc, char **argv)
+{
+   uint32_t scale = 1;
+
+   int selected = 0;
+
+   for (int i = 1; i < argc; ++i)
+   {
+      if (0 == strcmp(argv[i], "--quick"))
+      {
+         scale = 100;
+      }
+      else
+      {
+         ++selected;
+      }
+   }
+
+   try
+   {
+      for (const auto &benchmark : benchmarks)
+      {
+         bool run = (selected == 0);
+
+         for (int i = 1; !run && i < argc; ++i)
+         {
+            run = (0 == strcmp(argv[i], benchmark.pName));
+         }
+
+         if (run)
+         {
+            std::cout << "=== " << benchmark.pName << " ===" << std::endl;
+
+            benchmark.pFunction(scale);
+         }
+      }
+   }
+   catch (std::exception &e)
+   {
+      std::cout << "exception: " << e.what() << std::endl;
+
+      return EXIT_FAILURE;
+   }
+
+   return EXIT_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
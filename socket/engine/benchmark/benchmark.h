@@ -0,0 +1,150 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: benchmark.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Simple timing helpers for the benchmarks. These are platform neutral so that
+// the benchmarks can be run on whatever hardware is available.
+
+class stopwatch
+{
+   public :
+
+      stopwatch()
+         :  start(std::chrono::steady_clock::now())
+      {
+      }
+
+      void restart()
+      {
+         start = std::chrono::steady_clock::now();
+      }
+
+      double elapsed_seconds() const
+      {
+         return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      }
+
+   private :
+
+      std::chrono::steady_clock::time_point start;
+};
+
+inline void report(
+   const std::string &name,
+   const uint64_t operations,
+   const double seconds)
+{
+   const double ns_per_op = operations ? (seconds * 1e9) / static_cast<double>(operations) : 0.0;
+
+   const double ops_per_second = seconds > 0.0 ? static_cast<double>(operations) / seconds : 0.0;
+
+   std::cout << name << ": " << operations << " ops in " << seconds << "s - " << ns_per_op << " ns/op - " << ops_per_second << " ops/s" << std::endl;
+}
+
+// The number of times that operator new has been called by the benchmark
+// process, so that a benchmark can report the allocations made whilst it ran.
+
+uint64_t allocations();
+
+// Each benchmark is a function that is passed a scale factor so that quick runs
+// are possible, 1 is the full run.
+
+void poll_set_benchmark(
+   uint32_t scale);
+
+void slot_churn_benchmark(
+   uint32_t scale);
+
+void shard_benchmark(
+   uint32_t scale);
+
+void rearm_benchmark(
+   uint32_t scale);
+
+void pool_benchmark(
+   uint32_t scale);
+
+void timer_benchmark(
+   uint32_t scale);
+
+void reactor_benchmark(
+   uint32_t scale);
+
+void simulator_benchmark(
+   uint32_t scale);
+
+void send_queue_benchmark(
+   uint32_t scale);
+
+void receive_ring_benchmark(
+   uint32_t scale);
+
+void streaming_benchmark(
+   uint32_t scale);
+
+void dispatch_benchmark(
+   uint32_t scale);
+
+void churn_benchmark(
+   uint32_t scale);
+
+void disconnect_benchmark(
+   uint32_t scale);
+
+void slow_reader_benchmark(
+   uint32_t scale);
+
+void cork_benchmark(
+   uint32_t scale);
+
+void connect_benchmark(
+   uint32_t scale);
+
+void accept_storm_benchmark(
+   uint32_t scale);
+
+void fan_out_benchmark(
+   uint32_t scale);
+
+void sharded_accept_benchmark(
+   uint32_t scale);
+
+void overload_benchmark(
+   uint32_t scale);
+
+void accept_options_benchmark(
+   uint32_t scale);
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: benchmark.h
+///////////////////////////////////////////////////////////////////////////////
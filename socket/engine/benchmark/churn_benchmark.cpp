@@ -0,0 +1,385 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: churn_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "connection_pool.h"
+#include "epoll/epoll_reactor.h"
+#include "listening_socket/tcp_listening_socket.h"
+#include "tcp_socket.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Connection churn: clients connect, send a message, wait for it to be echoed
+// and then reset the connection, over and over, whilst the server accepts each
+// connection into a connection object, echoes, and releases the object once
+// the connection is closed. Compares connection objects that are allocated
+// with new and freed with delete with objects from a connection_pool, and
+// from a thread cache in front of the pool.
+//
+// The clients reset their connections so that churning through many thousands
+// of them doesn't leave the ports in TIME_WAIT.
+
+static constexpr size_t message_size = 64;
+
+class echo_connection : private tcp_socket_callbacks
+{
+   public :
+
+      echo_connection(
+         const reactor_socket accepted,
+         reactor &afd,
+         std::vector<echo_connection *> &retired)
+         :  retired(retired),
+            s(afd_handle(afd), accepted, *this)
+      {
+         echo();
+      }
+
+   private :
+
+      void echo()
+      {
+         int bytes = 0;
+
+         while ((bytes = s.read(buffer, sizeof buffer)) > 0)
+         {
+            s.write(buffer, bytes);
+         }
+      }
+
+      void on_connected(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_failed(
+         tcp_socket &,
+         uint32_t) override
+      {
+      }
+
+      void on_readable(
+         tcp_socket &) override
+      {
+         echo();
+      }
+
+      void on_readable_oob(
+         tcp_socket &) override
+      {
+      }
+
+      void on_writable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_client_close(
+         tcp_socket &) override
+      {
+         s.close();
+      }
+
+      void on_connection_reset(
+         tcp_socket &) override
+      {
+         s.close();
+      }
+
+      // the connection can't be released from inside its own callback, the
+      // server releases it once the reactor is done with it
+
+      void on_disconnected(
+         tcp_socket &) override
+      {
+         retired.push_back(this);
+      }
+
+      std::vector<echo_connection *> &retired;
+
+      tcp_socket s;
+
+      uint8_t buffer[256];
+};
+
+class heap_connections
+{
+   public :
+
+      template <typename... args>
+      echo_connection *acquire(
+         args &&...constructor_args)
+      {
+         return new echo_connection(std::forward<args>(constructor_args)...);
+      }
+
+      void release(
+         echo_connection *pConnection)
+      {
+         delete pConnection;
+      }
+};
+
+template <typename allocator>
+class churn_server : private tcp_listening_socket_callbacks
+{
+   public :
+
+      churn_server(
+         epoll_reactor &afd,
+         allocator &connections,
+         const sockaddr_in &address)
+         :  afd(afd),
+            connections(connections),
+            listener(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof address, *this)
+      {
+         listener.listen(128);
+      }
+
+      void release_retired()
+      {
+         for (echo_connection *pConnection : retired)
+         {
+            connections.release(pConnection);
+
+            ++closed;
+         }
+
+         retired.clear();
+      }
+
+      uint64_t closed = 0;
+
+   private :
+
+      void on_incoming_connections(
+         tcp_listening_socket &s) override
+      {
+         while (s.accept_into(connections, afd, retired))
+         {
+         }
+      }
+
+      void on_connection_reset(
+         tcp_listening_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_listening_socket &) override
+      {
+      }
+
+      epoll_reactor &afd;
+
+      allocator &connections;
+
+      std::vector<echo_connection *> retired;
+
+      tcp_listening_socket listener;
+};
+
+static sockaddr_in available_loopback_address()
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socklen_t address_length = sizeof address;
+
+   if (s == -1 ||
+       0 != ::bind(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&address), &address_length))
+   {
+      throw std::runtime_error("failed to find a port");
+   }
+
+   ::close(s);
+
+   return address;
+}
+
+static void run_clients(
+   const sockaddr_in &address,
+   const uint32_t connections,
+   std::atomic<bool> &failed)
+{
+   uint8_t message[message_size] = {};
+
+   uint8_t echoed[message_size];
+
+   for (uint32_t i = 0; i < connections && !failed; ++i)
+   {
+      const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+      if (s == -1 ||
+          0 != ::connect(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+          static_cast<ssize_t>(sizeof message) != ::send(s, message, sizeof message, MSG_NOSIGNAL))
+      {
+         failed = true;
+      }
+
+      size_t received = 0;
+
+      while (!failed && received < sizeof echoed)
+      {
+         const ssize_t bytes = ::recv(s, echoed + received, sizeof echoed - received, 0);
+
+         if (bytes <= 0)
+         {
+            failed = true;
+         }
+         else
+         {
+            received += static_cast<size_t>(bytes);
+         }
+      }
+
+      linger abortive {};
+
+      abortive.l_onoff = 1;
+
+      ::setsockopt(s, SOL_SOCKET, SO_LINGER, &abortive, sizeof abortive);
+
+      ::close(s);
+   }
+}
+
+template <typename allocator>
+static void run(
+   const std::string &name,
+   allocator &connections,
+   const uint32_t num_clients,
+   const uint32_t connections_per_client)
+{
+   const sockaddr_in address = available_loopback_address();
+
+   epoll_reactor afd;
+
+   churn_server<allocator> server(afd, connections, address);
+
+   const uint64_t total = static_cast<uint64_t>(num_clients) * connections_per_client;
+
+   std::atomic<bool> failed{ false };
+
+   const uint64_t allocations_before = allocations();
+
+   stopwatch timer;
+
+   std::vector<std::thread> clients;
+
+   for (uint32_t i = 0; i < num_clients; ++i)
+   {
+      clients.emplace_back(run_clients, std::cref(address), connections_per_client, std::ref(failed));
+   }
+
+   while (server.closed < total && !failed)
+   {
+      afd.run_once(10);
+
+      server.release_retired();
+   }
+
+   for (auto &client : clients)
+   {
+      client.join();
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   // the client threads allocate a little when they start
+
+   const uint64_t allocated = allocations() - allocations_before;
+
+   if (failed)
+   {
+      throw std::runtime_error("a client failed");
+   }
+
+   report(name, total, seconds);
+
+   std::cout << "   allocations per connection: " << (static_cast<double>(allocated) / static_cast<double>(total)) << std::endl;
+}
+
+void churn_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t num_clients = 4;
+
+   const uint32_t connections_per_client = 20000 / scale;
+
+   {
+      heap_connections connections;
+
+      run("new and delete", connections, num_clients, connections_per_client);
+   }
+
+   {
+      connection_pool<echo_connection> connections;
+
+      run("connection pool", connections, num_clients, connections_per_client);
+   }
+
+   {
+      connection_pool<echo_connection> pool;
+
+      connection_pool<echo_connection>::thread_cache connections(pool);
+
+      run("thread cache", connections, num_clients, connections_per_client);
+   }
+}
+
+#else
+
+void churn_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the churn benchmark uses the epoll reactor and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: churn_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,231 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: connect_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "epoll/epoll_reactor.h"
+#include "connection_batch.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Bulk outbound connects: a connection_batch connects a number of sockets to
+// a listener on loopback, which a thread accepts from, with different limits
+// on the connects in flight at once. Reports the connects per second, the
+// percentiles of the time that each took, and the most that were in flight.
+// The rate hardly changes with the limit, but the time that each connect
+// takes grows with it, as every connect that's in flight waits for the
+// handshakes of all of the others; with no limit a listener whose backlog
+// fills drops SYNs, and those are only retransmitted a second later.
+
+class ignore_callbacks : public tcp_socket_callbacks
+{
+   public :
+
+      void on_connected(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_failed(
+         tcp_socket &,
+         uint32_t) override
+      {
+      }
+
+      void on_readable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_readable_oob(
+         tcp_socket &) override
+      {
+      }
+
+      void on_writable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_client_close(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_reset(
+         tcp_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_socket &) override
+      {
+      }
+};
+
+static int listening_socket(
+   sockaddr_in &address)
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+
+   address = sockaddr_in{};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socklen_t address_length = sizeof address;
+
+   if (s == -1 ||
+       0 != ::bind(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::listen(s, SOMAXCONN) ||
+       0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&address), &address_length))
+   {
+      throw std::runtime_error("failed to listen");
+   }
+
+   return s;
+}
+
+static void run(
+   const uint32_t num_connections,
+   const uint32_t max_in_flight)
+{
+   sockaddr_in address;
+
+   const int listener = listening_socket(address);
+
+   std::atomic<bool> done{ false };
+
+   std::vector<int> accepted;
+
+   accepted.reserve(num_connections);
+
+   std::thread acceptor([&]()
+   {
+      pollfd listening { listener, POLLIN, 0 };
+
+      while (!done.load())
+      {
+         const int s = ::accept(listener, nullptr, nullptr);
+
+         if (s != -1)
+         {
+            accepted.push_back(s);
+         }
+         else
+         {
+            ::poll(&listening, 1, 10);
+         }
+      }
+   });
+
+   epoll_reactor afd;
+
+   ignore_callbacks callbacks;
+
+   connection_batch::latency latency {};
+
+   size_t connected = 0;
+
+   size_t peak = 0;
+
+   double seconds = 0.0;
+
+   {
+      connection_batch batch(afd, callbacks);
+
+      stopwatch timer;
+
+      batch.connect(reinterpret_cast<const sockaddr &>(address), sizeof address, num_connections, max_in_flight);
+
+      while (!batch.complete())
+      {
+         afd.run_once(100);
+      }
+
+      seconds = timer.elapsed_seconds();
+
+      latency = batch.connect_latency();
+
+      connected = batch.connected();
+
+      peak = batch.peak_in_flight();
+   }
+
+   done = true;
+
+   acceptor.join();
+
+   for (const int s : accepted)
+   {
+      ::close(s);
+   }
+
+   ::close(listener);
+
+   report(std::to_string(num_connections) + " connects, " + std::to_string(max_in_flight) + " in flight", connected, seconds);
+
+   std::cout << "   latency us - p50: " << latency.p50_us << " p90: " << latency.p90_us << " p99: " << latency.p99_us << " p99.9: " << latency.p999_us << " max: " << latency.max_us << " - peak in flight: " << peak << std::endl;
+}
+
+void connect_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t num_connections = 5000 / scale;
+
+   for (const uint32_t max_in_flight : { 16u, 64u, 512u, num_connections })
+   {
+      run(num_connections, max_in_flight);
+   }
+}
+
+#else
+
+void connect_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the connect benchmark uses the epoll reactor and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: connect_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,337 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: cork_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "epoll/epoll_reactor.h"
+#include "tcp_socket.h"
+
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Small messages: each client sends a request and the server replies to each
+// request with a number of small messages, one write() each. Uncorked, every
+// write is a send; corked, the replies that the handlers write whilst the
+// reactor dispatches go out with one send per connection when it has finished.
+// Uncorked with Nagle, the replies after the first wait for the client's
+// delayed ACK, so that's only run for a few rounds, and uncorked with
+// TCP_NODELAY shows the cost of the send calls themselves. Reports the
+// messages per second, and the send calls made per message.
+//
+// The send calls are counted by replacing send() and sendmsg() for the whole
+// process, as operator new is, the clients use write() so only the server's
+// sends are counted.
+
+static std::atomic<uint64_t> send_calls{ 0 };
+
+extern "C" ssize_t send(
+   int fd,
+   const void *pData,
+   size_t length,
+   int flags)
+{
+   send_calls.fetch_add(1, std::memory_order_relaxed);
+
+   return ::syscall(SYS_sendto, fd, pData, length, flags, nullptr, 0);
+}
+
+extern "C" ssize_t sendmsg(
+   int fd,
+   const msghdr *pMessage,
+   int flags)
+{
+   send_calls.fetch_add(1, std::memory_order_relaxed);
+
+   return ::syscall(SYS_sendmsg, fd, pMessage, flags);
+}
+
+class replying_connection : private tcp_socket_callbacks
+{
+   public :
+
+      replying_connection(
+         const reactor_socket accepted,
+         reactor &afd,
+         const bool cork,
+         const uint32_t replies,
+         const size_t reply_size)
+         :  replies(replies),
+            reply(reply_size, 'r'),
+            s(afd_handle(afd), accepted, *this, 64 * 1024)
+      {
+         s.set_cork(cork);
+
+         uint8_t buffer[16];
+
+         s.read(buffer, sizeof buffer);
+      }
+
+   private :
+
+      void on_connected(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_failed(
+         tcp_socket &,
+         uint32_t) override
+      {
+      }
+
+      void on_readable(
+         tcp_socket &) override
+      {
+         uint8_t requests[16];
+
+         const int bytes = s.read(requests, sizeof requests);
+
+         for (int request = 0; request < bytes; ++request)
+         {
+            for (uint32_t i = 0; i < replies; ++i)
+            {
+               s.write(reinterpret_cast<const uint8_t *>(reply.data()), static_cast<int>(reply.size()));
+            }
+         }
+      }
+
+      void on_readable_oob(
+         tcp_socket &) override
+      {
+      }
+
+      void on_writable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_client_close(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_reset(
+         tcp_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_socket &) override
+      {
+      }
+
+      const uint32_t replies;
+
+      const std::string reply;
+
+      tcp_socket s;
+};
+
+static int listening_socket(
+   sockaddr_in &address)
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   address = sockaddr_in{};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socklen_t address_length = sizeof address;
+
+   if (s == -1 ||
+       0 != ::bind(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::listen(s, SOMAXCONN) ||
+       0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&address), &address_length))
+   {
+      throw std::runtime_error("failed to listen");
+   }
+
+   return s;
+}
+
+enum class sending
+{
+   uncorked,
+   uncorked_no_delay,
+   corked
+};
+
+static void run(
+   const std::string &name,
+   const sending how,
+   const uint32_t num_connections,
+   const uint32_t replies,
+   const size_t reply_size,
+   const uint32_t rounds)
+{
+   sockaddr_in address;
+
+   const int listener = listening_socket(address);
+
+   epoll_reactor afd;
+
+   std::vector<int> clients;
+
+   std::vector<std::unique_ptr<replying_connection>> connections;
+
+   for (uint32_t i = 0; i < num_connections; ++i)
+   {
+      const int client = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+      if (client == -1 ||
+          0 != ::connect(client, reinterpret_cast<const sockaddr *>(&address), sizeof address))
+      {
+         throw std::runtime_error("failed to connect");
+      }
+
+      clients.push_back(client);
+
+      const int accepted = ::accept(listener, nullptr, nullptr);
+
+      if (accepted == -1)
+      {
+         throw std::runtime_error("failed to accept");
+      }
+
+      if (how == sending::uncorked_no_delay)
+      {
+         const int no_delay = 1;
+
+         ::setsockopt(accepted, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof no_delay);
+      }
+
+      connections.push_back(std::make_unique<replying_connection>(static_cast<reactor_socket>(accepted), afd, how == sending::corked, replies, reply_size));
+   }
+
+   ::close(listener);
+
+   const size_t expected = static_cast<size_t>(replies) * reply_size;
+
+   std::vector<uint8_t> buffer(expected);
+
+   const uint64_t sends_before = send_calls.load();
+
+   stopwatch timer;
+
+   for (uint32_t round = 0; round < rounds; ++round)
+   {
+      for (const int client : clients)
+      {
+         if (1 != ::write(client, "q", 1))
+         {
+            throw std::runtime_error("failed to send request");
+         }
+      }
+
+      // every client waits for all of its replies before the next round
+
+      for (const int client : clients)
+      {
+         size_t received = 0;
+
+         while (received < expected)
+         {
+            const ssize_t bytes = ::recv(client, buffer.data(), expected - received, MSG_DONTWAIT);
+
+            if (bytes > 0)
+            {
+               received += static_cast<size_t>(bytes);
+            }
+            else if (bytes == 0 || errno != EAGAIN)
+            {
+               throw std::runtime_error("failed to receive replies");
+            }
+            else
+            {
+               afd.run_once(0);
+            }
+         }
+      }
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   const uint64_t sends = send_calls.load() - sends_before;
+
+   const uint64_t messages = static_cast<uint64_t>(rounds) * num_connections * replies;
+
+   report(name, messages, seconds);
+
+   std::cout << "   send calls per message: " << static_cast<double>(sends) / static_cast<double>(messages) << std::endl;
+
+   connections.clear();
+
+   for (const int client : clients)
+   {
+      ::close(client);
+   }
+}
+
+void cork_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t rounds = 2000 / scale;
+
+   for (const uint32_t replies : { 4u, 32u })
+   {
+      const std::string messages = std::to_string(replies) + " x 64 byte replies";
+
+      run(messages + ", uncorked", sending::uncorked, 64, replies, 64, std::max(rounds / 50, 1u));
+      run(messages + ", uncorked, TCP_NODELAY", sending::uncorked_no_delay, 64, replies, 64, rounds);
+      run(messages + ", corked", sending::corked, 64, replies, 64, rounds);
+   }
+}
+
+#else
+
+void cork_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the cork benchmark uses the epoll reactor and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: cork_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,336 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: disconnect_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "epoll/epoll_reactor.h"
+#include "tcp_socket.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Mass disconnect: a server with many idle connections whose clients all reset
+// them at once. The server finds out either from the socket calls, as it
+// writes a message to every connection, or from the reactor, when each
+// connection has a read poll pending. The message goes out as a header and a
+// body; with the throwing calls the write of the header reports the reset and
+// the write of the body throws, with the try_ calls neither does.
+
+class idle_connection : private tcp_socket_callbacks
+{
+   public :
+
+      idle_connection(
+         const reactor_socket accepted,
+         reactor &afd,
+         uint64_t &resets)
+         :  resets(resets),
+            s(afd_handle(afd), accepted, *this)
+      {
+      }
+
+      tcp_socket &socket()
+      {
+         return s;
+      }
+
+   private :
+
+      void on_connected(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_failed(
+         tcp_socket &,
+         uint32_t) override
+      {
+      }
+
+      void on_readable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_readable_oob(
+         tcp_socket &) override
+      {
+      }
+
+      void on_writable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_client_close(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_reset(
+         tcp_socket &) override
+      {
+         ++resets;
+      }
+
+      void on_disconnected(
+         tcp_socket &) override
+      {
+      }
+
+      uint64_t &resets;
+
+      tcp_socket s;
+};
+
+struct storm
+{
+   epoll_reactor afd;
+
+   uint64_t resets = 0;
+
+   std::vector<std::unique_ptr<idle_connection>> connections;
+};
+
+static int listening_socket(
+   sockaddr_in &address)
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   address = sockaddr_in{};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socklen_t address_length = sizeof address;
+
+   if (s == -1 ||
+       0 != ::bind(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::listen(s, SOMAXCONN) ||
+       0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&address), &address_length))
+   {
+      throw std::runtime_error("failed to listen");
+   }
+
+   return s;
+}
+
+// Connects the clients, accepts them, and then resets every client connection.
+
+static void connect_and_reset(
+   storm &server,
+   const uint32_t num_connections,
+   const bool poll_for_reads)
+{
+   sockaddr_in address;
+
+   const int listener = listening_socket(address);
+
+   std::vector<int> clients;
+
+   clients.reserve(num_connections);
+
+   server.connections.reserve(num_connections);
+
+   for (uint32_t i = 0; i < num_connections; ++i)
+   {
+      const int client = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+      if (client == -1 ||
+          0 != ::connect(client, reinterpret_cast<const sockaddr *>(&address), sizeof address))
+      {
+         throw std::runtime_error("failed to connect");
+      }
+
+      clients.push_back(client);
+
+      const int accepted = ::accept(listener, nullptr, nullptr);
+
+      if (accepted == -1)
+      {
+         throw std::runtime_error("failed to accept");
+      }
+
+      server.connections.push_back(std::make_unique<idle_connection>(static_cast<reactor_socket>(accepted), server.afd, server.resets));
+
+      if (poll_for_reads)
+      {
+         uint8_t buffer[16];
+
+         server.connections.back()->socket().read(buffer, sizeof buffer);
+      }
+   }
+
+   ::close(listener);
+
+   for (const int client : clients)
+   {
+      linger abortive {};
+
+      abortive.l_onoff = 1;
+
+      ::setsockopt(client, SOL_SOCKET, SO_LINGER, &abortive, sizeof abortive);
+
+      ::close(client);
+   }
+
+   // let the resets arrive before the clock starts
+
+   std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+static const uint8_t header[8] = {};
+
+static const uint8_t body[56] = {};
+
+static uint64_t write_throwing(
+   storm &server)
+{
+   uint64_t caught = 0;
+
+   for (auto &connection : server.connections)
+   {
+      tcp_socket &s = connection->socket();
+
+      try
+      {
+         s.write(header, sizeof header);
+         s.write(body, sizeof body);
+      }
+      catch (const std::exception &)
+      {
+         ++caught;
+      }
+   }
+
+   return caught;
+}
+
+static uint64_t write_without_throwing(
+   storm &server)
+{
+   uint64_t failed = 0;
+
+   for (auto &connection : server.connections)
+   {
+      tcp_socket &s = connection->socket();
+
+      const socket_result<int> header_written = s.try_write(header, sizeof header);
+
+      const socket_result<int> body_written = s.try_write(body, sizeof body);
+
+      if (!header_written || !body_written)
+      {
+         ++failed;
+      }
+   }
+
+   return failed;
+}
+
+static uint64_t wait_for_polls(
+   storm &server)
+{
+   while (server.resets < server.connections.size())
+   {
+      if (!server.afd.run_once(1000))
+      {
+         break;
+      }
+   }
+
+   return server.resets;
+}
+
+static void run(
+   const std::string &name,
+   uint64_t (*pFunction)(storm &),
+   const bool poll_for_reads,
+   const uint32_t rounds,
+   const uint32_t num_connections)
+{
+   double seconds = 0.0;
+
+   for (uint32_t round = 0; round < rounds; ++round)
+   {
+      storm server;
+
+      connect_and_reset(server, num_connections, poll_for_reads);
+
+      stopwatch timer;
+
+      const uint64_t failures = pFunction(server);
+
+      seconds += timer.elapsed_seconds();
+
+      if (failures != num_connections || server.resets != num_connections)
+      {
+         throw std::runtime_error(name + ": resets went missing");
+      }
+   }
+
+   report(name, static_cast<uint64_t>(rounds) * num_connections, seconds);
+}
+
+void disconnect_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t num_connections = 500;
+
+   const uint32_t rounds = std::max(1u, 20 / scale);
+
+   run("write, catching exceptions", write_throwing, false, rounds, num_connections);
+   run("try_write", write_without_throwing, false, rounds, num_connections);
+   run("reported by the poll", wait_for_polls, true, rounds, num_connections);
+}
+
+#else
+
+void disconnect_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the disconnect benchmark uses the epoll reactor and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: disconnect_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,193 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: dispatch_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "tcp_socket.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+// Compares the cost of getting an event from the reactor to the application's
+// callback for tcp_socket, where every callback is a virtual call through
+// tcp_socket_callbacks, with a socket whose handler isn't polymorphic and has
+// its callbacks inlined. The reactor here simply calls the socket, so that
+// nothing but the dispatch is measured; the callbacks don't read or write, so
+// each event is one callback. The socket is one end of a connected pair, as an
+// accepted socket would be, since a socket that isn't connected is never told
+// that it's readable.
+
+class direct_reactor : public reactor
+{
+   public :
+
+      uint32_t allocate_slot() override
+      {
+         return 0;
+      }
+
+      void associate_socket(
+         uint32_t,
+         reactor_socket,
+         reactor_events &events) override
+      {
+         pEvents = &events;
+      }
+
+      void disassociate_socket(
+         uint32_t) override
+      {
+         pEvents = nullptr;
+      }
+
+      bool poll(
+         uint32_t,
+         const uint32_t events) override
+      {
+         interest = events;
+
+         return false;
+      }
+
+      uint32_t run(
+         const uint32_t iterations)
+      {
+         uint32_t result = 0;
+
+         for (uint32_t i = 0; i < iterations; ++i)
+         {
+            result += pEvents->handle_events((i & 1) ? reactor_event::send : reactor_event::receive, 0);
+         }
+
+         return result;
+      }
+
+      uint32_t interest = 0;
+
+   private :
+
+      reactor_events *pEvents = nullptr;
+};
+
+class virtual_handler : public tcp_socket_callbacks
+{
+   public :
+
+      void on_connected(tcp_socket &) override {}
+      void on_connection_failed(tcp_socket &, uint32_t) override {}
+      void on_readable(tcp_socket &) override { ++readable; }
+      void on_readable_oob(tcp_socket &) override {}
+      void on_writable(tcp_socket &) override { ++writable; }
+      void on_client_close(tcp_socket &) override {}
+      void on_connection_reset(tcp_socket &) override {}
+      void on_disconnected(tcp_socket &) override {}
+
+      uint64_t readable = 0;
+
+      uint64_t writable = 0;
+};
+
+// only the callbacks that it uses
+
+struct inline_handler
+{
+   void on_readable(basic_tcp_socket<inline_handler> &) { ++readable; }
+   void on_writable(basic_tcp_socket<inline_handler> &) { ++writable; }
+
+   uint64_t readable = 0;
+
+   uint64_t writable = 0;
+};
+
+template <typename handler, typename socket_type>
+static void run(
+   const std::string &name,
+   const uint32_t iterations)
+{
+   int pair[2];
+
+   if (0 != ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair))
+   {
+      throw std::runtime_error("socketpair failed");
+   }
+
+   direct_reactor afd;
+
+   handler callbacks;
+
+   uint32_t result = 0;
+
+   double seconds = 0.0;
+
+   {
+      socket_type socket(afd_handle(afd, 0), non_blocking_socket{ static_cast<reactor_socket>(pair[0]) }, callbacks);
+
+      stopwatch timer;
+
+      result = afd.run(iterations);
+
+      seconds = timer.elapsed_seconds();
+   }
+
+   ::close(pair[1]);
+
+   if (callbacks.readable + callbacks.writable != iterations || result != 0)
+   {
+      throw std::runtime_error("events went missing");
+   }
+
+   report(name, iterations, seconds);
+}
+
+void dispatch_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t iterations = 100000000 / scale;
+
+   run<virtual_handler, tcp_socket>("virtual callbacks", iterations);
+
+   run<inline_handler, basic_tcp_socket<inline_handler>>("inlined callbacks", iterations);
+}
+
+#else
+
+void dispatch_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the dispatch benchmark only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: dispatch_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,515 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: fan_out_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "epoll/epoll_reactor.h"
+#include "listening_socket/accept_fan_out.h"
+#include "listening_socket/tcp_listening_socket.h"
+#include "tcp_socket.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Listener fan out: a load generator holds a number of connections, each of
+// which sends a message, waits for the reply and sends another, for a fixed
+// time. Each message costs the server some work before it replies, so that
+// the established connections, rather than the system calls, are what keep
+// the server busy. The server either accepts and serves every connection on
+// one reactor, or an acceptor hands the connections to 1, 2, 4 or 8 worker
+// reactors, each on a thread of its own, in turn or by the fewest
+// connections. Reports the messages per second, which should grow with the
+// workers until the cores, or the load generator, run out.
+
+static constexpr size_t message_size = 64;
+
+static constexpr uint32_t work_per_message = 2000;
+
+static uint64_t work(
+   const uint8_t *pData,
+   const size_t length)
+{
+   uint64_t hash = 14695981039346656037ull;
+
+   for (uint32_t round = 0; round < work_per_message / length + 1; ++round)
+   {
+      for (size_t i = 0; i < length; ++i)
+      {
+         hash = (hash ^ pData[i]) * 1099511628211ull;
+      }
+   }
+
+   return hash;
+}
+
+class working_connection : private tcp_socket_callbacks
+{
+   public :
+
+      working_connection(
+         const reactor_socket accepted,
+         reactor &afd,
+         accept_fan_out_worker *pWorker,
+         std::vector<working_connection *> &retired)
+         :  pWorker(pWorker),
+            retired(retired),
+            s(afd_handle(afd), accepted, *this)
+      {
+         echo();
+      }
+
+      uint64_t hashed = 0;
+
+   private :
+
+      void echo()
+      {
+         // the load generator closes its connections whilst they're busy, so
+         // a write can find the reset and close the socket before the next read
+
+         socket_result<int> bytes = s.try_read(buffer, sizeof buffer);
+
+         while (bytes && *bytes > 0)
+         {
+            hashed += work(buffer, static_cast<size_t>(*bytes));
+
+            if (!s.try_write(buffer, *bytes))
+            {
+               return;
+            }
+
+            bytes = s.try_read(buffer, sizeof buffer);
+         }
+      }
+
+      void on_connected(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_failed(
+         tcp_socket &,
+         uint32_t) override
+      {
+      }
+
+      void on_readable(
+         tcp_socket &) override
+      {
+         echo();
+      }
+
+      void on_readable_oob(
+         tcp_socket &) override
+      {
+      }
+
+      void on_writable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_client_close(
+         tcp_socket &) override
+      {
+         s.close();
+      }
+
+      void on_connection_reset(
+         tcp_socket &) override
+      {
+         s.close();
+      }
+
+      void on_disconnected(
+         tcp_socket &) override
+      {
+         if (pWorker)
+         {
+            pWorker->connection_closed();
+         }
+
+         retired.push_back(this);
+      }
+
+      accept_fan_out_worker *pWorker;
+
+      std::vector<working_connection *> &retired;
+
+      tcp_socket s;
+
+      uint8_t buffer[message_size];
+};
+
+static void release(
+   std::vector<working_connection *> &retired)
+{
+   for (working_connection *pConnection : retired)
+   {
+      delete pConnection;
+   }
+
+   retired.clear();
+}
+
+// A worker reactor and the thread that runs it
+
+class fan_out_worker_thread : private accept_fan_out_callbacks
+{
+   public :
+
+      fan_out_worker_thread(
+         accept_fan_out &fan_out,
+         const std::atomic<bool> &stopping)
+         :  worker(afd, *this)
+      {
+         fan_out.add_worker(worker);
+
+         thread = std::thread([this, &stopping]()
+         {
+            while (!stopping)
+            {
+               afd.run_once(10);
+
+               release(retired);
+            }
+         });
+      }
+
+      ~fan_out_worker_thread() override
+      {
+         thread.join();
+
+         release(retired);
+      }
+
+   private :
+
+      void on_connection(
+         accept_fan_out_worker &accepted_by,
+         const reactor_socket accepted) override
+      {
+         new working_connection(accepted, afd, &accepted_by, retired);
+      }
+
+      epoll_reactor afd;
+
+      std::vector<working_connection *> retired;
+
+      accept_fan_out_worker worker;
+
+      std::thread thread;
+};
+
+// Accepts, and either serves the connections itself or hands them to the
+// fan out
+
+class fan_out_acceptor : private tcp_listening_socket_callbacks
+{
+   public :
+
+      fan_out_acceptor(
+         const sockaddr_in &address,
+         accept_fan_out *pFanOut)
+         :  pFanOut(pFanOut),
+            listener(afd_handle(afd), reinterpret_cast<const sockaddr &>(address), sizeof address, *this)
+      {
+         listener.listen(SOMAXCONN);
+      }
+
+      void run(
+         const std::atomic<bool> &stopping)
+      {
+         while (!stopping)
+         {
+            afd.run_once(10);
+
+            release(retired);
+         }
+
+         release(retired);
+      }
+
+   private :
+
+      void on_incoming_connections(
+         tcp_listening_socket &s) override
+      {
+         if (pFanOut)
+         {
+            pFanOut->accept_from(s);
+
+            return;
+         }
+
+         sockaddr_storage address {};
+
+         socket_length address_length = sizeof address;
+
+         reactor_socket accepted;
+
+         while ((accepted = s.accept(reinterpret_cast<sockaddr &>(address), address_length)) != invalid_socket)
+         {
+            new working_connection(accepted, afd, nullptr, retired);
+         }
+      }
+
+      void on_connection_reset(
+         tcp_listening_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_listening_socket &) override
+      {
+      }
+
+      accept_fan_out *pFanOut;
+
+      epoll_reactor afd;
+
+      std::vector<working_connection *> retired;
+
+      tcp_listening_socket listener;
+};
+
+static sockaddr_in available_loopback_address()
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socklen_t address_length = sizeof address;
+
+   if (s == -1 ||
+       0 != ::bind(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&address), &address_length))
+   {
+      throw std::runtime_error("failed to find a port");
+   }
+
+   ::close(s);
+
+   return address;
+}
+
+// One load generator thread, with connections of its own, returns the number
+// of replies that it received
+
+static uint64_t generate_load(
+   const sockaddr_in &address,
+   const uint32_t num_connections,
+   const double seconds)
+{
+   const int epoll_fd = ::epoll_create1(0);
+
+   std::vector<int> connections;
+
+   uint8_t message[message_size] = {};
+
+   for (uint32_t i = 0; i < num_connections; ++i)
+   {
+      const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+      const int no_delay = 1;
+
+      epoll_event event {};
+
+      event.events = EPOLLIN;
+      event.data.fd = s;
+
+      if (s == -1 ||
+          0 != ::connect(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+          0 != ::setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof no_delay) ||
+          0 != ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s, &event) ||
+          static_cast<ssize_t>(sizeof message) != ::send(s, message, sizeof message, MSG_NOSIGNAL))
+      {
+         throw std::runtime_error("failed to start a connection");
+      }
+
+      connections.push_back(s);
+   }
+
+   uint64_t replies = 0;
+
+   stopwatch timer;
+
+   while (timer.elapsed_seconds() < seconds)
+   {
+      epoll_event events[64];
+
+      const int count = ::epoll_wait(epoll_fd, events, 64, 10);
+
+      for (int i = 0; i < count; ++i)
+      {
+         // replies are small enough to arrive in one piece, more or less, the
+         // next message is sent for each whole one that's arrived
+
+         uint8_t reply[message_size * 4];
+
+         const ssize_t bytes = ::recv(events[i].data.fd, reply, sizeof reply, MSG_DONTWAIT);
+
+         if (bytes > 0)
+         {
+            const uint64_t whole = static_cast<uint64_t>(bytes) / message_size;
+
+            replies += whole;
+
+            for (uint64_t reply_count = 0; reply_count < whole; ++reply_count)
+            {
+               ::send(events[i].data.fd, message, sizeof message, MSG_NOSIGNAL);
+            }
+
+            if (bytes % message_size)
+            {
+               // the rest of the reply is on its way, ask for one less next time
+
+               ::recv(events[i].data.fd, reply, message_size - (bytes % message_size), MSG_WAITALL);
+
+               ++replies;
+
+               ::send(events[i].data.fd, message, sizeof message, MSG_NOSIGNAL);
+            }
+         }
+      }
+   }
+
+   for (const int s : connections)
+   {
+      ::close(s);
+   }
+
+   ::close(epoll_fd);
+
+   return replies;
+}
+
+static void run(
+   const std::string &name,
+   const uint32_t num_workers,
+   const accept_fan_out::placement how,
+   const double seconds)
+{
+   static constexpr uint32_t num_generators = 2;
+
+   static constexpr uint32_t connections_per_generator = 64;
+
+   const sockaddr_in address = available_loopback_address();
+
+   std::atomic<bool> stopping{ false };
+
+   accept_fan_out fan_out(how);
+
+   std::vector<std::unique_ptr<fan_out_worker_thread>> workers;
+
+   for (uint32_t i = 0; i < num_workers; ++i)
+   {
+      workers.push_back(std::make_unique<fan_out_worker_thread>(fan_out, stopping));
+   }
+
+   fan_out_acceptor server(address, num_workers ? &fan_out : nullptr);
+
+   std::thread accepting([&]()
+   {
+      server.run(stopping);
+   });
+
+   std::atomic<uint64_t> replies{ 0 };
+
+   std::vector<std::thread> generators;
+
+   for (uint32_t i = 0; i < num_generators; ++i)
+   {
+      generators.emplace_back([&]()
+      {
+         replies += generate_load(address, connections_per_generator, seconds);
+      });
+   }
+
+   for (auto &generator : generators)
+   {
+      generator.join();
+   }
+
+   stopping = true;
+
+   accepting.join();
+
+   workers.clear();
+
+   report(name, replies, seconds);
+}
+
+void fan_out_benchmark(
+   const uint32_t scale)
+{
+   const double seconds = scale > 1 ? 0.2 : 2.0;
+
+   std::cout << "cores: " << std::thread::hardware_concurrency() << std::endl;
+
+   run("one reactor", 0, accept_fan_out::placement::round_robin, seconds);
+
+   for (const uint32_t num_workers : { 1u, 2u, 4u, 8u })
+   {
+      const std::string workers = std::to_string(num_workers) + (num_workers == 1 ? " worker" : " workers");
+
+      run(workers + ", round robin", num_workers, accept_fan_out::placement::round_robin, seconds);
+      run(workers + ", least loaded", num_workers, accept_fan_out::placement::least_loaded, seconds);
+   }
+}
+
+#else
+
+void fan_out_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the fan out benchmark uses the epoll reactor and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: fan_out_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
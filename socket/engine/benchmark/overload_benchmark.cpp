@@ -0,0 +1,590 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: overload_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "epoll/epoll_reactor.h"
+#include "listening_socket/tcp_listening_socket.h"
+#include "tcp_socket.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Overload: a server that does some work for each message has a handful of
+// established clients, each sending a message and waiting for the reply, when
+// a surge of clients arrives, each of which does the same for as long as it's
+// served and reconnects if it's reset. The server either lets everyone in, or
+// limits the connections that it has open, or the rate at which it accepts
+// them, and either stops accepting at the limit, leaving the surge waiting in
+// the accept queue, or accepts and resets what's over it. Reports the
+// established clients' message rate and latency percentiles, and the
+// listener's admission counters.
+
+static constexpr size_t message_size = 64;
+
+static constexpr uint32_t work_per_message = 4000;
+
+static constexpr uint32_t num_established = 8;
+
+static constexpr uint32_t num_surge_generators = 2;
+
+static constexpr uint32_t surge_connections_per_generator = 128;
+
+static uint64_t work(
+   const uint8_t *pData,
+   const size_t length)
+{
+   uint64_t hash = 14695981039346656037ull;
+
+   for (uint32_t round = 0; round < work_per_message / length + 1; ++round)
+   {
+      for (size_t i = 0; i < length; ++i)
+      {
+         hash = (hash ^ pData[i]) * 1099511628211ull;
+      }
+   }
+
+   return hash;
+}
+
+class overload_connection : private tcp_socket_callbacks
+{
+   public :
+
+      overload_connection(
+         const reactor_socket accepted,
+         reactor &afd,
+         tcp_listening_socket &listener,
+         std::vector<overload_connection *> &retired)
+         :  listener(listener),
+            retired(retired),
+            s(afd_handle(afd), accepted, *this)
+      {
+         echo();
+      }
+
+      uint64_t hashed = 0;
+
+   private :
+
+      void echo()
+      {
+         socket_result<int> bytes = s.try_read(buffer, sizeof buffer);
+
+         while (bytes && *bytes > 0)
+         {
+            hashed += work(buffer, static_cast<size_t>(*bytes));
+
+            if (!s.try_write(buffer, *bytes))
+            {
+               return;
+            }
+
+            bytes = s.try_read(buffer, sizeof buffer);
+         }
+      }
+
+      void on_connected(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_failed(
+         tcp_socket &,
+         uint32_t) override
+      {
+      }
+
+      void on_readable(
+         tcp_socket &) override
+      {
+         echo();
+      }
+
+      void on_readable_oob(
+         tcp_socket &) override
+      {
+      }
+
+      void on_writable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_client_close(
+         tcp_socket &) override
+      {
+         s.close();
+      }
+
+      void on_connection_reset(
+         tcp_socket &) override
+      {
+         s.close();
+      }
+
+      void on_disconnected(
+         tcp_socket &) override
+      {
+         listener.connection_closed();
+
+         retired.push_back(this);
+      }
+
+      tcp_listening_socket &listener;
+
+      std::vector<overload_connection *> &retired;
+
+      tcp_socket s;
+
+      uint8_t buffer[message_size];
+};
+
+struct admission
+{
+   uint32_t max_connections;
+   uint32_t accept_rate;
+   uint32_t burst;
+   tcp_listening_socket::overload_policy policy;
+};
+
+class overload_server : private tcp_listening_socket_callbacks
+{
+   public :
+
+      overload_server(
+         const sockaddr_in &address,
+         const admission &limits)
+         :  listener(afd_handle(afd), reinterpret_cast<const sockaddr &>(address), sizeof address, *this)
+      {
+         listener.set_connection_limit(limits.max_connections);
+
+         if (limits.accept_rate != tcp_listening_socket::unlimited)
+         {
+            listener.set_accept_rate(limits.accept_rate, limits.burst);
+         }
+
+         listener.set_overload_policy(limits.policy);
+
+         listener.listen(SOMAXCONN);
+      }
+
+      ~overload_server() override
+      {
+         release();
+      }
+
+      // the listener's counters are copied once measuring stops, so that they
+      // don't include the clients going away
+
+      void run(
+         const std::atomic<bool> &measuring,
+         const std::atomic<bool> &stopping)
+      {
+         while (!stopping)
+         {
+            afd.run_once(10);
+
+            release();
+
+            if (!measuring && !measured)
+            {
+               stats = listener.stats();
+
+               measured = true;
+            }
+         }
+      }
+
+      std::atomic<uint64_t> accepted{ 0 };
+
+      std::atomic<bool> measured{ false };
+
+      tcp_listening_socket::statistics stats {};
+
+   private :
+
+      void release()
+      {
+         for (overload_connection *pConnection : retired)
+         {
+            delete pConnection;
+         }
+
+         retired.clear();
+      }
+
+      void on_incoming_connections(
+         tcp_listening_socket &s) override
+      {
+         sockaddr_storage address {};
+
+         socket_length address_length = sizeof address;
+
+         reactor_socket socket;
+
+         while ((socket = s.accept(reinterpret_cast<sockaddr &>(address), address_length)) != invalid_socket)
+         {
+            new overload_connection(socket, afd, listener, retired);
+
+            ++accepted;
+         }
+      }
+
+      void on_connection_reset(
+         tcp_listening_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_listening_socket &) override
+      {
+      }
+
+      epoll_reactor afd;
+
+      std::vector<overload_connection *> retired;
+
+      tcp_listening_socket listener;
+};
+
+static sockaddr_in available_loopback_address()
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socklen_t address_length = sizeof address;
+
+   if (s == -1 ||
+       0 != ::bind(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&address), &address_length))
+   {
+      throw std::runtime_error("failed to find a port");
+   }
+
+   ::close(s);
+
+   return address;
+}
+
+static int connect_to(
+   const sockaddr_in &address)
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   const int no_delay = 1;
+
+   if (s == -1 ||
+       0 != ::connect(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof no_delay))
+   {
+      throw std::runtime_error("failed to connect");
+   }
+
+   return s;
+}
+
+static void abort_connection(
+   const int s)
+{
+   linger abortive {};
+
+   abortive.l_onoff = 1;
+
+   ::setsockopt(s, SOL_SOCKET, SO_LINGER, &abortive, sizeof abortive);
+
+   ::close(s);
+}
+
+// The established clients take turns to send a message and wait for its
+// reply, the time that each took is returned
+
+static std::vector<uint64_t> measure_established(
+   const std::vector<int> &established,
+   const double seconds)
+{
+   std::vector<uint64_t> latency_us;
+
+   uint8_t message[message_size] = {};
+
+   stopwatch timer;
+
+   while (timer.elapsed_seconds() < seconds)
+   {
+      for (const int s : established)
+      {
+         const auto start = std::chrono::steady_clock::now();
+
+         if (static_cast<ssize_t>(sizeof message) != ::send(s, message, sizeof message, MSG_NOSIGNAL) ||
+             static_cast<ssize_t>(sizeof message) != ::recv(s, message, sizeof message, MSG_WAITALL))
+         {
+            throw std::runtime_error("an established client lost its connection");
+         }
+
+         latency_us.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+      }
+   }
+
+   return latency_us;
+}
+
+// One surge generator, keeps its connections busy, replacing any that are
+// reset, until it's stopped; returns the replies that it received
+
+static uint64_t surge(
+   const sockaddr_in &address,
+   const std::atomic<bool> &stopping)
+{
+   const int epoll_fd = ::epoll_create1(0);
+
+   uint8_t message[message_size] = {};
+
+   // a connection that's reset as soon as it's made is tried again on the
+   // next pass
+
+   const auto start_connection = [&]()
+   {
+      const int s = connect_to(address);
+
+      epoll_event event {};
+
+      event.events = EPOLLIN;
+      event.data.fd = s;
+
+      if (0 != ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s, &event) ||
+          static_cast<ssize_t>(sizeof message) != ::send(s, message, sizeof message, MSG_NOSIGNAL))
+      {
+         ::close(s);
+
+         return -1;
+      }
+
+      return s;
+   };
+
+   std::vector<int> connections(surge_connections_per_generator, -1);
+
+   uint64_t replies = 0;
+
+   while (!stopping)
+   {
+      for (int &s : connections)
+      {
+         if (s == -1)
+         {
+            s = start_connection();
+         }
+      }
+
+      epoll_event events[64];
+
+      const int count = ::epoll_wait(epoll_fd, events, 64, 10);
+
+      for (int i = 0; i < count; ++i)
+      {
+         const int s = events[i].data.fd;
+
+         uint8_t reply[message_size];
+
+         const ssize_t bytes = ::recv(s, reply, sizeof reply, MSG_WAITALL);
+
+         if (bytes == static_cast<ssize_t>(sizeof reply))
+         {
+            ++replies;
+
+            ::send(s, message, sizeof message, MSG_NOSIGNAL);
+         }
+         else if (bytes <= 0)
+         {
+            // shed, it tries again
+
+            ::close(s);
+
+            std::replace(connections.begin(), connections.end(), s, -1);
+         }
+      }
+   }
+
+   for (const int s : connections)
+   {
+      if (s != -1)
+      {
+         abort_connection(s);
+      }
+   }
+
+   ::close(epoll_fd);
+
+   return replies;
+}
+
+static void run(
+   const std::string &name,
+   const admission &limits,
+   const double seconds)
+{
+   const sockaddr_in address = available_loopback_address();
+
+   std::atomic<bool> measuring{ true };
+
+   std::atomic<bool> stopping{ false };
+
+   overload_server server(address, limits);
+
+   std::thread serving([&]()
+   {
+      server.run(measuring, stopping);
+   });
+
+   std::vector<int> established;
+
+   for (uint32_t i = 0; i < num_established; ++i)
+   {
+      established.push_back(connect_to(address));
+   }
+
+   while (server.accepted < num_established)
+   {
+      std::this_thread::yield();
+   }
+
+   std::atomic<bool> surge_stopping{ false };
+
+   std::atomic<uint64_t> surge_replies{ 0 };
+
+   std::vector<std::thread> generators;
+
+   for (uint32_t i = 0; i < num_surge_generators; ++i)
+   {
+      generators.emplace_back([&]()
+      {
+         surge_replies += surge(address, surge_stopping);
+      });
+   }
+
+   std::vector<uint64_t> latency_us = measure_established(established, seconds);
+
+   measuring = false;
+
+   while (!server.measured)
+   {
+      std::this_thread::yield();
+   }
+
+   surge_stopping = true;
+
+   for (auto &generator : generators)
+   {
+      generator.join();
+   }
+
+   for (const int s : established)
+   {
+      abort_connection(s);
+   }
+
+   stopping = true;
+
+   serving.join();
+
+   std::sort(latency_us.begin(), latency_us.end());
+
+   const auto percentile = [&](const size_t per_thousand)
+   {
+      return latency_us[std::min(latency_us.size() - 1, (latency_us.size() * per_thousand) / 1000)];
+   };
+
+   const tcp_listening_socket::statistics &stats = server.stats;
+
+   report(name, latency_us.size(), seconds);
+
+   std::cout << "   established latency us - p50: " << percentile(500) << " p99: " << percentile(990) << " max: " << latency_us.back() << std::endl;
+
+   std::cout << "   surge replies: " << surge_replies
+             << " accepted: " << stats.accepted
+             << " shed: " << stats.shed
+             << " paused: " << stats.paused
+             << " mean queue wait us: " << (stats.accepted + stats.shed ? stats.queue_wait_us / (stats.accepted + stats.shed) : 0)
+             << " max queue wait us: " << stats.max_queue_wait_us << std::endl;
+}
+
+void overload_benchmark(
+   const uint32_t scale)
+{
+   const double seconds = scale > 1 ? 0.2 : 2.0;
+
+   // room for the established clients and a few of the surge
+
+   const uint32_t max_connections = num_established + 16;
+
+   using policy = tcp_listening_socket::overload_policy;
+
+   const uint32_t unlimited = tcp_listening_socket::unlimited;
+
+   run("no admission control", { unlimited, unlimited, 0, policy::stop_accepting }, seconds);
+
+   run("connection limit, stop accepting", { max_connections, unlimited, 0, policy::stop_accepting }, seconds);
+
+   run("connection limit, accept and reset", { max_connections, unlimited, 0, policy::accept_and_reset }, seconds);
+
+   run("accept rate 100/s, stop accepting", { unlimited, 100, 16, policy::stop_accepting }, seconds);
+}
+
+#else
+
+void overload_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the overload benchmark uses the epoll reactor and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: overload_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: poll_set_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#include "afd_poll_set.h"
+
+#include "../fake_afd_poll_device.h"
+
+#include <string>
+
+// Compares the cost of building a poll submission and dispatching its results
+// when we submit every slot up to the highest ever used with submitting only
+// the slots that have some interest. The "server" has had a lot of connections
+// in the past and now only has a few active ones, spread across the slots.
+
+static void run(
+   const afd_poll_set::submission_mode mode,
+   const uint32_t num_slots,
+   const uint32_t num_active,
+   const uint32_t iterations)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(num_slots, mode);
+
+   constexpr uint32_t RECEIVE = 0x0001;
+
+   const uint32_t stride = num_slots / num_active;
+
+   for (uint32_t slot = 0; slot < num_slots; ++slot)
+   {
+      poll_set.associate(slot, 0x1000 + slot);
+   }
+
+   for (uint32_t i = 0; i < num_active; ++i)
+   {
+      poll_set.set_events(i * stride, RECEIVE);
+   }
+
+   // the highest slot is the one that stays active
+
+   poll_set.set_events(num_slots - 1, RECEIVE);
+
+   uint64_t dispatched = 0;
+
+   stopwatch timer;
+
+   for (uint32_t i = 0; i < iterations; ++i)
+   {
+      poll_set.build_submission();
+
+      device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+      // one connection has something to read each time around
+
+      const uint32_t slot = (i % num_active) * stride;
+
+      device.complete({ { 0x1000 + slot, RECEIVE, 0 } });
+
+      dispatched += poll_set.dispatch([](uint32_t, const uint32_t events, int32_t)
+      {
+         return events;
+      });
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   const std::string name = std::string(mode == afd_poll_set::submission_mode::all_slots ? "all_slots" : "active_slots") +
+      " - slots: " + std::to_string(num_slots) +
+      " active: " + std::to_string(num_active);
+
+   report(name, iterations, seconds);
+
+   std::cout << "   handles submitted per poll: " << (device.handles_submitted / iterations) << " dispatched: " << dispatched << std::endl;
+}
+
+void poll_set_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t iterations = 10000 / scale;
+
+   for (const uint32_t num_slots : { 1000u, 10000u, 100000u })
+   {
+      for (const uint32_t num_active : { 10u, 100u, 1000u })
+      {
+         run(afd_poll_set::submission_mode::all_slots, num_slots, num_active, iterations);
+         run(afd_poll_set::submission_mode::active_slots, num_slots, num_active, iterations);
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: poll_set_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
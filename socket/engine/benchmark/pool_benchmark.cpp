@@ -0,0 +1,210 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: pool_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#include "afd_shard_set.h"
+#include "completion_queue.h"
+#include "afd_worker_pool.h"
+
+#include "../queued_afd_poll_device.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Measures how completion handling scales as worker threads are added. Every
+// socket is always readable and re-arms after each event, so the shards keep
+// completing for as long as the run lasts. Each event does a fixed amount of
+// simulated work. Throughput is socket events per second, latency is the time
+// from a poll completing to a worker thread starting to dispatch it.
+
+static constexpr uint32_t RECEIVE = 0x0001;
+
+// latency in 250ns buckets up to 1ms, anything longer goes in the last bucket
+
+class latency_histogram
+{
+   public :
+
+      void record(
+         const std::chrono::steady_clock::duration latency)
+      {
+         const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+
+         const size_t bucket = std::min(static_cast<size_t>(ns / bucket_ns), buckets.size() - 1);
+
+         buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+      }
+
+      double percentile_us(
+         const double percentile) const
+      {
+         uint64_t total = 0;
+
+         for (const auto &bucket : buckets)
+         {
+            total += bucket.load();
+         }
+
+         const uint64_t target = static_cast<uint64_t>(static_cast<double>(total) * percentile);
+
+         uint64_t seen = 0;
+
+         for (size_t i = 0; i < buckets.size(); ++i)
+         {
+            seen += buckets[i].load();
+
+            if (seen > target)
+            {
+               return static_cast<double>((i + 1) * bucket_ns) / 1000.0;
+            }
+         }
+
+         return static_cast<double>(buckets.size() * bucket_ns) / 1000.0;
+      }
+
+   private :
+
+      static constexpr uint64_t bucket_ns = 250;
+
+      std::array<std::atomic<uint64_t>, 4001> buckets{};
+};
+
+static uint32_t simulate_work(
+   const uint32_t iterations)
+{
+   uint32_t value = iterations;
+
+   for (uint32_t i = 0; i < iterations; ++i)
+   {
+      value = value * 1664525u + 1013904223u;
+   }
+
+   return value;
+}
+
+static void run(
+   const uint32_t num_threads,
+   const uint32_t num_sockets,
+   const uint32_t max_shard_size,
+   const uint32_t work,
+   const std::chrono::milliseconds duration)
+{
+   completion_queue queue;
+
+   queued_shard_devices devices(queue, RECEIVE);
+
+   afd_shard_set shards(max_shard_size, std::ref(devices));
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < num_sockets; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x1000 + i);
+
+      slots.push_back(slot);
+   }
+
+   latency_histogram latency;
+
+   std::atomic<uint64_t> dispatched(0);
+
+   std::atomic<uint32_t> sink(0);
+
+   std::atomic<bool> stopping(false);
+
+   afd_worker_pool pool(queue, num_threads, [&](void *pContext)
+   {
+      const auto &completion = *static_cast<queued_afd_poll_device::completion *>(pContext);
+
+      latency.record(std::chrono::steady_clock::now() - completion.posted);
+
+      const uint32_t count = shards.dispatch(completion.shard, completion.buffer, [&](uint32_t, uint32_t, int32_t) -> uint32_t
+      {
+         sink.fetch_add(simulate_work(work), std::memory_order_relaxed);
+
+         return stopping.load(std::memory_order_relaxed) ? 0 : RECEIVE;
+      });
+
+      dispatched.fetch_add(count, std::memory_order_relaxed);
+   });
+
+   stopwatch timer;
+
+   for (const uint32_t slot : slots)
+   {
+      shards.poll(slot, RECEIVE);
+   }
+
+   std::this_thread::sleep_for(duration);
+
+   const uint64_t events = dispatched;
+
+   const double seconds = timer.elapsed_seconds();
+
+   stopping = true;
+
+   // once the handlers stop re-arming the polls drain
+
+   for (afd_poll_set::statistics stats = shards.stats(); stats.submissions != stats.completions; stats = shards.stats())
+   {
+      std::this_thread::yield();
+   }
+
+   pool.stop();
+
+   report("threads: " + std::to_string(num_threads) + " shards: " + std::to_string(shards.shards()), events, seconds);
+
+   std::cout << "   p50 latency: " << latency.percentile_us(0.50) << "us p99 latency: " << latency.percentile_us(0.99) << "us polls: " << devices.polls() << std::endl;
+}
+
+void pool_benchmark(
+   const uint32_t scale)
+{
+   const auto duration = std::chrono::milliseconds(std::max(1000u / scale, 10u));
+
+   const uint32_t max_threads = std::max(4u, std::thread::hardware_concurrency());
+
+   for (const uint32_t max_shard_size : { 1024u, 64u })
+   {
+      for (uint32_t num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+      {
+         run(num_threads, 1024, max_shard_size, 200, duration);
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: pool_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,389 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: reactor_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "afd_poll_set.h"
+#include "epoll/epoll_reactor.h"
+#include "io_uring/io_uring_reactor.h"
+
+#include "../fake_afd_poll_device.h"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Compares the cost of the re-arm that follows each report, for real sockets,
+// with the epoll reactor, which re-arms a one-shot registration with epoll_ctl,
+// the io_uring reactor, whose multishot polls don't need re-arming, and a
+// simulated AFD system, an afd_poll_set over a fake device, which rebuilds and
+// resubmits its poll for every completion.
+//
+// Each connection is a socket pair, the benchmark writes a byte to some of the
+// peers, the reactor reports them, and each one reads its byte and polls again.
+
+static constexpr uint32_t RECEIVE = reactor_event::receive;
+
+class connections
+{
+   public :
+
+      explicit connections(
+         const uint32_t count)
+      {
+         local.reserve(count);
+         remote.reserve(count);
+
+         for (uint32_t i = 0; i < count; ++i)
+         {
+            int pair[2];
+
+            if (0 != ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair))
+            {
+               close_all();
+
+               throw std::runtime_error("socketpair failed");
+            }
+
+            local.push_back(pair[0]);
+            remote.push_back(pair[1]);
+         }
+      }
+
+      connections(const connections &) = delete;
+      connections &operator=(const connections &) = delete;
+
+      ~connections()
+      {
+         close_all();
+      }
+
+      void make_ready(
+         const uint32_t connection) const
+      {
+         const char data = 1;
+
+         if (1 != ::write(remote[connection], &data, 1))
+         {
+            throw std::runtime_error("write failed");
+         }
+      }
+
+      void drain(
+         const uint32_t connection) const
+      {
+         char buffer[16];
+
+         while (::read(local[connection], buffer, sizeof buffer) > 0)
+         {
+         }
+      }
+
+      std::vector<int> local;
+      std::vector<int> remote;
+
+   private :
+
+      void close_all()
+      {
+         for (const int s : local)
+         {
+            ::close(s);
+         }
+
+         for (const int s : remote)
+         {
+            ::close(s);
+         }
+      }
+};
+
+// reads what it's told about and polls again, as a socket that reads until it
+// would block does
+
+class draining_events : public reactor_events
+{
+   public :
+
+      draining_events(
+         const connections &c,
+         const uint32_t connection,
+         uint64_t &reported)
+         :  c(c),
+            connection(connection),
+            reported(reported)
+      {
+      }
+
+      uint32_t handle_events(
+         const uint32_t events,
+         int32_t /*status*/) override
+      {
+         if (events & RECEIVE)
+         {
+            ++reported;
+
+            c.drain(connection);
+         }
+
+         return RECEIVE;
+      }
+
+   private :
+
+      const connections &c;
+
+      const uint32_t connection;
+
+      uint64_t &reported;
+};
+
+template <typename reactor_type>
+static void run_reactor(
+   const char *pName,
+   const uint32_t num_connections,
+   const uint32_t num_ready,
+   const uint32_t iterations,
+   uint64_t (*system_calls)(const reactor_type &))
+{
+   connections c(num_connections);
+
+   reactor_type reactor(num_connections);
+
+   uint64_t reported = 0;
+
+   std::vector<draining_events> events;
+
+   events.reserve(num_connections);
+
+   for (uint32_t i = 0; i < num_connections; ++i)
+   {
+      events.emplace_back(c, i, reported);
+
+      reactor.associate_socket(i, static_cast<reactor_socket>(c.local[i]), events[i]);
+
+      reactor.poll(i, RECEIVE);
+   }
+
+   // let the registrations settle before timing
+
+   reactor.run_once(0);
+
+   const uint64_t calls_before = system_calls(reactor);
+
+   stopwatch timer;
+
+   for (uint32_t i = 0; i < iterations; ++i)
+   {
+      for (uint32_t j = 0; j < num_ready; ++j)
+      {
+         c.make_ready((i * num_ready + j) % num_connections);
+      }
+
+      const uint64_t expected = reported + num_ready;
+
+      while (reported < expected)
+      {
+         reactor.run_once(-1);
+      }
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   const uint64_t calls = system_calls(reactor) - calls_before;
+
+   report(std::string(pName) +
+      " - connections: " + std::to_string(num_connections) +
+      " ready per wait: " + std::to_string(num_ready), reported, seconds);
+
+   std::cout << "   reactor system calls per report: " << (static_cast<double>(calls) / static_cast<double>(reported)) << std::endl;
+
+   for (uint32_t i = 0; i < num_connections; ++i)
+   {
+      reactor.disassociate_socket(i);
+   }
+}
+
+static void run_simulated_afd(
+   const uint32_t num_connections,
+   const uint32_t num_ready,
+   const uint32_t iterations)
+{
+   // the sockets are read and written as for the real reactors, only the
+   // readiness comes from the benchmark rather than the kernel
+
+   connections c(num_connections);
+
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(num_connections, afd_poll_set::submission_mode::active_slots);
+
+   for (uint32_t slot = 0; slot < num_connections; ++slot)
+   {
+      poll_set.associate(slot, 0x1000 + slot);
+
+      poll_set.set_events(slot, RECEIVE);
+   }
+
+   const auto submit = [&]()
+   {
+      poll_set.build_submission();
+
+      device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+   };
+
+   submit();
+
+   std::vector<afd_poll_handle_info> results(num_ready);
+
+   uint64_t reported = 0;
+
+   stopwatch timer;
+
+   for (uint32_t i = 0; i < iterations; ++i)
+   {
+      for (uint32_t j = 0; j < num_ready; ++j)
+      {
+         const uint32_t slot = (i * num_ready + j) % num_connections;
+
+         c.make_ready(slot);
+
+         results[j] = afd_poll_handle_info{ 0x1000 + slot, RECEIVE, 0 };
+      }
+
+      device.complete(results);
+
+      poll_set.dispatch([&](const uint32_t slot, const uint32_t, const int32_t) -> uint32_t
+      {
+         ++reported;
+
+         c.drain(slot);
+
+         // the poll is one-shot, so the socket has to poll again
+
+         return 0;
+      });
+
+      for (uint32_t j = 0; j < num_ready; ++j)
+      {
+         poll_set.set_events((i * num_ready + j) % num_connections, RECEIVE);
+      }
+
+      submit();
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   report("simulated afd - connections: " + std::to_string(num_connections) +
+      " ready per wait: " + std::to_string(num_ready), reported, seconds);
+
+   std::cout << "   handles submitted per report: " << (static_cast<double>(poll_set.stats().handles_submitted) / static_cast<double>(reported)) << std::endl;
+}
+
+static uint32_t raise_connection_limit(
+   const uint32_t wanted)
+{
+   // two descriptors per connection, and some to spare
+
+   rlimit limit {};
+
+   ::getrlimit(RLIMIT_NOFILE, &limit);
+
+   const rlim_t needed = static_cast<rlim_t>(wanted) * 2 + 64;
+
+   if (limit.rlim_cur < needed)
+   {
+      // raising the hard limit needs privileges that we may not have
+
+      rlimit raised { needed, std::max(needed, limit.rlim_max) };
+
+      if (0 != ::setrlimit(RLIMIT_NOFILE, &raised))
+      {
+         limit.rlim_cur = std::min(needed, limit.rlim_max);
+
+         ::setrlimit(RLIMIT_NOFILE, &limit);
+      }
+
+      ::getrlimit(RLIMIT_NOFILE, &limit);
+   }
+
+   return limit.rlim_cur >= needed ? wanted : static_cast<uint32_t>((limit.rlim_cur - 64) / 2);
+}
+
+void reactor_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t iterations = 20000 / scale;
+
+   for (const uint32_t wanted : { 100u, 1000u, 10000u })
+   {
+      const uint32_t num_connections = raise_connection_limit(wanted);
+
+      if (num_connections != wanted)
+      {
+         std::cout << "descriptor limit allows " << num_connections << " of " << wanted << " connections" << std::endl;
+      }
+
+      for (const uint32_t num_ready : { 1u, 50u })
+      {
+         run_reactor<epoll_reactor>("epoll", num_connections, num_ready, iterations, [](const epoll_reactor &r)
+         {
+            return r.stats().waits + r.stats().ctl_calls;
+         });
+
+         run_reactor<io_uring_reactor>("io_uring", num_connections, num_ready, iterations, [](const io_uring_reactor &r)
+         {
+            return r.stats().enters;
+         });
+
+         run_simulated_afd(num_connections, num_ready, iterations);
+      }
+   }
+}
+
+#else
+
+void reactor_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the epoll and io_uring reactors are only available on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: reactor_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
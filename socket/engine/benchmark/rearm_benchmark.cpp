@@ -0,0 +1,174 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: rearm_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#include "afd_poll_set.h"
+
+#include "../fake_afd_poll_device.h"
+
+#include <string>
+#include <vector>
+
+// Compares re-arming the poll each time a socket changes its interest during a
+// dispatch pass, which is what happens if every read or write that would block
+// issues a poll, with staging the changes and issuing one poll at the end of
+// the pass.
+
+static void run(
+   const bool coalesce,
+   const uint32_t num_sockets,
+   const uint32_t num_ready,
+   const uint32_t iterations)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(num_sockets, afd_poll_set::submission_mode::active_slots);
+
+   constexpr uint32_t RECEIVE = 0x0001;
+   constexpr uint32_t SEND = 0x0004;
+
+   for (uint32_t slot = 0; slot < num_sockets; ++slot)
+   {
+      poll_set.associate(slot, 0x1000 + slot);
+
+      poll_set.set_events(slot, RECEIVE);
+   }
+
+   const auto submit = [&]()
+   {
+      poll_set.build_submission();
+
+      device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+   };
+
+   submit();
+
+   std::vector<afd_poll_handle_info> results(num_ready);
+
+   std::vector<uint32_t> ready;
+
+   ready.reserve(num_ready);
+
+   stopwatch timer;
+
+   for (uint32_t i = 0; i < iterations; ++i)
+   {
+      for (uint32_t j = 0; j < num_ready; ++j)
+      {
+         const uint32_t slot = (i * num_ready + j) % num_sockets;
+
+         results[j] = afd_poll_handle_info{ 0x1000 + slot, RECEIVE, 0 };
+      }
+
+      device.complete(results);
+
+      // each socket reads, would block, and adds send interest as it has data
+      // queued, so every dispatched socket changes its interest...
+
+      if (coalesce)
+      {
+         poll_set.dispatch([&](const uint32_t slot, uint32_t, int32_t)
+         {
+            return poll_set.get_events(slot) ^ SEND;
+         });
+
+         if (poll_set.needs_submission())
+         {
+            submit();
+         }
+      }
+      else
+      {
+         // submitting from within dispatch would overwrite the results that
+         // are being dispatched, so the slots are collected and then each
+         // change is submitted as it is made, with the pending poll cancelled
+         // and completed first, as was needed before the output buffers were
+         // doubled up
+
+         ready.clear();
+
+         poll_set.dispatch([&](const uint32_t slot, uint32_t, int32_t)
+         {
+            ready.push_back(slot);
+
+            return poll_set.get_events(slot);
+         });
+
+         for (const uint32_t slot : ready)
+         {
+            poll_set.set_events(slot, poll_set.get_events(slot) ^ SEND);
+
+            if (device.pending())
+            {
+               device.complete({});
+
+               poll_set.dispatch([](uint32_t, uint32_t, int32_t) -> uint32_t
+               {
+                  return 0;
+               });
+            }
+
+            submit();
+         }
+      }
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   const afd_poll_set::statistics &stats = poll_set.stats();
+
+   report(std::string(coalesce ? "coalesced" : "per change") +
+      " - sockets: " + std::to_string(num_sockets) +
+      " ready per completion: " + std::to_string(num_ready), iterations, seconds);
+
+   // completions of cancelled polls don't count, we want the IOCTLs issued for
+   // each poll that reported events
+
+   std::cout << "   IOCTLs per completion: " << (static_cast<double>(stats.submissions) / static_cast<double>(iterations)) <<
+      " handles submitted per completion: " << (stats.handles_submitted / iterations) << std::endl;
+}
+
+void rearm_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t iterations = 10000 / scale;
+
+   for (const uint32_t num_sockets : { 100u, 1000u, 10000u })
+   {
+      for (const uint32_t num_ready : { 1u, 10u, 50u })
+      {
+         run(false, num_sockets, num_ready, iterations);
+         run(true, num_sockets, num_ready, iterations);
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: rearm_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
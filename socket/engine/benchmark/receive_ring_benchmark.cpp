@@ -0,0 +1,365 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: receive_ring_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "receive_ring.h"
+#include "socket_api.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Compares parsing a stream of length prefixed messages that's read into an
+// array, which has to be compacted with a memmove once the complete messages
+// have been dealt with, as echo_server_connection does, with parsing it in
+// place from a receive ring. A message that spans the end of a plain ring is
+// copied out so that it can be parsed, a mirrored ring never needs to.
+//
+// The stream is written to one end of a socket pair in whatever amounts the
+// socket takes and each consumer reads until the read would block.
+
+static constexpr size_t buffer_size = 64 * 1024;
+
+static constexpr size_t header_size = sizeof(uint32_t);
+
+struct parse_result
+{
+   uint64_t messages = 0;
+
+   uint64_t checksum = 0;
+
+   uint64_t copied = 0;
+};
+
+// Parses the complete messages at the start of the data, returns the number
+// of bytes that they took up.
+
+static size_t parse(
+   const uint8_t *pData,
+   const size_t length,
+   parse_result &result)
+{
+   size_t used = 0;
+
+   while (length - used >= header_size)
+   {
+      uint32_t message_length = 0;
+
+      memcpy(&message_length, pData + used, header_size);
+
+      if (length - used < header_size + message_length)
+      {
+         break;
+      }
+
+      const uint8_t *pMessage = pData + used + header_size;
+
+      result.checksum += pMessage[0] + pMessage[message_length - 1];
+
+      ++result.messages;
+
+      used += header_size + message_length;
+   }
+
+   return used;
+}
+
+static std::vector<uint8_t> make_stream(
+   const size_t target_size)
+{
+   std::mt19937 rng(1234);
+
+   std::uniform_int_distribution<uint32_t> sizes(16, 4096);
+
+   std::vector<uint8_t> stream;
+
+   stream.reserve(target_size + 4096 + header_size);
+
+   while (stream.size() < target_size)
+   {
+      const uint32_t length = sizes(rng);
+
+      const uint8_t *pLength = reinterpret_cast<const uint8_t *>(&length);
+
+      stream.insert(stream.end(), pLength, pLength + header_size);
+
+      stream.insert(stream.end(), length, static_cast<uint8_t>(length));
+   }
+
+   return stream;
+}
+
+class array_reader
+{
+   public :
+
+      int read(
+         const int s)
+      {
+         const ssize_t bytes = ::recv(s, buffer + used, sizeof buffer - used, 0);
+
+         if (bytes <= 0)
+         {
+            return 0;
+         }
+
+         used += static_cast<size_t>(bytes);
+
+         const size_t parsed = parse(buffer, used, result);
+
+         // move the partial message to the front
+
+         used -= parsed;
+
+         memmove(buffer, buffer + parsed, used);
+
+         result.copied += used;
+
+         return static_cast<int>(bytes);
+      }
+
+      parse_result result;
+
+   private :
+
+      uint8_t buffer[buffer_size];
+
+      size_t used = 0;
+};
+
+class ring_reader
+{
+   public :
+
+      explicit ring_reader(
+         const receive_ring::mapping how)
+         :  ring(buffer_size, how)
+      {
+      }
+
+      int read(
+         const int s)
+      {
+         std::span<uint8_t> spans[2];
+
+         socket_buffer buffers[2];
+
+         const uint32_t count = ring.writable_spans(spans);
+
+         for (uint32_t i = 0; i < count; ++i)
+         {
+            buffers[i] = make_socket_buffer(spans[i].data(), spans[i].size());
+         }
+
+         const int bytes = socket_recv_buffers(static_cast<reactor_socket>(s), buffers, count);
+
+         if (bytes <= 0)
+         {
+            return 0;
+         }
+
+         ring.commit(static_cast<size_t>(bytes));
+
+         for (;;)
+         {
+            const std::span<const uint8_t> readable = ring.readable_span();
+
+            const size_t parsed = parse(readable.data(), readable.size(), result);
+
+            ring.consume(parsed);
+
+            if (ring.mirrored() || ring.size() == ring.readable_span().size())
+            {
+               break;
+            }
+
+            // the next message spans the end of the ring, it's copied out and
+            // parsed from the copy, if it has all arrived
+
+            uint32_t message_length = 0;
+
+            if (!copy_out(header_size, reinterpret_cast<uint8_t *>(&message_length)) ||
+                !copy_out(header_size + message_length, scratch))
+            {
+               break;
+            }
+
+            parse(scratch, header_size + message_length, result);
+
+            ring.consume(header_size + message_length);
+         }
+
+         return bytes;
+      }
+
+      bool mirrored() const
+      {
+         return ring.mirrored();
+      }
+
+      parse_result result;
+
+   private :
+
+      bool copy_out(
+         const size_t length,
+         uint8_t *pTo)
+      {
+         if (ring.size() < length)
+         {
+            return false;
+         }
+
+         const std::span<const uint8_t> first = ring.readable_span();
+
+         const size_t from_first = std::min(first.size(), length);
+
+         memcpy(pTo, first.data(), from_first);
+
+         // the rest is at the start of the buffer, which is where the first
+         // span ends up if we briefly consume up to the wrap
+
+         if (from_first < length)
+         {
+            const uint8_t *pStart = first.data() + first.size() - ring.capacity();
+
+            memcpy(pTo + from_first, pStart, length - from_first);
+         }
+
+         result.copied += length;
+
+         return true;
+      }
+
+      receive_ring ring;
+
+      uint8_t scratch[header_size + 4096];
+};
+
+template <typename reader>
+static void run(
+   const std::string &name,
+   reader &consumer,
+   const std::vector<uint8_t> &stream)
+{
+   int pair[2];
+
+   if (0 != ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair))
+   {
+      throw std::runtime_error("socketpair failed");
+   }
+
+   const uint64_t allocations_before = allocations();
+
+   size_t written = 0;
+
+   size_t received = 0;
+
+   stopwatch timer;
+
+   while (received < stream.size())
+   {
+      if (written < stream.size())
+      {
+         const ssize_t bytes = ::write(pair[1], stream.data() + written, stream.size() - written);
+
+         if (bytes > 0)
+         {
+            written += static_cast<size_t>(bytes);
+         }
+      }
+
+      int bytes = 0;
+
+      while ((bytes = consumer.read(pair[0])) > 0)
+      {
+         received += static_cast<size_t>(bytes);
+      }
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   const uint64_t allocated = allocations() - allocations_before;
+
+   ::close(pair[0]);
+   ::close(pair[1]);
+
+   report(name, consumer.result.messages, seconds);
+
+   std::cout << "   MB/s: " << (static_cast<double>(stream.size()) / seconds / (1024.0 * 1024.0)) <<
+      " bytes copied per byte received: " << (static_cast<double>(consumer.result.copied) / static_cast<double>(stream.size())) <<
+      " allocations: " << allocated <<
+      " checksum: " << consumer.result.checksum << std::endl;
+}
+
+void receive_ring_benchmark(
+   const uint32_t scale)
+{
+   const std::vector<uint8_t> stream = make_stream((512 * 1024 * 1024) / scale);
+
+   {
+      array_reader consumer;
+
+      run("read into array", consumer, stream);
+   }
+
+   {
+      ring_reader consumer(receive_ring::mapping::plain);
+
+      run("plain ring", consumer, stream);
+   }
+
+   {
+      ring_reader consumer(receive_ring::mapping::mirrored);
+
+      run(consumer.mirrored() ? "mirrored ring" : "mirrored ring (not available, plain)", consumer, stream);
+   }
+}
+
+#else
+
+void receive_ring_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the receive ring benchmark uses socketpair() and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: receive_ring_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
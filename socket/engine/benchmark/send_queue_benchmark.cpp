@@ -0,0 +1,307 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: send_queue_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "send_queue.h"
+#include "socket_api.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Compares the two ways of dealing with a write that the socket won't take all
+// of. The first is what the applications have had to do, keep the rest in a
+// buffer of their own, send from the front of it when the socket is writable
+// and move what's left to the front; the second is the socket's send queue,
+// which appends to a chain of blocks and flushes them with one gathering send.
+//
+// The writer writes a batch of messages each round, as long as it has less
+// than a limit waiting to be sent, and the socket takes what fits in its send
+// buffer. The reader is slower than the writer, it reads no more than one
+// buffer's worth each round, so data builds up waiting to be sent. Each round
+// the writer flushes what it has waiting, as it would when told that it's
+// writable.
+
+static constexpr size_t pending_limit = 1024 * 1024;
+
+class application_buffer
+{
+   public :
+
+      explicit application_buffer(
+         const reactor_socket s)
+         :  s(s)
+      {
+      }
+
+      void write(
+         const uint8_t *pData,
+         const size_t length)
+      {
+         size_t sent = 0;
+
+         if (pending.empty())
+         {
+            sent = send(pData, length);
+         }
+
+         pending.insert(pending.end(), pData + sent, pData + length);
+
+         copied += length - sent;
+      }
+
+      void flush()
+      {
+         if (!pending.empty())
+         {
+            const size_t sent = send(pending.data(), pending.size());
+
+            // echo_server_connection::write_data's memmove
+
+            pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(sent));
+
+            copied += pending.size();
+         }
+      }
+
+      size_t size() const
+      {
+         return pending.size();
+      }
+
+      uint64_t sends = 0;
+
+      uint64_t copied = 0;
+
+   private :
+
+      size_t send(
+         const uint8_t *pData,
+         const size_t length)
+      {
+         ++sends;
+
+         const int bytes = socket_send(s, pData, static_cast<int>(length));
+
+         return bytes == socket_error ? 0 : static_cast<size_t>(bytes);
+      }
+
+      const reactor_socket s;
+
+      std::vector<uint8_t> pending;
+};
+
+class queued_sends
+{
+   public :
+
+      explicit queued_sends(
+         const reactor_socket s)
+         :  s(s),
+            queue(pending_limit)
+      {
+      }
+
+      void write(
+         const uint8_t *pData,
+         const size_t length)
+      {
+         size_t sent = 0;
+
+         if (queue.empty())
+         {
+            ++sends;
+
+            const int bytes = socket_send(s, pData, static_cast<int>(length));
+
+            sent = bytes == socket_error ? 0 : static_cast<size_t>(bytes);
+         }
+
+         queue.append(pData + sent, length - sent);
+
+         copied += length - sent;
+      }
+
+      void flush()
+      {
+         // as tcp_socket::flush()
+
+         while (!queue.empty())
+         {
+            socket_buffer buffers[64];
+
+            uint32_t count = 0;
+
+            const size_t gathered = queue.gather(64, [&](const uint8_t *pData, const size_t length)
+            {
+               buffers[count++] = make_socket_buffer(pData, length);
+            });
+
+            ++sends;
+
+            const int bytes = socket_send_buffers(s, buffers, count);
+
+            if (bytes == socket_error)
+            {
+               break;
+            }
+
+            queue.consume(static_cast<size_t>(bytes));
+
+            if (static_cast<size_t>(bytes) != gathered)
+            {
+               break;
+            }
+         }
+      }
+
+      size_t size() const
+      {
+         return queue.size();
+      }
+
+      uint64_t sends = 0;
+
+      uint64_t copied = 0;
+
+   private :
+
+      const reactor_socket s;
+
+      send_queue queue;
+};
+
+template <typename writer>
+static void run(
+   const std::string &name,
+   const size_t message_size,
+   const uint32_t messages_per_round,
+   const uint32_t rounds)
+{
+   int pair[2];
+
+   if (0 != ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair))
+   {
+      throw std::runtime_error("socketpair failed");
+   }
+
+   const int buffer_size = 64 * 1024;
+
+   ::setsockopt(pair[0], SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof buffer_size);
+
+   writer w(static_cast<reactor_socket>(pair[0]));
+
+   const std::vector<uint8_t> message(message_size, 0x42);
+
+   std::vector<uint8_t> scratch(buffer_size);
+
+   uint64_t written = 0;
+
+   uint64_t received = 0;
+
+   const auto read_some = [&]()
+   {
+      const ssize_t bytes = ::read(pair[1], scratch.data(), scratch.size());
+
+      if (bytes > 0)
+      {
+         received += static_cast<uint64_t>(bytes);
+      }
+   };
+
+   stopwatch timer;
+
+   for (uint32_t round = 0; round < rounds; ++round)
+   {
+      for (uint32_t i = 0; i < messages_per_round && w.size() + message_size <= pending_limit; ++i)
+      {
+         w.write(message.data(), message.size());
+
+         written += message.size();
+      }
+
+      read_some();
+
+      w.flush();
+   }
+
+   while (received < written)
+   {
+      read_some();
+
+      w.flush();
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   ::close(pair[0]);
+   ::close(pair[1]);
+
+   report(name + " - message size: " + std::to_string(message_size) +
+      " messages per round: " + std::to_string(messages_per_round), written / message_size, seconds);
+
+   std::cout << "   MB/s: " << (static_cast<double>(written) / seconds / (1024.0 * 1024.0)) <<
+      " sends per message: " << (static_cast<double>(w.sends) / static_cast<double>(written / message_size)) <<
+      " bytes copied per byte written: " << (static_cast<double>(w.copied) / static_cast<double>(written)) << std::endl;
+}
+
+void send_queue_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t rounds = 20000 / scale;
+
+   for (const size_t message_size : { 64u, 1024u, 16384u })
+   {
+      for (const uint32_t messages_per_round : { 16u, 256u })
+      {
+         run<application_buffer>("application buffer", message_size, messages_per_round, rounds);
+         run<queued_sends>("send queue", message_size, messages_per_round, rounds);
+      }
+   }
+}
+
+#else
+
+void send_queue_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the send queue benchmark uses socketpair() and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: send_queue_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
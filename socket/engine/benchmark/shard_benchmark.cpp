@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: shard_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#include "afd_shard_set.h"
+
+#include "../fake_afd_poll_device.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Measures the cost of re-arming the poll for a single socket when all of the
+// sockets are active, with everything in one shard and with the sockets spread
+// across shards of various sizes. With one shard every re-arm resubmits every
+// socket, with shards it only resubmits the sockets in the same shard.
+
+static void run(
+   const uint32_t num_sockets,
+   const uint32_t max_shard_size,
+   const uint32_t iterations)
+{
+   std::vector<std::unique_ptr<fake_afd_poll_device>> devices;
+
+   afd_shard_set shards(max_shard_size, [&devices](uint32_t)
+   {
+      devices.push_back(std::make_unique<fake_afd_poll_device>());
+
+      return afd_shard_binding{ *devices.back(), { nullptr } };
+   });
+
+   constexpr uint32_t RECEIVE = 0x0001;
+
+   std::vector<uint32_t> slots;
+
+   slots.reserve(num_sockets);
+
+   for (uint32_t i = 0; i < num_sockets; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x1000 + i);
+
+      shards.set_events(slot, RECEIVE);
+
+      slots.push_back(slot);
+   }
+
+   uint64_t dispatched = 0;
+
+   stopwatch timer;
+
+   for (uint32_t i = 0; i < iterations; ++i)
+   {
+      // one connection has something to read each time around and then
+      // re-arms its poll
+
+      const uint32_t index = (i * 7919) % num_sockets;
+
+      const uint32_t slot = slots[index];
+
+      shards.poll(slot, RECEIVE);
+
+      const uint32_t shard = shards.shard_of(slot);
+
+      devices[shard]->complete({ { 0x1000 + index, RECEIVE, 0 } });
+
+      dispatched += shards.dispatch(shard, [](uint32_t, const uint32_t events, int32_t)
+      {
+         return events;
+      });
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   uint64_t handles_submitted = 0;
+
+   for (const auto &device : devices)
+   {
+      handles_submitted += device->handles_submitted;
+   }
+
+   report("sockets: " + std::to_string(num_sockets) + " max shard size: " + std::to_string(max_shard_size), iterations, seconds);
+
+   std::cout << "   shards: " << shards.shards() << " handles submitted per poll: " << (handles_submitted / iterations) << " dispatched: " << dispatched << std::endl;
+}
+
+void shard_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t iterations = 10000 / scale;
+
+   for (const uint32_t num_sockets : { 10000u, 100000u })
+   {
+      for (const uint32_t max_shard_size : { num_sockets, 4096u, 1024u, 256u })
+      {
+         run(num_sockets, max_shard_size, iterations);
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: shard_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
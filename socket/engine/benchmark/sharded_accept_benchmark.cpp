@@ -0,0 +1,509 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: sharded_accept_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "epoll/epoll_reactor.h"
+#include "listening_socket/accept_fan_out.h"
+#include "listening_socket/tcp_listening_socket.h"
+#include "listening_socket/tcp_listening_socket_group.h"
+#include "tcp_socket.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Sharded listeners: load generator threads each connect, send a message, wait
+// for the echo and reset the connection, as fast as they can, so that the
+// server does little but accept. The server has one listener, on a reactor
+// that serves every connection itself or that hands them to 1, 2, 4 or 8
+// worker reactors, or it has 1, 2, 4 or 8 listeners in a group, each on a
+// reactor thread of its own that serves the connections that it accepts.
+// Reports the connections per second; a single acceptor stops growing when its
+// core is busy, the group should grow with its listeners until the cores, or
+// the load generators, run out.
+
+static constexpr size_t message_size = 64;
+
+static constexpr uint32_t num_generators = 4;
+
+class sharded_connection : private tcp_socket_callbacks
+{
+   public :
+
+      sharded_connection(
+         const reactor_socket accepted,
+         reactor &afd,
+         accept_fan_out_worker *pWorker,
+         std::vector<sharded_connection *> &retired)
+         :  pWorker(pWorker),
+            retired(retired),
+            s(afd_handle(afd), accepted, *this)
+      {
+         echo();
+      }
+
+   private :
+
+      void echo()
+      {
+         socket_result<int> bytes = s.try_read(buffer, sizeof buffer);
+
+         while (bytes && *bytes > 0)
+         {
+            if (!s.try_write(buffer, *bytes))
+            {
+               return;
+            }
+
+            bytes = s.try_read(buffer, sizeof buffer);
+         }
+      }
+
+      void on_connected(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_failed(
+         tcp_socket &,
+         uint32_t) override
+      {
+      }
+
+      void on_readable(
+         tcp_socket &) override
+      {
+         echo();
+      }
+
+      void on_readable_oob(
+         tcp_socket &) override
+      {
+      }
+
+      void on_writable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_client_close(
+         tcp_socket &) override
+      {
+         s.close();
+      }
+
+      void on_connection_reset(
+         tcp_socket &) override
+      {
+         s.close();
+      }
+
+      void on_disconnected(
+         tcp_socket &) override
+      {
+         if (pWorker)
+         {
+            pWorker->connection_closed();
+         }
+
+         retired.push_back(this);
+      }
+
+      accept_fan_out_worker *pWorker;
+
+      std::vector<sharded_connection *> &retired;
+
+      tcp_socket s;
+
+      uint8_t buffer[message_size];
+};
+
+static void release(
+   std::vector<sharded_connection *> &retired)
+{
+   for (sharded_connection *pConnection : retired)
+   {
+      delete pConnection;
+   }
+
+   retired.clear();
+}
+
+// A reactor, and the thread that runs it, that's handed connections by the
+// single listener
+
+class sharded_worker : private accept_fan_out_callbacks
+{
+   public :
+
+      sharded_worker(
+         accept_fan_out &fan_out,
+         const std::atomic<bool> &stopping)
+         :  worker(afd, *this)
+      {
+         fan_out.add_worker(worker);
+
+         thread = std::thread([this, &stopping]()
+         {
+            while (!stopping)
+            {
+               afd.run_once(10);
+
+               release(retired);
+            }
+         });
+      }
+
+      ~sharded_worker() override
+      {
+         thread.join();
+
+         release(retired);
+      }
+
+   private :
+
+      void on_connection(
+         accept_fan_out_worker &accepted_by,
+         const reactor_socket accepted) override
+      {
+         new sharded_connection(accepted, afd, &accepted_by, retired);
+      }
+
+      epoll_reactor afd;
+
+      std::vector<sharded_connection *> retired;
+
+      accept_fan_out_worker worker;
+
+      std::thread thread;
+};
+
+// A listener, and the thread that runs its reactor, either on its own or one
+// of a group; it serves the connections that it accepts, or hands them to a
+// fan out
+
+class sharded_server : private tcp_listening_socket_callbacks
+{
+   public :
+
+      sharded_server(
+         const sockaddr_in &address,
+         accept_fan_out *pFanOut,
+         const std::atomic<bool> &stopping)
+         :  pFanOut(pFanOut),
+            listener(afd_handle(afd), reinterpret_cast<const sockaddr &>(address), sizeof address, *this)
+      {
+         start(stopping);
+      }
+
+      sharded_server(
+         tcp_listening_socket_group &group,
+         const std::atomic<bool> &stopping)
+         :  pFanOut(nullptr),
+            listener(afd_handle(afd), *this)
+      {
+         group.join(listener);
+
+         start(stopping);
+      }
+
+      ~sharded_server() override
+      {
+         thread.join();
+
+         release(retired);
+      }
+
+   private :
+
+      void start(
+         const std::atomic<bool> &stopping)
+      {
+         listener.listen(SOMAXCONN);
+
+         thread = std::thread([this, &stopping]()
+         {
+            while (!stopping)
+            {
+               afd.run_once(10);
+
+               release(retired);
+            }
+         });
+      }
+
+      void on_incoming_connections(
+         tcp_listening_socket &s) override
+      {
+         if (pFanOut)
+         {
+            pFanOut->accept_from(s);
+
+            return;
+         }
+
+         sockaddr_storage address {};
+
+         socket_length address_length = sizeof address;
+
+         reactor_socket accepted;
+
+         while ((accepted = s.accept(reinterpret_cast<sockaddr &>(address), address_length)) != invalid_socket)
+         {
+            new sharded_connection(accepted, afd, nullptr, retired);
+         }
+      }
+
+      void on_connection_reset(
+         tcp_listening_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_listening_socket &) override
+      {
+      }
+
+      accept_fan_out *pFanOut;
+
+      epoll_reactor afd;
+
+      std::vector<sharded_connection *> retired;
+
+      tcp_listening_socket listener;
+
+      std::thread thread;
+};
+
+static sockaddr_in available_loopback_address()
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socklen_t address_length = sizeof address;
+
+   if (s == -1 ||
+       0 != ::bind(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&address), &address_length))
+   {
+      throw std::runtime_error("failed to find a port");
+   }
+
+   ::close(s);
+
+   return address;
+}
+
+// One load generator thread, returns the number of connections that it made
+// and had a reply on; they're reset, rather than closed, so that their ports
+// aren't left in TIME_WAIT
+
+static uint64_t generate_connections(
+   const sockaddr_in &address,
+   const double seconds)
+{
+   uint8_t message[message_size] = {};
+
+   uint64_t connections = 0;
+
+   stopwatch timer;
+
+   while (timer.elapsed_seconds() < seconds)
+   {
+      const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+      linger abortive {};
+
+      abortive.l_onoff = 1;
+
+      if (s == -1 ||
+          0 != ::connect(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+          0 != ::setsockopt(s, SOL_SOCKET, SO_LINGER, &abortive, sizeof abortive) ||
+          static_cast<ssize_t>(sizeof message) != ::send(s, message, sizeof message, MSG_NOSIGNAL))
+      {
+         throw std::runtime_error("failed to connect");
+      }
+
+      if (static_cast<ssize_t>(sizeof message) == ::recv(s, message, sizeof message, MSG_WAITALL))
+      {
+         ++connections;
+      }
+
+      ::close(s);
+   }
+
+   return connections;
+}
+
+static uint64_t generate_load(
+   const sockaddr_in &address,
+   const double seconds)
+{
+   std::atomic<uint64_t> connections{ 0 };
+
+   std::vector<std::thread> generators;
+
+   for (uint32_t i = 0; i < num_generators; ++i)
+   {
+      generators.emplace_back([&]()
+      {
+         connections += generate_connections(address, seconds);
+      });
+   }
+
+   for (auto &generator : generators)
+   {
+      generator.join();
+   }
+
+   return connections;
+}
+
+static void run_single_listener(
+   const std::string &name,
+   const uint32_t num_workers,
+   const double seconds)
+{
+   const sockaddr_in address = available_loopback_address();
+
+   std::atomic<bool> stopping{ false };
+
+   accept_fan_out fan_out(accept_fan_out::placement::least_loaded);
+
+   std::vector<std::unique_ptr<sharded_worker>> workers;
+
+   for (uint32_t i = 0; i < num_workers; ++i)
+   {
+      workers.push_back(std::make_unique<sharded_worker>(fan_out, stopping));
+   }
+
+   uint64_t connections = 0;
+
+   {
+      sharded_server server(address, num_workers ? &fan_out : nullptr, stopping);
+
+      connections = generate_load(address, seconds);
+
+      stopping = true;
+   }
+
+   workers.clear();
+
+   report(name, connections, seconds);
+}
+
+static void run_group(
+   const std::string &name,
+   const uint32_t num_listeners,
+   const double seconds)
+{
+   const sockaddr_in any_port = [&]()
+   {
+      sockaddr_in address {};
+
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+      return address;
+   }();
+
+   tcp_listening_socket_group group(reinterpret_cast<const sockaddr &>(any_port), sizeof any_port);
+
+   std::atomic<bool> stopping{ false };
+
+   std::vector<std::unique_ptr<sharded_server>> listeners;
+
+   for (uint32_t i = 0; i < num_listeners; ++i)
+   {
+      listeners.push_back(std::make_unique<sharded_server>(group, stopping));
+   }
+
+   const socket_address address = group.address();
+
+   const uint64_t connections = generate_load(reinterpret_cast<const sockaddr_in &>(address.storage), seconds);
+
+   stopping = true;
+
+   listeners.clear();
+
+   report(name, connections, seconds);
+}
+
+void sharded_accept_benchmark(
+   const uint32_t scale)
+{
+   const double seconds = scale > 1 ? 0.2 : 2.0;
+
+   std::cout << "cores: " << std::thread::hardware_concurrency() << std::endl;
+
+   run_single_listener("one listener", 0, seconds);
+
+   for (const uint32_t num_threads : { 1u, 2u, 4u, 8u })
+   {
+      const std::string threads = std::to_string(num_threads);
+
+      run_single_listener("one listener, " + threads + (num_threads == 1 ? " worker" : " workers"), num_threads, seconds);
+   }
+
+   for (const uint32_t num_threads : { 1u, 2u, 4u, 8u })
+   {
+      const std::string threads = std::to_string(num_threads);
+
+      run_group(threads + (num_threads == 1 ? " listener" : " listeners") + " in a group", num_threads, seconds);
+   }
+}
+
+#else
+
+void sharded_accept_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the sharded accept benchmark needs SO_REUSEPORT and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: sharded_accept_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,166 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: simulator_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#include "afd_shard_set.h"
+#include "afd_simulator.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+// Drives an afd_shard_set through the AFD simulator, so the whole path of a
+// socket becoming ready, the poll completing, the completion being retrieved,
+// dispatched and the shard re-armed is measured without a Windows kernel. The
+// sockets become ready in virtual time, each round a little later than the
+// last, so the completion port has to move time on to find them.
+
+static void run(
+   const uint32_t num_sockets,
+   const uint32_t num_ready,
+   const uint32_t max_shard_size,
+   const uint32_t iterations)
+{
+   constexpr uint32_t RECEIVE = 0x0001;
+
+   afd_simulator simulator;
+
+   struct shard_buffer
+   {
+      uint32_t shard;
+
+      uint32_t buffer;
+   };
+
+   std::deque<shard_buffer> contexts;
+
+   afd_shard_set shards(max_shard_size, [&](const uint32_t shard)
+   {
+      contexts.push_back(shard_buffer{ shard, 0 });
+
+      return afd_shard_binding{ simulator.create_device(), { &contexts.back() } };
+   });
+
+   std::vector<uintptr_t> handles(num_sockets);
+
+   for (uint32_t i = 0; i < num_sockets; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      handles[slot] = simulator.create_socket();
+
+      shards.associate(slot, handles[slot]);
+
+      shards.poll(slot, RECEIVE);
+   }
+
+   uint64_t reported = 0;
+
+   const auto handler = [&](const uint32_t slot, const uint32_t events, int32_t) -> uint32_t
+   {
+      ++reported;
+
+      // read until it would block and poll again
+
+      simulator.clear_events(handles[slot], events);
+
+      return RECEIVE;
+   };
+
+   // setting up issues a poll for each socket, only those made whilst the
+   // sockets are being serviced count
+
+   const afd_simulator::statistics before = simulator.stats();
+
+   stopwatch timer;
+
+   for (uint32_t i = 0; i < iterations; ++i)
+   {
+      const uint64_t at = simulator.now() + 10;
+
+      for (uint32_t j = 0; j < num_ready; ++j)
+      {
+         const uint32_t slot = ((i * num_ready + j) * 7919) % num_sockets;
+
+         simulator.schedule(at, handles[slot], RECEIVE, 0);
+      }
+
+      afd_simulator::completion result{};
+
+      while (simulator.get(result, 0) || (simulator.now() < at && simulator.get(result, afd_simulator::infinite)))
+      {
+         const shard_buffer &context = *static_cast<shard_buffer *>(result.pContext);
+
+         shards.dispatch(context.shard, context.buffer, handler);
+      }
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   const afd_simulator::statistics &stats = simulator.stats();
+
+   const double events = static_cast<double>(reported ? reported : 1);
+
+   report("sockets: " + std::to_string(num_sockets) +
+      " ready per round: " + std::to_string(num_ready) +
+      " shard size: " + std::to_string(max_shard_size), reported, seconds);
+
+   std::cout << "   polls per event: " << (static_cast<double>(stats.polls - before.polls) / events) <<
+      " completions per event: " << (static_cast<double>(stats.completions - before.completions) / events) <<
+      " virtual time: " << (simulator.now() / 10) << "us" << std::endl;
+}
+
+void simulator_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t iterations = 20000 / scale;
+
+   for (const uint32_t num_sockets : { 1000u, 10000u, 100000u })
+   {
+      for (const uint32_t num_ready : { 1u, 50u, 500u })
+      {
+         for (const uint32_t max_shard_size : { 256u, num_sockets })
+         {
+            if (max_shard_size == num_sockets && num_sockets == 100000u && num_ready < 500u)
+            {
+               // one poll of 100,000 handles per event takes too long to be
+               // worth waiting for, the 500 case shows the trend
+
+               continue;
+            }
+
+            run(num_sockets, num_ready, max_shard_size, iterations);
+         }
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: simulator_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,145 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: slot_churn_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#include "afd_poll_set.h"
+
+#include "../fake_afd_poll_device.h"
+
+#include <random>
+#include <vector>
+
+// Connections arriving and leaving. The poll set hands out the slots, grows as
+// the number of connections rises and compacts as they drain away. A poll is
+// kept in flight throughout, as it would be in a server, so growth has to
+// happen without disturbing it.
+
+void slot_churn_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t num_sockets = 100000 / scale;
+
+   const uint32_t churn_operations = 1000000 / scale;
+
+   constexpr uint32_t RECEIVE = 0x0001;
+
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(16, afd_poll_set::submission_mode::active_slots);
+
+   std::vector<uint32_t> connected;
+
+   connected.reserve(num_sockets);
+
+   uintptr_t next_handle = 0x1000;
+
+   auto connect = [&]()
+   {
+      const uint32_t slot = poll_set.allocate_slot();
+
+      poll_set.associate(slot, next_handle++);
+
+      poll_set.set_events(slot, RECEIVE);
+
+      connected.push_back(slot);
+   };
+
+   // the first connection starts a poll that stays pending whilst we grow
+
+   connect();
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   stopwatch timer;
+
+   while (connected.size() < num_sockets)
+   {
+      connect();
+   }
+
+   report("associate - sockets: " + std::to_string(num_sockets), num_sockets, timer.elapsed_seconds());
+
+   std::cout << "   capacity: " << poll_set.capacity() << std::endl;
+
+   std::mt19937 random(42);
+
+   timer.restart();
+
+   for (uint32_t i = 0; i < churn_operations; ++i)
+   {
+      // a random connection closes and a new one arrives
+
+      const size_t index = random() % connected.size();
+
+      poll_set.disassociate(connected[index]);
+
+      connected[index] = connected.back();
+
+      connected.pop_back();
+
+      connect();
+   }
+
+   report("churn - sockets: " + std::to_string(num_sockets), churn_operations, timer.elapsed_seconds());
+
+   std::cout << "   capacity: " << poll_set.capacity() << " in use: " << poll_set.slots_in_use() << std::endl;
+
+   timer.restart();
+
+   poll_set.build_submission();
+
+   report("submission - sockets: " + std::to_string(num_sockets), 1, timer.elapsed_seconds());
+
+   device.complete({});
+
+   poll_set.dispatch([](uint32_t, const uint32_t events, int32_t) { return events; });
+
+   // everyone leaves, the most recent connections first
+
+   timer.restart();
+
+   while (!connected.empty())
+   {
+      poll_set.disassociate(connected.back());
+
+      connected.pop_back();
+   }
+
+   report("disassociate - sockets: " + std::to_string(num_sockets), num_sockets, timer.elapsed_seconds());
+
+   poll_set.build_submission();
+
+   std::cout << "   capacity: " << poll_set.capacity() << " buffer capacity: " << poll_set.buffer_capacity() << std::endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: slot_churn_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,356 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: slow_reader_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "epoll/epoll_reactor.h"
+#include "tcp_socket.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A slow reader behind a proxy: a client sends as fast as it can to a proxy
+// that forwards everything to a second client, which reads slowly. Without
+// flow control the proxy reads as fast as the sender sends and queues what
+// the reader hasn't taken, so its memory grows with the difference; with
+// send watermarks the proxy stops reading from the sender whilst the queue to
+// the reader is high, and TCP holds the sender back. Reports the peak
+// resident set of the process whilst the data was forwarded, above what it
+// was before, and the most that the proxy queued.
+
+static size_t resident_bytes()
+{
+   std::ifstream statm("/proc/self/statm");
+
+   size_t pages = 0;
+
+   size_t resident = 0;
+
+   statm >> pages >> resident;
+
+   return resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+class proxy : private tcp_socket_callbacks
+{
+   public :
+
+      proxy(
+         epoll_reactor &afd,
+         const reactor_socket upstream_socket,
+         const reactor_socket downstream_socket,
+         const size_t send_queue_limit)
+         :  upstream(afd_handle(afd), upstream_socket, *this),
+            downstream(afd_handle(afd), downstream_socket, *this, send_queue_limit)
+      {
+      }
+
+      void start(
+         const bool flow_control,
+         const size_t high,
+         const size_t low)
+      {
+         if (flow_control)
+         {
+            // it's the other socket that we stop reading, so the downstream
+            // socket's reads, of which there are none, aren't paused
+
+            downstream.set_send_watermarks({ high, low, false });
+         }
+
+         on_readable(upstream);
+      }
+
+      size_t peak_queued = 0;
+
+      uint64_t paused = 0;
+
+   private :
+
+      void on_connected(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_failed(
+         tcp_socket &,
+         uint32_t) override
+      {
+      }
+
+      // the socket calls us again whilst we read something, until we stop
+      // reading, which leaves the upstream socket without a poll until we
+      // start again
+
+      void on_readable(
+         tcp_socket &s) override
+      {
+         if (&s != &upstream || downstream_high)
+         {
+            return;
+         }
+
+         const int bytes = upstream.read(buffer, sizeof buffer);
+
+         if (bytes > 0)
+         {
+            downstream.write(buffer, bytes);
+
+            peak_queued = std::max(peak_queued, downstream.queued_bytes());
+         }
+      }
+
+      void on_readable_oob(
+         tcp_socket &) override
+      {
+      }
+
+      void on_writable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_client_close(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_reset(
+         tcp_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_socket &) override
+      {
+      }
+
+      void on_send_queue_high(
+         tcp_socket &) override
+      {
+         downstream_high = true;
+
+         ++paused;
+      }
+
+      void on_send_queue_drained(
+         tcp_socket &) override
+      {
+         downstream_high = false;
+
+         // there's probably data waiting for us, we read until it runs out,
+         // and the read polls, or until the queue is high again
+
+         int bytes = 1;
+
+         while (bytes > 0 && !downstream_high)
+         {
+            bytes = upstream.read(buffer, sizeof buffer);
+
+            if (bytes > 0)
+            {
+               downstream.write(buffer, bytes);
+            }
+         }
+      }
+
+      bool downstream_high = false;
+
+      tcp_socket upstream;
+
+      tcp_socket downstream;
+
+      uint8_t buffer[64 * 1024];
+};
+
+static int connected_socket(
+   const sockaddr_in &address)
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   if (s == -1 ||
+       0 != ::connect(s, reinterpret_cast<const sockaddr *>(&address), sizeof address))
+   {
+      throw std::runtime_error("failed to connect");
+   }
+
+   return s;
+}
+
+static void run(
+   const std::string &name,
+   const bool flow_control,
+   const size_t total)
+{
+   const int listener = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socklen_t address_length = sizeof address;
+
+   if (listener == -1 ||
+       0 != ::bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::listen(listener, 2) ||
+       0 != ::getsockname(listener, reinterpret_cast<sockaddr *>(&address), &address_length))
+   {
+      throw std::runtime_error("failed to listen");
+   }
+
+   const int sender = connected_socket(address);
+
+   const int upstream = ::accept(listener, nullptr, nullptr);
+
+   const int reader = connected_socket(address);
+
+   const int downstream = ::accept(listener, nullptr, nullptr);
+
+   ::close(listener);
+
+   const size_t baseline = resident_bytes();
+
+   epoll_reactor afd;
+
+   // the queue can take the whole transfer, so without flow control nothing
+   // is ever refused, and the high watermark is far below it
+
+   proxy server(afd, static_cast<reactor_socket>(upstream), static_cast<reactor_socket>(downstream), total);
+
+   server.start(flow_control, 1024 * 1024, 256 * 1024);
+
+   std::atomic<size_t> received{ 0 };
+
+   std::thread sending([&]()
+   {
+      std::vector<uint8_t> data(64 * 1024, 7);
+
+      size_t sent = 0;
+
+      while (sent < total)
+      {
+         const ssize_t bytes = ::send(sender, data.data(), std::min(data.size(), total - sent), MSG_NOSIGNAL);
+
+         if (bytes <= 0)
+         {
+            break;
+         }
+
+         sent += static_cast<size_t>(bytes);
+      }
+   });
+
+   // about 64MB/s
+
+   std::thread reading([&]()
+   {
+      std::vector<uint8_t> data(64 * 1024);
+
+      while (received < total)
+      {
+         const ssize_t bytes = ::recv(reader, data.data(), data.size(), 0);
+
+         if (bytes <= 0)
+         {
+            break;
+         }
+
+         received += static_cast<size_t>(bytes);
+
+         std::this_thread::sleep_for(std::chrono::microseconds(1000));
+      }
+   });
+
+   stopwatch timer;
+
+   size_t peak_resident = baseline;
+
+   while (received < total && timer.elapsed_seconds() < 60.0)
+   {
+      afd.run_once(10);
+
+      peak_resident = std::max(peak_resident, resident_bytes());
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   ::shutdown(sender, SHUT_RDWR);
+   ::shutdown(reader, SHUT_RDWR);
+
+   sending.join();
+   reading.join();
+
+   ::close(sender);
+   ::close(reader);
+
+   if (received < total)
+   {
+      throw std::runtime_error(name + ": the reader didn't get everything");
+   }
+
+   report(name, total / (64 * 1024), seconds);
+
+   std::cout << "   peak resident growth: " << (peak_resident - baseline) / 1024 << "KB peak queued: " << server.peak_queued / 1024 << "KB times paused: " << server.paused << std::endl;
+}
+
+void slow_reader_benchmark(
+   const uint32_t scale)
+{
+   const size_t total = (256 * 1024 * 1024) / scale;
+
+   run("send watermarks", true, total);
+   run("no flow control", false, total);
+}
+
+#else
+
+void slow_reader_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the slow reader benchmark uses the epoll reactor and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: slow_reader_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
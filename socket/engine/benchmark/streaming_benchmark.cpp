@@ -0,0 +1,328 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: streaming_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#ifdef __linux__
+
+#include "epoll/epoll_reactor.h"
+#include "tcp_socket.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Streams data to several connections at once, over loopback, and compares
+// how many reactor round trips it takes to read it, and how long any one
+// connection gets to read for before the others get a turn, for different
+// read budgets. Each on_readable() reads one buffer, as a callback that
+// leaves the looping to the socket does; a budget of one callback is a poll
+// per read.
+
+static constexpr size_t read_size = 16 * 1024;
+
+// Who read last, and for how long, across all of the connections.
+
+struct run_tracker
+{
+   const void *pLast = nullptr;
+
+   uint64_t run = 0;
+
+   uint64_t longest = 0;
+
+   void read(
+      const void *pReader,
+      const uint64_t bytes)
+   {
+      if (pReader != pLast)
+      {
+         pLast = pReader;
+
+         run = 0;
+      }
+
+      run += bytes;
+
+      longest = std::max(longest, run);
+   }
+};
+
+class stream_reader : public tcp_socket_callbacks
+{
+   public :
+
+      explicit stream_reader(
+         run_tracker &tracker)
+         :  tracker(tracker)
+      {
+      }
+
+      void on_connected(
+         tcp_socket &s) override
+      {
+         // nothing's been sent yet, this polls for the data
+
+         s.read(buffer, sizeof buffer);
+      }
+
+      void on_connection_failed(
+         tcp_socket &,
+         uint32_t) override
+      {
+         throw std::runtime_error("connection failed");
+      }
+
+      void on_readable(
+         tcp_socket &s) override
+      {
+         const int bytes = s.read(buffer, sizeof buffer);
+
+         received += static_cast<uint64_t>(bytes);
+
+         tracker.read(this, static_cast<uint64_t>(bytes));
+      }
+
+      void on_readable_oob(
+         tcp_socket &) override
+      {
+      }
+
+      void on_writable(
+         tcp_socket &) override
+      {
+      }
+
+      void on_client_close(
+         tcp_socket &) override
+      {
+      }
+
+      void on_connection_reset(
+         tcp_socket &) override
+      {
+         throw std::runtime_error("connection reset");
+      }
+
+      void on_disconnected(
+         tcp_socket &) override
+      {
+      }
+
+      uint64_t received = 0;
+
+   private :
+
+      run_tracker &tracker;
+
+      uint8_t buffer[read_size];
+};
+
+static int listen_on_loopback(
+   uint16_t &port)
+{
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socklen_t address_length = sizeof address;
+
+   if (s == -1 ||
+       0 != ::bind(s, reinterpret_cast<const sockaddr *>(&address), sizeof address) ||
+       0 != ::listen(s, 64) ||
+       0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&address), &address_length))
+   {
+      throw std::runtime_error("failed to create listening socket");
+   }
+
+   port = ntohs(address.sin_port);
+
+   return s;
+}
+
+static void run(
+   const std::string &name,
+   const tcp_socket::read_budget &budget,
+   const uint32_t num_connections,
+   const uint64_t bytes_per_connection)
+{
+   uint16_t port = 0;
+
+   const int listener = listen_on_loopback(port);
+
+   epoll_reactor afd(num_connections);
+
+   run_tracker tracker;
+
+   std::vector<std::unique_ptr<stream_reader>> readers;
+
+   std::vector<std::unique_ptr<tcp_socket>> sockets;
+
+   std::vector<int> peers;
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   address.sin_port = htons(port);
+
+   for (uint32_t i = 0; i < num_connections; ++i)
+   {
+      readers.push_back(std::make_unique<stream_reader>(tracker));
+
+      sockets.push_back(std::make_unique<tcp_socket>(afd_handle(afd, i), *readers.back()));
+
+      sockets.back()->set_read_budget(budget);
+
+      sockets.back()->connect(reinterpret_cast<const sockaddr &>(address), sizeof address);
+
+      const int peer = ::accept(listener, nullptr, nullptr);
+
+      if (peer == -1)
+      {
+         throw std::runtime_error("failed to accept");
+      }
+
+      ::fcntl(peer, F_SETFL, ::fcntl(peer, F_GETFL) | O_NONBLOCK);
+
+      peers.push_back(peer);
+   }
+
+   while (afd.run_once(0))
+   {
+   }
+
+   const std::vector<uint8_t> data(64 * 1024, 0x42);
+
+   std::vector<uint64_t> sent(num_connections, 0);
+
+   const uint64_t total = bytes_per_connection * num_connections;
+
+   uint64_t received = 0;
+
+   const epoll_reactor::statistics before = afd.stats();
+
+   uint64_t dispatches = 0;
+
+   stopwatch timer;
+
+   while (received < total)
+   {
+      // keep every connection's socket buffers full, so that each one always
+      // has more to read than its budget allows
+
+      for (uint32_t i = 0; i < num_connections; ++i)
+      {
+         while (sent[i] < bytes_per_connection)
+         {
+            const size_t length = static_cast<size_t>(std::min<uint64_t>(data.size(), bytes_per_connection - sent[i]));
+
+            const ssize_t bytes = ::send(peers[i], data.data(), length, MSG_NOSIGNAL);
+
+            if (bytes <= 0)
+            {
+               break;
+            }
+
+            sent[i] += static_cast<uint64_t>(bytes);
+         }
+      }
+
+      dispatches += afd.run_once(10);
+
+      received = 0;
+
+      for (const auto &reader : readers)
+      {
+         received += reader->received;
+      }
+   }
+
+   const double seconds = timer.elapsed_seconds();
+
+   const epoll_reactor::statistics &after = afd.stats();
+
+   const double megabytes = static_cast<double>(total) / (1024.0 * 1024.0);
+
+   report(name, dispatches, seconds);
+
+   std::cout << "   MB/s: " << (megabytes / seconds) <<
+      " dispatches per MB: " << (static_cast<double>(dispatches) / megabytes) <<
+      " epoll_ctl per MB: " << (static_cast<double>(after.ctl_calls - before.ctl_calls) / megabytes) <<
+      " epoll_wait calls: " << (after.waits - before.waits) <<
+      " longest run for one connection: " << (tracker.longest / 1024) << "KB" << std::endl;
+
+   sockets.clear();
+
+   for (const int peer : peers)
+   {
+      ::close(peer);
+   }
+
+   ::close(listener);
+}
+
+void streaming_benchmark(
+   const uint32_t scale)
+{
+   const uint32_t num_connections = 8;
+
+   const uint64_t bytes_per_connection = (256ull * 1024 * 1024) / scale;
+
+   run("one read per poll", { 1, std::numeric_limits<size_t>::max() }, num_connections, bytes_per_connection);
+
+   run("default budget", tcp_socket::default_read_budget, num_connections, bytes_per_connection);
+
+   run("until would block", { std::numeric_limits<uint32_t>::max(), std::numeric_limits<size_t>::max() }, num_connections, bytes_per_connection);
+}
+
+#else
+
+void streaming_benchmark(
+   const uint32_t /*scale*/)
+{
+   std::cout << "the streaming benchmark uses the epoll reactor and only runs on Linux" << std::endl;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: streaming_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
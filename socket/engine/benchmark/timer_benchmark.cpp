@@ -0,0 +1,187 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: timer_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#include "timer_wheel.h"
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// Measures the timer wheel with the kind of timers that connections use; idle
+// timeouts that are reset whenever there's activity and mostly never expire,
+// and connect deadlines that mostly do. An ordered map, as a simple timer
+// queue would use, is measured for comparison.
+
+static constexpr uint64_t max_timeout = 60000;
+
+static void run_wheel(
+   const uint32_t num_timers,
+   const uint32_t resets)
+{
+   std::mt19937 random(1);
+
+   timer_wheel wheel(0, num_timers);
+
+   std::vector<timer_wheel::timer_id> ids(num_timers);
+
+   stopwatch timer;
+
+   for (uint32_t i = 0; i < num_timers; ++i)
+   {
+      ids[i] = wheel.arm(1 + (random() % max_timeout), i);
+   }
+
+   report("wheel arm " + std::to_string(num_timers), num_timers, timer.elapsed_seconds());
+
+   // activity on a connection cancels its idle timer and arms a new one
+
+   uint64_t now = 0;
+
+   timer.restart();
+
+   for (uint32_t i = 0; i < resets; ++i)
+   {
+      const uint32_t index = random() % num_timers;
+
+      wheel.cancel(ids[index]);
+
+      ids[index] = wheel.arm(now + 1 + (random() % max_timeout), index);
+
+      if (i % 1000 == 0)
+      {
+         // time passes
+
+         wheel.advance(++now, [](timer_wheel::timer_id, uintptr_t) {});
+      }
+   }
+
+   report("wheel reset", resets, timer.elapsed_seconds());
+
+   size_t expired = 0;
+
+   uint32_t wakeups = 0;
+
+   timer.restart();
+
+   // as an I/O thread would, wake when the next timer is due
+
+   while (wheel.size())
+   {
+      now = wheel.next_expiry();
+
+      expired += wheel.advance(now, [](timer_wheel::timer_id, uintptr_t) {});
+
+      ++wakeups;
+   }
+
+   report("wheel expire", expired, timer.elapsed_seconds());
+
+   std::cout << "   wakeups: " << wakeups << " timers per wakeup: " << (wakeups ? expired / wakeups : 0) << std::endl;
+}
+
+static void run_map(
+   const uint32_t num_timers,
+   const uint32_t resets)
+{
+   std::mt19937 random(1);
+
+   std::multimap<uint64_t, uintptr_t> timers;
+
+   std::vector<std::multimap<uint64_t, uintptr_t>::iterator> ids(num_timers);
+
+   stopwatch timer;
+
+   for (uint32_t i = 0; i < num_timers; ++i)
+   {
+      ids[i] = timers.emplace(1 + (random() % max_timeout), i);
+   }
+
+   report("map arm " + std::to_string(num_timers), num_timers, timer.elapsed_seconds());
+
+   uint64_t now = 0;
+
+   timer.restart();
+
+   for (uint32_t i = 0; i < resets; ++i)
+   {
+      const uint32_t index = random() % num_timers;
+
+      if (ids[index] != timers.end())
+      {
+         timers.erase(ids[index]);
+      }
+
+      ids[index] = timers.emplace(now + 1 + (random() % max_timeout), index);
+
+      if (i % 1000 == 0)
+      {
+         ++now;
+
+         while (!timers.empty() && timers.begin()->first <= now)
+         {
+            ids[timers.begin()->second] = timers.end();
+
+            timers.erase(timers.begin());
+         }
+      }
+   }
+
+   report("map reset", resets, timer.elapsed_seconds());
+
+   const size_t expired = timers.size();
+
+   timer.restart();
+
+   while (!timers.empty())
+   {
+      timers.erase(timers.begin());
+   }
+
+   report("map expire", expired, timer.elapsed_seconds());
+}
+
+void timer_benchmark(
+   const uint32_t scale)
+{
+   for (const uint32_t num_timers : { 10000u, 1000000u })
+   {
+      const uint32_t timers = num_timers / scale;
+
+      const uint32_t resets = 2000000 / scale;
+
+      run_wheel(timers, resets);
+      run_map(timers, resets);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: timer_benchmark.cpp
+///////////////////////////////////////////////////////////////////////////////
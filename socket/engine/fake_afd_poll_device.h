@@ -0,0 +1,221 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: fake_afd_poll_device.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_poll_device.h"
+#include "afd_poll_set.h"
+
+#include <stdexcept>
+#include <vector>
+
+// An afd_poll_device that doesn't talk to the kernel. It captures each submission
+// and holds on to the output buffer so that a test can complete the poll with
+// whatever results it likes, in the same way that \Device\Afd only reports the
+// handles that have events. A poll can be pending on each buffer, completions
+// without a buffer complete the oldest pending poll.
+
+class fake_afd_poll_device : public afd_poll_device
+{
+   public :
+
+      fake_afd_poll_device()
+         :  polls(0),
+            handles_submitted(0),
+            cancels(0)
+      {
+      }
+
+      bool poll(
+         const uint32_t buffer,
+         afd_poll_info &in,
+         const uint32_t in_size,
+         afd_poll_info &out,
+         const uint32_t out_size,
+         void *pContext) override
+      {
+         if (in_size < afd_poll_info_size(in.number_of_handles))
+         {
+            throw std::runtime_error("fake_afd_poll_device - input too small");
+         }
+
+         for (const auto &poll : pending_polls)
+         {
+            if (poll.buffer == buffer)
+            {
+               throw std::runtime_error("fake_afd_poll_device - poll already pending on buffer");
+            }
+         }
+
+         ++polls;
+
+         handles_submitted += in.number_of_handles;
+
+         submitted.assign(in.handles, in.handles + in.number_of_handles);
+
+         pending_polls.push_back(pending_poll{ buffer, &out, out_size, pContext, false });
+
+         return false;
+      }
+
+      void cancel(
+         const uint32_t buffer) override
+      {
+         ++cancels;
+
+         for (auto &poll : pending_polls)
+         {
+            if (poll.buffer == buffer)
+            {
+               poll.cancelled = true;
+            }
+         }
+      }
+
+      bool pending() const
+      {
+         return !pending_polls.empty();
+      }
+
+      size_t pending_count() const
+      {
+         return pending_polls.size();
+      }
+
+      bool cancelled(
+         const uint32_t buffer) const
+      {
+         for (const auto &poll : pending_polls)
+         {
+            if (poll.buffer == buffer)
+            {
+               return poll.cancelled;
+            }
+         }
+
+         return false;
+      }
+
+      // Complete the oldest pending poll, results are written to the output
+      // buffer in the order given. Returns the completion context.
+
+      void *complete(
+         const std::vector<afd_poll_handle_info> &results)
+      {
+         if (pending_polls.empty())
+         {
+            throw std::runtime_error("fake_afd_poll_device - no poll pending");
+         }
+
+         return complete(pending_polls.front().buffer, results);
+      }
+
+      void *complete(
+         const uint32_t buffer,
+         const std::vector<afd_poll_handle_info> &results)
+      {
+         auto it = pending_polls.begin();
+
+         while (it != pending_polls.end() && it->buffer != buffer)
+         {
+            ++it;
+         }
+
+         if (it == pending_polls.end())
+         {
+            throw std::runtime_error("fake_afd_poll_device - no poll pending on buffer");
+         }
+
+         if (afd_poll_info_size(static_cast<uint32_t>(results.size())) > it->out_size)
+         {
+            throw std::runtime_error("fake_afd_poll_device - output too small");
+         }
+
+         uint32_t i = 0;
+
+         for (const auto &result : results)
+         {
+            it->pOut->handles[i++] = result;
+         }
+
+         it->pOut->number_of_handles = i;
+
+         void *pContext = it->pContext;
+
+         pending_polls.erase(it);
+
+         return pContext;
+      }
+
+      // Complete the oldest pending poll reporting the given events for every
+      // handle that was last submitted with an interest in them.
+
+      void *complete_all(
+         const uint32_t events)
+      {
+         std::vector<afd_poll_handle_info> results;
+
+         for (const auto &handle : submitted)
+         {
+            if (handle.events & events)
+            {
+               results.push_back(afd_poll_handle_info{ handle.handle, handle.events & events, 0 });
+            }
+         }
+
+         return complete(results);
+      }
+
+      size_t polls;
+
+      size_t handles_submitted;
+
+      size_t cancels;
+
+      std::vector<afd_poll_handle_info> submitted;
+
+   private :
+
+      struct pending_poll
+      {
+         uint32_t buffer;
+
+         afd_poll_info *pOut;
+
+         uint32_t out_size;
+
+         void *pContext;
+
+         bool cancelled;
+      };
+
+      std::vector<pending_poll> pending_polls;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: fake_afd_poll_device.h
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,189 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: queued_afd_poll_device.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_poll_device.h"
+#include "afd_poll_set.h"
+#include "afd_shard_set.h"
+#include "afd_completion_port.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// An afd_poll_device that completes every poll straight away, as if each of the
+// submitted handles were always ready for the events given when it was
+// constructed, and posts the completion to a completion port. As AFD polls are
+// level triggered a socket that keeps re-arming keeps being reported, so the
+// worker threads are kept busy without a test having to complete anything.
+// Polls for a shard are issued with the shard locked and so one device is
+// never polled by more than one thread at a time.
+
+class queued_afd_poll_device : public afd_poll_device
+{
+   public :
+
+      struct completion
+      {
+         uint32_t shard;
+
+         uint32_t buffer;
+
+         std::chrono::steady_clock::time_point posted;
+      };
+
+      queued_afd_poll_device(
+         afd_completion_port &port,
+         const uint32_t shard,
+         const uint32_t ready_events)
+         :  polls(0),
+            cancels(0),
+            port(port),
+            ready_events(ready_events),
+            completions{ { shard, 0, {} } }
+      {
+      }
+
+      bool poll(
+         const uint32_t /*buffer*/,
+         afd_poll_info &in,
+         const uint32_t /*in_size*/,
+         afd_poll_info &out,
+         const uint32_t /*out_size*/,
+         void *pContext) override
+      {
+         ++polls;
+
+         uint32_t ready = 0;
+
+         for (uint32_t i = 0; i < in.number_of_handles; ++i)
+         {
+            const uint32_t events = in.handles[i].events & ready_events;
+
+            if (events)
+            {
+               out.handles[ready++] = afd_poll_handle_info{ in.handles[i].handle, events, 0 };
+            }
+         }
+
+         out.number_of_handles = ready;
+
+         completion *pCompletion = static_cast<completion *>(pContext);
+
+         pCompletion->posted = std::chrono::steady_clock::now();
+
+         port.post(pCompletion);
+
+         return false;
+      }
+
+      void cancel(
+         const uint32_t /*buffer*/) override
+      {
+         // every poll has already completed
+
+         ++cancels;
+      }
+
+      void *context(
+         const uint32_t buffer)
+      {
+         return &completions[buffer];
+      }
+
+      std::atomic<size_t> polls;
+
+      std::atomic<size_t> cancels;
+
+   private :
+
+      afd_completion_port &port;
+
+      const uint32_t ready_events;
+
+      completion completions[afd_poll_set::poll_buffers];
+};
+
+// A shard factory for afd_shard_set that creates a queued_afd_poll_device for
+// each shard, all posting to the same port.
+
+class queued_shard_devices
+{
+   public :
+
+      queued_shard_devices(
+         afd_completion_port &port,
+         const uint32_t ready_events)
+         :  port(port),
+            ready_events(ready_events)
+      {
+      }
+
+      afd_shard_binding operator()(
+         const uint32_t shard)
+      {
+         std::lock_guard<std::mutex> lock(devices_lock);
+
+         devices.push_back(std::make_unique<queued_afd_poll_device>(port, shard, ready_events));
+
+         queued_afd_poll_device &device = *devices.back();
+
+         return afd_shard_binding{ device, { device.context(0) } };
+      }
+
+      size_t polls() const
+      {
+         std::lock_guard<std::mutex> lock(devices_lock);
+
+         size_t total = 0;
+
+         for (const auto &device : devices)
+         {
+            total += device->polls;
+         }
+
+         return total;
+      }
+
+   private :
+
+      afd_completion_port &port;
+
+      const uint32_t ready_events;
+
+      mutable std::mutex devices_lock;
+
+      std::vector<std::unique_ptr<queued_afd_poll_device>> devices;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: queued_afd_poll_device.h
+///////////////////////////////////////////////////////////////////////////////
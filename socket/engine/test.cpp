@@ -0,0 +1,3993 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: test.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "third_party/GoogleTest/gtest.h"
+#include "third_party/GoogleTest/gmock.h"
+
+#include "afd_poll_set.h"
+#include "afd_shard_set.h"
+#include "completion_queue.h"
+#include "afd_worker_pool.h"
+#include "timer_wheel.h"
+#include "afd_poll_timers.h"
+#include "afd_reactor_timers.h"
+#include "afd_simulator.h"
+#include "send_queue.h"
+#include "receive_ring.h"
+#include "slab_allocator.h"
+#include "connection_pool.h"
+#include "mpsc_queue.h"
+#include "socket_result.h"
+
+#include "fake_afd_poll_device.h"
+#include "queued_afd_poll_device.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+// These tests exercise the platform neutral parts of the socket code and so they
+// run anywhere, they don't need \Device\Afd
+
+int main(int argc, char **argv) {
+   testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
+
+static constexpr uint32_t RECEIVE = 0x0001;
+static constexpr uint32_t SEND = 0x0004;
+
+// Completes the poll that was last built, with no results, so that the next
+// submission can be built.
+
+static void complete_submission(
+   afd_poll_set &poll_set)
+{
+   poll_set.dispatch([](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      return 0;
+   });
+}
+
+TEST(AFDPollSet, TestConstruct)
+{
+   afd_poll_set poll_set(10);
+
+   EXPECT_EQ(10u, poll_set.capacity());
+   EXPECT_EQ(0u, poll_set.active_slots());
+   EXPECT_EQ(afd_poll_set::submission_mode::all_slots, poll_set.mode());
+}
+
+TEST(AFDPollSet, TestConstructNoSlots)
+{
+   EXPECT_THROW(afd_poll_set poll_set(0), std::exception);
+}
+
+TEST(AFDPollSet, TestInvalidSlot)
+{
+   afd_poll_set poll_set(2);
+
+   EXPECT_THROW(poll_set.associate(2, 0x100), std::exception);
+   EXPECT_THROW(poll_set.disassociate(2), std::exception);
+   EXPECT_THROW(poll_set.set_events(2, RECEIVE), std::exception);
+}
+
+TEST(AFDPollSet, TestAssociateDuplicateHandle)
+{
+   afd_poll_set poll_set(2);
+
+   poll_set.associate(0, 0x100);
+
+   EXPECT_THROW(poll_set.associate(1, 0x100), std::exception);
+   EXPECT_THROW(poll_set.associate(0, 0x200), std::exception);
+}
+
+TEST(AFDPollSet, TestSlotForHandle)
+{
+   afd_poll_set poll_set(4);
+
+   poll_set.associate(3, 0x300);
+   poll_set.associate(1, 0x100);
+
+   EXPECT_EQ(3u, poll_set.slot_for_handle(0x300));
+   EXPECT_EQ(1u, poll_set.slot_for_handle(0x100));
+   EXPECT_EQ(afd_poll_set::no_slot, poll_set.slot_for_handle(0x200));
+
+   poll_set.disassociate(3);
+
+   EXPECT_EQ(afd_poll_set::no_slot, poll_set.slot_for_handle(0x300));
+}
+
+TEST(AFDPollSet, TestAllSlotsSubmitsUpToHighestSlotUsed)
+{
+   afd_poll_set poll_set(10, afd_poll_set::submission_mode::all_slots);
+
+   poll_set.associate(5, 0x500);
+   poll_set.associate(1, 0x100);
+
+   poll_set.set_events(1, RECEIVE);
+
+   EXPECT_EQ(6u, poll_set.build_submission());
+
+   const auto &in = poll_set.poll_info_in();
+
+   EXPECT_EQ(6u, in.number_of_handles);
+   EXPECT_EQ(0x100u, in.handles[1].handle);
+   EXPECT_EQ(RECEIVE, in.handles[1].events);
+   EXPECT_EQ(0x500u, in.handles[5].handle);
+   EXPECT_EQ(0u, in.handles[5].events);
+   EXPECT_EQ(afd_poll_info_size(6), poll_set.submission_size());
+}
+
+TEST(AFDPollSet, TestActiveSlotsSubmitsOnlySlotsWithInterest)
+{
+   afd_poll_set poll_set(10, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.associate(5, 0x500);
+   poll_set.associate(1, 0x100);
+   poll_set.associate(7, 0x700);
+
+   poll_set.set_events(7, SEND);
+   poll_set.set_events(1, RECEIVE);
+
+   EXPECT_EQ(2u, poll_set.active_slots());
+
+   EXPECT_EQ(2u, poll_set.build_submission());
+
+   const auto &in = poll_set.poll_info_in();
+
+   EXPECT_EQ(2u, in.number_of_handles);
+   EXPECT_EQ(0x700u, in.handles[0].handle);
+   EXPECT_EQ(SEND, in.handles[0].events);
+   EXPECT_EQ(0x100u, in.handles[1].handle);
+   EXPECT_EQ(RECEIVE, in.handles[1].events);
+   EXPECT_EQ(afd_poll_info_size(2), poll_set.submission_size());
+}
+
+TEST(AFDPollSet, TestActiveSlotsIgnoresInterestWithoutHandle)
+{
+   afd_poll_set poll_set(4, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.set_events(2, RECEIVE);
+
+   EXPECT_EQ(0u, poll_set.active_slots());
+   EXPECT_EQ(0u, poll_set.build_submission());
+
+   poll_set.associate(2, 0x200);
+
+   EXPECT_EQ(1u, poll_set.active_slots());
+   EXPECT_EQ(1u, poll_set.build_submission());
+}
+
+TEST(AFDPollSet, TestActiveSlotsDisassociateRemovesSlot)
+{
+   afd_poll_set poll_set(4, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.associate(0, 0x100);
+   poll_set.associate(1, 0x200);
+   poll_set.associate(2, 0x300);
+
+   poll_set.set_events(0, RECEIVE);
+   poll_set.set_events(1, RECEIVE);
+   poll_set.set_events(2, RECEIVE);
+
+   complete_submission(poll_set);
+
+   poll_set.disassociate(0);
+
+   EXPECT_EQ(2u, poll_set.active_slots());
+   EXPECT_EQ(2u, poll_set.build_submission());
+
+   const auto &in = poll_set.poll_info_in();
+
+   EXPECT_NE(0x100u, in.handles[0].handle);
+   EXPECT_NE(0x100u, in.handles[1].handle);
+
+   complete_submission(poll_set);
+
+   poll_set.set_events(1, 0);
+
+   EXPECT_EQ(1u, poll_set.build_submission());
+   EXPECT_EQ(0x300u, poll_set.poll_info_in().handles[0].handle);
+}
+
+TEST(AFDPollSet, TestDispatchMapsHandlesToSlots)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(10, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.associate(9, 0x900);
+   poll_set.associate(4, 0x400);
+
+   poll_set.set_events(9, RECEIVE);
+   poll_set.set_events(4, RECEIVE | SEND);
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), &poll_set);
+
+   // the device reports only the handles with events, in an order of its choosing
+
+   EXPECT_EQ(&poll_set, device.complete({ { 0x400, SEND, 0 } }));
+
+   std::vector<std::pair<uint32_t, uint32_t>> handled;
+
+   EXPECT_EQ(1u, poll_set.dispatch([&](const uint32_t slot, const uint32_t events, const int32_t status)
+   {
+      (void)status;
+
+      handled.emplace_back(slot, events);
+
+      return RECEIVE;
+   }));
+
+   ASSERT_EQ(1u, handled.size());
+   EXPECT_EQ(4u, handled[0].first);
+   EXPECT_EQ(SEND, handled[0].second);
+
+   // the value returned by the handler is the new interest for the slot
+
+   EXPECT_EQ(RECEIVE, poll_set.get_events(4));
+   EXPECT_EQ(RECEIVE, poll_set.get_events(9));
+}
+
+TEST(AFDPollSet, TestDispatchIgnoresUnknownHandles)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(2, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.associate(0, 0x100);
+
+   poll_set.set_events(0, RECEIVE);
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   // the socket was disassociated whilst the poll was pending...
+
+   poll_set.disassociate(0);
+
+   device.complete({ { 0x100, RECEIVE, 0 } });
+
+   EXPECT_EQ(0u, poll_set.dispatch([](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      ADD_FAILURE() << "unexpected dispatch";
+
+      return 0;
+   }));
+}
+
+TEST(AFDPollSet, TestDispatchHandlerDisablesSlot)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(2, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.associate(0, 0x100);
+   poll_set.associate(1, 0x200);
+
+   poll_set.set_events(0, RECEIVE);
+   poll_set.set_events(1, RECEIVE);
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   device.complete_all(RECEIVE);
+
+   EXPECT_EQ(2u, poll_set.dispatch([](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      return slot == 0 ? 0 : RECEIVE;
+   }));
+
+   EXPECT_EQ(1u, poll_set.build_submission());
+   EXPECT_EQ(0x200u, poll_set.poll_info_in().handles[0].handle);
+}
+
+TEST(AFDPollSet, TestDispatchHandlerReusesSlot)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(2, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.associate(poll_set.allocate_slot(), 0x100);
+
+   poll_set.set_events(0, RECEIVE);
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   device.complete_all(RECEIVE);
+
+   // the handler closes the socket and opens another, which is given the same
+   // slot; the closed socket's interest mustn't replace the new socket's
+
+   EXPECT_EQ(1u, poll_set.dispatch([&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      poll_set.disassociate(slot);
+
+      EXPECT_EQ(slot, poll_set.allocate_slot());
+
+      poll_set.associate(slot, 0x200);
+
+      poll_set.set_events(slot, RECEIVE | SEND);
+
+      return 0;
+   }));
+
+   EXPECT_EQ(RECEIVE | SEND, poll_set.get_events(0));
+
+   EXPECT_EQ(1u, poll_set.build_submission());
+   EXPECT_EQ(0x200u, poll_set.poll_info_in().handles[0].handle);
+}
+
+TEST(AFDPollSet, TestAllocateSlot)
+{
+   afd_poll_set poll_set(4);
+
+   EXPECT_EQ(0u, poll_set.allocate_slot());
+   EXPECT_EQ(1u, poll_set.allocate_slot());
+   EXPECT_EQ(2u, poll_set.allocate_slot());
+
+   EXPECT_EQ(3u, poll_set.slots_in_use());
+}
+
+TEST(AFDPollSet, TestAllocateSlotReusesReleasedSlots)
+{
+   afd_poll_set poll_set(4);
+
+   const uint32_t slot0 = poll_set.allocate_slot();
+   const uint32_t slot1 = poll_set.allocate_slot();
+   const uint32_t slot2 = poll_set.allocate_slot();
+
+   (void)slot0;
+   (void)slot2;
+
+   poll_set.associate(slot1, 0x100);
+
+   poll_set.disassociate(slot1);
+
+   EXPECT_EQ(2u, poll_set.slots_in_use());
+
+   EXPECT_EQ(slot1, poll_set.allocate_slot());
+}
+
+TEST(AFDPollSet, TestAllocateSlotSkipsSlotsChosenByCaller)
+{
+   afd_poll_set poll_set(4);
+
+   poll_set.associate(0, 0x100);
+   poll_set.associate(2, 0x300);
+
+   EXPECT_EQ(1u, poll_set.allocate_slot());
+   EXPECT_EQ(3u, poll_set.allocate_slot());
+   EXPECT_EQ(4u, poll_set.allocate_slot());
+}
+
+TEST(AFDPollSet, TestAllocateSlotGrows)
+{
+   afd_poll_set poll_set(2);
+
+   for (uint32_t i = 0; i < 5; ++i)
+   {
+      EXPECT_EQ(i, poll_set.allocate_slot());
+   }
+
+   EXPECT_EQ(8u, poll_set.capacity());
+
+   poll_set.associate(4, 0x400);
+
+   poll_set.set_events(4, RECEIVE);
+
+   EXPECT_EQ(5u, poll_set.build_submission());
+   EXPECT_LE(5u, poll_set.buffer_capacity());
+}
+
+TEST(AFDPollSet, TestReleaseSlotCompacts)
+{
+   afd_poll_set poll_set(2);
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 64; ++i)
+   {
+      slots.push_back(poll_set.allocate_slot());
+   }
+
+   EXPECT_EQ(64u, poll_set.capacity());
+
+   for (auto it = slots.rbegin(); it != slots.rend(); ++it)
+   {
+      poll_set.release_slot(*it);
+   }
+
+   EXPECT_EQ(0u, poll_set.slots_in_use());
+   EXPECT_EQ(2u, poll_set.capacity());
+
+   EXPECT_EQ(0u, poll_set.allocate_slot());
+   EXPECT_EQ(1u, poll_set.allocate_slot());
+}
+
+TEST(AFDPollSet, TestReleaseSlotDuringDispatchCompactsWhenThePassIsComplete)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(2, afd_poll_set::submission_mode::active_slots);
+
+   for (uint32_t i = 0; i < 16; ++i)
+   {
+      poll_set.associate(poll_set.allocate_slot(), 0x100 + i);
+
+      poll_set.set_events(i, RECEIVE);
+   }
+
+   EXPECT_EQ(16u, poll_set.capacity());
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   device.complete({ { 0x10f, RECEIVE, 0 } });
+
+   // the handler closes every socket, which would leave few enough slots in
+   // use for the set to shrink below the slot being dispatched
+
+   EXPECT_EQ(1u, poll_set.dispatch([&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      EXPECT_EQ(15u, slot);
+
+      for (uint32_t i = 0; i < 16; ++i)
+      {
+         poll_set.disassociate(i);
+      }
+
+      EXPECT_EQ(16u, poll_set.capacity());
+
+      return 0;
+   }));
+
+   EXPECT_EQ(0u, poll_set.slots_in_use());
+   EXPECT_EQ(2u, poll_set.capacity());
+}
+
+TEST(AFDPollSet, TestReleaseSlotDoesNotCompactBelowSlotsInUse)
+{
+   afd_poll_set poll_set(2);
+
+   for (uint32_t i = 0; i < 64; ++i)
+   {
+      poll_set.allocate_slot();
+   }
+
+   for (uint32_t i = 0; i < 63; ++i)
+   {
+      poll_set.release_slot(i);
+   }
+
+   EXPECT_EQ(64u, poll_set.capacity());
+
+   // we can still use the slot that's left
+
+   poll_set.associate(63, 0x100);
+
+   poll_set.set_events(63, RECEIVE);
+
+   EXPECT_EQ(64u, poll_set.build_submission());
+
+   // and reuse the free slots
+
+   EXPECT_EQ(1u, poll_set.slots_in_use());
+
+   for (uint32_t i = 0; i < 63; ++i)
+   {
+      EXPECT_GT(63u, poll_set.allocate_slot());
+   }
+
+   EXPECT_EQ(64u, poll_set.allocate_slot());
+}
+
+TEST(AFDPollSet, TestReleaseAssociatedSlotFails)
+{
+   afd_poll_set poll_set(2);
+
+   const uint32_t slot = poll_set.allocate_slot();
+
+   poll_set.associate(slot, 0x100);
+
+   EXPECT_THROW(poll_set.release_slot(slot), std::exception);
+}
+
+TEST(AFDPollSet, TestAllSlotsSubmissionShrinksWithHighestSlot)
+{
+   afd_poll_set poll_set(2, afd_poll_set::submission_mode::all_slots);
+
+   for (uint32_t i = 0; i < 10; ++i)
+   {
+      poll_set.associate(poll_set.allocate_slot(), 0x100 + i);
+   }
+
+   EXPECT_EQ(10u, poll_set.build_submission());
+
+   complete_submission(poll_set);
+
+   poll_set.disassociate(9);
+   poll_set.disassociate(8);
+   poll_set.disassociate(4);
+
+   EXPECT_EQ(8u, poll_set.build_submission());
+}
+
+TEST(AFDPollSet, TestGrowWhilstPollInFlightKeepsOutputBuffer)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(1, afd_poll_set::submission_mode::active_slots);
+
+   const uint32_t first = poll_set.allocate_slot();
+
+   poll_set.associate(first, 0x100);
+
+   poll_set.set_events(first, RECEIVE);
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   const afd_poll_info *pFirstOut = &poll_set.poll_info_out();
+
+   // lots of new connections arrive whilst the poll is pending
+
+   for (uint32_t i = 0; i < 100; ++i)
+   {
+      const uint32_t slot = poll_set.allocate_slot();
+
+      poll_set.associate(slot, 0x1000 + i);
+
+      poll_set.set_events(slot, RECEIVE);
+   }
+
+   // the buffer isn't touched whilst the poll is pending, the new slots are
+   // submitted once it completes
+
+   EXPECT_EQ(0u, poll_set.build_submission());
+
+   EXPECT_EQ(pFirstOut, &poll_set.poll_info_out());
+
+   // the kernel can still complete the first poll into the buffer it was given,
+   // which the address sanitiser would complain about if it had been freed
+
+   device.complete({ { 0x100, RECEIVE, 0 } });
+
+   EXPECT_EQ(1u, pFirstOut->number_of_handles);
+
+   EXPECT_EQ(1u, poll_set.dispatch([](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      return RECEIVE;
+   }));
+
+   EXPECT_EQ(101u, poll_set.build_submission());
+
+   EXPECT_LE(101u, poll_set.buffer_capacity());
+}
+
+TEST(AFDPollSet, TestNeedsSubmission)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(4, afd_poll_set::submission_mode::active_slots);
+
+   EXPECT_FALSE(poll_set.needs_submission());
+
+   poll_set.associate(0, 0x100);
+
+   EXPECT_FALSE(poll_set.needs_submission());
+
+   poll_set.set_events(0, RECEIVE);
+
+   EXPECT_TRUE(poll_set.needs_submission());
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   EXPECT_FALSE(poll_set.needs_submission());
+
+   // setting the same interest again is not a change
+
+   poll_set.set_events(0, RECEIVE);
+
+   EXPECT_FALSE(poll_set.needs_submission());
+
+   poll_set.set_events(0, RECEIVE | SEND);
+
+   EXPECT_TRUE(poll_set.needs_submission());
+}
+
+TEST(AFDPollSet, TestCompletedPollNeedsSubmissionIfThereIsInterest)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(4, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.associate(0, 0x100);
+   poll_set.associate(1, 0x200);
+
+   poll_set.set_events(0, RECEIVE);
+   poll_set.set_events(1, RECEIVE);
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   device.complete({ { 0x100, RECEIVE, 0 } });
+
+   poll_set.dispatch([](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      return 0;
+   });
+
+   // slot 1 is still interested but is no longer being polled for
+
+   EXPECT_TRUE(poll_set.needs_submission());
+
+   poll_set.set_events(1, 0);
+
+   EXPECT_FALSE(poll_set.needs_submission());
+}
+
+TEST(AFDPollSet, TestChangesDuringDispatchAreStaged)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(4, afd_poll_set::submission_mode::active_slots);
+
+   for (uint32_t slot = 0; slot < 4; ++slot)
+   {
+      poll_set.associate(slot, 0x100 * (slot + 1));
+
+      poll_set.set_events(slot, RECEIVE);
+   }
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   device.complete_all(RECEIVE);
+
+   EXPECT_FALSE(poll_set.dispatching());
+
+   poll_set.dispatch([&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      EXPECT_TRUE(poll_set.dispatching());
+
+      poll_set.set_events((slot + 1) % 4, RECEIVE | SEND);
+
+      return RECEIVE | SEND;
+   });
+
+   EXPECT_FALSE(poll_set.dispatching());
+
+   const afd_poll_set::statistics &stats = poll_set.stats();
+
+   EXPECT_EQ(1u, stats.submissions);
+   EXPECT_EQ(1u, stats.completions);
+   EXPECT_EQ(4u, stats.handles_submitted);
+   EXPECT_EQ(4u, stats.staged_changes);
+
+   EXPECT_TRUE(poll_set.needs_submission());
+}
+
+TEST(AFDPollSet, TestDispatchingIsResetIfHandlerThrows)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(1, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.associate(0, 0x100);
+
+   poll_set.set_events(0, RECEIVE);
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   device.complete_all(RECEIVE);
+
+   EXPECT_THROW(poll_set.dispatch([](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      throw std::runtime_error("handler failed");
+   }), std::runtime_error);
+
+   EXPECT_FALSE(poll_set.dispatching());
+}
+
+TEST(AFDPollSet, TestAddingInterestWhilstPollPendingCancelsIt)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(4, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.associate(0, 0x100);
+   poll_set.associate(1, 0x200);
+
+   poll_set.set_events(0, RECEIVE);
+
+   EXPECT_EQ(1u, poll_set.build_submission());
+
+   const uint32_t buffer = poll_set.submission_buffer();
+
+   device.poll(buffer, poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   EXPECT_EQ(afd_poll_set::no_buffer, poll_set.cancel_buffer());
+
+   poll_set.set_events(1, RECEIVE);
+
+   EXPECT_TRUE(poll_set.needs_submission());
+
+   // AFD won't complete a second poll for a socket alongside the first, so
+   // nothing is built, the pending poll is to be cancelled
+
+   EXPECT_EQ(0u, poll_set.build_submission());
+
+   EXPECT_EQ(buffer, poll_set.cancel_buffer());
+
+   EXPECT_TRUE(poll_set.in_flight(buffer));
+
+   // and only once
+
+   EXPECT_TRUE(poll_set.needs_submission());
+
+   EXPECT_EQ(0u, poll_set.build_submission());
+
+   EXPECT_EQ(afd_poll_set::no_buffer, poll_set.cancel_buffer());
+
+   // the poll completes, with whatever it had when it was cancelled...
+
+   device.complete(buffer, { { 0x100, RECEIVE, 0 } });
+
+   EXPECT_EQ(1u, poll_set.dispatch(buffer, [](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      EXPECT_EQ(0u, slot);
+
+      return RECEIVE;
+   }));
+
+   // and the changes can be submitted
+
+   EXPECT_TRUE(poll_set.needs_submission());
+
+   EXPECT_EQ(2u, poll_set.build_submission());
+
+   EXPECT_EQ(afd_poll_set::no_buffer, poll_set.cancel_buffer());
+
+   EXPECT_EQ(2u, poll_set.stats().submissions);
+   EXPECT_EQ(1u, poll_set.stats().cancelled);
+}
+
+TEST(AFDPollSet, TestChangesMadeWhilstCancellingAreSubmittedTogether)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(4, afd_poll_set::submission_mode::active_slots);
+
+   const auto submit = [&]()
+   {
+      const uint32_t handles = poll_set.build_submission();
+
+      if (handles)
+      {
+         device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+      }
+      else if (poll_set.cancel_buffer() != afd_poll_set::no_buffer)
+      {
+         device.cancel(poll_set.cancel_buffer());
+      }
+
+      return handles;
+   };
+
+   for (uint32_t slot = 0; slot < 3; ++slot)
+   {
+      poll_set.associate(slot, 0x100 * (slot + 1));
+   }
+
+   poll_set.set_events(0, RECEIVE);
+
+   EXPECT_EQ(1u, submit());
+
+   poll_set.set_events(1, RECEIVE);
+
+   EXPECT_EQ(0u, submit());
+
+   poll_set.set_events(2, RECEIVE);
+
+   EXPECT_EQ(0u, submit());
+
+   EXPECT_EQ(1u, device.cancels);
+
+   // the cancelled poll completes with nothing...
+
+   device.complete({});
+
+   EXPECT_EQ(0u, poll_set.dispatch([](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      return 0;
+   }));
+
+   // and both of the changes are submitted with one poll
+
+   EXPECT_TRUE(poll_set.needs_submission());
+
+   EXPECT_EQ(3u, submit());
+
+   EXPECT_EQ(2u, device.polls);
+
+   EXPECT_EQ(3u, device.submitted.size());
+}
+
+TEST(AFDPollSet, TestRemovingInterestWhilstPollPendingDoesNotNeedSubmission)
+{
+   fake_afd_poll_device device;
+
+   afd_poll_set poll_set(4, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.associate(0, 0x100);
+   poll_set.associate(1, 0x200);
+
+   poll_set.set_events(0, RECEIVE | SEND);
+   poll_set.set_events(1, RECEIVE);
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   poll_set.set_events(0, RECEIVE);
+   poll_set.set_events(1, 0);
+
+   EXPECT_FALSE(poll_set.needs_submission());
+
+   // events that are no longer of interest are not reported
+
+   device.complete({ { 0x100, RECEIVE | SEND, 0 }, { 0x200, RECEIVE, 0 } });
+
+   std::vector<std::pair<uint32_t, uint32_t>> handled;
+
+   EXPECT_EQ(1u, poll_set.dispatch([&](const uint32_t slot, const uint32_t events, int32_t) -> uint32_t
+   {
+      handled.emplace_back(slot, events);
+
+      return 0;
+   }));
+
+   ASSERT_EQ(1u, handled.size());
+   EXPECT_EQ(0u, handled[0].first);
+   EXPECT_EQ(RECEIVE, handled[0].second);
+}
+
+TEST(AFDPollSet, TestDispatchOfBufferWithoutPollDoesNothing)
+{
+   afd_poll_set poll_set(1, afd_poll_set::submission_mode::active_slots);
+
+   poll_set.associate(0, 0x100);
+
+   poll_set.set_events(0, RECEIVE);
+
+   EXPECT_EQ(0u, poll_set.dispatch(0, [](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      ADD_FAILURE() << "unexpected dispatch";
+
+      return 0;
+   }));
+
+   EXPECT_EQ(0u, poll_set.stats().completions);
+
+   EXPECT_THROW(poll_set.dispatch(afd_poll_set::poll_buffers, [](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      return 0;
+   }), std::exception);
+}
+
+class fake_shard_devices
+{
+   public :
+
+      afd_shard_binding operator()(
+         const uint32_t shard)
+      {
+         devices.push_back(std::make_unique<fake_afd_poll_device>());
+
+         void *pContext = reinterpret_cast<void *>(static_cast<uintptr_t>(shard + 1));
+
+         return afd_shard_binding{ *devices.back(), { pContext } };
+      }
+
+      fake_afd_poll_device &device(
+         const uint32_t shard)
+      {
+         return *devices.at(shard);
+      }
+
+      std::vector<std::unique_ptr<fake_afd_poll_device>> devices;
+};
+
+TEST(AFDShardSet, TestConstruct)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(4, std::ref(devices));
+
+   EXPECT_EQ(0u, shards.shards());
+   EXPECT_EQ(4u, shards.max_shard_size());
+}
+
+TEST(AFDShardSet, TestConstructZeroShardSize)
+{
+   fake_shard_devices devices;
+
+   EXPECT_THROW(afd_shard_set shards(0, std::ref(devices)), std::exception);
+}
+
+TEST(AFDShardSet, TestShardsAreCreatedWhenFull)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(2, std::ref(devices));
+
+   const uint32_t slot0 = shards.allocate_slot();
+   const uint32_t slot1 = shards.allocate_slot();
+
+   EXPECT_EQ(1u, shards.shards());
+   EXPECT_EQ(0u, shards.shard_of(slot0));
+   EXPECT_EQ(0u, shards.shard_of(slot1));
+
+   const uint32_t slot2 = shards.allocate_slot();
+
+   EXPECT_EQ(2u, shards.shards());
+   EXPECT_EQ(1u, shards.shard_of(slot2));
+   EXPECT_EQ(2u, devices.devices.size());
+}
+
+TEST(AFDShardSet, TestPlacementPrefersLeastLoadedShard)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(2, std::ref(devices));
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 6; ++i)
+   {
+      slots.push_back(shards.allocate_slot());
+   }
+
+   EXPECT_EQ(3u, shards.shards());
+
+   shards.release_slot(slots[0]);
+   shards.release_slot(slots[1]);
+   shards.release_slot(slots[4]);
+
+   EXPECT_EQ(0u, shards.shard_size(0));
+   EXPECT_EQ(1u, shards.shard_size(2));
+
+   EXPECT_EQ(0u, shards.shard_of(shards.allocate_slot()));
+}
+
+TEST(AFDShardSet, TestPollOnlyArmsOwningShard)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(2, std::ref(devices));
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 6; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x100 + i);
+
+      slots.push_back(slot);
+   }
+
+   shards.poll(slots[5], RECEIVE);
+
+   const uint32_t shard = shards.shard_of(slots[5]);
+
+   for (uint32_t i = 0; i < shards.shards(); ++i)
+   {
+      EXPECT_EQ(i == shard ? 1u : 0u, devices.device(i).polls);
+   }
+
+   ASSERT_EQ(1u, devices.device(shard).submitted.size());
+   EXPECT_EQ(0x105u, devices.device(shard).submitted[0].handle);
+}
+
+TEST(AFDShardSet, TestDispatchReportsGlobalSlot)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(2, std::ref(devices));
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 4; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x100 + i);
+
+      slots.push_back(slot);
+   }
+
+   shards.poll(slots[3], RECEIVE);
+
+   const uint32_t shard = shards.shard_of(slots[3]);
+
+   void *pContext = devices.device(shard).complete_all(RECEIVE);
+
+   EXPECT_EQ(reinterpret_cast<void *>(static_cast<uintptr_t>(shard + 1)), pContext);
+
+   std::vector<uint32_t> handled;
+
+   EXPECT_EQ(1u, shards.dispatch(shard, [&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      handled.push_back(slot);
+
+      return 0;
+   }));
+
+   ASSERT_EQ(1u, handled.size());
+   EXPECT_EQ(slots[3], handled[0]);
+   EXPECT_EQ(0u, shards.get_events(slots[3]));
+}
+
+TEST(AFDShardSet, TestDisassociateReleasesSlot)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(2, std::ref(devices));
+
+   const uint32_t slot = shards.allocate_slot();
+
+   shards.associate(slot, 0x100);
+
+   shards.disassociate(slot);
+
+   EXPECT_EQ(0u, shards.shard_size(0));
+
+   EXPECT_THROW(shards.shard_of(slot), std::exception);
+
+   EXPECT_EQ(slot, shards.allocate_slot());
+}
+
+TEST(AFDShardSet, TestDisassociateDuringDispatch)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(64, std::ref(devices));
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 64; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x100 + i);
+
+      shards.set_events(slot, RECEIVE);
+
+      slots.push_back(slot);
+   }
+
+   EXPECT_EQ(1u, shards.shards());
+
+   shards.submit(0);
+
+   devices.device(0).complete({ { 0x13f, RECEIVE, 0 } });
+
+   EXPECT_EQ(1u, shards.dispatch(0, [&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      EXPECT_EQ(slots[63], slot);
+
+      for (const uint32_t closed : slots)
+      {
+         shards.disassociate(closed);
+      }
+
+      return 0;
+   }));
+
+   EXPECT_EQ(0u, shards.shard_size(0));
+
+   // the shard is usable once the pass is over
+
+   const uint32_t slot = shards.allocate_slot();
+
+   shards.associate(slot, 0x200);
+
+   shards.set_events(slot, RECEIVE);
+
+   EXPECT_EQ(0u, shards.shard_of(slot));
+}
+
+TEST(AFDShardSet, TestRebalance)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(8, std::ref(devices));
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 16; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x100 + i);
+
+      shards.set_events(slot, RECEIVE);
+
+      slots.push_back(slot);
+   }
+
+   EXPECT_EQ(2u, shards.shards());
+
+   // most of the connections in one shard go away
+
+   uint32_t removed = 0;
+
+   for (const uint32_t slot : slots)
+   {
+      if (shards.shard_of(slot) == 1 && removed < 7)
+      {
+         shards.disassociate(slot);
+
+         ++removed;
+      }
+   }
+
+   EXPECT_EQ(8u, shards.shard_size(0));
+   EXPECT_EQ(1u, shards.shard_size(1));
+
+   EXPECT_EQ(0u, shards.rebalance(0));
+
+   const uint32_t moved = shards.rebalance(100);
+
+   EXPECT_EQ(3u, moved);
+   EXPECT_EQ(5u, shards.shard_size(0));
+   EXPECT_EQ(4u, shards.shard_size(1));
+
+   // the shard that gained sockets is re-armed to include them, with their interest
+
+   EXPECT_EQ(0u, devices.device(0).polls);
+   EXPECT_EQ(1u, devices.device(1).polls);
+   EXPECT_EQ(4u, devices.device(1).submitted.size());
+
+   // and events for the moved sockets are reported against their original slots
+
+   devices.device(1).complete_all(RECEIVE);
+
+   uint32_t dispatched = 0;
+
+   shards.dispatch(1, [&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      EXPECT_EQ(1u, shards.shard_of(slot));
+
+      ++dispatched;
+
+      return RECEIVE;
+   });
+
+   EXPECT_EQ(4u, dispatched);
+}
+
+TEST(AFDShardSet, TestRebalanceIgnoresMovedSocketInOldShardResults)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(4, std::ref(devices));
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 5; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x100 + i);
+
+      slots.push_back(slot);
+   }
+
+   shards.disassociate(slots[4]);
+
+   // shard 0 has a poll pending for all four of its sockets
+
+   shards.set_events(slots[0], RECEIVE);
+   shards.set_events(slots[1], RECEIVE);
+   shards.set_events(slots[2], RECEIVE);
+   shards.set_events(slots[3], RECEIVE);
+
+   shards.submit(0);
+
+   EXPECT_EQ(2u, shards.rebalance(100));
+
+   // the pending poll completes with data for everything
+
+   devices.device(0).complete_all(RECEIVE);
+
+   uint32_t dispatched = 0;
+
+   shards.dispatch(0, [&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      EXPECT_EQ(0u, shards.shard_of(slot));
+
+      ++dispatched;
+
+      return RECEIVE;
+   });
+
+   EXPECT_EQ(2u, dispatched);
+}
+
+TEST(AFDShardSet, TestPollsDuringDispatchAreCoalesced)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(4, std::ref(devices));
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 8; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x100 + i);
+
+      shards.set_events(slot, RECEIVE);
+
+      slots.push_back(slot);
+   }
+
+   EXPECT_EQ(2u, shards.shards());
+
+   shards.submit(0);
+   shards.submit(1);
+
+   devices.device(0).complete_all(RECEIVE);
+
+   // every socket that is dispatched re-arms itself, and pokes a socket in
+   // the other shard...
+
+   const uint32_t other = shards.shard_of(slots[0]) == 0 ? 1 : 0;
+
+   uint32_t other_slot = afd_shard_set::no_slot;
+
+   for (const uint32_t slot : slots)
+   {
+      if (shards.shard_of(slot) == other)
+      {
+         other_slot = slot;
+      }
+   }
+
+   EXPECT_EQ(4u, shards.dispatch(0, [&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      EXPECT_FALSE(shards.poll(slot, RECEIVE | SEND));
+
+      EXPECT_FALSE(shards.poll(other_slot, RECEIVE | SEND));
+
+      return RECEIVE | SEND;
+   }));
+
+   // one poll for the dispatched shard at the end of the pass, rather than
+   // four, and the other shard's pending poll is cancelled, once, so that its
+   // changes can be submitted when it completes
+
+   EXPECT_EQ(2u, devices.device(0).polls);
+   EXPECT_EQ(1u, devices.device(1).polls);
+   EXPECT_EQ(1u, devices.device(1).cancels);
+
+   const afd_poll_set::statistics stats = shards.stats();
+
+   EXPECT_EQ(3u, stats.submissions);
+   EXPECT_EQ(1u, stats.completions);
+   EXPECT_EQ(1u, stats.cancelled);
+}
+
+TEST(AFDShardSet, TestNoPollIfNothingChangedDuringDispatch)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(4, std::ref(devices));
+
+   const uint32_t slot = shards.allocate_slot();
+
+   shards.associate(slot, 0x100);
+
+   shards.poll(slot, RECEIVE);
+
+   devices.device(0).complete_all(RECEIVE);
+
+   shards.dispatch(0, [](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      return 0;
+   });
+
+   EXPECT_EQ(1u, devices.device(0).polls);
+}
+
+TEST(AFDShardSet, TestAfterDispatchCompletesOnceTheShardHasBeenDispatched)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(4, std::ref(devices));
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 3; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x100 + i);
+
+      shards.set_events(slot, RECEIVE);
+
+      slots.push_back(slot);
+   }
+
+   shards.submit(0);
+
+   // not dispatching
+
+   EXPECT_FALSE(shards.after_dispatch(slots[0]));
+
+   devices.device(0).complete_all(RECEIVE);
+
+   std::vector<uint32_t> completed;
+
+   EXPECT_EQ(3u, shards.dispatch(0, 0, [&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      EXPECT_TRUE(shards.after_dispatch(slot));
+
+      EXPECT_TRUE(completed.empty());
+
+      if (slot == slots[2])
+      {
+         // closed after asking, it isn't completed
+
+         shards.disassociate(slot);
+
+         return 0;
+      }
+
+      return RECEIVE;
+   },
+   [](uint32_t)
+   {
+   },
+   [&](const uint32_t slot)
+   {
+      completed.push_back(slot);
+
+      // the writes that were held back can be made now
+
+      EXPECT_FALSE(shards.after_dispatch(slot));
+
+      EXPECT_FALSE(shards.poll(slot, RECEIVE | SEND));
+   }));
+
+   EXPECT_EQ((std::vector<uint32_t>{ slots[0], slots[1] }), completed);
+
+   // the polls made on completion are part of the poll at the end of the pass
+
+   EXPECT_EQ(2u, devices.device(0).polls);
+
+   EXPECT_EQ(RECEIVE | SEND, shards.get_events(slots[0]));
+
+   // a dispatch without a completion handler can't complete anything
+
+   devices.device(0).complete_all(RECEIVE | SEND);
+
+   shards.dispatch(0, [&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+   {
+      EXPECT_FALSE(shards.after_dispatch(slot));
+
+      return RECEIVE;
+   });
+}
+
+TEST(AFDShardSet, TestAddingInterestWhilstPollPendingCancelsOldPoll)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(4, std::ref(devices));
+
+   const uint32_t slot1 = shards.allocate_slot();
+   const uint32_t slot2 = shards.allocate_slot();
+
+   shards.associate(slot1, 0x100);
+   shards.associate(slot2, 0x200);
+
+   shards.poll(slot1, RECEIVE);
+
+   fake_afd_poll_device &device = devices.device(0);
+
+   EXPECT_EQ(1u, device.polls);
+
+   // no new poll is needed if the pending poll covers the interest
+
+   EXPECT_FALSE(shards.poll(slot1, RECEIVE));
+
+   EXPECT_EQ(1u, device.polls);
+
+   shards.poll(slot2, RECEIVE);
+
+   // the pending poll is cancelled, rather than a second poll issued alongside
+   // it, and cancelled only once
+
+   EXPECT_EQ(1u, device.polls);
+   EXPECT_EQ(1u, device.cancels);
+   EXPECT_EQ(1u, device.pending_count());
+
+   EXPECT_FALSE(shards.poll(slot2, RECEIVE | SEND));
+
+   EXPECT_EQ(1u, device.cancels);
+
+   // once it has completed the changes are submitted
+
+   device.complete({});
+
+   EXPECT_EQ(0u, shards.dispatch(0, 0, [](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      return 0;
+   }));
+
+   EXPECT_EQ(2u, device.polls);
+
+   EXPECT_EQ(1u, shards.stats().cancelled);
+
+   device.complete_all(RECEIVE);
+
+   EXPECT_EQ(2u, shards.dispatch(0, 0, [](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      return RECEIVE;
+   }));
+
+   EXPECT_EQ(3u, device.polls);
+}
+
+TEST(CompletionQueue, TestGetReturnsContextsInOrder)
+{
+   completion_queue queue;
+
+   int one = 1;
+   int two = 2;
+
+   queue.post(&one);
+   queue.post(&two);
+
+   EXPECT_EQ(2u, queue.size());
+
+   void *pContext = nullptr;
+
+   EXPECT_TRUE(queue.get(pContext, 0));
+   EXPECT_EQ(&one, pContext);
+
+   EXPECT_TRUE(queue.get(pContext, 0));
+   EXPECT_EQ(&two, pContext);
+
+   EXPECT_EQ(0u, queue.size());
+}
+
+TEST(CompletionQueue, TestGetTimesOut)
+{
+   completion_queue queue;
+
+   void *pContext = nullptr;
+
+   EXPECT_FALSE(queue.get(pContext, 0));
+   EXPECT_FALSE(queue.get(pContext, 10));
+}
+
+TEST(CompletionQueue, TestGetWaitsForPostFromAnotherThread)
+{
+   completion_queue queue;
+
+   int context = 1;
+
+   std::thread poster([&]()
+   {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+      queue.post(&context);
+   });
+
+   void *pContext = nullptr;
+
+   EXPECT_TRUE(queue.get(pContext, afd_completion_port::infinite));
+   EXPECT_EQ(&context, pContext);
+
+   poster.join();
+}
+
+TEST(AFDWorkerPool, TestConstructNoThreads)
+{
+   completion_queue queue;
+
+   EXPECT_THROW(afd_worker_pool pool(queue, 0, [](void *) {}), std::exception);
+}
+
+TEST(AFDWorkerPool, TestCompletionsAreHandled)
+{
+   completion_queue queue;
+
+   std::atomic<uint32_t> handled(0);
+
+   afd_worker_pool pool(queue, 4, [&](void *pContext)
+   {
+      handled += static_cast<uint32_t>(reinterpret_cast<uintptr_t>(pContext));
+   });
+
+   EXPECT_EQ(4u, pool.threads());
+
+   for (uint32_t i = 0; i < 1000; ++i)
+   {
+      queue.post(reinterpret_cast<void *>(static_cast<uintptr_t>(1)));
+   }
+
+   // anything already queued is handled before the threads exit
+
+   pool.stop();
+
+   EXPECT_EQ(1000u, handled);
+   EXPECT_EQ(0u, pool.threads());
+   EXPECT_EQ(0u, queue.size());
+}
+
+TEST(AFDWorkerPool, TestStopRethrowsHandlerException)
+{
+   completion_queue queue;
+
+   afd_worker_pool pool(queue, 2, [](void *)
+   {
+      throw std::runtime_error("failed");
+   });
+
+   queue.post(&queue);
+
+   EXPECT_THROW(pool.stop(), std::runtime_error);
+
+   EXPECT_NO_THROW(pool.stop());
+}
+
+// Waits until every poll that has been issued has been dispatched, which, once
+// the handlers stop re-arming, means that nothing more will be posted.
+
+static bool wait_until_idle(
+   const afd_shard_set &shards)
+{
+   const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+   while (std::chrono::steady_clock::now() < deadline)
+   {
+      const afd_poll_set::statistics stats = shards.stats();
+
+      if (stats.submissions == stats.completions)
+      {
+         return true;
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+
+   return false;
+}
+
+TEST(AFDShardSet, TestConcurrentDispatchOfAShardIsSerialised)
+{
+   completion_queue queue;
+
+   queued_shard_devices devices(queue, RECEIVE);
+
+   afd_shard_set shards(4, std::ref(devices));
+
+   std::atomic<int> inside[4] = {};
+
+   std::atomic<uint32_t> dispatched(0);
+
+   std::atomic<uint32_t> overlapped(0);
+
+   std::atomic<bool> stopping(false);
+
+   afd_worker_pool pool(queue, 4, [&](void *pContext)
+   {
+      const auto &completion = *static_cast<queued_afd_poll_device::completion *>(pContext);
+
+      shards.dispatch(completion.shard, completion.buffer, [&](uint32_t, uint32_t, int32_t) -> uint32_t
+      {
+         if (++inside[completion.shard] != 1)
+         {
+            ++overlapped;
+         }
+
+         --inside[completion.shard];
+
+         ++dispatched;
+
+         return stopping ? 0 : RECEIVE;
+      });
+   });
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 16; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x100 + i);
+
+      slots.push_back(slot);
+   }
+
+   EXPECT_EQ(4u, shards.shards());
+
+   // each shard keeps completing whilst its sockets re-arm...
+
+   for (const uint32_t slot : slots)
+   {
+      shards.poll(slot, RECEIVE);
+   }
+
+   const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+   while (dispatched < 10000 && std::chrono::steady_clock::now() < deadline)
+   {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+
+   stopping = true;
+
+   EXPECT_TRUE(wait_until_idle(shards));
+
+   EXPECT_NO_THROW(pool.stop());
+
+   EXPECT_GE(dispatched, 10000u);
+   EXPECT_EQ(0u, overlapped);
+}
+
+TEST(AFDShardSet, TestBusyShardDoesNotStallOtherShards)
+{
+   completion_queue queue;
+
+   queued_shard_devices devices(queue, RECEIVE);
+
+   afd_shard_set shards(1, std::ref(devices));
+
+   const uint32_t busy_slot = shards.allocate_slot();
+   const uint32_t other_slot = shards.allocate_slot();
+
+   shards.associate(busy_slot, 0x100);
+   shards.associate(other_slot, 0x200);
+
+   EXPECT_EQ(2u, shards.shards());
+
+   std::mutex lock;
+
+   std::condition_variable progress;
+
+   uint32_t other_dispatched = 0;
+
+   bool busy_unblocked = false;
+
+   std::atomic<bool> stopping(false);
+
+   afd_worker_pool pool(queue, 2, [&](void *pContext)
+   {
+      const auto &completion = *static_cast<queued_afd_poll_device::completion *>(pContext);
+
+      shards.dispatch(completion.shard, completion.buffer, [&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+      {
+         std::unique_lock<std::mutex> guard(lock);
+
+         if (slot == busy_slot)
+         {
+            // the busy shard holds on to its thread until the other shard has
+            // been dispatched many times on the other thread
+
+            busy_unblocked = progress.wait_for(guard, std::chrono::seconds(10), [&]() { return other_dispatched >= 100; });
+
+            stopping = true;
+
+            return 0;
+         }
+
+         ++other_dispatched;
+
+         progress.notify_all();
+
+         return stopping ? 0 : RECEIVE;
+      });
+   });
+
+   shards.poll(busy_slot, RECEIVE);
+   shards.poll(other_slot, RECEIVE);
+
+   const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+   while (!stopping && std::chrono::steady_clock::now() < deadline)
+   {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+
+   EXPECT_TRUE(wait_until_idle(shards));
+
+   EXPECT_NO_THROW(pool.stop());
+
+   EXPECT_TRUE(busy_unblocked);
+}
+
+TEST(AFDShardSet, TestPollOfAnotherShardDuringConcurrentDispatch)
+{
+   completion_queue queue;
+
+   queued_shard_devices devices(queue, RECEIVE);
+
+   afd_shard_set shards(2, std::ref(devices));
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 8; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x100 + i);
+
+      slots.push_back(slot);
+   }
+
+   EXPECT_EQ(4u, shards.shards());
+
+   std::atomic<uint32_t> dispatched(0);
+
+   std::atomic<bool> stopping(false);
+
+   // every socket that is dispatched also re-arms a socket that is probably in
+   // another shard, which may be being dispatched on another thread
+
+   afd_worker_pool pool(queue, 4, [&](void *pContext)
+   {
+      const auto &completion = *static_cast<queued_afd_poll_device::completion *>(pContext);
+
+      shards.dispatch(completion.shard, completion.buffer, [&](const uint32_t slot, uint32_t, int32_t) -> uint32_t
+      {
+         const uint32_t count = ++dispatched;
+
+         if (stopping)
+         {
+            return 0;
+         }
+
+         shards.poll(slots[(slot + count) % slots.size()], RECEIVE);
+
+         return RECEIVE;
+      });
+   });
+
+   for (const uint32_t slot : slots)
+   {
+      shards.poll(slot, RECEIVE);
+   }
+
+   const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+   while (dispatched < 10000 && std::chrono::steady_clock::now() < deadline)
+   {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+
+   stopping = true;
+
+   EXPECT_TRUE(wait_until_idle(shards));
+
+   EXPECT_NO_THROW(pool.stop());
+
+   EXPECT_GE(dispatched, 10000u);
+}
+
+TEST(TimerWheel, TestConstruct)
+{
+   timer_wheel wheel(100);
+
+   EXPECT_EQ(100u, wheel.now());
+   EXPECT_EQ(0u, wheel.size());
+   EXPECT_EQ(timer_wheel::no_deadline, wheel.next_expiry());
+}
+
+TEST(TimerWheel, TestTimerExpiresAtDeadline)
+{
+   timer_wheel wheel;
+
+   const timer_wheel::timer_id id = wheel.arm(10, 42);
+
+   EXPECT_NE(timer_wheel::no_timer, id);
+   EXPECT_TRUE(wheel.armed(id));
+   EXPECT_EQ(1u, wheel.size());
+   EXPECT_EQ(10u, wheel.next_expiry());
+
+   std::vector<uintptr_t> expired;
+
+   const auto handler = [&](timer_wheel::timer_id, const uintptr_t context)
+   {
+      expired.push_back(context);
+   };
+
+   EXPECT_EQ(0u, wheel.advance(9, handler));
+
+   EXPECT_EQ(1u, wheel.advance(10, handler));
+
+   EXPECT_EQ(std::vector<uintptr_t>{ 42 }, expired);
+   EXPECT_FALSE(wheel.armed(id));
+   EXPECT_EQ(0u, wheel.size());
+   EXPECT_EQ(timer_wheel::no_deadline, wheel.next_expiry());
+}
+
+TEST(TimerWheel, TestDeadlineInThePastExpiresOnNextAdvance)
+{
+   timer_wheel wheel(1000);
+
+   wheel.arm(10, 1);
+
+   EXPECT_EQ(1000u, wheel.next_expiry());
+
+   EXPECT_EQ(1u, wheel.advance(1000, [](timer_wheel::timer_id, uintptr_t) {}));
+}
+
+TEST(TimerWheel, TestCancel)
+{
+   timer_wheel wheel;
+
+   const timer_wheel::timer_id id1 = wheel.arm(10, 1);
+   const timer_wheel::timer_id id2 = wheel.arm(10, 2);
+
+   EXPECT_TRUE(wheel.cancel(id1));
+   EXPECT_FALSE(wheel.cancel(id1));
+   EXPECT_FALSE(wheel.cancel(timer_wheel::no_timer));
+
+   std::vector<uintptr_t> expired;
+
+   wheel.advance(100, [&](timer_wheel::timer_id, const uintptr_t context)
+   {
+      expired.push_back(context);
+   });
+
+   EXPECT_EQ(std::vector<uintptr_t>{ 2 }, expired);
+
+   EXPECT_FALSE(wheel.cancel(id2));
+}
+
+TEST(TimerWheel, TestIdsAreNotReused)
+{
+   timer_wheel wheel;
+
+   const timer_wheel::timer_id id1 = wheel.arm(10, 1);
+
+   wheel.cancel(id1);
+
+   const timer_wheel::timer_id id2 = wheel.arm(10, 2);
+
+   // the storage is reused, the id isn't
+
+   EXPECT_EQ(1u, wheel.capacity());
+   EXPECT_NE(id1, id2);
+   EXPECT_FALSE(wheel.cancel(id1));
+   EXPECT_TRUE(wheel.armed(id2));
+}
+
+TEST(TimerWheel, TestTimersExpireInDeadlineOrder)
+{
+   timer_wheel wheel;
+
+   wheel.arm(70000, 4);
+   wheel.arm(300, 2);
+   wheel.arm(5, 1);
+   wheel.arm(300, 3);
+   wheel.arm(uint64_t{ 1 } << 40, 5);
+
+   std::vector<uintptr_t> expired;
+
+   wheel.advance(uint64_t{ 1 } << 41, [&](timer_wheel::timer_id, const uintptr_t context)
+   {
+      expired.push_back(context);
+   });
+
+   EXPECT_EQ((std::vector<uintptr_t>{ 1, 2, 3, 4, 5 }), expired);
+}
+
+TEST(TimerWheel, TestNextExpiryIsNeverAfterTheNextDeadline)
+{
+   timer_wheel wheel(12345);
+
+   wheel.arm(12345 + 100000, 1);
+
+   uint64_t now = wheel.now();
+
+   uint32_t wakeups = 0;
+
+   size_t expired = 0;
+
+   while (!expired)
+   {
+      const uint64_t next = wheel.next_expiry();
+
+      EXPECT_LE(next, 12345u + 100000u);
+      EXPECT_GE(next, now);
+
+      now = next;
+
+      expired = wheel.advance(now, [](timer_wheel::timer_id, uintptr_t) {});
+
+      ++wakeups;
+   }
+
+   EXPECT_EQ(12345u + 100000u, now);
+
+   // one wakeup per level that the timer cascades through, not one per tick
+
+   EXPECT_LE(wakeups, 5u);
+}
+
+TEST(TimerWheel, TestHandlerCanArmAndCancel)
+{
+   timer_wheel wheel;
+
+   const timer_wheel::timer_id cancelled = wheel.arm(10, 2);
+
+   wheel.arm(10, 1);
+
+   std::vector<uintptr_t> expired;
+
+   // a timer that is armed for now, from within the handler, expires in the
+   // same call
+
+   wheel.arm(5, 0);
+
+   wheel.advance(20, [&](timer_wheel::timer_id, const uintptr_t context)
+   {
+      expired.push_back(context);
+
+      if (context == 0)
+      {
+         wheel.cancel(cancelled);
+      }
+      else if (context == 1)
+      {
+         wheel.arm(15, 3);
+      }
+   });
+
+   EXPECT_EQ((std::vector<uintptr_t>{ 0, 1, 3 }), expired);
+}
+
+TEST(TimerWheel, TestMatchesReference)
+{
+   // random arms, cancels and advances, checked against an ordered map of
+   // deadlines
+
+   std::mt19937_64 random(1);
+
+   timer_wheel wheel(1000);
+
+   std::multimap<uint64_t, timer_wheel::timer_id> reference;
+
+   std::vector<timer_wheel::timer_id> ids;
+
+   uint64_t now = 1000;
+
+   for (uint32_t round = 0; round < 2000; ++round)
+   {
+      for (uint32_t i = 0; i < 20; ++i)
+      {
+         const uint64_t range = uint64_t{ 1 } << (random() % 34 == 33 ? 33 : random() % 24);
+
+         const uint64_t deadline = now + (random() % range);
+
+         const timer_wheel::timer_id id = wheel.arm(deadline, static_cast<uintptr_t>(deadline));
+
+         reference.emplace(deadline, id);
+
+         ids.push_back(id);
+      }
+
+      for (uint32_t i = 0; i < 5; ++i)
+      {
+         const timer_wheel::timer_id id = ids[random() % ids.size()];
+
+         bool found = false;
+
+         for (auto it = reference.begin(); it != reference.end(); ++it)
+         {
+            if (it->second == id)
+            {
+               reference.erase(it);
+
+               found = true;
+
+               break;
+            }
+         }
+
+         EXPECT_EQ(found, wheel.cancel(id));
+      }
+
+      const uint64_t next = wheel.next_expiry();
+
+      if (!reference.empty())
+      {
+         EXPECT_LE(next, reference.begin()->first);
+      }
+
+      now += (random() % 4 == 0) ? next - now : random() % 5000;
+
+      wheel.advance(now, [&](const timer_wheel::timer_id id, const uintptr_t context)
+      {
+         ASSERT_FALSE(reference.empty());
+
+         EXPECT_EQ(reference.begin()->first, context);
+         EXPECT_LE(context, now);
+
+         // timers with the same deadline may be in any order if one of them
+         // was cascaded
+
+         bool found = false;
+
+         for (auto it = reference.lower_bound(context); it != reference.end() && it->first == context; ++it)
+         {
+            if (it->second == id)
+            {
+               reference.erase(it);
+
+               found = true;
+
+               break;
+            }
+         }
+
+         EXPECT_TRUE(found);
+      });
+
+      if (!reference.empty())
+      {
+         EXPECT_GT(reference.begin()->first, now);
+      }
+
+      EXPECT_EQ(reference.size(), wheel.size());
+   }
+}
+
+TEST(AFDPollTimers, TestPollHasNoTimeoutWithoutTimers)
+{
+   afd_poll_set poll_set(1);
+
+   afd_poll_timers timers(poll_set, 1000);
+
+   poll_set.associate(0, 0x100);
+   poll_set.set_events(0, RECEIVE);
+
+   timers.prepare_submission(1000);
+
+   EXPECT_EQ(1u, poll_set.build_submission());
+   EXPECT_EQ(afd_poll_set::no_timeout, poll_set.poll_info_in().timeout);
+   EXPECT_EQ(afd_poll_timers::infinite, timers.wait_timeout(1000));
+}
+
+TEST(AFDPollTimers, TestPollTimesOutAtNextDeadline)
+{
+   afd_poll_set poll_set(1);
+
+   afd_poll_timers timers(poll_set, 1000);
+
+   poll_set.associate(0, 0x100);
+   poll_set.set_events(0, RECEIVE);
+
+   timers.set_timer(1000, 500, 1);
+   timers.set_timer(1000, 50, 2);
+
+   timers.prepare_submission(1010);
+
+   EXPECT_EQ(1u, poll_set.build_submission());
+
+   // relative, in 100ns units
+
+   EXPECT_EQ(-400000, poll_set.poll_info_in().timeout);
+   EXPECT_EQ(40u, timers.wait_timeout(1010));
+   EXPECT_EQ(0u, timers.wait_timeout(2000));
+}
+
+TEST(AFDPollTimers, TestEarlierTimerRequiresNewPoll)
+{
+   afd_poll_set poll_set(1);
+
+   afd_poll_timers timers(poll_set, 1000);
+
+   fake_afd_poll_device device;
+
+   poll_set.associate(0, 0x100);
+   poll_set.set_events(0, RECEIVE);
+
+   timers.set_timer(1000, 100, 1);
+
+   timers.prepare_submission(1000);
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   EXPECT_FALSE(poll_set.needs_submission());
+
+   // the pending poll wakes us in time for this one
+
+   timers.set_timer(1000, 200, 2);
+
+   EXPECT_FALSE(poll_set.needs_submission());
+
+   // but not for this one
+
+   timers.set_timer(1000, 50, 3);
+
+   EXPECT_TRUE(poll_set.needs_submission());
+
+   timers.prepare_submission(1000);
+
+   // the pending poll is cancelled, the poll that replaces it has the new
+   // timeout
+
+   EXPECT_EQ(0u, poll_set.build_submission());
+   EXPECT_EQ(0u, poll_set.cancel_buffer());
+
+   device.complete({});
+
+   poll_set.dispatch([](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      return RECEIVE;
+   });
+
+   timers.prepare_submission(1000);
+
+   EXPECT_EQ(1u, poll_set.build_submission());
+   EXPECT_EQ(-500000, poll_set.poll_info_in().timeout);
+}
+
+TEST(AFDPollTimers, TestTimedOutPollExpiresTimers)
+{
+   afd_poll_set poll_set(1);
+
+   afd_poll_timers timers(poll_set, 1000);
+
+   fake_afd_poll_device device;
+
+   poll_set.associate(0, 0x100);
+   poll_set.set_events(0, RECEIVE);
+
+   const afd_poll_timers::timer_id id = timers.set_timer(1000, 100, 42);
+
+   timers.set_timer(1000, 300, 43);
+
+   timers.prepare_submission(1000);
+
+   poll_set.build_submission();
+
+   device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr);
+
+   // AFD completes the poll with no handles when it times out
+
+   device.complete({});
+
+   EXPECT_EQ(0u, poll_set.dispatch([](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      return RECEIVE;
+   }));
+
+   std::vector<uintptr_t> expired;
+
+   EXPECT_EQ(1u, timers.expire(1100, [&](const afd_poll_timers::timer_id expired_id, const uintptr_t context)
+   {
+      EXPECT_EQ(id, expired_id);
+
+      expired.push_back(context);
+   }));
+
+   EXPECT_EQ(std::vector<uintptr_t>{ 42 }, expired);
+   EXPECT_EQ(1u, timers.timers());
+
+   // and the next poll waits for the next timer, or for the wheel to cascade
+   // it, which may be a little sooner
+
+   EXPECT_TRUE(poll_set.needs_submission());
+
+   timers.prepare_submission(1100);
+
+   poll_set.build_submission();
+
+   EXPECT_LE(-2000000, poll_set.poll_info_in().timeout);
+   EXPECT_GT(0, poll_set.poll_info_in().timeout);
+}
+
+TEST(AFDPollTimers, TestCancelledTimerDoesNotExpire)
+{
+   afd_poll_set poll_set(1);
+
+   afd_poll_timers timers(poll_set, 0);
+
+   const afd_poll_timers::timer_id id = timers.set_timer(0, 10, 1);
+
+   EXPECT_TRUE(timers.cancel_timer(id));
+   EXPECT_FALSE(timers.cancel_timer(id));
+
+   EXPECT_EQ(0u, timers.expire(100, [](afd_poll_timers::timer_id, uintptr_t) {}));
+   EXPECT_EQ(afd_poll_timers::infinite, timers.wait_timeout(100));
+}
+
+// The simulator is checked against what the tests in understand.cpp show AFD
+// doing, the constants are the AFD_POLL values
+
+static constexpr uint32_t DISCONNECT = 0x0008;
+static constexpr uint32_t LOCAL_CLOSE = 0x0020;
+static constexpr uint32_t CONNECT = 0x0040;
+static constexpr uint32_t CONNECT_FAIL = 0x0100;
+
+struct simulated_poll
+{
+   explicit simulated_poll(
+      const uintptr_t handle,
+      const uint32_t events,
+      const uint32_t exclusive = 0)
+      :  in{ afd_poll_set::no_timeout, 1, exclusive, { { handle, events, 0 } } },
+         out{}
+   {
+   }
+
+   bool poll(
+      afd_simulator::device &device,
+      const uint32_t buffer = 0)
+   {
+      return device.poll(buffer, in, sizeof in, out, sizeof out, this);
+   }
+
+   afd_poll_info in;
+
+   afd_poll_info out;
+};
+
+TEST(AFDSimulator, TestPollIsLevelTriggered)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   const uintptr_t s = simulator.create_socket();
+
+   simulated_poll data(s, RECEIVE | SEND | CONNECT);
+
+   EXPECT_FALSE(data.poll(device));
+
+   EXPECT_EQ(0u, simulator.queued());
+
+   simulator.set_events(s, CONNECT | SEND);
+
+   afd_simulator::completion result{};
+
+   ASSERT_TRUE(simulator.get(result, 0));
+
+   EXPECT_EQ(&data, result.pContext);
+   EXPECT_EQ(afd_simulator::status_success, result.status);
+   EXPECT_EQ(32u, result.information);
+   EXPECT_EQ(1u, data.out.number_of_handles);
+   EXPECT_EQ(CONNECT | SEND, data.out.handles[0].events);
+
+   // nothing has changed, the socket is still writable and still connected,
+   // so each poll completes straight away and still queues a completion
+
+   for (int i = 0; i < 2; ++i)
+   {
+      data.out = afd_poll_info{};
+
+      EXPECT_TRUE(data.poll(device));
+
+      ASSERT_TRUE(simulator.get(result, 0));
+
+      EXPECT_EQ(&data, result.pContext);
+      EXPECT_EQ(CONNECT | SEND, data.out.handles[0].events);
+   }
+
+   EXPECT_FALSE(simulator.get(result, 0));
+
+   EXPECT_EQ(3u, simulator.stats().polls);
+   EXPECT_EQ(2u, simulator.stats().completed_immediately);
+}
+
+TEST(AFDSimulator, TestPollCompletionReportsStateAtTimeOfCompletion)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   const uintptr_t s = simulator.create_socket();
+
+   simulated_poll data(s, RECEIVE | DISCONNECT);
+
+   EXPECT_FALSE(data.poll(device));
+
+   simulator.set_events(s, CONNECT | SEND);
+
+   EXPECT_EQ(0u, simulator.queued());
+
+   simulator.set_events(s, RECEIVE);
+
+   // the remote end closes after the poll has completed but before the
+   // completion is retrieved, the results don't change
+
+   simulator.set_events(s, DISCONNECT);
+
+   void *pContext = nullptr;
+
+   ASSERT_TRUE(simulator.get(pContext, 0));
+
+   EXPECT_EQ(&data, pContext);
+   EXPECT_EQ(RECEIVE, data.out.handles[0].events);
+
+   EXPECT_TRUE(data.poll(device));
+
+   ASSERT_TRUE(simulator.get(pContext, 0));
+
+   EXPECT_EQ(RECEIVE | DISCONNECT, data.out.handles[0].events);
+}
+
+TEST(AFDSimulator, TestSkipCompletionPortOnSuccess)
+{
+   afd_simulator simulator(true);
+
+   afd_simulator::device &device = simulator.create_device();
+
+   const uintptr_t s = simulator.create_socket();
+
+   simulated_poll data(s, SEND);
+
+   EXPECT_FALSE(data.poll(device));
+
+   simulator.set_events(s, CONNECT | SEND);
+
+   void *pContext = nullptr;
+
+   ASSERT_TRUE(simulator.get(pContext, 0));
+
+   EXPECT_EQ(&data, pContext);
+
+   // the results are available straight away and nothing is queued
+
+   data.out = afd_poll_info{};
+
+   EXPECT_TRUE(data.poll(device));
+
+   EXPECT_EQ(SEND, data.out.handles[0].events);
+
+   EXPECT_FALSE(simulator.get(pContext, 0));
+}
+
+TEST(AFDSimulator, TestPollTwiceSameDataGivesTwoCompletions)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   const uintptr_t s = simulator.create_socket();
+
+   simulated_poll data(s, RECEIVE | CONNECT_FAIL);
+
+   EXPECT_FALSE(data.poll(device, 0));
+   EXPECT_FALSE(data.poll(device, 1));
+
+   EXPECT_THROW(data.poll(device, 1), std::exception);
+
+   EXPECT_EQ(2u, simulator.pending_polls());
+
+   device.cancel(0);
+   device.cancel(1);
+
+   for (int i = 0; i < 2; ++i)
+   {
+      afd_simulator::completion result{};
+
+      ASSERT_TRUE(simulator.get(result, 0));
+
+      EXPECT_EQ(&data, result.pContext);
+      EXPECT_EQ(afd_simulator::status_cancelled, result.status);
+      EXPECT_EQ(16u, result.information);
+      EXPECT_EQ(0u, data.out.number_of_handles);
+   }
+
+   void *pContext = nullptr;
+
+   EXPECT_FALSE(simulator.get(pContext, 0));
+
+   // cancelling a poll that has completed does nothing
+
+   device.cancel(0);
+
+   EXPECT_FALSE(simulator.get(pContext, 0));
+
+   EXPECT_EQ(2u, simulator.stats().cancelled);
+}
+
+TEST(AFDSimulator, TestNonExclusivePollsBothReportEvents)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   const uintptr_t s = simulator.create_socket();
+
+   simulated_poll data1(s, RECEIVE);
+   simulated_poll data2(s, RECEIVE);
+
+   EXPECT_FALSE(data1.poll(device, 0));
+   EXPECT_FALSE(data2.poll(device, 1));
+
+   simulator.set_events(s, RECEIVE);
+
+   void *pContext = nullptr;
+
+   ASSERT_TRUE(simulator.get(pContext, 0));
+   EXPECT_EQ(&data1, pContext);
+
+   ASSERT_TRUE(simulator.get(pContext, 0));
+   EXPECT_EQ(&data2, pContext);
+
+   EXPECT_EQ(RECEIVE, data1.out.handles[0].events);
+   EXPECT_EQ(RECEIVE, data2.out.handles[0].events);
+}
+
+TEST(AFDSimulator, TestExclusivePollCompletesEarlierExclusivePoll)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   const uintptr_t s = simulator.create_socket();
+
+   simulated_poll data1(s, RECEIVE, 1);
+   simulated_poll data2(s, RECEIVE, 1);
+
+   EXPECT_FALSE(data1.poll(device, 0));
+
+   EXPECT_FALSE(data2.poll(device, 1));
+
+   // the first poll completes successfully, with nothing, and the second
+   // stays pending
+
+   afd_simulator::completion result{};
+
+   ASSERT_TRUE(simulator.get(result, 0));
+
+   EXPECT_EQ(&data1, result.pContext);
+   EXPECT_EQ(afd_simulator::status_success, result.status);
+   EXPECT_EQ(16u, result.information);
+
+   EXPECT_FALSE(device.pending_on(0));
+   EXPECT_TRUE(device.pending_on(1));
+
+   simulator.set_events(s, RECEIVE);
+
+   ASSERT_TRUE(simulator.get(result, 0));
+
+   EXPECT_EQ(&data2, result.pContext);
+   EXPECT_EQ(RECEIVE, data2.out.handles[0].events);
+
+   EXPECT_EQ(1u, simulator.stats().exclusive_replaced);
+}
+
+TEST(AFDSimulator, TestPollOnlyReportsHandlesWithEvents)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   afd_poll_set poll_set(3);
+
+   std::vector<uintptr_t> handles;
+
+   for (uint32_t slot = 0; slot < 3; ++slot)
+   {
+      handles.push_back(simulator.create_socket());
+
+      poll_set.associate(slot, handles.back());
+      poll_set.set_events(slot, RECEIVE);
+   }
+
+   simulator.set_events(handles[2], RECEIVE | SEND);
+
+   ASSERT_EQ(3u, poll_set.build_submission());
+
+   EXPECT_TRUE(device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr));
+
+   void *pContext = nullptr;
+
+   ASSERT_TRUE(simulator.get(pContext, 0));
+
+   std::vector<uint32_t> slots;
+
+   EXPECT_EQ(1u, poll_set.dispatch([&](const uint32_t slot, const uint32_t events, int32_t) -> uint32_t
+   {
+      slots.push_back(slot);
+
+      EXPECT_EQ(RECEIVE, events);
+
+      return RECEIVE;
+   }));
+
+   EXPECT_EQ(std::vector<uint32_t>{ 2 }, slots);
+}
+
+TEST(AFDSimulator, TestConnectFailReportsStatus)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   const uintptr_t s = simulator.create_socket();
+
+   simulated_poll data(s, SEND | CONNECT_FAIL);
+
+   EXPECT_FALSE(data.poll(device));
+
+   simulator.set_events(s, CONNECT_FAIL, afd_simulator::status_connection_refused);
+
+   void *pContext = nullptr;
+
+   ASSERT_TRUE(simulator.get(pContext, 0));
+
+   EXPECT_EQ(CONNECT_FAIL, data.out.handles[0].events);
+   EXPECT_EQ(afd_simulator::status_connection_refused, data.out.handles[0].status);
+}
+
+TEST(AFDSimulator, TestLocalClose)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   const uintptr_t s = simulator.create_socket();
+
+   simulated_poll data1(s, RECEIVE | LOCAL_CLOSE);
+   simulated_poll data2(s, RECEIVE);
+
+   EXPECT_FALSE(data1.poll(device, 0));
+   EXPECT_FALSE(data2.poll(device, 1));
+
+   simulator.close_socket(s);
+
+   void *pContext = nullptr;
+
+   ASSERT_TRUE(simulator.get(pContext, 0));
+
+   EXPECT_EQ(&data1, pContext);
+   EXPECT_EQ(LOCAL_CLOSE, data1.out.handles[0].events);
+
+   // a poll that doesn't want to know stays pending
+
+   EXPECT_FALSE(simulator.get(pContext, 0));
+   EXPECT_TRUE(device.pending_on(1));
+
+   EXPECT_THROW(data1.poll(device, 0), std::exception);
+   EXPECT_THROW(simulator.set_events(s, RECEIVE), std::exception);
+}
+
+TEST(AFDSimulator, TestOutputSmallerThanInputFails)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   const uintptr_t s = simulator.create_socket();
+
+   afd_poll_set poll_set(2);
+
+   poll_set.associate(0, s);
+   poll_set.associate(1, simulator.create_socket());
+   poll_set.set_events(0, RECEIVE);
+   poll_set.set_events(1, RECEIVE);
+
+   ASSERT_EQ(2u, poll_set.build_submission());
+
+   simulated_poll data(s, RECEIVE);
+
+   EXPECT_THROW(device.poll(0, poll_set.poll_info_in(), poll_set.submission_size(), data.out, sizeof data.out, nullptr), std::exception);
+
+   // a larger output is fine
+
+   EXPECT_FALSE(device.poll(0, data.in, sizeof data.in, poll_set.poll_info_out(), poll_set.submission_size(), nullptr));
+}
+
+TEST(AFDSimulator, TestPollTimesOutInVirtualTime)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   const uintptr_t s = simulator.create_socket();
+
+   simulated_poll data(s, RECEIVE);
+
+   // relative, 5ms
+
+   data.in.timeout = -5 * static_cast<int64_t>(afd_simulator::ticks_per_ms);
+
+   EXPECT_FALSE(data.poll(device));
+
+   afd_simulator::completion result{};
+
+   EXPECT_FALSE(simulator.get(result, 2));
+
+   EXPECT_EQ(2 * afd_simulator::ticks_per_ms, simulator.now());
+
+   ASSERT_TRUE(simulator.get(result, afd_simulator::infinite));
+
+   EXPECT_EQ(5 * afd_simulator::ticks_per_ms, simulator.now());
+
+   EXPECT_EQ(&data, result.pContext);
+   EXPECT_EQ(afd_simulator::status_timeout, result.status);
+   EXPECT_EQ(0u, data.out.number_of_handles);
+
+   // a poll that completes before its timeout doesn't time out later
+
+   EXPECT_FALSE(data.poll(device));
+
+   simulator.set_events(s, RECEIVE);
+
+   ASSERT_TRUE(simulator.get(result, 0));
+
+   EXPECT_EQ(afd_simulator::status_success, result.status);
+
+   EXPECT_FALSE(simulator.get(result, afd_simulator::infinite));
+
+   EXPECT_EQ(1u, simulator.stats().timed_out);
+}
+
+TEST(AFDSimulator, TestScheduledChangesHappenInOrder)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   const uintptr_t s1 = simulator.create_socket();
+   const uintptr_t s2 = simulator.create_socket();
+
+   simulator.schedule(300, s2, RECEIVE, 0);
+   simulator.schedule(100, s1, RECEIVE, 0);
+   simulator.schedule(200, s1, 0, RECEIVE);
+
+   EXPECT_EQ(100u, simulator.next_event_time());
+
+   simulated_poll data1(s1, RECEIVE);
+   simulated_poll data2(s2, RECEIVE);
+
+   EXPECT_FALSE(data1.poll(device, 0));
+   EXPECT_FALSE(data2.poll(device, 1));
+
+   afd_simulator::completion result{};
+
+   ASSERT_TRUE(simulator.get(result, afd_simulator::infinite));
+
+   EXPECT_EQ(&data1, result.pContext);
+   EXPECT_EQ(100u, simulator.now());
+
+   simulator.advance(150);
+
+   EXPECT_EQ(250u, simulator.now());
+   EXPECT_EQ(0u, simulator.get_events(s1));
+
+   ASSERT_TRUE(simulator.get(result, afd_simulator::infinite));
+
+   EXPECT_EQ(&data2, result.pContext);
+   EXPECT_EQ(300u, simulator.now());
+
+   EXPECT_EQ(UINT64_MAX, simulator.next_event_time());
+
+   EXPECT_FALSE(simulator.get(result, afd_simulator::infinite));
+}
+
+TEST(AFDSimulator, TestPostIsReturnedInOrder)
+{
+   afd_simulator simulator;
+
+   int one = 1;
+   int two = 2;
+
+   simulator.post(&one);
+   simulator.post(&two);
+
+   void *pContext = nullptr;
+
+   ASSERT_TRUE(simulator.get(pContext, afd_simulator::infinite));
+   EXPECT_EQ(&one, pContext);
+
+   ASSERT_TRUE(simulator.get(pContext, afd_simulator::infinite));
+   EXPECT_EQ(&two, pContext);
+}
+
+TEST(AFDSimulator, TestFuzzedShardSetReportsEveryReadySocket)
+{
+   // random state and interest changes, driving an afd_shard_set through the
+   // simulator; every report must be for the state that the socket is in and
+   // once the completions are drained no socket may be left with events that
+   // it's interested in and that haven't been reported
+
+   afd_simulator simulator;
+
+   struct shard_buffer
+   {
+      uint32_t shard;
+
+      uint32_t buffer;
+   };
+
+   std::deque<shard_buffer> contexts;
+
+   afd_shard_set shards(16, [&](const uint32_t shard)
+   {
+      contexts.push_back(shard_buffer{ shard, 0 });
+
+      return afd_shard_binding{ simulator.create_device(), { &contexts.back() } };
+   });
+
+   constexpr uint32_t num_sockets = 64;
+
+   std::vector<uintptr_t> handles;
+
+   std::vector<uint32_t> interest(num_sockets, RECEIVE);
+
+   for (uint32_t i = 0; i < num_sockets; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      ASSERT_EQ(i, slot);
+
+      handles.push_back(simulator.create_socket());
+
+      shards.associate(slot, handles.back());
+
+      shards.poll(slot, RECEIVE);
+   }
+
+   std::mt19937 rng(42);
+
+   uint64_t reported = 0;
+
+   const auto handler = [&](const uint32_t slot, const uint32_t events, int32_t) -> uint32_t
+   {
+      EXPECT_EQ(events, events & interest[slot] & simulator.get_events(handles[slot]));
+
+      // read or write until it would block
+
+      simulator.clear_events(handles[slot], events);
+
+      ++reported;
+
+      return interest[slot];
+   };
+
+   const auto drain = [&](const uint32_t timeout_ms)
+   {
+      afd_simulator::completion result{};
+
+      while (simulator.get(result, timeout_ms))
+      {
+         const shard_buffer &context = *static_cast<shard_buffer *>(result.pContext);
+
+         shards.dispatch(context.shard, context.buffer, handler);
+      }
+   };
+
+   const auto check = [&]()
+   {
+      for (uint32_t slot = 0; slot < num_sockets; ++slot)
+      {
+         EXPECT_EQ(0u, simulator.get_events(handles[slot]) & interest[slot]) << "slot " << slot;
+      }
+   };
+
+   for (uint32_t i = 0; i < 20000; ++i)
+   {
+      const uint32_t slot = rng() % num_sockets;
+
+      switch (rng() % 4)
+      {
+         case 0 :
+
+            simulator.set_events(handles[slot], RECEIVE);
+
+         break;
+
+         case 1 :
+
+            simulator.set_events(handles[slot], SEND);
+
+         break;
+
+         case 2 :
+
+            simulator.schedule(simulator.now() + (rng() % 1000), handles[slot], RECEIVE, 0);
+
+         break;
+
+         case 3 :
+
+            interest[slot] ^= SEND;
+
+            shards.poll(slot, interest[slot]);
+
+         break;
+      }
+
+      simulator.advance(rng() % 10);
+
+      drain(0);
+
+      check();
+   }
+
+   drain(afd_simulator::infinite);
+
+   check();
+
+   EXPECT_LT(0u, reported);
+   EXPECT_EQ(0u, simulator.queued());
+   EXPECT_GE(shards.shards() * afd_poll_set::poll_buffers, simulator.pending_polls());
+}
+
+class counting_reactor_events : public reactor_events
+{
+   public :
+
+      uint32_t handle_events(
+         uint32_t,
+         int32_t) override
+      {
+         return 0;
+      }
+
+      void timer_expired() override
+      {
+         ++expired;
+      }
+
+      uint32_t expired = 0;
+};
+
+static uint64_t simulated_ms(
+   const afd_simulator &simulator)
+{
+   return simulator.now() / afd_simulator::ticks_per_ms;
+}
+
+static size_t expire_afd_timers(
+   afd_poll_timers &timers,
+   const uint64_t now)
+{
+   return timers.expire(now, [](const afd_poll_timers::timer_id id, const uintptr_t context)
+   {
+      reinterpret_cast<afd_timer_events *>(context)->on_timer(id);
+   });
+}
+
+TEST(AFDReactorTimers, TestTimerExpiresWhenThePollTimesOut)
+{
+   afd_simulator simulator;
+
+   afd_simulator::device &device = simulator.create_device();
+
+   afd_poll_set poll_set(2);
+
+   afd_poll_timers timers(poll_set, simulated_ms(simulator));
+
+   afd_reactor_timers slot_timers(timers);
+
+   counting_reactor_events events;
+
+   // a socket that never becomes readable, so only the timer ends the poll
+
+   poll_set.associate(0, simulator.create_socket());
+   poll_set.set_events(0, RECEIVE);
+
+   slot_timers.set_timer(simulated_ms(simulator), 0, 50, events);
+
+   EXPECT_TRUE(slot_timers.armed(0));
+
+   timers.prepare_submission(simulated_ms(simulator));
+
+   ASSERT_EQ(1u, poll_set.build_submission());
+
+   EXPECT_FALSE(device.poll(poll_set.submission_buffer(), poll_set.poll_info_in(), poll_set.submission_size(), poll_set.poll_info_out(), poll_set.submission_size(), nullptr));
+
+   afd_simulator::completion result{};
+
+   ASSERT_TRUE(simulator.get(result, afd_simulator::infinite));
+
+   EXPECT_EQ(afd_simulator::status_timeout, result.status);
+   EXPECT_EQ(50u, simulated_ms(simulator));
+
+   EXPECT_EQ(0u, poll_set.dispatch([](uint32_t, uint32_t, int32_t) -> uint32_t
+   {
+      ADD_FAILURE() << "unexpected dispatch";
+
+      return 0;
+   }));
+
+   EXPECT_EQ(1u, expire_afd_timers(timers, simulated_ms(simulator)));
+
+   EXPECT_EQ(1u, events.expired);
+   EXPECT_FALSE(slot_timers.armed(0));
+}
+
+TEST(AFDReactorTimers, TestSettingTheTimerAgainReplacesIt)
+{
+   afd_poll_set poll_set(2);
+
+   afd_poll_timers timers(poll_set, 1000);
+
+   afd_reactor_timers slot_timers(timers);
+
+   counting_reactor_events events;
+
+   slot_timers.set_timer(1000, 1, 50, events);
+   slot_timers.set_timer(1000, 1, 100, events);
+
+   EXPECT_EQ(1u, timers.timers());
+
+   EXPECT_EQ(0u, expire_afd_timers(timers, 1050));
+   EXPECT_EQ(0u, events.expired);
+
+   EXPECT_EQ(1u, expire_afd_timers(timers, 1100));
+   EXPECT_EQ(1u, events.expired);
+}
+
+TEST(AFDReactorTimers, TestCancelledTimerDoesNotExpire)
+{
+   afd_poll_set poll_set(2);
+
+   afd_poll_timers timers(poll_set, 1000);
+
+   afd_reactor_timers slot_timers(timers);
+
+   counting_reactor_events events;
+
+   slot_timers.set_timer(1000, 0, 50, events);
+
+   slot_timers.cancel_timer(0);
+
+   // and cancelling a slot that has never had a timer does nothing
+
+   slot_timers.cancel_timer(7);
+
+   EXPECT_FALSE(slot_timers.armed(0));
+   EXPECT_EQ(0u, timers.timers());
+
+   EXPECT_EQ(0u, expire_afd_timers(timers, 2000));
+   EXPECT_EQ(0u, events.expired);
+}
+
+struct simulated_shard_buffer
+{
+   uint32_t shard;
+
+   uint32_t buffer;
+};
+
+TEST(AFDShardSet, TestTimerTimesOutItsShardsPoll)
+{
+   afd_simulator simulator;
+
+   std::deque<simulated_shard_buffer> contexts;
+
+   afd_shard_set shards(4, [&](const uint32_t shard)
+   {
+      contexts.push_back(simulated_shard_buffer{ shard, 0 });
+
+      return afd_shard_binding{ simulator.create_device(), { &contexts.back() } };
+   },
+   afd_poll_set::submission_mode::active_slots,
+   [&]() { return simulated_ms(simulator); });
+
+   // sockets that never become readable, so only a timer ends a poll
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 8; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, simulator.create_socket());
+
+      shards.poll(slot, RECEIVE);
+
+      slots.push_back(slot);
+   }
+
+   EXPECT_EQ(2u, shards.shards());
+
+   shards.set_timer(slots[5], 50);
+
+   std::vector<uint32_t> expired;
+
+   std::vector<uint32_t> timed_out;
+
+   afd_simulator::completion result{};
+
+   // the poll that the timer replaced completes, cancelled, first
+
+   while (expired.empty() && simulator.get(result, afd_simulator::infinite))
+   {
+      const simulated_shard_buffer &context = *static_cast<simulated_shard_buffer *>(result.pContext);
+
+      if (result.status == afd_simulator::status_timeout)
+      {
+         timed_out.push_back(context.shard);
+      }
+
+      shards.dispatch(context.shard, context.buffer, [](uint32_t, uint32_t, int32_t) -> uint32_t
+      {
+         ADD_FAILURE() << "unexpected dispatch";
+
+         return 0;
+      },
+      [&](const uint32_t slot)
+      {
+         expired.push_back(slot);
+      });
+   }
+
+   EXPECT_EQ(std::vector<uint32_t>{ slots[5] }, expired);
+   EXPECT_EQ(std::vector<uint32_t>{ shards.shard_of(slots[5]) }, timed_out);
+
+   EXPECT_EQ(50u, simulated_ms(simulator));
+
+   // the shard is polled again, without a timeout
+
+   EXPECT_FALSE(simulator.get(result, afd_simulator::infinite));
+}
+
+TEST(AFDShardSet, TestTimerMovesWithItsSlotWhenRebalanced)
+{
+   afd_simulator simulator;
+
+   std::deque<simulated_shard_buffer> contexts;
+
+   afd_shard_set shards(4, [&](const uint32_t shard)
+   {
+      contexts.push_back(simulated_shard_buffer{ shard, 0 });
+
+      return afd_shard_binding{ simulator.create_device(), { &contexts.back() } };
+   },
+   afd_poll_set::submission_mode::active_slots,
+   [&]() { return simulated_ms(simulator); });
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 8; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, simulator.create_socket());
+
+      shards.poll(slot, RECEIVE);
+
+      slots.push_back(slot);
+   }
+
+   // the socket in the highest slot of the first shard is the one that moves
+
+   ASSERT_EQ(0u, shards.shard_of(slots[3]));
+
+   shards.set_timer(slots[3], 50);
+
+   simulator.advance(20 * afd_simulator::ticks_per_ms);
+
+   for (uint32_t i = 5; i < 8; ++i)
+   {
+      shards.disassociate(slots[i]);
+   }
+
+   EXPECT_EQ(1u, shards.rebalance(1));
+
+   EXPECT_EQ(1u, shards.shard_of(slots[3]));
+
+   std::vector<uint32_t> expired;
+
+   std::vector<uint32_t> timed_out;
+
+   afd_simulator::completion result{};
+
+   while (simulator.get(result, afd_simulator::infinite))
+   {
+      const simulated_shard_buffer &context = *static_cast<simulated_shard_buffer *>(result.pContext);
+
+      if (result.status == afd_simulator::status_timeout)
+      {
+         timed_out.push_back(context.shard);
+      }
+
+      shards.dispatch(context.shard, context.buffer, [](uint32_t, uint32_t, int32_t) -> uint32_t
+      {
+         return RECEIVE;
+      },
+      [&](const uint32_t slot)
+      {
+         expired.push_back(slot);
+      });
+   }
+
+   // it keeps its deadline, and the shard that it left doesn't time out
+
+   EXPECT_EQ(std::vector<uint32_t>{ slots[3] }, expired);
+   EXPECT_EQ(std::vector<uint32_t>{ 1 }, timed_out);
+
+   EXPECT_EQ(50u, simulated_ms(simulator));
+}
+
+TEST(AFDShardSet, TestTimersExpireWithoutAPoll)
+{
+   fake_shard_devices devices;
+
+   uint64_t now = 1000;
+
+   afd_shard_set shards(2, std::ref(devices), afd_poll_set::submission_mode::active_slots, [&]() { return now; });
+
+   std::vector<uint32_t> slots;
+
+   for (uint32_t i = 0; i < 4; ++i)
+   {
+      const uint32_t slot = shards.allocate_slot();
+
+      shards.associate(slot, 0x100 + i);
+
+      slots.push_back(slot);
+   }
+
+   EXPECT_EQ(afd_poll_timers::infinite, shards.timer_wait_timeout());
+
+   // nothing is polled for, so there's no poll to time out
+
+   shards.set_timer(slots[0], 30);
+   shards.set_timer(slots[3], 10);
+   shards.set_timer(slots[1], 20);
+
+   shards.cancel_timer(slots[1]);
+
+   EXPECT_EQ(10u, shards.timer_wait_timeout());
+
+   std::vector<uint32_t> expired;
+
+   const auto on_timer = [&](const uint32_t slot)
+   {
+      expired.push_back(slot);
+   };
+
+   now = 1010;
+
+   EXPECT_EQ(1u, shards.expire_timers(on_timer));
+
+   EXPECT_EQ(20u, shards.timer_wait_timeout());
+
+   // and a released slot's timer is cancelled
+
+   shards.disassociate(slots[0]);
+
+   now = 1030;
+
+   EXPECT_EQ(0u, shards.expire_timers(on_timer));
+
+   EXPECT_EQ(std::vector<uint32_t>{ slots[3] }, expired);
+   EXPECT_EQ(afd_poll_timers::infinite, shards.timer_wait_timeout());
+}
+
+TEST(AFDShardSet, TestTimersNeedAClock)
+{
+   fake_shard_devices devices;
+
+   afd_shard_set shards(2, std::ref(devices));
+
+   const uint32_t slot = shards.allocate_slot();
+
+   EXPECT_THROW(shards.set_timer(slot, 10), std::exception);
+}
+
+static std::vector<uint8_t> gather_all(
+   const send_queue &queue,
+   const size_t max_buffers = SIZE_MAX)
+{
+   std::vector<uint8_t> data;
+
+   queue.gather(max_buffers, [&](const uint8_t *pData, const size_t length)
+   {
+      data.insert(data.end(), pData, pData + length);
+   });
+
+   return data;
+}
+
+static std::vector<uint8_t> test_data(
+   const size_t length,
+   const uint8_t first = 0)
+{
+   std::vector<uint8_t> data(length);
+
+   for (size_t i = 0; i < length; ++i)
+   {
+      data[i] = static_cast<uint8_t>(first + i);
+   }
+
+   return data;
+}
+
+TEST(SendQueue, TestConstruct)
+{
+   send_queue queue(1000, 100);
+
+   EXPECT_TRUE(queue.empty());
+   EXPECT_EQ(0u, queue.size());
+   EXPECT_EQ(1000u, queue.limit());
+   EXPECT_EQ(1000u, queue.space());
+   EXPECT_EQ(0u, queue.blocks_allocated());
+
+   EXPECT_THROW(send_queue(1000, 0), std::exception);
+}
+
+TEST(SendQueue, TestNoLimitQueuesNothing)
+{
+   send_queue queue(0);
+
+   const std::vector<uint8_t> data = test_data(10);
+
+   EXPECT_EQ(0u, queue.append(data.data(), data.size()));
+
+   EXPECT_TRUE(queue.empty());
+   EXPECT_EQ(0u, queue.blocks_allocated());
+}
+
+TEST(SendQueue, TestAppendSpansBlocks)
+{
+   send_queue queue(1000, 100);
+
+   const std::vector<uint8_t> data = test_data(250);
+
+   EXPECT_EQ(250u, queue.append(data.data(), data.size()));
+
+   EXPECT_EQ(250u, queue.size());
+   EXPECT_EQ(3u, queue.blocks_in_use());
+
+   size_t buffers = 0;
+
+   EXPECT_EQ(250u, queue.gather(SIZE_MAX, [&](const uint8_t *, const size_t) { ++buffers; }));
+
+   EXPECT_EQ(3u, buffers);
+
+   EXPECT_EQ(data, gather_all(queue));
+
+   // the gather can be limited to fewer buffers than there are
+
+   EXPECT_EQ(200u, queue.gather(2, [](const uint8_t *, size_t) {}));
+}
+
+TEST(SendQueue, TestAppendStopsAtLimit)
+{
+   send_queue queue(150, 100);
+
+   const std::vector<uint8_t> data = test_data(100);
+
+   EXPECT_EQ(100u, queue.append(data.data(), data.size()));
+   EXPECT_EQ(50u, queue.append(data.data(), data.size()));
+   EXPECT_EQ(0u, queue.append(data.data(), data.size()));
+
+   EXPECT_EQ(150u, queue.size());
+   EXPECT_EQ(0u, queue.space());
+
+   std::vector<uint8_t> expected = data;
+
+   expected.insert(expected.end(), data.begin(), data.begin() + 50);
+
+   EXPECT_EQ(expected, gather_all(queue));
+}
+
+TEST(SendQueue, TestConsumeAcrossBlocks)
+{
+   send_queue queue(1000, 100);
+
+   const std::vector<uint8_t> data = test_data(250);
+
+   queue.append(data.data(), data.size());
+
+   queue.consume(30);
+
+   EXPECT_EQ(std::vector<uint8_t>(data.begin() + 30, data.end()), gather_all(queue));
+
+   queue.consume(100);
+
+   EXPECT_EQ(120u, queue.size());
+   EXPECT_EQ(2u, queue.blocks_in_use());
+   EXPECT_EQ(std::vector<uint8_t>(data.begin() + 130, data.end()), gather_all(queue));
+
+   // more data goes on the end, filling the space in the last block first
+
+   const std::vector<uint8_t> more = test_data(60, 250);
+
+   queue.append(more.data(), more.size());
+
+   EXPECT_EQ(3u, queue.blocks_in_use());
+
+   std::vector<uint8_t> expected(data.begin() + 130, data.end());
+
+   expected.insert(expected.end(), more.begin(), more.end());
+
+   EXPECT_EQ(expected, gather_all(queue));
+
+   EXPECT_THROW(queue.consume(181), std::exception);
+
+   queue.consume(180);
+
+   EXPECT_TRUE(queue.empty());
+   EXPECT_TRUE(gather_all(queue).empty());
+}
+
+TEST(SendQueue, TestBlocksAreReused)
+{
+   send_queue queue(10000, 100);
+
+   const std::vector<uint8_t> data = test_data(250);
+
+   for (int i = 0; i < 100; ++i)
+   {
+      queue.append(data.data(), data.size());
+
+      EXPECT_EQ(data, gather_all(queue));
+
+      queue.consume(data.size());
+   }
+
+   EXPECT_EQ(3u, queue.blocks_allocated());
+
+   // no more than a few are kept once a large queue has drained
+
+   const std::vector<uint8_t> large = test_data(5000);
+
+   queue.append(large.data(), large.size());
+
+   EXPECT_EQ(50u, queue.blocks_allocated());
+
+   queue.clear();
+
+   EXPECT_TRUE(queue.empty());
+   EXPECT_EQ(send_queue::max_spare_blocks, queue.blocks_allocated());
+}
+
+static size_t write_into(
+   receive_ring &ring,
+   const std::vector<uint8_t> &data)
+{
+   std::span<uint8_t> spans[2];
+
+   const uint32_t count = ring.writable_spans(spans);
+
+   size_t written = 0;
+
+   for (uint32_t i = 0; i < count && written < data.size(); ++i)
+   {
+      const size_t bytes = std::min(spans[i].size(), data.size() - written);
+
+      memcpy(spans[i].data(), data.data() + written, bytes);
+
+      written += bytes;
+   }
+
+   ring.commit(written);
+
+   return written;
+}
+
+TEST(ReceiveRing, TestCapacityIsAPowerOfTwo)
+{
+   receive_ring ring(1000);
+
+   EXPECT_EQ(1024u, ring.capacity());
+   EXPECT_FALSE(ring.mirrored());
+   EXPECT_TRUE(ring.empty());
+   EXPECT_EQ(1024u, ring.space());
+
+   EXPECT_THROW(receive_ring(0), std::exception);
+}
+
+TEST(ReceiveRing, TestReadableAndConsume)
+{
+   receive_ring ring(64);
+
+   const std::vector<uint8_t> data = test_data(40);
+
+   EXPECT_EQ(40u, write_into(ring, data));
+
+   EXPECT_EQ(40u, ring.size());
+
+   std::span<const uint8_t> readable = ring.readable_span();
+
+   EXPECT_EQ(data, std::vector<uint8_t>(readable.begin(), readable.end()));
+
+   ring.consume(10);
+
+   readable = ring.readable_span();
+
+   EXPECT_EQ(std::vector<uint8_t>(data.begin() + 10, data.end()), std::vector<uint8_t>(readable.begin(), readable.end()));
+
+   EXPECT_THROW(ring.consume(31), std::exception);
+
+   EXPECT_THROW(ring.commit(ring.space() + 1), std::exception);
+}
+
+TEST(ReceiveRing, TestPlainRingWraps)
+{
+   receive_ring ring(64);
+
+   const std::vector<uint8_t> data = test_data(48);
+
+   write_into(ring, data);
+
+   ring.consume(40);
+
+   // the free space wraps, so it's in two parts
+
+   std::span<uint8_t> spans[2];
+
+   ASSERT_EQ(2u, ring.writable_spans(spans));
+
+   EXPECT_EQ(16u, spans[0].size());
+   EXPECT_EQ(40u, spans[1].size());
+
+   const std::vector<uint8_t> more = test_data(30, 48);
+
+   EXPECT_EQ(30u, write_into(ring, more));
+
+   // and the data does too, the first part goes to the end of the buffer
+
+   EXPECT_EQ(38u, ring.size());
+
+   std::span<const uint8_t> readable = ring.readable_span();
+
+   EXPECT_EQ(24u, readable.size());
+   EXPECT_EQ(40u, readable[0]);
+
+   ring.consume(readable.size());
+
+   readable = ring.readable_span();
+
+   EXPECT_EQ(14u, readable.size());
+   EXPECT_EQ(64u, readable[0]);
+}
+
+TEST(ReceiveRing, TestEmptyRingStartsAgain)
+{
+   receive_ring ring(64);
+
+   const std::vector<uint8_t> data = test_data(48);
+
+   write_into(ring, data);
+
+   ring.consume(48);
+
+   std::span<uint8_t> spans[2];
+
+   ASSERT_EQ(1u, ring.writable_spans(spans));
+
+   EXPECT_EQ(64u, spans[0].size());
+}
+
+TEST(ReceiveRing, TestFullRingHasNoSpace)
+{
+   receive_ring ring(64);
+
+   EXPECT_EQ(64u, write_into(ring, test_data(100)));
+
+   EXPECT_TRUE(ring.full());
+
+   std::span<uint8_t> spans[2];
+
+   EXPECT_EQ(0u, ring.writable_spans(spans));
+}
+
+TEST(ReceiveRing, TestMirroredRingIsContiguous)
+{
+   receive_ring ring(64, receive_ring::mapping::mirrored);
+
+   if (!ring.mirrored())
+   {
+      GTEST_SKIP() << "mirrored mapping not available";
+   }
+
+   // the size is rounded up to what can be mapped
+
+   const size_t capacity = ring.capacity();
+
+   EXPECT_LE(64u, capacity);
+   EXPECT_EQ(0u, capacity & (capacity - 1));
+
+   const std::vector<uint8_t> data = test_data(capacity - 10);
+
+   write_into(ring, data);
+
+   ring.consume(capacity - 20);
+
+   // the space wraps, but is one span
+
+   std::span<uint8_t> spans[2];
+
+   ASSERT_EQ(1u, ring.writable_spans(spans));
+
+   EXPECT_EQ(capacity - 10, spans[0].size());
+
+   const std::vector<uint8_t> more = test_data(100, 7);
+
+   EXPECT_EQ(100u, write_into(ring, more));
+
+   // and so is the data that spans the end of the buffer
+
+   const std::span<const uint8_t> readable = ring.readable_span();
+
+   ASSERT_EQ(110u, readable.size());
+
+   std::vector<uint8_t> expected(data.end() - 10, data.end());
+
+   expected.insert(expected.end(), more.begin(), more.end());
+
+   EXPECT_EQ(expected, std::vector<uint8_t>(readable.begin(), readable.end()));
+}
+
+TEST(SlabAllocator, TestSlotsAreWholeCacheLines)
+{
+   slab_allocator allocator(10, 4, 8);
+
+   EXPECT_EQ(slab_allocator::cache_line_size, allocator.slot_size());
+
+   slab_allocator larger(100, 8, 8);
+
+   EXPECT_EQ(2 * slab_allocator::cache_line_size, larger.slot_size());
+
+   slab_allocator aligned(10, 256, 8);
+
+   EXPECT_EQ(256u, aligned.slot_size());
+
+   void *p = aligned.allocate();
+
+   EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(p) % 256);
+
+   aligned.deallocate(p);
+}
+
+TEST(SlabAllocator, TestSlabsAreAddedAsNeeded)
+{
+   slab_allocator allocator(32, 8, 4);
+
+   EXPECT_EQ(0u, allocator.slabs());
+   EXPECT_EQ(0u, allocator.available());
+
+   std::vector<void *> slots;
+
+   for (int i = 0; i < 5; ++i)
+   {
+      slots.push_back(allocator.allocate());
+
+      EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(slots.back()) % slab_allocator::cache_line_size);
+   }
+
+   EXPECT_EQ(2u, allocator.slabs());
+   EXPECT_EQ(8u, allocator.capacity());
+   EXPECT_EQ(3u, allocator.available());
+
+   // slots within a slab are handed out in address order
+
+   EXPECT_EQ(static_cast<uint8_t *>(slots[0]) + allocator.slot_size(), slots[1]);
+
+   std::sort(slots.begin(), slots.end());
+
+   EXPECT_EQ(slots.end(), std::adjacent_find(slots.begin(), slots.end()));
+
+   for (void *p : slots)
+   {
+      allocator.deallocate(p);
+   }
+
+   EXPECT_EQ(2u, allocator.slabs());
+   EXPECT_EQ(8u, allocator.available());
+}
+
+TEST(SlabAllocator, TestFreedSlotIsReusedFirst)
+{
+   slab_allocator allocator(32, 8, 4);
+
+   void *p1 = allocator.allocate();
+   void *p2 = allocator.allocate();
+
+   allocator.deallocate(p1);
+
+   EXPECT_EQ(p1, allocator.allocate());
+
+   allocator.deallocate(p1);
+   allocator.deallocate(p2);
+}
+
+TEST(SlabAllocator, TestCacheMovesSlotsInBatches)
+{
+   slab_allocator allocator(32, 8, 16);
+
+   {
+      slab_cache cache(allocator, 8);
+
+      void *p = cache.allocate();
+
+      // half of the cache's capacity was taken, one has been handed out
+
+      EXPECT_EQ(3u, cache.cached());
+      EXPECT_EQ(12u, allocator.available());
+
+      std::vector<void *> slots{ p };
+
+      for (int i = 0; i < 7; ++i)
+      {
+         slots.push_back(cache.allocate());
+      }
+
+      EXPECT_EQ(0u, cache.cached());
+      EXPECT_EQ(8u, allocator.available());
+
+      for (void *slot : slots)
+      {
+         cache.deallocate(slot);
+      }
+
+      // the cache filled up and gave half back
+
+      EXPECT_EQ(4u, cache.cached());
+      EXPECT_EQ(12u, allocator.available());
+   }
+
+   // and the rest when it went away
+
+   EXPECT_EQ(16u, allocator.available());
+   EXPECT_EQ(1u, allocator.slabs());
+}
+
+TEST(SlabAllocator, TestNoObjectsPerSlabFails)
+{
+   EXPECT_THROW(slab_allocator(32, 8, 0), std::exception);
+}
+
+class pooled_object
+{
+   public :
+
+      pooled_object(
+         int &live,
+         const int value,
+         const bool fail = false)
+         :  live(live),
+            value(value)
+      {
+         if (fail)
+         {
+            throw std::runtime_error("failed to construct");
+         }
+
+         ++live;
+      }
+
+      ~pooled_object()
+      {
+         --live;
+      }
+
+      int &live;
+
+      const int value;
+};
+
+TEST(ConnectionPool, TestAcquireConstructsAndReleaseDestroys)
+{
+   connection_pool<pooled_object> pool(4);
+
+   int live = 0;
+
+   pooled_object *p1 = pool.acquire(live, 1);
+   pooled_object *p2 = pool.acquire(live, 2);
+
+   EXPECT_EQ(2, live);
+   EXPECT_EQ(1, p1->value);
+   EXPECT_EQ(2, p2->value);
+
+   pool.release(p1);
+
+   EXPECT_EQ(1, live);
+
+   // the memory is reused, the object is new
+
+   pooled_object *p3 = pool.acquire(live, 3);
+
+   EXPECT_EQ(static_cast<void *>(p1), static_cast<void *>(p3));
+   EXPECT_EQ(3, p3->value);
+
+   pool.release(p2);
+   pool.release(p3);
+
+   EXPECT_EQ(0, live);
+   EXPECT_EQ(1u, pool.allocator().slabs());
+   EXPECT_EQ(4u, pool.allocator().available());
+}
+
+TEST(ConnectionPool, TestFailedConstructionReturnsTheSlot)
+{
+   connection_pool<pooled_object> pool(4);
+
+   int live = 0;
+
+   EXPECT_THROW(pool.acquire(live, 1, true), std::exception);
+
+   EXPECT_EQ(0, live);
+   EXPECT_EQ(4u, pool.allocator().available());
+
+   connection_pool<pooled_object>::thread_cache cache(pool, 4);
+
+   EXPECT_THROW(cache.acquire(live, 1, true), std::exception);
+
+   EXPECT_EQ(0, live);
+   EXPECT_EQ(1u, cache.cached());
+   EXPECT_EQ(3u, pool.allocator().available());
+}
+
+TEST(ConnectionPool, TestThreadCachesShareThePool)
+{
+   connection_pool<pooled_object> pool(64);
+
+   std::atomic<int> total{ 0 };
+
+   const auto worker = [&]()
+   {
+      connection_pool<pooled_object>::thread_cache cache(pool, 16);
+
+      int live = 0;
+
+      std::vector<pooled_object *> objects;
+
+      for (int round = 0; round < 100; ++round)
+      {
+         for (int i = 0; i < 20; ++i)
+         {
+            objects.push_back(cache.acquire(live, i));
+         }
+
+         total += static_cast<int>(objects.size());
+
+         // released to the pool rather than the cache, now and then
+
+         for (pooled_object *p : objects)
+         {
+            if (p->value % 5)
+            {
+               cache.release(p);
+            }
+            else
+            {
+               pool.release(p);
+            }
+         }
+
+         objects.clear();
+      }
+
+      EXPECT_EQ(0, live);
+   };
+
+   std::thread t1(worker);
+   std::thread t2(worker);
+
+   t1.join();
+   t2.join();
+
+   EXPECT_EQ(4000, total.load());
+
+   EXPECT_EQ(pool.allocator().capacity(), pool.allocator().available());
+}
+
+TEST(MpscQueue, TestCapacityIsRoundedUpToAPowerOfTwo)
+{
+   EXPECT_THROW(mpsc_queue<int>(0), std::runtime_error);
+
+   EXPECT_EQ(2u, mpsc_queue<int>(1).capacity());
+   EXPECT_EQ(8u, mpsc_queue<int>(5).capacity());
+   EXPECT_EQ(8u, mpsc_queue<int>(8).capacity());
+}
+
+TEST(MpscQueue, TestValuesArePoppedInTheOrderThatTheyArePushed)
+{
+   mpsc_queue<int> queue(4);
+
+   int value = 0;
+
+   EXPECT_FALSE(queue.pop(value));
+
+   // around the ring more than once
+
+   for (int i = 0; i < 10; ++i)
+   {
+      EXPECT_TRUE(queue.push(i));
+      EXPECT_TRUE(queue.push(i + 100));
+
+      EXPECT_TRUE(queue.pop(value));
+      EXPECT_EQ(i, value);
+
+      EXPECT_TRUE(queue.pop(value));
+      EXPECT_EQ(i + 100, value);
+   }
+
+   EXPECT_FALSE(queue.pop(value));
+}
+
+TEST(MpscQueue, TestPushFailsWhenFull)
+{
+   mpsc_queue<int> queue(4);
+
+   for (int i = 0; i < 4; ++i)
+   {
+      EXPECT_TRUE(queue.push(i));
+   }
+
+   EXPECT_FALSE(queue.push(4));
+
+   int value = 0;
+
+   EXPECT_TRUE(queue.pop(value));
+   EXPECT_EQ(0, value);
+
+   EXPECT_TRUE(queue.push(4));
+   EXPECT_FALSE(queue.push(5));
+}
+
+TEST(MpscQueue, TestManyProducers)
+{
+   mpsc_queue<uint32_t> queue(64);
+
+   static constexpr uint32_t num_producers = 4;
+
+   static constexpr uint32_t values_per_producer = 20000;
+
+   const auto producer = [&](const uint32_t id)
+   {
+      for (uint32_t i = 0; i < values_per_producer; ++i)
+      {
+         while (!queue.push((id << 24) | i))
+         {
+            std::this_thread::yield();
+         }
+      }
+   };
+
+   std::vector<std::thread> producers;
+
+   for (uint32_t id = 0; id < num_producers; ++id)
+   {
+      producers.emplace_back(producer, id);
+   }
+
+   // each producer's values arrive in the order that it pushed them
+
+   uint32_t expected[num_producers] = {};
+
+   uint32_t popped = 0;
+
+   while (popped < num_producers * values_per_producer)
+   {
+      uint32_t value = 0;
+
+      if (queue.pop(value))
+      {
+         const uint32_t id = value >> 24;
+
+         ASSERT_LT(id, num_producers);
+         ASSERT_EQ(expected[id], value & 0xFFFFFF);
+
+         ++expected[id];
+
+         ++popped;
+      }
+      else
+      {
+         std::this_thread::yield();
+      }
+   }
+
+   for (auto &t : producers)
+   {
+      t.join();
+   }
+
+   uint32_t value = 0;
+
+   EXPECT_FALSE(queue.pop(value));
+}
+
+TEST(SocketResult, TestSuccessHasAValue)
+{
+   const socket_result<int> result = socket_result<int>::success(42);
+
+   EXPECT_TRUE(result);
+   EXPECT_TRUE(result.has_value());
+   EXPECT_EQ(42, result.value());
+   EXPECT_EQ(42, *result);
+   EXPECT_EQ(42, result.value_or(7));
+   EXPECT_EQ(0, result.error());
+
+   const socket_result<void> done = socket_result<void>::success();
+
+   EXPECT_TRUE(done);
+   EXPECT_NO_THROW(done.value());
+}
+
+TEST(SocketResult, TestFailureHasTheErrorAndNoValue)
+{
+   const socket_result<int> result = socket_result<int>::failure(104);
+
+   EXPECT_FALSE(result);
+   EXPECT_FALSE(result.has_value());
+   EXPECT_EQ(104, result.error());
+   EXPECT_EQ(7, result.value_or(7));
+   EXPECT_THROW(result.value(), std::exception);
+
+   const socket_result<void> failed = socket_result<void>::failure(104);
+
+   EXPECT_FALSE(failed);
+   EXPECT_EQ(104, failed.error());
+   EXPECT_THROW(failed.value(), std::exception);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: test.cpp
+///////////////////////////////////////////////////////////////////////////////
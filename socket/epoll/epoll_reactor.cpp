@@ -0,0 +1,514 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: epoll_reactor.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "epoll_reactor.h"
+#include "poll_events.h"
+
+#include <poll.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+
+static_assert(EPOLLIN == POLLIN && EPOLLPRI == POLLPRI && EPOLLOUT == POLLOUT && EPOLLRDHUP == POLLRDHUP &&
+              EPOLLERR == POLLERR && EPOLLHUP == POLLHUP, "epoll and poll conditions differ");
+
+static constexpr int max_results = 64;
+
+static uint64_t now_ms()
+{
+   return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static uint64_t make_key(
+   const uint32_t slot,
+   const uint32_t generation)
+{
+   return (static_cast<uint64_t>(generation) << 32) | slot;
+}
+
+epoll_reactor::epoll_reactor(
+   const uint32_t num_slots)
+   :  epoll_fd(::epoll_create1(EPOLL_CLOEXEC)),
+      slots(num_slots, slot_data{}),
+      dispatching(false),
+      timers(now_ms()),
+      associated(0),
+      counters{}
+{
+   if (epoll_fd == -1)
+   {
+      throw std::runtime_error("epoll_create1 - failed to create epoll instance");
+   }
+
+   for (uint32_t slot = num_slots; slot > 0; --slot)
+   {
+      free_slots.push_back(slot - 1);
+   }
+}
+
+epoll_reactor::~epoll_reactor()
+{
+   ::close(epoll_fd);
+}
+
+uint32_t epoll_reactor::allocate_slot()
+{
+   uint32_t slot;
+
+   if (free_slots.empty())
+   {
+      slot = static_cast<uint32_t>(slots.size());
+
+      slots.push_back(slot_data{});
+   }
+   else
+   {
+      slot = free_slots.back();
+
+      free_slots.pop_back();
+   }
+
+   slots[slot].allocated = true;
+
+   return slot;
+}
+
+void epoll_reactor::associate_socket(
+   const uint32_t slot,
+   const reactor_socket s,
+   reactor_events &events)
+{
+   slot_data &data = get_slot(slot);
+
+   if (data.pEvents)
+   {
+      throw std::runtime_error("slot already in use");
+   }
+
+   if (!data.allocated)
+   {
+      // a slot that the caller chose rather than one we handed out
+
+      free_slots.erase(std::find(free_slots.begin(), free_slots.end(), slot));
+
+      data.allocated = true;
+   }
+
+   data.s = s;
+   data.pEvents = &events;
+   data.interest = 0;
+   data.armed = 0;
+   data.registered = false;
+   data.closing = false;
+
+   ++associated;
+}
+
+void epoll_reactor::disassociate_socket(
+   const uint32_t slot)
+{
+   slot_data &data = get_slot(slot);
+
+   if (!data.allocated)
+   {
+      return;
+   }
+
+   if (data.registered)
+   {
+      unregister(data);
+   }
+
+   cancel_timer(slot);
+
+   if (data.pEvents)
+   {
+      --associated;
+   }
+
+   data.pEvents = nullptr;
+   data.interest = 0;
+   data.allocated = false;
+
+   ++data.generation;
+
+   free_slots.push_back(slot);
+}
+
+bool epoll_reactor::poll(
+   const uint32_t slot,
+   const uint32_t events)
+{
+   get_slot(slot).interest = events;
+
+   arm(slot);
+
+   // events are only ever reported from run_once()
+
+   return false;
+}
+
+void epoll_reactor::closing_socket(
+   const uint32_t slot,
+   const bool poll_pending)
+{
+   slot_data &data = get_slot(slot);
+
+   // remove it whilst the descriptor is still valid, once it's closed the
+   // number can be reused before we hear about it, and before we'd remove it
+   // when the socket is disassociated, which would remove whichever socket
+   // had the number by then
+
+   if (data.registered)
+   {
+      unregister(data);
+   }
+
+   // nor is it polled again; a handler that closes its socket whilst it's
+   // being dispatched may still return an interest, for the local_close that
+   // we report
+
+   data.closing = true;
+
+   if (poll_pending && (data.interest & reactor_event::local_close))
+   {
+      closed.push_back(make_key(slot, data.generation));
+   }
+}
+
+bool epoll_reactor::after_dispatch(
+   const uint32_t slot)
+{
+   if (!dispatching)
+   {
+      return false;
+   }
+
+   completing.push_back(make_key(slot, get_slot(slot).generation));
+
+   return true;
+}
+
+bool epoll_reactor::set_timer(
+   const uint32_t slot,
+   const uint32_t timeout_ms)
+{
+   slot_data &data = get_slot(slot);
+
+   timers.cancel(data.timer);
+
+   // a tick more, as part of the current one has already passed
+
+   data.timer = timers.arm(now_ms() + timeout_ms + 1, make_key(slot, data.generation));
+
+   return true;
+}
+
+void epoll_reactor::cancel_timer(
+   const uint32_t slot)
+{
+   slot_data &data = get_slot(slot);
+
+   timers.cancel(data.timer);
+
+   data.timer = timer_wheel::no_timer;
+}
+
+uint32_t epoll_reactor::run_once(
+   const int timeout_ms)
+{
+   epoll_event results[max_results];
+
+   const int count = ::epoll_wait(epoll_fd, results, max_results, closed.empty() ? wait_timeout(timeout_ms) : 0);
+
+   ++counters.waits;
+
+   if (count == -1 && errno != EINTR)
+   {
+      throw std::runtime_error("epoll_wait - failed");
+   }
+
+   // every socket that reported has had its poll consumed, including those that
+   // a handler re-polls before we get to them
+
+   for (int i = 0; i < count; ++i)
+   {
+      const uint32_t slot = static_cast<uint32_t>(results[i].data.u64);
+
+      if (slot < slots.size() && slots[slot].generation == static_cast<uint32_t>(results[i].data.u64 >> 32))
+      {
+         slots[slot].armed = 0;
+      }
+   }
+
+   uint32_t dispatched = 0;
+
+   dispatching = true;
+
+   for (int i = 0; i < count; ++i)
+   {
+      const uint32_t slot = static_cast<uint32_t>(results[i].data.u64);
+
+      if (slot >= slots.size())
+      {
+         continue;
+      }
+
+      const slot_data &data = slots[slot];
+
+      if (data.generation != static_cast<uint32_t>(results[i].data.u64 >> 32) || !data.pEvents || !data.registered)
+      {
+         // disassociated or closed by an earlier handler
+
+         continue;
+      }
+
+      ++counters.reports;
+
+      int32_t status = 0;
+
+      const uint32_t events = from_poll_events(static_cast<int>(data.s), data.interest, results[i].events, status) & data.interest;
+
+      if (events || (status && data.interest))
+      {
+         dispatch(slot, events, status);
+
+         ++dispatched;
+      }
+   }
+
+   std::vector<uint64_t> closing;
+
+   closing.swap(closed);
+
+   for (const uint64_t key : closing)
+   {
+      const uint32_t slot = static_cast<uint32_t>(key);
+
+      if (slots[slot].generation == static_cast<uint32_t>(key >> 32) && slots[slot].pEvents)
+      {
+         dispatch(slot, reactor_event::local_close, 0);
+
+         ++dispatched;
+      }
+   }
+
+   dispatched += expire_timers();
+
+   // anything that these sockets' handlers do happens now, rather than being
+   // left for another pass
+
+   dispatching = false;
+
+   std::vector<uint64_t> complete;
+
+   complete.swap(completing);
+
+   for (const uint64_t key : complete)
+   {
+      const uint32_t slot = static_cast<uint32_t>(key);
+
+      if (slots[slot].generation == static_cast<uint32_t>(key >> 32) && slots[slot].pEvents)
+      {
+         ++counters.dispatch_completions;
+
+         slots[slot].pEvents->dispatch_complete();
+      }
+   }
+
+   return dispatched;
+}
+
+int epoll_reactor::wait_timeout(
+   const int timeout_ms) const
+{
+   if (!timers.size() || timeout_ms == 0)
+   {
+      return timeout_ms;
+   }
+
+   const uint64_t next = timers.next_expiry();
+
+   const uint64_t now = now_ms();
+
+   const uint64_t until = next > now ? next - now : 0;
+
+   return (timeout_ms < 0 || until < static_cast<uint64_t>(timeout_ms)) ? static_cast<int>(until) : timeout_ms;
+}
+
+uint32_t epoll_reactor::expire_timers()
+{
+   if (!timers.size())
+   {
+      return 0;
+   }
+
+   uint32_t expired = 0;
+
+   timers.advance(now_ms(), [&](const timer_wheel::timer_id id, const uintptr_t key)
+   {
+      const uint32_t slot = static_cast<uint32_t>(key);
+
+      slot_data &data = slots[slot];
+
+      if (data.generation == static_cast<uint32_t>(static_cast<uint64_t>(key) >> 32) && data.pEvents && data.timer == id)
+      {
+         data.timer = timer_wheel::no_timer;
+
+         ++counters.timers_expired;
+
+         data.pEvents->timer_expired();
+
+         ++expired;
+      }
+   });
+
+   return expired;
+}
+
+uint32_t epoll_reactor::sockets() const
+{
+   return associated;
+}
+
+const epoll_reactor::statistics &epoll_reactor::stats() const
+{
+   return counters;
+}
+
+epoll_reactor::slot_data &epoll_reactor::get_slot(
+   const uint32_t slot)
+{
+   if (slot >= slots.size())
+   {
+      throw std::runtime_error("slot out of range");
+   }
+
+   return slots[slot];
+}
+
+void epoll_reactor::arm(
+   const uint32_t slot)
+{
+   slot_data &data = slots[slot];
+
+   if (!data.pEvents)
+   {
+      throw std::runtime_error("no socket associated with slot");
+   }
+
+   if (data.closing)
+   {
+      return;
+   }
+
+   if (data.interest == 0)
+   {
+      if (data.armed)
+      {
+         // a one-shot registration with no events still reports errors
+
+         unregister(data);
+      }
+
+      return;
+   }
+
+   const uint32_t wanted = to_poll_events(data.interest) | EPOLLONESHOT;
+
+   if (data.armed == wanted)
+   {
+      // the pending poll already covers this interest
+
+      return;
+   }
+
+   epoll_event event {};
+
+   event.events = wanted;
+   event.data.u64 = make_key(slot, data.generation);
+
+   const int fd = static_cast<int>(data.s);
+
+   ++counters.ctl_calls;
+
+   if (0 != ::epoll_ctl(epoll_fd, data.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event))
+   {
+      throw std::runtime_error("epoll_ctl - failed to poll socket");
+   }
+
+   data.registered = true;
+   data.armed = wanted;
+}
+
+void epoll_reactor::unregister(
+   slot_data &data)
+{
+   // the descriptor may already have been closed, which removes it for us
+
+   ++counters.ctl_calls;
+
+   ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, static_cast<int>(data.s), nullptr);
+
+   data.registered = false;
+   data.armed = 0;
+}
+
+void epoll_reactor::dispatch(
+   const uint32_t slot,
+   const uint32_t events,
+   const int32_t status)
+{
+   const uint32_t generation = slots[slot].generation;
+
+   const uint32_t interest = slots[slot].pEvents->handle_events(events, status);
+
+   // the handler may have disassociated the slot, or allocated more
+
+   slot_data &data = slots[slot];
+
+   if (data.generation != generation || !data.pEvents)
+   {
+      return;
+   }
+
+   data.interest = interest;
+
+   if (data.registered || interest)
+   {
+      arm(slot);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: epoll_reactor.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,174 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: epoll_reactor.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "reactor.h"
+#include "timer_wheel.h"
+
+#include <cstdint>
+#include <vector>
+
+// A reactor over a level triggered epoll instance, for Linux. Each socket is
+// registered with EPOLLONESHOT so that, as with an AFD poll, a socket's poll
+// is consumed when it reports and nothing more is reported until the socket
+// is polled again. The epoll interest is only changed when a socket's interest
+// changes, or when its last poll has been consumed.
+//
+// epoll reports conditions rather than AFD events, the events that a socket
+// sees are derived from them, see poll_events.h, and are masked by the
+// interest, as AFD does. Closing a socket removes it from
+// the epoll instance, so local_close is reported by the reactor itself, for
+// sockets that tell it that they are closing with a poll pending. Sockets that
+// ask are called once everything that a wait reported has been dispatched.
+// Socket timers are held in a timer_wheel, in milliseconds of the steady
+// clock, and the wait is no longer than it takes for the next one to expire.
+//
+// Not thread safe, a reactor is run by a single thread.
+
+class epoll_reactor : public reactor
+{
+   public :
+
+      // num_slots are available to sockets that are given a slot rather than
+      // allocating one, more are added as slots are allocated
+
+      explicit epoll_reactor(
+         uint32_t num_slots = 1);
+
+      epoll_reactor(
+         const epoll_reactor &) = delete;
+
+      epoll_reactor &operator=(
+         const epoll_reactor &) = delete;
+
+      ~epoll_reactor() override;
+
+      uint32_t allocate_slot() override;
+
+      void associate_socket(
+         uint32_t slot,
+         reactor_socket s,
+         reactor_events &events) override;
+
+      void disassociate_socket(
+         uint32_t slot) override;
+
+      bool poll(
+         uint32_t slot,
+         uint32_t events) override;
+
+      void closing_socket(
+         uint32_t slot,
+         bool poll_pending) override;
+
+      bool after_dispatch(
+         uint32_t slot) override;
+
+      bool set_timer(
+         uint32_t slot,
+         uint32_t timeout_ms) override;
+
+      void cancel_timer(
+         uint32_t slot) override;
+
+      // Waits for up to timeout_ms for sockets to report, -1 waits forever,
+      // and dispatches what they report. Returns the number of sockets that
+      // were dispatched.
+
+      uint32_t run_once(
+         int timeout_ms);
+
+      uint32_t sockets() const;
+
+      struct statistics
+      {
+         uint64_t waits;                     // epoll_wait calls
+         uint64_t ctl_calls;                 // epoll_ctl calls, to arm, re-arm and remove sockets
+         uint64_t reports;                   // sockets reported by epoll_wait
+         uint64_t dispatch_completions;      // dispatch_complete() calls
+         uint64_t timers_expired;
+      };
+
+      const statistics &stats() const;
+
+   private :
+
+      struct slot_data
+      {
+         reactor_socket s;
+         reactor_events *pEvents;
+         uint32_t interest;                  // the events the socket is polling for
+         uint32_t armed;                     // the epoll events of the pending poll, zero if none
+         uint32_t generation;                // bumped on disassociate, stale reports are ignored
+         timer_wheel::timer_id timer;
+         bool registered;                    // known to the epoll instance
+         bool closing;                       // the descriptor is being closed, and is never polled again
+         bool allocated;
+      };
+
+      slot_data &get_slot(
+         uint32_t slot);
+
+      void arm(
+         uint32_t slot);
+
+      void unregister(
+         slot_data &data);
+
+      void dispatch(
+         uint32_t slot,
+         uint32_t events,
+         int32_t status);
+
+      int wait_timeout(
+         int timeout_ms) const;
+
+      uint32_t expire_timers();
+
+      const int epoll_fd;
+
+      std::vector<slot_data> slots;
+
+      std::vector<uint32_t> free_slots;
+
+      std::vector<uint64_t> closed;          // slot and generation of sockets to report local_close for
+
+      std::vector<uint64_t> completing;      // slot and generation of sockets waiting for the end of dispatch
+
+      bool dispatching;
+
+      timer_wheel timers;
+
+      uint32_t associated;
+
+      statistics counters;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: epoll_reactor.h
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,2805 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: test.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "third_party/GoogleTest/gtest.h"
+#include "third_party/GoogleTest/gmock.h"
+
+#include "tcp_socket.h"
+#include "connection_batch.h"
+#include "reactor_wakeup.h"
+#include "epoll_reactor.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The AFDSocket scenarios, run against the epoll reactor. Where Linux reports
+// something different from AFD the test says so and expects what Linux does.
+
+static constexpr int SHORT_TIME_NON_ZERO = 100;
+
+int main(int argc, char **argv) {
+   testing::InitGoogleTest(&argc, argv);
+
+   return RUN_ALL_TESTS();
+}
+
+class ListeningSocket
+{
+   public :
+
+   ListeningSocket()
+      :  s(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)),
+         port(0)
+   {
+      sockaddr_in addr {};
+
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+      socklen_t addressLength = sizeof addr;
+
+      if (s == -1 ||
+          0 != ::bind(s, reinterpret_cast<const sockaddr *>(&addr), sizeof addr) ||
+          0 != ::listen(s, 10) ||
+          0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&addr), &addressLength))
+      {
+         throw std::runtime_error("failed to create listening socket: " + std::string(strerror(errno)));
+      }
+
+      port = ntohs(addr.sin_port);
+   }
+
+   ListeningSocket(const ListeningSocket &) = delete;
+   ListeningSocket& operator=(const ListeningSocket &) = delete;
+
+   [[nodiscard]] int Accept() const
+   {
+      const int accepted = ::accept(s, nullptr, nullptr);
+
+      if (accepted == -1)
+      {
+         throw std::runtime_error("accept: " + std::string(strerror(errno)));
+      }
+
+      return accepted;
+   }
+
+   ~ListeningSocket()
+   {
+      ::close(s);
+   }
+
+   const int s;
+
+   uint16_t port;
+};
+
+static void Write(
+   const int s,
+   const std::string &message)
+{
+   if (static_cast<ssize_t>(message.length()) != ::send(s, message.data(), message.length(), MSG_NOSIGNAL))
+   {
+      throw std::runtime_error("send: " + std::string(strerror(errno)));
+   }
+}
+
+static void Abort(
+   const int s)
+{
+   linger lingerStruct {};
+
+   lingerStruct.l_onoff = 1;
+   lingerStruct.l_linger = 0;
+
+   if (0 != ::setsockopt(s, SOL_SOCKET, SO_LINGER, &lingerStruct, sizeof lingerStruct))
+   {
+      throw std::runtime_error("Abort - setsockopt: " + std::string(strerror(errno)));
+   }
+
+   ::close(s);
+}
+
+static void Close(
+   const int s)
+{
+   ::close(s);
+}
+
+static sockaddr_in LoopbackAddress(
+   const uint16_t port)
+{
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   address.sin_port = htons(port);
+
+   return address;
+}
+
+class mock_tcp_socket_callbacks : public tcp_socket_callbacks
+{
+   public :
+
+   MOCK_METHOD(void, on_connected, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_connection_failed, (tcp_socket &, uint32_t), (override));
+   MOCK_METHOD(void, on_readable, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_readable_oob, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_writable, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_client_close, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_connection_reset, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_disconnected, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_send_queue_high, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_send_queue_drained, (tcp_socket &), (override));
+};
+
+// Handlers that aren't tcp_socket_callbacks, they only have the callbacks
+// that they care about, and the socket calls them directly.
+
+template <bool with_oob>
+struct counting_handler
+{
+   using socket_type = basic_tcp_socket<counting_handler>;
+
+   void on_connected(
+      socket_type &)
+   {
+      ++connected;
+   }
+
+   void on_connection_failed(
+      socket_type &,
+      uint32_t)
+   {
+   }
+
+   void on_readable(
+      socket_type &s)
+   {
+      uint8_t buffer[100];
+
+      const int bytes = s.read(buffer, sizeof buffer);
+
+      received.append(reinterpret_cast<const char *>(buffer), static_cast<size_t>(bytes));
+   }
+
+   void on_readable_oob(
+      socket_type &) requires with_oob
+   {
+      ++oob;
+   }
+
+   int connected = 0;
+
+   int oob = 0;
+
+   std::string received;
+};
+
+TEST(EpollSocket, TestConstruct)
+{
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   EXPECT_EQ(1u, afd.sockets());
+}
+
+TEST(EpollSocket, TestConnectFail)
+{
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   /* Attempt to connect to an address that we won't be able to connect to. */
+   const sockaddr_in address = LoopbackAddress(1);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connection_failed(::testing::_, ECONNREFUSED)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(-1));
+}
+
+TEST(EpollSocket, TestConnect)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectAndSend)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   static const uint8_t data[] = { 1, 2, 3, 4 };
+
+   EXPECT_EQ(static_cast<int>(sizeof data), socket.write(data, sizeof data));
+}
+
+TEST(EpollSocket, TestConnectAndRecv)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   // Note that at present the remote end hasn't accepted
+
+   const int s = listeningSocket.Accept();
+
+   const std::string testData("test");
+
+   Write(s, testData);
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, static_cast<int>(testData.length()));
+
+   EXPECT_EQ(0, memcmp(testData.c_str(), buffer, available));
+
+   available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndLocalCloseWithNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_CALL(callbacks, on_disconnected(::testing::_)).Times(1);
+
+   socket.close();
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectAndLocalCloseWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   socket.close();
+
+   EXPECT_CALL(callbacks, on_disconnected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectAndLocalShutdownSendNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   socket.shutdown(tcp_socket::shutdown_how::send);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndLocalShutdownSendWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   socket.shutdown(tcp_socket::shutdown_how::send);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndLocalShutdownRecvNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   socket.shutdown(tcp_socket::shutdown_how::receive);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndLocalShutdownRecvWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   socket.shutdown(tcp_socket::shutdown_how::receive);
+
+   // AFD reports nothing, Linux reports the end of our receive side as a
+   // client close
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndLocalShutdownBothNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   socket.shutdown(tcp_socket::shutdown_how::both);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndLocalShutdownBothWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   socket.shutdown(tcp_socket::shutdown_how::both);
+
+   // AFD reports nothing, Linux reports the end of our receive side as a
+   // client close
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndRemoteCloseNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Close(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectAndRemoteCloseWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   Close(s);
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectAndRemoteCloseWithNoPollPendingDetectsOnNextRead)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Close(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectAndRemoteCloseWithNoPollPendingDoesNotDetectOnNextWrite)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Close(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   static const uint8_t data[] = { 1, 2, 3, 4 };
+
+   const int sent = socket.write(data, sizeof data);
+
+   EXPECT_EQ(sent, static_cast<int>(sizeof data));
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectAndRemoteResetNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Abort(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectAndRemoteResetWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   Abort(s);
+
+   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectAndRemoteResetWithNoPollPendingDetectsOnNextRead)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Abort(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   // the read reports the reset, there's nothing left for a poll to report
+
+   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectAndRemoteResetWithNoPollPendingDetectsOnNextWrite)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Abort(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   static const uint8_t data[] = { 1, 2, 3, 4 };
+
+   // the write reports the reset, and doesn't poll to be told when it can
+   // write the rest
+
+   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+
+   const int sent = socket.write(data, sizeof data);
+
+   EXPECT_EQ(sent, 0);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectAndRemoteShutdownSendNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   ::shutdown(s, SHUT_WR);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndRemoteShutdownSendWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   ::shutdown(s, SHUT_WR);
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndRemoteShutdownSendWithNoPollPendingDetectsOnNextRead)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   ::shutdown(s, SHUT_WR);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndRemoteShutdownSendWithNoPollPendingDoesNotDetectOnNextWrite)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   ::shutdown(s, SHUT_WR);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   static const uint8_t data[] = { 1, 2, 3, 4 };
+
+   const int sent = socket.write(data, sizeof data);
+
+   EXPECT_EQ(sent, static_cast<int>(sizeof data));
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndRemoteShutdownRecvNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   ::shutdown(s, SHUT_RD);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndRemoteShutdownRecvWithPollPendingDetectsNothing)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   ::shutdown(s, SHUT_RD);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectNoContiguousHandleArray)
+{
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 1);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   // slot 1 is outside of the single slot that we have
+
+   EXPECT_THROW(tcp_socket socket(handle, callbacks), std::exception);
+}
+
+TEST(EpollSocket, TestConnectMultipleSocketsOnSingleReactor)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd(2);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket1(afd_handle(afd, 0), callbacks);
+
+   tcp_socket socket2(afd_handle(afd, 1), callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket1.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   socket2.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectMultipleSocketsWithAllocatedSlots)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   const afd_handle handle1(afd);
+
+   const afd_handle handle2(afd);
+
+   EXPECT_NE(handle1.slot, handle2.slot);
+
+   tcp_socket socket1(handle1, callbacks);
+
+   tcp_socket socket2(handle2, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket1.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   socket2.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestConnectMultipleSocketsReportInOneWait)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket1(afd_handle(afd), callbacks);
+
+   tcp_socket socket2(afd_handle(afd), callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket1.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   socket2.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   // unlike the sharded AFD system there is one wait for all of the sockets
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(2);
+
+   EXPECT_EQ(2u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestReportsNothingForAClosedSlot)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   const int s = listeningSocket.Accept();
+
+   Write(s, "test");
+
+   // the socket goes away with data waiting for it
+
+   afd.disassociate_socket(handle.slot);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestClosedSocketDoesNotUnregisterTheNextUserOfItsDescriptor)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   auto first = std::make_unique<tcp_socket>(afd_handle(afd), callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   first->connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   // closed with no poll pending, the descriptor is free for the next socket
+
+   EXPECT_CALL(callbacks, on_disconnected(::testing::_)).Times(1);
+
+   first->close();
+
+   tcp_socket second(afd_handle(afd), callbacks);
+
+   second.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   // disassociating the first socket mustn't take the second with it
+
+   first.reset();
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestSocketClosedByItsHandlerWithAPollPendingIsNotPolledAgain)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(afd_handle(afd), callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   Write(s, "test");
+
+   // the handler reads until the read would block, which polls again, and
+   // then closes the socket; the descriptor is closed, and could be another
+   // thread's next socket by the time the handler returns, so it mustn't be
+   // polled
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).WillOnce([&](tcp_socket &readable)
+   {
+      EXPECT_EQ(4, readable.read(buffer, sizeof buffer));
+      EXPECT_EQ(0, readable.read(buffer, sizeof buffer));
+
+      readable.close();
+   });
+
+   EXPECT_CALL(callbacks, on_disconnected(::testing::_)).Times(1);
+
+   EXPECT_EQ(2u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(0u, afd.run_once(0));
+
+   Close(s);
+}
+
+// A listener whose backlog is full, so that connections to it neither succeed
+// nor fail, the SYNs are dropped and the connect waits for its retries.
+
+class UnresponsiveListener
+{
+   public :
+
+   UnresponsiveListener()
+      :  s(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)),
+         client(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)),
+         port(0)
+   {
+      sockaddr_in addr = LoopbackAddress(0);
+
+      socklen_t addressLength = sizeof addr;
+
+      if (s == -1 ||
+          0 != ::bind(s, reinterpret_cast<const sockaddr *>(&addr), sizeof addr) ||
+          0 != ::listen(s, 0) ||
+          0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&addr), &addressLength) ||
+          0 != ::connect(client, reinterpret_cast<const sockaddr *>(&addr), sizeof addr))
+      {
+         throw std::runtime_error("failed to create unresponsive listener: " + std::string(strerror(errno)));
+      }
+
+      port = ntohs(addr.sin_port);
+   }
+
+   UnresponsiveListener(const UnresponsiveListener &) = delete;
+   UnresponsiveListener& operator=(const UnresponsiveListener &) = delete;
+
+   ~UnresponsiveListener()
+   {
+      ::close(client);
+      ::close(s);
+   }
+
+   const int s;
+
+   const int client;
+
+   uint16_t port;
+};
+
+static socket_address LoopbackSocketAddress(
+   const uint16_t port)
+{
+   const sockaddr_in address = LoopbackAddress(port);
+
+   return make_socket_address(reinterpret_cast<const sockaddr &>(address), sizeof address);
+}
+
+static uint64_t MillisecondsSince(
+   const std::chrono::steady_clock::time_point start)
+{
+   return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+TEST(EpollSocket, TestConnectRaceStartsTheNextAddressWhenTheStaggerPasses)
+{
+   const UnresponsiveListener unresponsive;
+
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(afd_handle(afd), callbacks);
+
+   const socket_address addresses[] = { LoopbackSocketAddress(unresponsive.port), LoopbackSocketAddress(listeningSocket.port) };
+
+   const auto start = std::chrono::steady_clock::now();
+
+   socket.connect(addresses, 5000, 50);
+
+   bool connected = false;
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).WillOnce([&](tcp_socket &)
+   {
+      connected = true;
+   });
+
+   while (!connected && MillisecondsSince(start) < 5000)
+   {
+      afd.run_once(SHORT_TIME_NON_ZERO);
+   }
+
+   EXPECT_TRUE(connected);
+
+   EXPECT_GE(MillisecondsSince(start), 50u);
+   EXPECT_LT(MillisecondsSince(start), 1000u);
+
+   // the loser has gone, and the winner is ours
+
+   EXPECT_EQ(1u, afd.sockets());
+
+   const int s = listeningSocket.Accept();
+
+   EXPECT_EQ(4, socket.write(reinterpret_cast<const uint8_t *>("test"), 4));
+
+   char buffer[10] = {};
+
+   EXPECT_EQ(4, ::recv(s, buffer, sizeof buffer, 0));
+
+   EXPECT_STREQ("test", buffer);
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectRaceStartsTheNextAddressAsSoonAsOneFails)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(afd_handle(afd), callbacks);
+
+   const socket_address addresses[] = { LoopbackSocketAddress(1), LoopbackSocketAddress(listeningSocket.port) };
+
+   const auto start = std::chrono::steady_clock::now();
+
+   socket.connect(addresses, 5000, 2000);
+
+   bool connected = false;
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).WillOnce([&](tcp_socket &)
+   {
+      connected = true;
+   });
+
+   while (!connected && MillisecondsSince(start) < 5000)
+   {
+      afd.run_once(SHORT_TIME_NON_ZERO);
+   }
+
+   EXPECT_TRUE(connected);
+
+   EXPECT_LT(MillisecondsSince(start), 1000u);
+}
+
+TEST(EpollSocket, TestConnectRaceFailsWhenTheDeadlinePasses)
+{
+   const UnresponsiveListener unresponsive;
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(afd_handle(afd), callbacks);
+
+   const socket_address addresses[] = { LoopbackSocketAddress(unresponsive.port), LoopbackSocketAddress(unresponsive.port) };
+
+   const auto start = std::chrono::steady_clock::now();
+
+   socket.connect(addresses, 100, 20);
+
+   bool failed = false;
+
+   EXPECT_CALL(callbacks, on_connection_failed(::testing::_, static_cast<uint32_t>(socket_timed_out))).WillOnce([&](tcp_socket &, uint32_t)
+   {
+      failed = true;
+   });
+
+   while (!failed && MillisecondsSince(start) < 5000)
+   {
+      afd.run_once(SHORT_TIME_NON_ZERO);
+   }
+
+   EXPECT_TRUE(failed);
+
+   EXPECT_GE(MillisecondsSince(start), 100u);
+   EXPECT_LT(MillisecondsSince(start), 1000u);
+
+   EXPECT_EQ(1u, afd.sockets());
+}
+
+TEST(EpollSocket, TestConnectRaceClosedWhilstRacing)
+{
+   const UnresponsiveListener unresponsive;
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(afd_handle(afd), callbacks);
+
+   const socket_address addresses[] = { LoopbackSocketAddress(unresponsive.port) };
+
+   socket.connect(addresses, 100, 20);
+
+   EXPECT_EQ(2u, afd.sockets());
+
+   EXPECT_CALL(callbacks, on_disconnected(::testing::_)).Times(1);
+
+   socket.close();
+
+   EXPECT_EQ(1u, afd.sockets());
+
+   // and the deadline isn't reported
+
+   EXPECT_EQ(0u, afd.run_once(200));
+}
+
+TEST(EpollSocket, TestConnectionBatchConnectsNoMoreThanMaxInFlightAtATime)
+{
+   const ListeningSocket listeningSocket;
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   connection_batch batch(afd, callbacks);
+
+   std::vector<int> accepted;
+
+   // the listener's backlog is only 10, so the batch must wait for each
+   // connect that it has started before it starts more
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(20).WillRepeatedly([&](tcp_socket &)
+   {
+      accepted.push_back(listeningSocket.Accept());
+   });
+
+   batch.connect(reinterpret_cast<const sockaddr &>(address), sizeof address, 20, 4);
+
+   EXPECT_EQ(20u, batch.size());
+   EXPECT_EQ(4u, batch.in_flight());
+   EXPECT_EQ(20u, afd.sockets());
+
+   const auto start = std::chrono::steady_clock::now();
+
+   while (!batch.complete() && MillisecondsSince(start) < 5000)
+   {
+      afd.run_once(SHORT_TIME_NON_ZERO);
+   }
+
+   EXPECT_EQ(20u, batch.connected());
+   EXPECT_EQ(0u, batch.failed());
+   EXPECT_EQ(0u, batch.in_flight());
+   EXPECT_EQ(4u, batch.peak_in_flight());
+
+   const connection_batch::latency latency = batch.connect_latency();
+
+   EXPECT_EQ(20u, latency.samples);
+   EXPECT_LE(latency.p50_us, latency.p99_us);
+   EXPECT_LE(latency.p99_us, latency.max_us);
+
+   for (const int s : accepted)
+   {
+      Close(s);
+   }
+}
+
+TEST(EpollSocket, TestConnectionBatchCountsFailedConnects)
+{
+   const sockaddr_in address = LoopbackAddress(1);
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   connection_batch batch(afd, callbacks);
+
+   EXPECT_CALL(callbacks, on_connection_failed(::testing::_, static_cast<uint32_t>(ECONNREFUSED))).Times(5);
+
+   batch.connect(reinterpret_cast<const sockaddr &>(address), sizeof address, 5, 2);
+
+   const auto start = std::chrono::steady_clock::now();
+
+   while (!batch.complete() && MillisecondsSince(start) < 5000)
+   {
+      afd.run_once(SHORT_TIME_NON_ZERO);
+   }
+
+   EXPECT_EQ(0u, batch.connected());
+   EXPECT_EQ(5u, batch.failed());
+   EXPECT_EQ(2u, batch.peak_in_flight());
+
+   EXPECT_EQ(0u, batch.connect_latency().samples);
+}
+
+TEST(EpollSocket, TestConnectionBatchSocketsAreDestroyedWithTheBatch)
+{
+   const ListeningSocket listeningSocket;
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   {
+      connection_batch batch(afd, callbacks);
+
+      batch.connect(reinterpret_cast<const sockaddr &>(address), sizeof address, 3, 3);
+
+      EXPECT_EQ(3u, afd.sockets());
+   }
+
+   EXPECT_EQ(0u, afd.sockets());
+}
+
+class mock_reactor_wakeup_callbacks : public reactor_wakeup_callbacks
+{
+   public :
+
+   MOCK_METHOD(void, on_wakeup, (reactor_wakeup &), (override));
+};
+
+TEST(EpollSocket, TestWakeupFromAnotherThread)
+{
+   epoll_reactor afd;
+
+   mock_reactor_wakeup_callbacks callbacks;
+
+   reactor_wakeup wakeup(afd_handle(afd), callbacks);
+
+   EXPECT_EQ(0u, afd.run_once(0));
+
+   std::thread waker([&]()
+   {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+      wakeup.wake();
+   });
+
+   EXPECT_CALL(callbacks, on_wakeup(::testing::_)).Times(1);
+
+   const auto start = std::chrono::steady_clock::now();
+
+   EXPECT_EQ(1u, afd.run_once(5000));
+
+   EXPECT_LT(MillisecondsSince(start), 1000u);
+
+   waker.join();
+
+   EXPECT_EQ(0u, afd.run_once(0));
+}
+
+TEST(EpollSocket, TestWakesBeforeTheWakeupIsHandledAreCoalesced)
+{
+   epoll_reactor afd;
+
+   mock_reactor_wakeup_callbacks callbacks;
+
+   reactor_wakeup wakeup(afd_handle(afd), callbacks);
+
+   wakeup.wake();
+   wakeup.wake();
+   wakeup.wake();
+
+   EXPECT_EQ(1u, wakeup.signals());
+
+   EXPECT_CALL(callbacks, on_wakeup(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(0));
+
+   EXPECT_EQ(0u, afd.run_once(0));
+
+   // a wake whilst the callback runs calls it again
+
+   EXPECT_CALL(callbacks, on_wakeup(::testing::_)).Times(2).WillOnce([](reactor_wakeup &woken)
+   {
+      woken.wake();
+   }).WillOnce(::testing::Return());
+
+   wakeup.wake();
+
+   EXPECT_EQ(1u, afd.run_once(0));
+   EXPECT_EQ(1u, afd.run_once(0));
+   EXPECT_EQ(0u, afd.run_once(0));
+
+   EXPECT_EQ(3u, wakeup.signals());
+}
+
+// Counts the wakes that it has seen, as the values that the waking thread
+// stores before each wake
+
+class counting_wakeup_callbacks : public reactor_wakeup_callbacks
+{
+   public :
+
+      void on_wakeup(
+         reactor_wakeup &) override
+      {
+         seen = sent.load(std::memory_order_relaxed);
+      }
+
+      std::atomic<uint64_t> sent{ 0 };
+
+      uint64_t seen = 0;
+};
+
+TEST(EpollSocket, TestWakesRacingTheWakeupAreNeverLost)
+{
+   epoll_reactor afd;
+
+   counting_wakeup_callbacks callbacks;
+
+   reactor_wakeup wakeup(afd_handle(afd), callbacks);
+
+   // the waking thread wakes as fast as it can whilst the reactor handles the
+   // wakes, so that some arrive whilst the wakeup is being drained; once
+   // it's done, the last value that it sent must be seen
+
+   static constexpr uint64_t num_wakes = 200000;
+
+   std::thread waker([&]()
+   {
+      for (uint64_t i = 1; i <= num_wakes; ++i)
+      {
+         callbacks.sent.store(i, std::memory_order_relaxed);
+
+         wakeup.wake();
+      }
+   });
+
+   const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+   while (callbacks.seen != num_wakes && std::chrono::steady_clock::now() < deadline)
+   {
+      afd.run_once(10);
+   }
+
+   waker.join();
+
+   EXPECT_EQ(num_wakes, callbacks.seen);
+}
+
+static std::vector<uint8_t> TestData(
+   const size_t length)
+{
+   std::vector<uint8_t> data(length);
+
+   for (size_t i = 0; i < length; ++i)
+   {
+      data[i] = static_cast<uint8_t>(i * 7);
+   }
+
+   return data;
+}
+
+// Reads whatever has arrived without waiting for more
+
+static void ReadAvailable(
+   const int s,
+   std::vector<uint8_t> &received)
+{
+   uint8_t buffer[65536];
+
+   ssize_t bytes = 0;
+
+   while ((bytes = ::recv(s, buffer, sizeof buffer, MSG_DONTWAIT)) > 0)
+   {
+      received.insert(received.end(), buffer, buffer + bytes);
+   }
+}
+
+TEST(EpollSocket, TestConnectAndWriteQueuesWhatTheSocketWillNotTake)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks, 64 * 1024 * 1024);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   // far more than the socket will take in one go, all of it is accepted
+
+   const std::vector<uint8_t> data = TestData(32 * 1024 * 1024);
+
+   EXPECT_EQ(static_cast<int>(data.size()), socket.write(data.data(), static_cast<int>(data.size())));
+
+   EXPECT_LT(0u, socket.queued_bytes());
+
+   // and later writes go behind it
+
+   static const uint8_t more[] = { 1, 2, 3, 4 };
+
+   EXPECT_EQ(static_cast<int>(sizeof more), socket.write(more, sizeof more));
+
+   std::vector<uint8_t> expected = data;
+
+   expected.insert(expected.end(), more, more + sizeof more);
+
+   // the queue is flushed as the peer reads, and we're told once it's empty
+
+   EXPECT_CALL(callbacks, on_writable(::testing::_)).Times(1);
+
+   std::vector<uint8_t> received;
+
+   for (int i = 0; i < 100000 && received.size() < expected.size(); ++i)
+   {
+      ReadAvailable(s, received);
+
+      afd.run_once(0);
+   }
+
+   EXPECT_EQ(0u, socket.queued_bytes());
+
+   EXPECT_TRUE(expected == received);
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestConnectAndWriteBeyondSendQueueLimitIsPartial)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   constexpr size_t limit = 64 * 1024;
+
+   tcp_socket socket(handle, callbacks, limit);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   const std::vector<uint8_t> data = TestData(32 * 1024 * 1024);
+
+   const int written = socket.write(data.data(), static_cast<int>(data.size()));
+
+   EXPECT_GT(static_cast<int>(data.size()), written);
+
+   EXPECT_EQ(limit, socket.queued_bytes());
+
+   EXPECT_EQ(0, socket.write(data.data(), static_cast<int>(data.size())));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestQueueIsStillFlushedAfterDataIsReported)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks, 64 * 1024 * 1024);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[10];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   const std::vector<uint8_t> data = TestData(32 * 1024 * 1024);
+
+   EXPECT_EQ(static_cast<int>(data.size()), socket.write(data.data(), static_cast<int>(data.size())));
+
+   // the peer sends before it reads, and we're told about the data whilst
+   // we're still waiting to send
+
+   Write(s, "test");
+
+   std::string readable;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).WillRepeatedly([&](tcp_socket &reading)
+   {
+      const int bytes = reading.read(buffer, sizeof buffer);
+
+      readable.append(reinterpret_cast<const char *>(buffer), static_cast<size_t>(bytes));
+   });
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ("test", readable);
+
+   // which doesn't stop the queue being flushed
+
+   EXPECT_CALL(callbacks, on_writable(::testing::_)).Times(1);
+
+   std::vector<uint8_t> received;
+
+   for (int i = 0; i < 100000 && received.size() < data.size(); ++i)
+   {
+      ReadAvailable(s, received);
+
+      afd.run_once(0);
+   }
+
+   EXPECT_TRUE(data == received);
+
+   Close(s);
+}
+
+// An epoll reactor that can also report events as AFD does, epoll doesn't
+// report data alongside a reset, AFD does
+
+class reporting_epoll_reactor : public epoll_reactor
+{
+   public :
+
+      void associate_socket(
+         const uint32_t slot,
+         const reactor_socket s,
+         reactor_events &events) override
+      {
+         pEvents = &events;
+
+         epoll_reactor::associate_socket(slot, s, events);
+      }
+
+      uint32_t report(
+         const uint32_t events)
+      {
+         return pEvents->handle_events(events, 0);
+      }
+
+   private :
+
+      reactor_events *pEvents = nullptr;
+};
+
+TEST(EpollSocket, TestResetFoundByAFlushIsNotFollowedByReadable)
+{
+   const ListeningSocket listeningSocket;
+
+   reporting_epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks, 64 * 1024 * 1024);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   const std::vector<uint8_t> data = TestData(32 * 1024 * 1024);
+
+   EXPECT_EQ(static_cast<int>(data.size()), socket.write(data.data(), static_cast<int>(data.size())));
+
+   EXPECT_LT(0u, socket.queued_bytes());
+
+   // the peer sends and then resets, and we're told that we can send, that
+   // there's data, and that the connection was reset; the flush runs into the
+   // reset first
+
+   Write(s, "test");
+
+   Abort(s);
+
+   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+
+   // there's no point reading from a connection that's gone, a read would
+   // throw
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(0);
+
+   EXPECT_EQ(0u, afd.report(reactor_event::send | reactor_event::receive | reactor_event::abort));
+}
+
+TEST(EpollSocket, TestSendWatermarksMustBeWithinTheQueueLimit)
+{
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks, 1024);
+
+   EXPECT_THROW(socket.set_send_watermarks({ 0, 0, false }), std::exception);
+   EXPECT_THROW(socket.set_send_watermarks({ 512, 512, false }), std::exception);
+   EXPECT_THROW(socket.set_send_watermarks({ 2048, 512, false }), std::exception);
+
+   EXPECT_NO_THROW(socket.set_send_watermarks({ 1024, 0, false }));
+}
+
+TEST(EpollSocket, TestSendWatermarksReportHighAndDrained)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   const size_t high = 1024 * 1024;
+
+   tcp_socket socket(handle, callbacks, 2 * high);
+
+   socket.set_send_watermarks({ high, high / 4, false });
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   // the peer isn't reading, we're told once, when the queue reaches the
+   // high watermark
+
+   EXPECT_CALL(callbacks, on_send_queue_high(::testing::_)).Times(1);
+
+   const std::vector<uint8_t> data = TestData(64 * 1024);
+
+   size_t written = 0;
+
+   while (socket.queued_bytes() < high + data.size())
+   {
+      written += static_cast<size_t>(socket.write(data.data(), static_cast<int>(data.size())));
+   }
+
+   ::testing::Mock::VerifyAndClearExpectations(&callbacks);
+
+   // and once, when it drains to the low watermark, then when it's empty
+
+   EXPECT_CALL(callbacks, on_send_queue_drained(::testing::_)).Times(1);
+   EXPECT_CALL(callbacks, on_writable(::testing::_)).Times(1);
+
+   std::vector<uint8_t> received;
+
+   for (int i = 0; i < 100000 && received.size() < written; ++i)
+   {
+      ReadAvailable(s, received);
+
+      afd.run_once(0);
+   }
+
+   EXPECT_EQ(written, received.size());
+
+   EXPECT_EQ(0u, socket.queued_bytes());
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestReadingIsPausedWhilstTheSendQueueIsHigh)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   const size_t high = 1024 * 1024;
+
+   tcp_socket socket(handle, callbacks, 2 * high);
+
+   socket.set_send_watermarks({ high, high / 4, true });
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   EXPECT_CALL(callbacks, on_send_queue_high(::testing::_)).Times(1);
+
+   const std::vector<uint8_t> data = TestData(64 * 1024);
+
+   size_t written = 0;
+
+   while (!socket.reading_paused())
+   {
+      written += static_cast<size_t>(socket.write(data.data(), static_cast<int>(data.size())));
+   }
+
+   // the peer sends, but isn't reading, so we don't either
+
+   Write(s, "test");
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(0);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   ::testing::Mock::VerifyAndClearExpectations(&callbacks);
+
+   // once the queue drains reading resumes, and what arrived is reported
+
+   EXPECT_CALL(callbacks, on_send_queue_drained(::testing::_)).Times(1);
+   EXPECT_CALL(callbacks, on_writable(::testing::_)).Times(1);
+
+   std::string readable;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).WillRepeatedly([&](tcp_socket &resumed)
+   {
+      char buffer[10];
+
+      const int bytes = resumed.read(reinterpret_cast<uint8_t *>(buffer), sizeof buffer);
+
+      readable.append(buffer, static_cast<size_t>(bytes));
+   });
+
+   std::vector<uint8_t> received;
+
+   for (int i = 0; i < 100000 && (received.size() < written || readable.empty()); ++i)
+   {
+      ReadAvailable(s, received);
+
+      afd.run_once(0);
+   }
+
+   EXPECT_FALSE(socket.reading_paused());
+
+   EXPECT_EQ(written, received.size());
+
+   EXPECT_EQ("test", readable);
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestCorkNeedsASendQueue)
+{
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   EXPECT_THROW(socket.set_cork(true), std::exception);
+
+   EXPECT_NO_THROW(socket.set_cork(false));
+}
+
+TEST(EpollSocket, TestCorkedWritesAreSentWhenTheReactorHasDispatched)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks, 64 * 1024);
+
+   socket.set_cork(true);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[10];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   Write(s, "test");
+
+   // the replies are queued whilst the reactor is dispatching
+
+   size_t queued = 0;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).WillRepeatedly([&](tcp_socket &reading)
+   {
+      if (reading.read(buffer, sizeof buffer) > 0)
+      {
+         for (const char *pReply : { "one", "two", "three" })
+         {
+            EXPECT_EQ(static_cast<int>(strlen(pReply)), reading.write(reinterpret_cast<const uint8_t *>(pReply), static_cast<int>(strlen(pReply))));
+         }
+
+         queued = reading.queued_bytes();
+      }
+   });
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(11u, queued);
+
+   // and sent together once it has
+
+   EXPECT_EQ(0u, socket.queued_bytes());
+
+   EXPECT_EQ(1u, afd.stats().dispatch_completions);
+
+   std::vector<uint8_t> received;
+
+   ReadAvailable(s, received);
+
+   EXPECT_EQ("onetwothree", std::string(received.begin(), received.end()));
+
+   // outside of a pass a write is sent there and then
+
+   EXPECT_EQ(4, socket.write(reinterpret_cast<const uint8_t *>("four"), 4));
+
+   EXPECT_EQ(0u, socket.queued_bytes());
+
+   EXPECT_EQ(1u, afd.stats().dispatch_completions);
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestCorkedSocketDestroyedBeforeTheEndOfDispatchIsNotCalled)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   auto pCorked = std::make_unique<tcp_socket>(afd_handle(afd), callbacks, 64 * 1024);
+
+   pCorked->set_cork(true);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   pCorked->connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   ::testing::Mock::VerifyAndClearExpectations(&callbacks);
+
+   // another socket's handler writes to it, and then destroys it, within the
+   // pass
+
+   tcp_socket socket(afd_handle(afd), callbacks);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).WillOnce([&](tcp_socket &)
+   {
+      EXPECT_EQ(4, pCorked->write(reinterpret_cast<const uint8_t *>("test"), 4));
+
+      EXPECT_EQ(4u, pCorked->queued_bytes());
+
+      pCorked.reset();
+   });
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(0u, afd.stats().dispatch_completions);
+}
+
+TEST(EpollSocket, TestConnectAndReceiveIntoRing)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks, 0, 64);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(0, socket.receive());
+
+   const int s = listeningSocket.Accept();
+
+   const std::string testData("0123456789012345678901234567890123456789");
+
+   Write(s, testData);
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(static_cast<int>(testData.length()), socket.receive());
+
+   std::span<const uint8_t> readable = socket.readable_span();
+
+   EXPECT_EQ(testData, std::string(readable.begin(), readable.end()));
+
+   // the data can be written straight from the ring
+
+   EXPECT_EQ(10, socket.write(readable.data(), 10));
+
+   socket.consume(30);
+
+   // more than there is space for at the end of the ring, so the receive
+   // fills the space at the end and then the start
+
+   Write(s, testData);
+
+   EXPECT_EQ(static_cast<int>(testData.length()), socket.receive());
+
+   EXPECT_EQ(50u, socket.get_receive_ring()->size());
+
+   readable = socket.readable_span();
+
+   EXPECT_EQ(testData.substr(30) + testData.substr(0, 24), std::string(readable.begin(), readable.end()));
+
+   socket.consume(readable.size());
+
+   readable = socket.readable_span();
+
+   EXPECT_EQ(testData.substr(24), std::string(readable.begin(), readable.end()));
+
+   socket.consume(readable.size());
+
+   EXPECT_EQ(0, socket.receive());
+
+   char echoed[10];
+
+   EXPECT_EQ(static_cast<ssize_t>(sizeof echoed), ::recv(s, echoed, sizeof echoed, 0));
+
+   EXPECT_EQ(testData.substr(0, 10), std::string(echoed, sizeof echoed));
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestReceiveWithoutRingFails)
+{
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   EXPECT_THROW(socket.receive(), std::exception);
+   EXPECT_THROW(socket.readable_span(), std::exception);
+}
+
+TEST(EpollSocket, TestTryCallsReportNotConnected)
+{
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   uint8_t buffer[4] {};
+
+   EXPECT_EQ(socket_not_connected, socket.try_read(buffer, sizeof buffer).error());
+   EXPECT_EQ(socket_not_connected, socket.try_write(buffer, sizeof buffer).error());
+   EXPECT_EQ(socket_not_connected, socket.try_shutdown(tcp_socket::shutdown_how::both).error());
+
+   EXPECT_THROW(socket.read(buffer, sizeof buffer), std::exception);
+   EXPECT_THROW(socket.write(buffer, sizeof buffer), std::exception);
+   EXPECT_THROW(socket.shutdown(tcp_socket::shutdown_how::both), std::exception);
+}
+
+TEST(EpollSocket, TestTryReadReportsTheResetAndItsError)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   EXPECT_TRUE(socket.try_connect(reinterpret_cast<const sockaddr &>(address), sizeof(address)));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Abort(listeningSocket.Accept());
+
+   uint8_t buffer[100];
+
+   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+
+   const socket_result<int> result = socket.try_read(buffer, sizeof buffer);
+
+   EXPECT_FALSE(result);
+   EXPECT_EQ(ECONNRESET, result.error());
+   EXPECT_THROW(result.value(), std::exception);
+
+   // the connection has gone, and the reset isn't reported again
+
+   EXPECT_EQ(socket_not_connected, socket.try_read(buffer, sizeof buffer).error());
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestResetFoundByAReadIsNotReportedAgainByThePendingPoll)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   // would block, and polls
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   Abort(listeningSocket.Accept());
+
+   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+
+   EXPECT_FALSE(socket.try_read(buffer, sizeof buffer));
+
+   // the poll completes with the reset, which has already been reported
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestReadableIsCalledAgainWhilstReadsMakeProgress)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[4];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   const int s = listeningSocket.Accept();
+
+   Write(s, "01234567890123456789");
+
+   // each call reads a little, the last one would block and polls again
+
+   std::string received;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(6).WillRepeatedly([&](tcp_socket &readable)
+   {
+      const int bytes = readable.read(buffer, sizeof buffer);
+
+      received.append(reinterpret_cast<const char *>(buffer), static_cast<size_t>(bytes));
+   });
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ("01234567890123456789", received);
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestReadBudgetLetsOthersHaveATurn)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   socket.set_read_budget({ 2, 1024 });
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[4];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   const int s = listeningSocket.Accept();
+
+   Write(s, "0123456789");
+
+   std::string received;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).WillRepeatedly([&](tcp_socket &readable)
+   {
+      const int bytes = readable.read(buffer, sizeof buffer);
+
+      received.append(reinterpret_cast<const char *>(buffer), static_cast<size_t>(bytes));
+   });
+
+   // two reads per report, the socket is told again about what's left
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ("01234567", received);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ("0123456789", received);
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestReadBudgetInBytes)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   socket.set_read_budget({ 100, 6 });
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[4];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   const int s = listeningSocket.Accept();
+
+   Write(s, "0123456789");
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(2).WillRepeatedly([&](tcp_socket &readable)
+   {
+      EXPECT_EQ(4, readable.read(buffer, sizeof buffer));
+   });
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_THROW(socket.set_read_budget({ 0, 6 }), std::exception);
+   EXPECT_THROW(socket.set_read_budget({ 1, 0 }), std::exception);
+
+   Close(s);
+}
+
+TEST(EpollSocket, TestReadBudgetDoesNotApplyOnceThePeerHasClosed)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   const int s = listeningSocket.Accept();
+
+   // far more than the budget of 16 reads, and then the end of the stream,
+   // so both are reported together
+
+   const std::string sent(10000, 'x');
+
+   Write(s, sent);
+
+   Close(s);
+
+   std::string received;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).WillRepeatedly([&](tcp_socket &readable)
+   {
+      const int bytes = readable.read(buffer, sizeof buffer);
+
+      received.append(reinterpret_cast<const char *>(buffer), static_cast<size_t>(bytes));
+   });
+
+   // all of the data is read before the close is reported, and the close is
+   // only reported once
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(sent.size(), received.size());
+
+   afd.run_once(SHORT_TIME_NON_ZERO);
+
+   EXPECT_EQ(sent.size(), received.size());
+}
+
+TEST(EpollSocket, TestHandlerWithoutVirtualCallbacks)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   counting_handler<false> callbacks;
+
+   basic_tcp_socket<counting_handler<false>> socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(1, callbacks.connected);
+
+   uint8_t buffer[100];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   const int s = listeningSocket.Accept();
+
+   Write(s, "test");
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ("test", callbacks.received);
+
+   // the handler has no on_client_close(), the socket still sees the close
+
+   Close(s);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(EpollSocket, TestExpeditedIsOnlyPolledForByHandlersThatWantIt)
+{
+   const ListeningSocket listeningSocket;
+
+   epoll_reactor afd(2);
+
+   counting_handler<false> without_callbacks;
+
+   basic_tcp_socket<counting_handler<false>> without(afd_handle(afd, 0), without_callbacks);
+
+   counting_handler<true> with_callbacks;
+
+   basic_tcp_socket<counting_handler<true>> with(afd_handle(afd, 1), with_callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   without.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   const int s1 = listeningSocket.Accept();
+
+   with.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   const int s2 = listeningSocket.Accept();
+
+   EXPECT_EQ(2u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   EXPECT_EQ(0, without.read(buffer, sizeof buffer));
+   EXPECT_EQ(0, with.read(buffer, sizeof buffer));
+
+   EXPECT_EQ(1, ::send(s1, "!", 1, MSG_OOB));
+   EXPECT_EQ(1, ::send(s2, "!", 1, MSG_OOB));
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(0, without_callbacks.oob);
+   EXPECT_EQ(1, with_callbacks.oob);
+
+   Close(s1);
+   Close(s2);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: test.cpp
+///////////////////////////////////////////////////////////////////////////////
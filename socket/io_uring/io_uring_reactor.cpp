@@ -0,0 +1,938 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: io_uring_reactor.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "io_uring_reactor.h"
+#include "poll_events.h"
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <ctime>
+#include <stdexcept>
+
+// the user data of the operations whose completions aren't poll reports
+
+static constexpr uint64_t control_operation = uint64_t{ 1 } << 63;
+
+static constexpr uint64_t probe_poll = control_operation | 1;
+
+static constexpr uint32_t generation_mask = 0x7FFFFFFF;
+
+static uint64_t now_ms()
+{
+   return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static uint64_t make_key(
+   const uint32_t slot,
+   const uint32_t generation)
+{
+   return (static_cast<uint64_t>(generation & generation_mask) << 32) | slot;
+}
+
+static uint32_t load_acquire(
+   uint32_t *pValue)
+{
+   return std::atomic_ref<uint32_t>(*pValue).load(std::memory_order_acquire);
+}
+
+static void store_release(
+   uint32_t *pValue,
+   const uint32_t value)
+{
+   std::atomic_ref<uint32_t>(*pValue).store(value, std::memory_order_release);
+}
+
+template <typename T>
+static T *ring_pointer(
+   void *pRing,
+   const uint32_t offset)
+{
+   return reinterpret_cast<T *>(static_cast<std::byte *>(pRing) + offset);
+}
+
+io_uring_reactor::io_uring_reactor(
+   const uint32_t num_slots,
+   const uint32_t ring_entries)
+   :  ring_fd(-1),
+      pSubmissionRing(MAP_FAILED),
+      submission_ring_size(0),
+      pCompletionRing(MAP_FAILED),
+      completion_ring_size(0),
+      pSqes(nullptr),
+      sqes_size(0),
+      pSqHead(nullptr),
+      pSqTail(nullptr),
+      pSqArray(nullptr),
+      sq_mask(0),
+      sq_entries(0),
+      pCqHead(nullptr),
+      pCqTail(nullptr),
+      pCqes(nullptr),
+      cq_mask(0),
+      unsubmitted(0),
+      slots(num_slots, slot_data{}),
+      dispatching(false),
+      timers(now_ms()),
+      associated(0),
+      counters{}
+{
+   io_uring_params params {};
+
+   // multishot polls mean that there can be more reports in flight than there
+   // are submissions
+
+   params.flags = IORING_SETUP_CQSIZE;
+   params.cq_entries = ring_entries * 4;
+
+   ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, ring_entries, &params));
+
+   if (ring_fd == -1)
+   {
+      throw std::runtime_error("io_uring_setup - failed to create ring");
+   }
+
+   try
+   {
+      if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_EXT_ARG))
+      {
+         throw std::runtime_error("io_uring - kernel is too old");
+      }
+
+      submission_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+      completion_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+      const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+
+      if (single_mmap)
+      {
+         submission_ring_size = completion_ring_size = std::max(submission_ring_size, completion_ring_size);
+      }
+
+      pSubmissionRing = ::mmap(nullptr, submission_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+
+      if (pSubmissionRing == MAP_FAILED)
+      {
+         throw std::runtime_error("io_uring - failed to map submission ring");
+      }
+
+      pCompletionRing = single_mmap ? pSubmissionRing : ::mmap(nullptr, completion_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+
+      if (pCompletionRing == MAP_FAILED)
+      {
+         throw std::runtime_error("io_uring - failed to map completion ring");
+      }
+
+      sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+      void *pMapped = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+
+      if (pMapped == MAP_FAILED)
+      {
+         throw std::runtime_error("io_uring - failed to map submission entries");
+      }
+
+      pSqes = static_cast<io_uring_sqe *>(pMapped);
+
+      pSqHead = ring_pointer<uint32_t>(pSubmissionRing, params.sq_off.head);
+      pSqTail = ring_pointer<uint32_t>(pSubmissionRing, params.sq_off.tail);
+      pSqArray = ring_pointer<uint32_t>(pSubmissionRing, params.sq_off.array);
+      sq_mask = *ring_pointer<uint32_t>(pSubmissionRing, params.sq_off.ring_mask);
+      sq_entries = params.sq_entries;
+
+      pCqHead = ring_pointer<uint32_t>(pCompletionRing, params.cq_off.head);
+      pCqTail = ring_pointer<uint32_t>(pCompletionRing, params.cq_off.tail);
+      pCqes = ring_pointer<io_uring_cqe>(pCompletionRing, params.cq_off.cqes);
+      cq_mask = *ring_pointer<uint32_t>(pCompletionRing, params.cq_off.ring_mask);
+
+      check_multishot_poll();
+   }
+   catch (...)
+   {
+      release();
+
+      throw;
+   }
+
+   for (uint32_t slot = num_slots; slot > 0; --slot)
+   {
+      free_slots.push_back(slot - 1);
+   }
+}
+
+io_uring_reactor::~io_uring_reactor()
+{
+   // closing the ring cancels the polls that are still armed
+
+   release();
+}
+
+void io_uring_reactor::release()
+{
+   if (pSqes)
+   {
+      ::munmap(pSqes, sqes_size);
+   }
+
+   if (pCompletionRing != MAP_FAILED && pCompletionRing != pSubmissionRing)
+   {
+      ::munmap(pCompletionRing, completion_ring_size);
+   }
+
+   if (pSubmissionRing != MAP_FAILED)
+   {
+      ::munmap(pSubmissionRing, submission_ring_size);
+   }
+
+   if (ring_fd != -1)
+   {
+      ::close(ring_fd);
+   }
+}
+
+void io_uring_reactor::check_multishot_poll()
+{
+   // kernels before 5.13 fail IORING_POLL_ADD_MULTI, and one that completed
+   // the poll without IORING_CQE_F_MORE would report each socket once and
+   // then never again, so we arm one on an eventfd, which is always
+   // writable, and see what it reports
+
+   const int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+   if (fd == -1)
+   {
+      throw std::runtime_error("io_uring - failed to create eventfd");
+   }
+
+   io_uring_sqe sqe {};
+
+   sqe.opcode = IORING_OP_POLL_ADD;
+   sqe.fd = fd;
+   sqe.poll32_events = POLLOUT;
+   sqe.len = IORING_POLL_ADD_MULTI;
+   sqe.user_data = probe_poll;
+
+   push(sqe);
+
+   bool reported = false;
+
+   bool supported = false;
+
+   try
+   {
+      enter(1, 1000);
+
+      uint32_t head = *pCqHead;
+
+      const uint32_t tail = load_acquire(pCqTail);
+
+      while (head != tail)
+      {
+         const io_uring_cqe cqe = pCqes[head & cq_mask];
+
+         store_release(pCqHead, ++head);
+
+         if (cqe.user_data == probe_poll && !reported)
+         {
+            reported = true;
+
+            supported = cqe.res > 0 && (cqe.flags & IORING_CQE_F_MORE);
+         }
+      }
+
+      if (supported)
+      {
+         // the completion of the removal, and of the poll, are control
+         // operations that reap() skips
+
+         io_uring_sqe remove {};
+
+         remove.opcode = IORING_OP_POLL_REMOVE;
+         remove.fd = -1;
+         remove.addr = probe_poll;
+         remove.user_data = control_operation;
+
+         push(remove);
+
+         submit();
+      }
+   }
+   catch (...)
+   {
+      ::close(fd);
+
+      throw;
+   }
+
+   ::close(fd);
+
+   if (!supported)
+   {
+      throw std::runtime_error(reported ? "io_uring - kernel doesn't support multishot polls" : "io_uring - multishot poll check didn't complete");
+   }
+
+   // the check isn't something that the reactor has done
+
+   counters = statistics{};
+}
+
+uint32_t io_uring_reactor::allocate_slot()
+{
+   uint32_t slot;
+
+   if (free_slots.empty())
+   {
+      slot = static_cast<uint32_t>(slots.size());
+
+      slots.push_back(slot_data{});
+   }
+   else
+   {
+      slot = free_slots.back();
+
+      free_slots.pop_back();
+   }
+
+   slots[slot].allocated = true;
+
+   return slot;
+}
+
+void io_uring_reactor::associate_socket(
+   const uint32_t slot,
+   const reactor_socket s,
+   reactor_events &events)
+{
+   slot_data &data = get_slot(slot);
+
+   if (data.pEvents)
+   {
+      throw std::runtime_error("slot already in use");
+   }
+
+   if (!data.allocated)
+   {
+      // a slot that the caller chose rather than one we handed out
+
+      free_slots.erase(std::find(free_slots.begin(), free_slots.end(), slot));
+
+      data.allocated = true;
+   }
+
+   data.s = s;
+   data.pEvents = &events;
+   data.interest = 0;
+   data.last_interest = 0;
+   data.watching = 0;
+   data.kept = 0;
+   data.polling = false;
+   data.closing = false;
+   data.replay_queued = false;
+
+   ++associated;
+}
+
+void io_uring_reactor::disassociate_socket(
+   const uint32_t slot)
+{
+   slot_data &data = get_slot(slot);
+
+   if (!data.allocated)
+   {
+      return;
+   }
+
+   cancel(slot);
+
+   cancel_timer(slot);
+
+   if (data.pEvents)
+   {
+      --associated;
+   }
+
+   data.pEvents = nullptr;
+   data.interest = 0;
+   data.kept = 0;
+   data.allocated = false;
+   data.replay_queued = false;
+
+   data.generation = (data.generation + 1) & generation_mask;
+
+   free_slots.push_back(slot);
+}
+
+bool io_uring_reactor::poll(
+   const uint32_t slot,
+   const uint32_t events)
+{
+   slot_data &data = get_slot(slot);
+
+   data.interest = events;
+
+   if (events)
+   {
+      data.last_interest = events;
+   }
+
+   arm(slot);
+
+   // events are only ever reported from run_once()
+
+   return false;
+}
+
+void io_uring_reactor::closing_socket(
+   const uint32_t slot,
+   const bool poll_pending)
+{
+   cancel(slot);
+
+   slot_data &data = get_slot(slot);
+
+   data.kept = 0;
+
+   // a handler that closes its socket whilst it's being dispatched may return
+   // an interest, which is for the local_close that we report, the descriptor
+   // may be another socket's by the time that it would be polled
+
+   data.closing = true;
+
+   if (poll_pending && (data.interest & reactor_event::local_close))
+   {
+      closed.push_back(make_key(slot, data.generation));
+   }
+}
+
+void io_uring_reactor::deferred(
+   const uint32_t slot,
+   const uint32_t events)
+{
+   // the multishot poll won't report these again unless something changes,
+   // they're replayed when the socket polls for them
+
+   get_slot(slot).kept |= events;
+}
+
+bool io_uring_reactor::after_dispatch(
+   const uint32_t slot)
+{
+   if (!dispatching)
+   {
+      return false;
+   }
+
+   completing.push_back(make_key(slot, get_slot(slot).generation));
+
+   return true;
+}
+
+bool io_uring_reactor::set_timer(
+   const uint32_t slot,
+   const uint32_t timeout_ms)
+{
+   slot_data &data = get_slot(slot);
+
+   timers.cancel(data.timer);
+
+   // a tick more, as part of the current one has already passed
+
+   data.timer = timers.arm(now_ms() + timeout_ms + 1, make_key(slot, data.generation));
+
+   return true;
+}
+
+void io_uring_reactor::cancel_timer(
+   const uint32_t slot)
+{
+   slot_data &data = get_slot(slot);
+
+   timers.cancel(data.timer);
+
+   data.timer = timer_wheel::no_timer;
+}
+
+uint32_t io_uring_reactor::run_once(
+   const int timeout_ms)
+{
+   const int timeout = (replays.empty() && closed.empty()) ? wait_timeout(timeout_ms) : 0;
+
+   if (timeout != 0)
+   {
+      enter(1, timeout);
+   }
+   else if (unsubmitted)
+   {
+      submit();
+   }
+
+   // replays that are queued whilst dispatching wait for the next pass, a
+   // socket that deferred its events goes behind those that have just been
+   // reported
+
+   std::vector<uint64_t> replaying;
+
+   replaying.swap(replays);
+
+   dispatching = true;
+
+   uint32_t dispatched = reap();
+
+   for (const uint64_t key : replaying)
+   {
+      const uint32_t slot = static_cast<uint32_t>(key);
+
+      slot_data &data = slots[slot];
+
+      if (data.generation != static_cast<uint32_t>(key >> 32) || !data.pEvents)
+      {
+         continue;
+      }
+
+      data.replay_queued = false;
+
+      const uint32_t events = data.kept & data.interest;
+
+      if (events)
+      {
+         ++counters.replayed;
+
+         dispatch(slot, events, 0);
+
+         ++dispatched;
+      }
+   }
+
+   std::vector<uint64_t> closing;
+
+   closing.swap(closed);
+
+   for (const uint64_t key : closing)
+   {
+      const uint32_t slot = static_cast<uint32_t>(key);
+
+      if (slots[slot].generation == static_cast<uint32_t>(key >> 32) && slots[slot].pEvents)
+      {
+         dispatch(slot, reactor_event::local_close, 0);
+
+         ++dispatched;
+      }
+   }
+
+   dispatched += expire_timers();
+
+   // anything that these sockets' handlers do happens now, rather than being
+   // left for another pass
+
+   dispatching = false;
+
+   std::vector<uint64_t> complete;
+
+   complete.swap(completing);
+
+   for (const uint64_t key : complete)
+   {
+      const uint32_t slot = static_cast<uint32_t>(key);
+
+      if (slots[slot].generation == static_cast<uint32_t>(key >> 32) && slots[slot].pEvents)
+      {
+         ++counters.dispatch_completions;
+
+         slots[slot].pEvents->dispatch_complete();
+      }
+   }
+
+   return dispatched;
+}
+
+int io_uring_reactor::wait_timeout(
+   const int timeout_ms) const
+{
+   if (!timers.size() || timeout_ms == 0)
+   {
+      return timeout_ms;
+   }
+
+   const uint64_t next = timers.next_expiry();
+
+   const uint64_t now = now_ms();
+
+   const uint64_t until = next > now ? next - now : 0;
+
+   return (timeout_ms < 0 || until < static_cast<uint64_t>(timeout_ms)) ? static_cast<int>(until) : timeout_ms;
+}
+
+uint32_t io_uring_reactor::expire_timers()
+{
+   if (!timers.size())
+   {
+      return 0;
+   }
+
+   uint32_t expired = 0;
+
+   timers.advance(now_ms(), [&](const timer_wheel::timer_id id, const uintptr_t key)
+   {
+      const uint32_t slot = static_cast<uint32_t>(key);
+
+      slot_data &data = slots[slot];
+
+      if (data.generation == static_cast<uint32_t>(static_cast<uint64_t>(key) >> 32) && data.pEvents && data.timer == id)
+      {
+         data.timer = timer_wheel::no_timer;
+
+         ++counters.timers_expired;
+
+         data.pEvents->timer_expired();
+
+         ++expired;
+      }
+   });
+
+   return expired;
+}
+
+uint32_t io_uring_reactor::sockets() const
+{
+   return associated;
+}
+
+const io_uring_reactor::statistics &io_uring_reactor::stats() const
+{
+   return counters;
+}
+
+io_uring_reactor::slot_data &io_uring_reactor::get_slot(
+   const uint32_t slot)
+{
+   if (slot >= slots.size())
+   {
+      throw std::runtime_error("slot out of range");
+   }
+
+   return slots[slot];
+}
+
+void io_uring_reactor::arm(
+   const uint32_t slot)
+{
+   slot_data &data = slots[slot];
+
+   if (!data.pEvents)
+   {
+      throw std::runtime_error("no socket associated with slot");
+   }
+
+   if (data.closing)
+   {
+      return;
+   }
+
+   if (data.interest == 0)
+   {
+      // the poll stays armed, anything that it reports is kept
+
+      return;
+   }
+
+   const uint32_t wanted = to_poll_events(data.interest);
+
+   if (!data.polling)
+   {
+      io_uring_sqe sqe {};
+
+      sqe.opcode = IORING_OP_POLL_ADD;
+      sqe.fd = static_cast<int>(data.s);
+      sqe.poll32_events = wanted;
+      sqe.len = IORING_POLL_ADD_MULTI;
+      sqe.user_data = make_key(slot, data.generation);
+
+      push(sqe);
+
+      data.polling = true;
+      data.watching = wanted;
+
+      ++counters.polls_added;
+   }
+   else if ((data.watching & wanted) != wanted)
+   {
+      // the poll is updated in place, and never narrowed, the reports are
+      // masked by the interest anyway
+
+      io_uring_sqe sqe {};
+
+      sqe.opcode = IORING_OP_POLL_REMOVE;
+      sqe.fd = -1;
+      sqe.addr = make_key(slot, data.generation);
+      sqe.poll32_events = data.watching | wanted;
+      sqe.len = IORING_POLL_ADD_MULTI | IORING_POLL_UPDATE_EVENTS;
+      sqe.user_data = control_operation;
+
+      push(sqe);
+
+      data.watching |= wanted;
+
+      ++counters.polls_updated;
+   }
+
+   if ((data.kept & data.interest) && !data.replay_queued)
+   {
+      replays.push_back(make_key(slot, data.generation));
+
+      data.replay_queued = true;
+   }
+}
+
+void io_uring_reactor::cancel(
+   const uint32_t slot)
+{
+   slot_data &data = slots[slot];
+
+   if (!data.polling)
+   {
+      return;
+   }
+
+   io_uring_sqe sqe {};
+
+   sqe.opcode = IORING_OP_POLL_REMOVE;
+   sqe.fd = -1;
+   sqe.addr = make_key(slot, data.generation);
+   sqe.user_data = control_operation;
+
+   push(sqe);
+
+   data.polling = false;
+   data.watching = 0;
+
+   ++counters.polls_cancelled;
+
+   // now, the poll holds a reference to the socket
+
+   submit();
+}
+
+void io_uring_reactor::push(
+   const io_uring_sqe &sqe)
+{
+   if (unsubmitted == sq_entries)
+   {
+      submit();
+   }
+
+   const uint32_t tail = *pSqTail;
+
+   const uint32_t index = tail & sq_mask;
+
+   pSqes[index] = sqe;
+
+   pSqArray[index] = index;
+
+   store_release(pSqTail, tail + 1);
+
+   ++unsubmitted;
+}
+
+void io_uring_reactor::submit()
+{
+   enter(0, 0);
+}
+
+void io_uring_reactor::enter(
+   const uint32_t wait_for,
+   const int timeout_ms)
+{
+   unsigned flags = 0;
+
+   io_uring_getevents_arg arg {};
+
+   timespec timeout {};
+
+   if (wait_for)
+   {
+      flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+
+      arg.sigmask_sz = _NSIG / 8;
+
+      if (timeout_ms >= 0)
+      {
+         timeout.tv_sec = timeout_ms / 1000;
+         timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+         arg.ts = reinterpret_cast<uint64_t>(&timeout);
+      }
+   }
+
+   ++counters.enters;
+
+   const long result = ::syscall(__NR_io_uring_enter, ring_fd, unsubmitted, wait_for, flags, wait_for ? &arg : nullptr, wait_for ? sizeof arg : 0);
+
+   if (result == -1 && errno != ETIME && errno != EINTR)
+   {
+      throw std::runtime_error("io_uring_enter - failed");
+   }
+
+   // without SQPOLL the kernel has consumed whatever it's going to by now
+
+   unsubmitted = *pSqTail - load_acquire(pSqHead);
+}
+
+uint32_t io_uring_reactor::reap()
+{
+   uint32_t dispatched = 0;
+
+   uint32_t head = *pCqHead;
+
+   const uint32_t tail = load_acquire(pCqTail);
+
+   while (head != tail)
+   {
+      const io_uring_cqe cqe = pCqes[head & cq_mask];
+
+      store_release(pCqHead, ++head);
+
+      if (cqe.user_data & control_operation)
+      {
+         continue;
+      }
+
+      const uint32_t slot = static_cast<uint32_t>(cqe.user_data);
+
+      if (slot >= slots.size())
+      {
+         continue;
+      }
+
+      slot_data &data = slots[slot];
+
+      if (data.generation != static_cast<uint32_t>(cqe.user_data >> 32) || !data.pEvents || !data.polling)
+      {
+         // disassociated, closed, or a report from a poll we've since cancelled
+
+         continue;
+      }
+
+      if (!(cqe.flags & IORING_CQE_F_MORE))
+      {
+         // the poll has ended, it's added again the next time that the socket
+         // polls
+
+         data.polling = false;
+         data.watching = 0;
+      }
+
+      if (cqe.res < 0)
+      {
+         // the poll has failed, rather than leave the socket waiting for a
+         // report that will never come we tell it, as a reset, or as a failed
+         // connect if it's connecting; if it isn't polling then it's told when
+         // it next polls and the poll that we add then fails too
+
+         if (data.interest)
+         {
+            ++counters.polls_failed;
+
+            const uint32_t failure = (data.interest & reactor_event::connect_fail) ? reactor_event::connect_fail : reactor_event::abort;
+
+            dispatch(slot, data.interest & failure, -cqe.res);
+
+            ++dispatched;
+         }
+
+         continue;
+      }
+
+      ++counters.completions;
+
+      // a socket that isn't polling can't be connecting
+
+      const uint32_t interest = data.interest ? data.interest : (data.last_interest & ~reactor_event::connect_fail);
+
+      int32_t status = 0;
+
+      const uint32_t events = from_poll_events(static_cast<int>(data.s), interest, static_cast<uint32_t>(cqe.res), status);
+
+      data.kept |= events & ~data.interest;
+
+      if ((events & data.interest) || (status && data.interest))
+      {
+         dispatch(slot, events & data.interest, status);
+
+         ++dispatched;
+      }
+      else if (!data.polling && data.interest)
+      {
+         arm(slot);
+      }
+   }
+
+   return dispatched;
+}
+
+void io_uring_reactor::dispatch(
+   const uint32_t slot,
+   const uint32_t events,
+   const int32_t status)
+{
+   const uint32_t generation = slots[slot].generation;
+
+   slots[slot].kept &= ~events;
+
+   const uint32_t interest = slots[slot].pEvents->handle_events(events, status);
+
+   // the handler may have disassociated the slot, or allocated more
+
+   slot_data &data = slots[slot];
+
+   if (data.generation != generation || !data.pEvents)
+   {
+      return;
+   }
+
+   data.interest = interest;
+
+   if (interest)
+   {
+      data.last_interest = interest;
+
+      arm(slot);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: io_uring_reactor.cpp
+///////////////////////////////////////////////////////////////////////////////
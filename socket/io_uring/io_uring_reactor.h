@@ -0,0 +1,245 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: io_uring_reactor.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "reactor.h"
+#include "timer_wheel.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// A reactor over an io_uring instance, for Linux, driven with the raw system
+// calls rather than liburing.
+//
+// Each socket has one multishot poll (IORING_OP_POLL_ADD with
+// IORING_POLL_ADD_MULTI) which stays armed for as long as the socket is
+// associated, so re-polling after a report costs nothing; the poll is only
+// touched when the socket's interest grows beyond the conditions that it is
+// watching, and then it's updated in place. Sockets still see AFD style one-
+// shot polls. A report for events that the socket isn't polling for is kept
+// and replayed when the socket next polls for them, which may be after the
+// socket has consumed them, sockets treat a report as a hint, as they have to
+// anyway. Events that a socket defers are kept and replayed in the same way.
+// Sockets that ask are called once everything that a pass reported, replayed
+// and closed has been dispatched. Socket timers are held in a timer_wheel, in
+// milliseconds of the steady clock, and the wait is no longer than it takes
+// for the next one to expire.
+//
+// Submissions are batched and made when the reactor next waits, apart from
+// cancellations, which are made as soon as a socket closes, the poll holds a
+// reference to the socket and would otherwise keep the connection open.
+//
+// Multishot accept isn't used, tcp_listening_socket accepts for itself once it
+// is told that there are connections to accept, the multishot poll removes
+// the re-arm for listening sockets as it does for connected ones.
+//
+// Multishot polls need Linux 5.13 or later, the constructor checks that one
+// can be armed and throws if not. A poll that fails once it has been armed is
+// reported to the socket as a reset, or a failed connect, with the error as
+// the status.
+//
+// Events are mapped as for epoll, see poll_events.h. Not thread safe, a reactor
+// is run by a single thread.
+
+class io_uring_reactor : public reactor
+{
+   public :
+
+      // num_slots are available to sockets that are given a slot rather than
+      // allocating one, more are added as slots are allocated
+
+      explicit io_uring_reactor(
+         uint32_t num_slots = 1,
+         uint32_t ring_entries = 4096);
+
+      io_uring_reactor(
+         const io_uring_reactor &) = delete;
+
+      io_uring_reactor &operator=(
+         const io_uring_reactor &) = delete;
+
+      ~io_uring_reactor() override;
+
+      uint32_t allocate_slot() override;
+
+      void associate_socket(
+         uint32_t slot,
+         reactor_socket s,
+         reactor_events &events) override;
+
+      void disassociate_socket(
+         uint32_t slot) override;
+
+      bool poll(
+         uint32_t slot,
+         uint32_t events) override;
+
+      void closing_socket(
+         uint32_t slot,
+         bool poll_pending) override;
+
+      void deferred(
+         uint32_t slot,
+         uint32_t events) override;
+
+      bool after_dispatch(
+         uint32_t slot) override;
+
+      bool set_timer(
+         uint32_t slot,
+         uint32_t timeout_ms) override;
+
+      void cancel_timer(
+         uint32_t slot) override;
+
+      // Submits any pending changes, waits for up to timeout_ms for sockets to
+      // report, -1 waits forever, and dispatches what they report. Returns the
+      // number of sockets that were dispatched.
+
+      uint32_t run_once(
+         int timeout_ms);
+
+      uint32_t sockets() const;
+
+      struct statistics
+      {
+         uint64_t enters;                    // io_uring_enter calls
+         uint64_t polls_added;
+         uint64_t polls_updated;             // interest grew beyond the poll
+         uint64_t polls_cancelled;
+         uint64_t polls_failed;              // reported to the socket
+         uint64_t completions;               // poll reports read from the ring
+         uint64_t replayed;                  // kept reports replayed on a poll
+         uint64_t dispatch_completions;      // dispatch_complete() calls
+         uint64_t timers_expired;
+      };
+
+      const statistics &stats() const;
+
+   private :
+
+      struct slot_data
+      {
+         reactor_socket s;
+         reactor_events *pEvents;
+         uint32_t interest;                  // the events the socket is polling for
+         uint32_t last_interest;             // the last non-zero interest, to interpret reports with
+         uint32_t watching;                  // the conditions of the multishot poll
+         uint32_t kept;                      // events reported whilst the socket wasn't polling for them
+         uint32_t generation;                // bumped on disassociate, stale reports are ignored
+         timer_wheel::timer_id timer;
+         bool polling;                       // the multishot poll is armed
+         bool closing;                       // the descriptor is being closed, and is never polled again
+         bool allocated;
+         bool replay_queued;
+      };
+
+      slot_data &get_slot(
+         uint32_t slot);
+
+      void arm(
+         uint32_t slot);
+
+      void cancel(
+         uint32_t slot);
+
+      void push(
+         const io_uring_sqe &sqe);
+
+      void submit();
+
+      void enter(
+         uint32_t wait_for,
+         int timeout_ms);
+
+      uint32_t reap();
+
+      void release();
+
+      void check_multishot_poll();
+
+      void dispatch(
+         uint32_t slot,
+         uint32_t events,
+         int32_t status);
+
+      int wait_timeout(
+         int timeout_ms) const;
+
+      uint32_t expire_timers();
+
+      int ring_fd;
+
+      void *pSubmissionRing;
+      size_t submission_ring_size;
+
+      void *pCompletionRing;
+      size_t completion_ring_size;
+
+      io_uring_sqe *pSqes;
+      size_t sqes_size;
+
+      uint32_t *pSqHead;
+      uint32_t *pSqTail;
+      uint32_t *pSqArray;
+      uint32_t sq_mask;
+      uint32_t sq_entries;
+
+      uint32_t *pCqHead;
+      uint32_t *pCqTail;
+      io_uring_cqe *pCqes;
+      uint32_t cq_mask;
+
+      uint32_t unsubmitted;
+
+      std::vector<slot_data> slots;
+
+      std::vector<uint32_t> free_slots;
+
+      std::vector<uint64_t> replays;         // slot and generation of sockets with kept events to replay
+
+      std::vector<uint64_t> closed;          // slot and generation of sockets to report local_close for
+
+      std::vector<uint64_t> completing;      // slot and generation of sockets waiting for the end of dispatch
+
+      bool dispatching;
+
+      timer_wheel timers;
+
+      uint32_t associated;
+
+      statistics counters;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: io_uring_reactor.h
+///////////////////////////////////////////////////////////////////////////////
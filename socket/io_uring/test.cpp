@@ -0,0 +1,3034 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: test.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "third_party/GoogleTest/gtest.h"
+#include "third_party/GoogleTest/gmock.h"
+
+#include "tcp_socket.h"
+#include "connection_pool.h"
+#include "listening_socket/tcp_listening_socket.h"
+#include "listening_socket/accept_fan_out.h"
+#include "listening_socket/tcp_listening_socket_group.h"
+#include "io_uring_reactor.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The AFDSocket scenarios, run against the io_uring reactor. Where Linux reports
+// something different from AFD the test says so and expects what Linux does.
+
+static constexpr int SHORT_TIME_NON_ZERO = 100;
+
+int main(int argc, char **argv) {
+   testing::InitGoogleTest(&argc, argv);
+
+   return RUN_ALL_TESTS();
+}
+
+class ListeningSocket
+{
+   public :
+
+   ListeningSocket()
+      :  s(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)),
+         port(0)
+   {
+      sockaddr_in addr {};
+
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+      socklen_t addressLength = sizeof addr;
+
+      if (s == -1 ||
+          0 != ::bind(s, reinterpret_cast<const sockaddr *>(&addr), sizeof addr) ||
+          0 != ::listen(s, 10) ||
+          0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&addr), &addressLength))
+      {
+         throw std::runtime_error("failed to create listening socket: " + std::string(strerror(errno)));
+      }
+
+      port = ntohs(addr.sin_port);
+   }
+
+   ListeningSocket(const ListeningSocket &) = delete;
+   ListeningSocket& operator=(const ListeningSocket &) = delete;
+
+   [[nodiscard]] int Accept() const
+   {
+      const int accepted = ::accept(s, nullptr, nullptr);
+
+      if (accepted == -1)
+      {
+         throw std::runtime_error("accept: " + std::string(strerror(errno)));
+      }
+
+      return accepted;
+   }
+
+   ~ListeningSocket()
+   {
+      ::close(s);
+   }
+
+   const int s;
+
+   uint16_t port;
+};
+
+static void Write(
+   const int s,
+   const std::string &message)
+{
+   if (static_cast<ssize_t>(message.length()) != ::send(s, message.data(), message.length(), MSG_NOSIGNAL))
+   {
+      throw std::runtime_error("send: " + std::string(strerror(errno)));
+   }
+}
+
+static void Abort(
+   const int s)
+{
+   linger lingerStruct {};
+
+   lingerStruct.l_onoff = 1;
+   lingerStruct.l_linger = 0;
+
+   if (0 != ::setsockopt(s, SOL_SOCKET, SO_LINGER, &lingerStruct, sizeof lingerStruct))
+   {
+      throw std::runtime_error("Abort - setsockopt: " + std::string(strerror(errno)));
+   }
+
+   ::close(s);
+}
+
+static void Close(
+   const int s)
+{
+   ::close(s);
+}
+
+static uint16_t GetAvailablePort()
+{
+   const ListeningSocket s;
+
+   return s.port;
+}
+
+static sockaddr_in LoopbackAddress(
+   const uint16_t port)
+{
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   address.sin_port = htons(port);
+
+   return address;
+}
+
+class mock_tcp_socket_callbacks : public tcp_socket_callbacks
+{
+   public :
+
+   MOCK_METHOD(void, on_connected, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_connection_failed, (tcp_socket &, uint32_t), (override));
+   MOCK_METHOD(void, on_readable, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_readable_oob, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_writable, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_client_close, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_connection_reset, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_disconnected, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_send_queue_high, (tcp_socket &), (override));
+   MOCK_METHOD(void, on_send_queue_drained, (tcp_socket &), (override));
+};
+
+class mock_tcp_listening_socket_callbacks : public tcp_listening_socket_callbacks
+{
+   public :
+
+   MOCK_METHOD(void, on_incoming_connections, (tcp_listening_socket &), (override));
+   MOCK_METHOD(void, on_connection_reset, (tcp_listening_socket &), (override));
+   MOCK_METHOD(void, on_disconnected, (tcp_listening_socket &), (override));
+};
+
+TEST(IoUringSocket, TestConstruct)
+{
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   EXPECT_EQ(1u, afd.sockets());
+}
+
+class recording_events : public reactor_events
+{
+   public :
+
+   uint32_t handle_events(
+      const uint32_t events,
+      const int32_t status) override
+   {
+      reported.emplace_back(events, status);
+
+      return 0;
+   }
+
+   std::vector<std::pair<uint32_t, int32_t>> reported;
+};
+
+TEST(IoUringSocket, TestFailedPollIsReportedToTheSocket)
+{
+   io_uring_reactor afd;
+
+   // the construction checks that multishot polls work, and isn't counted
+
+   EXPECT_EQ(0u, afd.stats().enters);
+
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   ASSERT_NE(-1, s);
+
+   recording_events events;
+
+   afd.associate_socket(0, s, events);
+
+   afd.poll(0, reactor_event::receive | reactor_event::abort);
+
+   // the poll is submitted when the reactor next waits, by which time the
+   // descriptor has gone, so it fails
+
+   Close(s);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   ASSERT_EQ(1u, events.reported.size());
+
+   EXPECT_EQ(reactor_event::abort, events.reported[0].first);
+   EXPECT_EQ(EBADF, events.reported[0].second);
+
+   EXPECT_EQ(1u, afd.stats().polls_failed);
+
+   afd.disassociate_socket(0);
+}
+
+TEST(IoUringSocket, TestConnectFail)
+{
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   /* Attempt to connect to an address that we won't be able to connect to. */
+   const sockaddr_in address = LoopbackAddress(1);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connection_failed(::testing::_, ECONNREFUSED)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(-1));
+}
+
+TEST(IoUringSocket, TestConnect)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectAndSend)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   static const uint8_t data[] = { 1, 2, 3, 4 };
+
+   EXPECT_EQ(static_cast<int>(sizeof data), socket.write(data, sizeof data));
+}
+
+TEST(IoUringSocket, TestConnectAndRecv)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   // Note that at present the remote end hasn't accepted
+
+   const int s = listeningSocket.Accept();
+
+   const std::string testData("test");
+
+   Write(s, testData);
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, static_cast<int>(testData.length()));
+
+   EXPECT_EQ(0, memcmp(testData.c_str(), buffer, available));
+
+   available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndLocalCloseWithNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_CALL(callbacks, on_disconnected(::testing::_)).Times(1);
+
+   socket.close();
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectAndLocalCloseWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   socket.close();
+
+   EXPECT_CALL(callbacks, on_disconnected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectAndLocalShutdownSendNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   socket.shutdown(tcp_socket::shutdown_how::send);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndLocalShutdownSendWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   socket.shutdown(tcp_socket::shutdown_how::send);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndLocalShutdownRecvNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   socket.shutdown(tcp_socket::shutdown_how::receive);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndLocalShutdownRecvWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   socket.shutdown(tcp_socket::shutdown_how::receive);
+
+   // AFD reports nothing, Linux reports the end of our receive side as a
+   // client close
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndLocalShutdownBothNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   socket.shutdown(tcp_socket::shutdown_how::both);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndLocalShutdownBothWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   socket.shutdown(tcp_socket::shutdown_how::both);
+
+   // AFD reports nothing, Linux reports the end of our receive side as a
+   // client close
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteCloseNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Close(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteCloseWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   Close(s);
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteCloseWithNoPollPendingDetectsOnNextRead)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Close(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteCloseWithNoPollPendingDoesNotDetectOnNextWrite)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Close(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   static const uint8_t data[] = { 1, 2, 3, 4 };
+
+   const int sent = socket.write(data, sizeof data);
+
+   EXPECT_EQ(sent, static_cast<int>(sizeof data));
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteResetNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Abort(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteResetWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   Abort(s);
+
+   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteResetWithNoPollPendingDetectsOnNextRead)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Abort(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   // unlike epoll, the multishot poll has already seen the reset, and taken
+   // the socket's error with it, so the read finds the end of the stream and
+   // the reset that the reactor kept is reported when the socket polls
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteResetWithNoPollPendingDetectsOnNextWrite)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   Abort(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   static const uint8_t data[] = { 1, 2, 3, 4 };
+
+   // the write reports the reset, and doesn't poll to be told when it can
+   // write the rest
+
+   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+
+   const int sent = socket.write(data, sizeof data);
+
+   EXPECT_EQ(sent, 0);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteShutdownSendNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   ::shutdown(s, SHUT_WR);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteShutdownSendWithPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   ::shutdown(s, SHUT_WR);
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteShutdownSendWithNoPollPendingDetectsOnNextRead)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   ::shutdown(s, SHUT_WR);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteShutdownSendWithNoPollPendingDoesNotDetectOnNextWrite)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   ::shutdown(s, SHUT_WR);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   static const uint8_t data[] = { 1, 2, 3, 4 };
+
+   const int sent = socket.write(data, sizeof data);
+
+   EXPECT_EQ(sent, static_cast<int>(sizeof data));
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteShutdownRecvNoPollPending)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   ::shutdown(s, SHUT_RD);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectAndRemoteShutdownRecvWithPollPendingDetectsNothing)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   ::shutdown(s, SHUT_RD);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectNoContiguousHandleArray)
+{
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 1);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   // slot 1 is outside of the single slot that we have
+
+   EXPECT_THROW(tcp_socket socket(handle, callbacks), std::exception);
+}
+
+TEST(IoUringSocket, TestConnectMultipleSocketsOnSingleReactor)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd(2);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket1(afd_handle(afd, 0), callbacks);
+
+   tcp_socket socket2(afd_handle(afd, 1), callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket1.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   socket2.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectMultipleSocketsWithAllocatedSlots)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   const afd_handle handle1(afd);
+
+   const afd_handle handle2(afd);
+
+   EXPECT_NE(handle1.slot, handle2.slot);
+
+   tcp_socket socket1(handle1, callbacks);
+
+   tcp_socket socket2(handle2, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket1.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   socket2.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestConnectMultipleSocketsReportInOneWait)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket1(afd_handle(afd), callbacks);
+
+   tcp_socket socket2(afd_handle(afd), callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket1.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   socket2.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   // unlike the sharded AFD system there is one wait for all of the sockets
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(2);
+
+   EXPECT_EQ(2u, afd.run_once(SHORT_TIME_NON_ZERO));
+}
+
+TEST(IoUringSocket, TestReportsNothingForAClosedSlot)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   int available = socket.read(buffer, buffer_length);
+
+   EXPECT_EQ(available, 0);
+
+   const int s = listeningSocket.Accept();
+
+   Write(s, "test");
+
+   // the socket goes away with data waiting for it
+
+   afd.disassociate_socket(handle.slot);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+}
+
+
+TEST(IoUringSocket, TestRepollDoesNotRearm)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(3);
+
+   for (int i = 0; i < 3; ++i)
+   {
+      EXPECT_EQ(0, socket.read(buffer, buffer_length));
+
+      Write(s, "test");
+
+      EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+      EXPECT_EQ(4, socket.read(buffer, buffer_length));
+   }
+
+   // one poll for the connect, which is widened once to include receive, and
+   // then left alone
+
+   EXPECT_EQ(1u, afd.stats().polls_added);
+   EXPECT_EQ(1u, afd.stats().polls_updated);
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestReportWhilstNotPollingIsReplayedOnPoll)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   int buffer_length = sizeof buffer;
+
+   EXPECT_EQ(0, socket.read(buffer, buffer_length));
+
+   Write(s, "test");
+
+   // the socket doesn't read, so it isn't polling after this
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(2);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   Close(s);
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(4, socket.read(buffer, buffer_length));
+
+   EXPECT_EQ(0, socket.read(buffer, buffer_length));
+
+   // the poll already covers the interest, so the kept report is replayed, the
+   // data that it reported has been read since, a report is only ever a hint
+
+   EXPECT_CALL(callbacks, on_client_close(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(1u, afd.stats().replayed);
+   EXPECT_EQ(1u, afd.stats().polls_updated);
+}
+
+// A listener whose backlog is full, so that connections to it neither succeed
+// nor fail, the SYNs are dropped and the connect waits for its retries.
+
+class UnresponsiveListener
+{
+   public :
+
+   UnresponsiveListener()
+      :  s(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)),
+         client(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)),
+         port(0)
+   {
+      sockaddr_in addr = LoopbackAddress(0);
+
+      socklen_t addressLength = sizeof addr;
+
+      if (s == -1 ||
+          0 != ::bind(s, reinterpret_cast<const sockaddr *>(&addr), sizeof addr) ||
+          0 != ::listen(s, 0) ||
+          0 != ::getsockname(s, reinterpret_cast<sockaddr *>(&addr), &addressLength) ||
+          0 != ::connect(client, reinterpret_cast<const sockaddr *>(&addr), sizeof addr))
+      {
+         throw std::runtime_error("failed to create unresponsive listener: " + std::string(strerror(errno)));
+      }
+
+      port = ntohs(addr.sin_port);
+   }
+
+   UnresponsiveListener(const UnresponsiveListener &) = delete;
+   UnresponsiveListener& operator=(const UnresponsiveListener &) = delete;
+
+   ~UnresponsiveListener()
+   {
+      ::close(client);
+      ::close(s);
+   }
+
+   const int s;
+
+   const int client;
+
+   uint16_t port;
+};
+
+static socket_address LoopbackSocketAddress(
+   const uint16_t port)
+{
+   const sockaddr_in address = LoopbackAddress(port);
+
+   return make_socket_address(reinterpret_cast<const sockaddr &>(address), sizeof address);
+}
+
+static uint64_t MillisecondsSince(
+   const std::chrono::steady_clock::time_point start)
+{
+   return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+TEST(IoUringSocket, TestConnectRaceStartsTheNextAddressWhenTheStaggerPasses)
+{
+   const UnresponsiveListener unresponsive;
+
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(afd_handle(afd), callbacks);
+
+   const socket_address addresses[] = { LoopbackSocketAddress(unresponsive.port), LoopbackSocketAddress(listeningSocket.port) };
+
+   const auto start = std::chrono::steady_clock::now();
+
+   socket.connect(addresses, 5000, 50);
+
+   bool connected = false;
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).WillOnce([&](tcp_socket &)
+   {
+      connected = true;
+   });
+
+   while (!connected && MillisecondsSince(start) < 5000)
+   {
+      afd.run_once(SHORT_TIME_NON_ZERO);
+   }
+
+   EXPECT_TRUE(connected);
+
+   EXPECT_GE(MillisecondsSince(start), 50u);
+   EXPECT_LT(MillisecondsSince(start), 1000u);
+
+   // the loser has gone, and the winner is ours
+
+   EXPECT_EQ(1u, afd.sockets());
+
+   const int s = listeningSocket.Accept();
+
+   EXPECT_EQ(4, socket.write(reinterpret_cast<const uint8_t *>("test"), 4));
+
+   char buffer[10] = {};
+
+   EXPECT_EQ(4, ::recv(s, buffer, sizeof buffer, 0));
+
+   EXPECT_STREQ("test", buffer);
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestConnectRaceFailsWhenTheDeadlinePasses)
+{
+   const UnresponsiveListener unresponsive;
+
+   io_uring_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(afd_handle(afd), callbacks);
+
+   const socket_address addresses[] = { LoopbackSocketAddress(unresponsive.port), LoopbackSocketAddress(unresponsive.port) };
+
+   const auto start = std::chrono::steady_clock::now();
+
+   socket.connect(addresses, 100, 20);
+
+   bool failed = false;
+
+   EXPECT_CALL(callbacks, on_connection_failed(::testing::_, static_cast<uint32_t>(socket_timed_out))).WillOnce([&](tcp_socket &, uint32_t)
+   {
+      failed = true;
+   });
+
+   while (!failed && MillisecondsSince(start) < 5000)
+   {
+      afd.run_once(SHORT_TIME_NON_ZERO);
+   }
+
+   EXPECT_TRUE(failed);
+
+   EXPECT_GE(MillisecondsSince(start), 100u);
+   EXPECT_LT(MillisecondsSince(start), 1000u);
+
+   EXPECT_EQ(1u, afd.sockets());
+}
+
+TEST(IoUringSocket, TestSocketClosedByItsHandlerWithAPollPendingIsNotPolledAgain)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(afd_handle(afd), callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[100];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   Write(s, "test");
+
+   // the handler reads until the read would block, which polls again, and
+   // then closes the socket; the descriptor is closed, and could be another
+   // thread's next socket by the time the handler returns, so it mustn't be
+   // polled
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).WillOnce([&](tcp_socket &readable)
+   {
+      EXPECT_EQ(4, readable.read(buffer, sizeof buffer));
+      EXPECT_EQ(0, readable.read(buffer, sizeof buffer));
+
+      readable.close();
+   });
+
+   EXPECT_CALL(callbacks, on_disconnected(::testing::_)).Times(1);
+
+   EXPECT_EQ(2u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(0u, afd.run_once(0));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestListeningSocketAccepts)
+{
+   io_uring_reactor afd;
+
+   mock_tcp_listening_socket_callbacks callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket socket(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), callbacks);
+
+   socket.listen(10);
+
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   ASSERT_EQ(0, ::connect(s, reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+
+   EXPECT_CALL(callbacks, on_incoming_connections(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   sockaddr_in client_address {};
+
+   socket_length client_address_length = sizeof client_address;
+
+   const reactor_socket client_socket = socket.accept(reinterpret_cast<sockaddr &>(client_address), client_address_length);
+
+   EXPECT_NE(invalid_socket, client_socket);
+
+   // the listening socket's poll stays armed, the next connection is reported
+   // without it having been re-armed
+
+   const int s2 = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   ASSERT_EQ(0, ::connect(s2, reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+
+   EXPECT_CALL(callbacks, on_incoming_connections(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(1u, afd.stats().polls_added);
+   EXPECT_EQ(0u, afd.stats().polls_updated);
+
+   Close(s);
+   Close(s2);
+   close_socket(client_socket);
+}
+
+TEST(IoUringSocket, TestReadableIsCalledAgainWhilstReadsMakeProgress)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[4];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   const int s = listeningSocket.Accept();
+
+   Write(s, "01234567890123456789");
+
+   // each call reads a little, the last one would block and polls again
+
+   std::string received;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(6).WillRepeatedly([&](tcp_socket &readable)
+   {
+      const int bytes = readable.read(buffer, sizeof buffer);
+
+      received.append(reinterpret_cast<const char *>(buffer), static_cast<size_t>(bytes));
+   });
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ("01234567890123456789", received);
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestReadBudgetLetsOthersHaveATurn)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   socket.set_read_budget({ 2, 1024 });
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[4];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   const int s = listeningSocket.Accept();
+
+   Write(s, "0123456789");
+
+   std::string received;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).WillRepeatedly([&](tcp_socket &readable)
+   {
+      const int bytes = readable.read(buffer, sizeof buffer);
+
+      received.append(reinterpret_cast<const char *>(buffer), static_cast<size_t>(bytes));
+   });
+
+   // two reads per report, the socket is told again about what's left
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ("01234567", received);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ("0123456789", received);
+
+   // the multishot poll wouldn't report the data again, it was kept
+
+   EXPECT_EQ(1u, afd.stats().replayed);
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestReadBudgetInBytes)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks);
+
+   socket.set_read_budget({ 100, 6 });
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   uint8_t buffer[4];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   const int s = listeningSocket.Accept();
+
+   Write(s, "0123456789");
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(2).WillRepeatedly([&](tcp_socket &readable)
+   {
+      EXPECT_EQ(4, readable.read(buffer, sizeof buffer));
+   });
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_THROW(socket.set_read_budget({ 0, 6 }), std::exception);
+   EXPECT_THROW(socket.set_read_budget({ 1, 0 }), std::exception);
+
+   Close(s);
+}
+
+// A connection that's constructed from an accepted socket.
+
+class pooled_connection
+{
+   public :
+
+      pooled_connection(
+         const reactor_socket accepted,
+         reactor &afd,
+         tcp_socket_callbacks &callbacks)
+         :  s(afd_handle(afd), accepted, callbacks)
+      {
+      }
+
+      tcp_socket s;
+};
+
+// Reads whatever has arrived without waiting for more
+
+static size_t ReadAvailable(
+   const int s)
+{
+   uint8_t buffer[65536];
+
+   size_t total = 0;
+
+   ssize_t bytes = 0;
+
+   while ((bytes = ::recv(s, buffer, sizeof buffer, MSG_DONTWAIT)) > 0)
+   {
+      total += static_cast<size_t>(bytes);
+   }
+
+   return total;
+}
+
+TEST(IoUringSocket, TestReadingIsPausedWhilstTheSendQueueIsHigh)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   const size_t high = 1024 * 1024;
+
+   tcp_socket socket(handle, callbacks, 2 * high);
+
+   socket.set_send_watermarks({ high, high / 4, true });
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   // polls for reads, the multishot poll is armed before we pause
+
+   uint8_t buffer[10];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   EXPECT_CALL(callbacks, on_send_queue_high(::testing::_)).Times(1);
+
+   const std::vector<uint8_t> data(64 * 1024, 7);
+
+   size_t written = 0;
+
+   while (!socket.reading_paused())
+   {
+      written += static_cast<size_t>(socket.write(data.data(), static_cast<int>(data.size())));
+   }
+
+   // the pending poll reports the data, but it's left where it is
+
+   Write(s, "test");
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(0);
+
+   afd.run_once(SHORT_TIME_NON_ZERO);
+
+   ::testing::Mock::VerifyAndClearExpectations(&callbacks);
+
+   // and reported again once the queue has drained, even though nothing has
+   // changed for the multishot poll to report
+
+   EXPECT_CALL(callbacks, on_send_queue_drained(::testing::_)).Times(1);
+   EXPECT_CALL(callbacks, on_writable(::testing::_)).Times(1);
+
+   std::string readable;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).WillRepeatedly([&](tcp_socket &resumed)
+   {
+      const int bytes = resumed.read(buffer, sizeof buffer);
+
+      readable.append(reinterpret_cast<const char *>(buffer), static_cast<size_t>(bytes));
+   });
+
+   size_t received = 0;
+
+   for (int i = 0; i < 100000 && (received < written || readable.empty()); ++i)
+   {
+      received += ReadAvailable(s);
+
+      afd.run_once(0);
+   }
+
+   EXPECT_FALSE(socket.reading_paused());
+
+   EXPECT_EQ(written, received);
+
+   EXPECT_EQ("test", readable);
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestCorkedWritesAreSentWhenTheReactorHasDispatched)
+{
+   const ListeningSocket listeningSocket;
+
+   io_uring_reactor afd;
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks, 64 * 1024);
+
+   socket.set_cork(true);
+
+   const sockaddr_in address = LoopbackAddress(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   const int s = listeningSocket.Accept();
+
+   uint8_t buffer[10];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   Write(s, "test");
+
+   // the replies are queued whilst the reactor is dispatching
+
+   size_t queued = 0;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).WillRepeatedly([&](tcp_socket &reading)
+   {
+      if (reading.read(buffer, sizeof buffer) > 0)
+      {
+         for (const char *pReply : { "one", "two", "three" })
+         {
+            EXPECT_EQ(static_cast<int>(strlen(pReply)), reading.write(reinterpret_cast<const uint8_t *>(pReply), static_cast<int>(strlen(pReply))));
+         }
+
+         queued = reading.queued_bytes();
+      }
+   });
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(11u, queued);
+
+   // and sent together once it has
+
+   EXPECT_EQ(0u, socket.queued_bytes());
+
+   EXPECT_EQ(1u, afd.stats().dispatch_completions);
+
+   char received[32] = {};
+
+   EXPECT_EQ(11, ::recv(s, received, sizeof received, MSG_DONTWAIT));
+
+   EXPECT_STREQ("onetwothree", received);
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestListeningSocketAcceptsIntoPool)
+{
+   io_uring_reactor afd;
+
+   mock_tcp_listening_socket_callbacks listening_callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket listener(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), listening_callbacks);
+
+   listener.listen(10);
+
+   const int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+   ASSERT_EQ(0, ::connect(s, reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+
+   EXPECT_CALL(listening_callbacks, on_incoming_connections(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   connection_pool<pooled_connection> pool(4);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   pooled_connection *pConnection = listener.accept_into(pool, afd, callbacks);
+
+   ASSERT_NE(nullptr, pConnection);
+
+   EXPECT_EQ(nullptr, listener.accept_into(pool, afd, callbacks));
+
+   EXPECT_EQ(3u, pool.allocator().available());
+
+   // the accepted socket is connected
+
+   uint8_t buffer[100];
+
+   EXPECT_EQ(0, pConnection->s.read(buffer, sizeof buffer));
+
+   Write(s, "test");
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(4, pConnection->s.read(buffer, sizeof buffer));
+
+   EXPECT_EQ(4, pConnection->s.write(buffer, 4));
+
+   pool.release(pConnection);
+
+   EXPECT_EQ(4u, pool.allocator().available());
+
+   char echoed[4];
+
+   EXPECT_EQ(4, ::recv(s, echoed, sizeof echoed, 0));
+
+   // releasing the connection closed the socket
+
+   EXPECT_EQ(0, ::recv(s, echoed, sizeof echoed, 0));
+
+   Close(s);
+}
+
+TEST(IoUringSocket, TestListeningSocketAcceptBudgetLetsOthersHaveATurn)
+{
+   io_uring_reactor afd;
+
+   mock_tcp_listening_socket_callbacks callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket listener(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), callbacks);
+
+   EXPECT_THROW(listener.set_accept_budget(0), std::runtime_error);
+
+   listener.set_accept_budget(2);
+
+   listener.listen(10);
+
+   std::vector<int> clients;
+
+   for (int i = 0; i < 5; ++i)
+   {
+      clients.push_back(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+
+      ASSERT_EQ(0, ::connect(clients.back(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+   }
+
+   std::vector<reactor_socket> accepted;
+
+   size_t accepted_this_time = 0;
+
+   EXPECT_CALL(callbacks, on_incoming_connections(::testing::_)).WillRepeatedly([&](tcp_listening_socket &s)
+   {
+      accepted_this_time = 0;
+
+      sockaddr_in client_address {};
+
+      socket_length client_address_length = sizeof client_address;
+
+      reactor_socket client_socket;
+
+      while ((client_socket = s.accept(reinterpret_cast<sockaddr &>(client_address), client_address_length)) != invalid_socket)
+      {
+         accepted.push_back(client_socket);
+
+         ++accepted_this_time;
+      }
+   });
+
+   // the listener stops accepting when the budget is spent, and is reported
+   // again on the next pass
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+   EXPECT_EQ(2u, accepted_this_time);
+
+   EXPECT_EQ(1u, afd.run_once(0));
+   EXPECT_EQ(2u, accepted_this_time);
+
+   EXPECT_EQ(1u, afd.run_once(0));
+   EXPECT_EQ(1u, accepted_this_time);
+
+   EXPECT_EQ(5u, accepted.size());
+
+   // accepts outside of the callback aren't limited
+
+   for (int i = 0; i < 3; ++i)
+   {
+      clients.push_back(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+
+      ASSERT_EQ(0, ::connect(clients.back(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+   }
+
+   for (int i = 0; i < 3; ++i)
+   {
+      sockaddr_in client_address {};
+
+      socket_length client_address_length = sizeof client_address;
+
+      accepted.push_back(listener.accept(reinterpret_cast<sockaddr &>(client_address), client_address_length));
+
+      EXPECT_NE(invalid_socket, accepted.back());
+   }
+
+   for (const reactor_socket client_socket : accepted)
+   {
+      close_socket(client_socket);
+   }
+
+   for (const int client : clients)
+   {
+      Close(client);
+   }
+}
+
+TEST(IoUringSocket, TestListeningSocketAcceptsABatchIntoPool)
+{
+   io_uring_reactor afd;
+
+   mock_tcp_listening_socket_callbacks listening_callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket listener(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), listening_callbacks);
+
+   listener.set_accept_budget(4);
+
+   listener.listen(10);
+
+   std::vector<int> clients;
+
+   for (int i = 0; i < 5; ++i)
+   {
+      clients.push_back(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+
+      ASSERT_EQ(0, ::connect(clients.back(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+   }
+
+   connection_pool<pooled_connection> pool(8);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   pooled_connection *connections[8] = {};
+
+   size_t accepted = 0;
+
+   // the array has room for 3, the budget is 4, so the next batch only gets one
+
+   EXPECT_CALL(listening_callbacks, on_incoming_connections(::testing::_)).Times(1).WillOnce([&](tcp_listening_socket &s)
+   {
+      accepted += s.accept_batch(pool, connections, 3, afd, callbacks);
+
+      accepted += s.accept_batch(pool, connections + accepted, 3, afd, callbacks);
+   });
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(4u, accepted);
+
+   EXPECT_CALL(listening_callbacks, on_incoming_connections(::testing::_)).Times(1).WillOnce([&](tcp_listening_socket &s)
+   {
+      accepted += s.accept_batch(pool, connections + accepted, 3, afd, callbacks);
+   });
+
+   EXPECT_EQ(1u, afd.run_once(0));
+
+   EXPECT_EQ(5u, accepted);
+
+   EXPECT_EQ(3u, pool.allocator().available());
+
+   // each connection is ready to use
+
+   uint8_t buffer[100];
+
+   for (size_t i = 0; i < accepted; ++i)
+   {
+      EXPECT_EQ(0, connections[i]->s.read(buffer, sizeof buffer));
+   }
+
+   Write(clients[0], "test");
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   for (size_t i = 0; i < accepted; ++i)
+   {
+      pool.release(connections[i]);
+   }
+
+   for (const int client : clients)
+   {
+      Close(client);
+   }
+}
+
+// Hands out pooled connections until it's told to fail, as a pool that runs
+// out of memory would, before anything has taken on the socket
+
+class failing_allocator
+{
+   public :
+
+      failing_allocator(
+         connection_pool<pooled_connection> &pool,
+         const size_t fail_at)
+         :  pool(pool),
+            fail_at(fail_at)
+      {
+      }
+
+      pooled_connection *acquire(
+         const reactor_socket accepted,
+         reactor &afd,
+         tcp_socket_callbacks &callbacks)
+      {
+         given.push_back(accepted);
+
+         if (given.size() == fail_at)
+         {
+            throw std::bad_alloc();
+         }
+
+         return pool.acquire(accepted, afd, callbacks);
+      }
+
+      std::vector<reactor_socket> given;
+
+   private :
+
+      connection_pool<pooled_connection> &pool;
+
+      const size_t fail_at;
+};
+
+TEST(IoUringSocket, TestListeningSocketAcceptBatchClosesTheSocketThatFailed)
+{
+   io_uring_reactor afd;
+
+   mock_tcp_listening_socket_callbacks listening_callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket listener(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), listening_callbacks);
+
+   listener.listen(10);
+
+   std::vector<int> clients;
+
+   for (int i = 0; i < 3; ++i)
+   {
+      clients.push_back(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+
+      ASSERT_EQ(0, ::connect(clients.back(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+   }
+
+   connection_pool<pooled_connection> pool(8);
+
+   failing_allocator allocator(pool, 2);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   pooled_connection *connections[3] = {};
+
+   EXPECT_CALL(listening_callbacks, on_incoming_connections(::testing::_)).Times(1).WillOnce([&](tcp_listening_socket &s)
+   {
+      EXPECT_THROW(s.accept_batch(allocator, connections, 3, afd, callbacks), std::bad_alloc);
+   });
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   ASSERT_EQ(2u, allocator.given.size());
+
+   ASSERT_NE(nullptr, connections[0]);
+
+   EXPECT_EQ(nullptr, connections[1]);
+
+   // the socket that the allocator failed with, and the one after it, are
+   // closed, so their clients see the end of the stream
+
+   EXPECT_EQ(-1, ::fcntl(static_cast<int>(allocator.given[1]), F_GETFD));
+
+   uint8_t buffer[1];
+
+   EXPECT_EQ(-1, ::recv(clients[0], buffer, sizeof buffer, MSG_DONTWAIT));
+   EXPECT_EQ(EAGAIN, errno);
+
+   EXPECT_EQ(0, ::recv(clients[1], buffer, sizeof buffer, MSG_DONTWAIT));
+
+   EXPECT_EQ(0, ::recv(clients[2], buffer, sizeof buffer, MSG_DONTWAIT));
+
+   pool.release(connections[0]);
+
+   for (const int client : clients)
+   {
+      Close(client);
+   }
+}
+
+// Keeps the connections that the workers are given, and closes them when done
+
+class fan_out_connections : public accept_fan_out_callbacks
+{
+   public :
+
+      ~fan_out_connections() override
+      {
+         for (const auto &connection : connections)
+         {
+            close_socket(connection.second);
+         }
+      }
+
+      void on_connection(
+         accept_fan_out_worker &worker,
+         const reactor_socket accepted) override
+      {
+         connections.emplace_back(&worker, accepted);
+      }
+
+      size_t given_to(
+         const accept_fan_out_worker &worker) const
+      {
+         return static_cast<size_t>(std::count_if(connections.begin(), connections.end(), [&](const auto &connection) { return connection.first == &worker; }));
+      }
+
+      std::vector<std::pair<accept_fan_out_worker *, reactor_socket>> connections;
+};
+
+// A listener on its own reactor that hands what it accepts to a fan out
+
+class fan_out_acceptor : public tcp_listening_socket_callbacks
+{
+   public :
+
+      fan_out_acceptor(
+         accept_fan_out &fan_out,
+         const uint16_t port)
+         :  fan_out(fan_out),
+            address(LoopbackAddress(port)),
+            listener(afd_handle(afd), reinterpret_cast<const sockaddr &>(address), sizeof(address), *this)
+      {
+         listener.listen(10);
+      }
+
+      ~fan_out_acceptor() override
+      {
+         for (const int client : clients)
+         {
+            Close(client);
+         }
+      }
+
+      void connect(
+         const size_t count)
+      {
+         for (size_t i = 0; i < count; ++i)
+         {
+            clients.push_back(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+
+            ASSERT_EQ(0, ::connect(clients.back(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+         }
+
+         EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+      }
+
+      size_t handed_off = 0;
+
+   private :
+
+      void on_incoming_connections(
+         tcp_listening_socket &s) override
+      {
+         handed_off += fan_out.accept_from(s);
+      }
+
+      void on_connection_reset(
+         tcp_listening_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_listening_socket &) override
+      {
+      }
+
+      accept_fan_out &fan_out;
+
+      const sockaddr_in address;
+
+      io_uring_reactor afd;
+
+      tcp_listening_socket listener;
+
+      std::vector<int> clients;
+};
+
+TEST(IoUringSocket, TestAcceptFanOutRoundRobin)
+{
+   fan_out_connections connections;
+
+   io_uring_reactor afd1;
+   io_uring_reactor afd2;
+
+   accept_fan_out_worker worker1(afd1, connections);
+   accept_fan_out_worker worker2(afd2, connections);
+
+   accept_fan_out fan_out(accept_fan_out::placement::round_robin);
+
+   fan_out.add_worker(worker1);
+   fan_out.add_worker(worker2);
+
+   fan_out_acceptor acceptor(fan_out, GetAvailablePort());
+
+   acceptor.connect(4);
+
+   EXPECT_EQ(4u, acceptor.handed_off);
+
+   EXPECT_EQ(2u, worker1.connections());
+   EXPECT_EQ(2u, worker2.connections());
+
+   // each worker is woken once for what was queued for it
+
+   EXPECT_EQ(1u, worker1.wakeups());
+   EXPECT_EQ(1u, worker2.wakeups());
+
+   EXPECT_EQ(0u, connections.connections.size());
+
+   EXPECT_EQ(1u, afd1.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(2u, connections.given_to(worker1));
+   EXPECT_EQ(0u, connections.given_to(worker2));
+
+   EXPECT_EQ(1u, afd2.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(2u, connections.given_to(worker2));
+
+   EXPECT_EQ(0u, fan_out.shed());
+}
+
+TEST(IoUringSocket, TestAcceptFanOutLeastLoaded)
+{
+   fan_out_connections connections;
+
+   io_uring_reactor afd1;
+   io_uring_reactor afd2;
+
+   accept_fan_out_worker worker1(afd1, connections);
+   accept_fan_out_worker worker2(afd2, connections);
+
+   accept_fan_out fan_out(accept_fan_out::placement::least_loaded);
+
+   fan_out.add_worker(worker1);
+   fan_out.add_worker(worker2);
+
+   fan_out_acceptor acceptor(fan_out, GetAvailablePort());
+
+   acceptor.connect(2);
+
+   EXPECT_EQ(1u, worker1.connections());
+   EXPECT_EQ(1u, worker2.connections());
+
+   EXPECT_EQ(1u, afd2.run_once(SHORT_TIME_NON_ZERO));
+
+   // one of the second worker's connections has gone, so it gets the next two,
+   // whoever's turn it is
+
+   worker2.connection_closed();
+
+   acceptor.connect(1);
+
+   EXPECT_EQ(1u, worker1.connections());
+   EXPECT_EQ(1u, worker2.connections());
+
+   worker2.connection_closed();
+
+   acceptor.connect(1);
+
+   EXPECT_EQ(1u, worker1.connections());
+   EXPECT_EQ(1u, worker2.connections());
+
+   EXPECT_EQ(1u, afd2.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(3u, connections.given_to(worker2));
+}
+
+TEST(IoUringSocket, TestAcceptFanOutShedsWhenEveryQueueIsFull)
+{
+   fan_out_connections connections;
+
+   io_uring_reactor afd1;
+   io_uring_reactor afd2;
+
+   accept_fan_out_worker worker1(afd1, connections, 2);
+   accept_fan_out_worker worker2(afd2, connections, 2);
+
+   accept_fan_out fan_out(accept_fan_out::placement::round_robin);
+
+   fan_out.add_worker(worker1);
+   fan_out.add_worker(worker2);
+
+   fan_out_acceptor acceptor(fan_out, GetAvailablePort());
+
+   acceptor.connect(5);
+
+   EXPECT_EQ(4u, acceptor.handed_off);
+
+   EXPECT_EQ(1u, fan_out.shed());
+
+   EXPECT_EQ(2u, worker1.connections());
+   EXPECT_EQ(2u, worker2.connections());
+
+   // once the first worker has taken its connections it has room again
+
+   EXPECT_EQ(1u, afd1.run_once(SHORT_TIME_NON_ZERO));
+
+   acceptor.connect(1);
+
+   EXPECT_EQ(5u, acceptor.handed_off);
+
+   EXPECT_EQ(1u, fan_out.shed());
+}
+
+// A listener in a group, on a reactor of its own, that accepts whatever it's
+// given
+
+class group_listener : private tcp_listening_socket_callbacks
+{
+   public :
+
+      explicit group_listener(
+         tcp_listening_socket_group &group)
+         :  listener(afd_handle(afd), *this)
+      {
+         group.join(listener);
+
+         listener.listen(SOMAXCONN);
+      }
+
+      ~group_listener() override
+      {
+         for (const reactor_socket accepted : connections)
+         {
+            close_socket(accepted);
+         }
+      }
+
+      size_t run_once()
+      {
+         return afd.run_once(0);
+      }
+
+      std::vector<reactor_socket> connections;
+
+   private :
+
+      void on_incoming_connections(
+         tcp_listening_socket &s) override
+      {
+         sockaddr_storage address {};
+
+         socket_length address_length = sizeof address;
+
+         reactor_socket accepted;
+
+         while ((accepted = s.accept(reinterpret_cast<sockaddr &>(address), address_length)) != invalid_socket)
+         {
+            connections.push_back(accepted);
+         }
+      }
+
+      void on_connection_reset(
+         tcp_listening_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_listening_socket &) override
+      {
+      }
+
+      io_uring_reactor afd;
+
+      tcp_listening_socket listener;
+};
+
+TEST(IoUringSocket, TestListeningSocketGroupSpreadsConnections)
+{
+   const sockaddr_in any_port = LoopbackAddress(0);
+
+   tcp_listening_socket_group group(reinterpret_cast<const sockaddr &>(any_port), sizeof(any_port));
+
+   group_listener listener1(group);
+   group_listener listener2(group);
+
+   EXPECT_EQ(2u, group.listeners());
+
+   // the first listener chose the port, and the second shares it
+
+   const socket_address address = group.address();
+
+   ASSERT_NE(0, reinterpret_cast<const sockaddr_in &>(address.storage).sin_port);
+
+   static constexpr size_t num_clients = 32;
+
+   std::vector<int> clients;
+
+   for (size_t i = 0; i < num_clients; ++i)
+   {
+      clients.push_back(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+
+      ASSERT_EQ(0, ::connect(clients.back(), &address.address(), address.length));
+   }
+
+   for (int i = 0; i < 10 && listener1.connections.size() + listener2.connections.size() < num_clients; ++i)
+   {
+      listener1.run_once();
+      listener2.run_once();
+   }
+
+   // the kernel spreads the connections by a hash of their addresses, the
+   // chance of 32 of them going to one listener is negligible
+
+   EXPECT_EQ(num_clients, listener1.connections.size() + listener2.connections.size());
+
+   EXPECT_NE(0u, listener1.connections.size());
+   EXPECT_NE(0u, listener2.connections.size());
+
+   for (const int client : clients)
+   {
+      Close(client);
+   }
+}
+
+TEST(IoUringSocket, TestListeningSocketGroupJoinAfterBind)
+{
+   io_uring_reactor afd;
+
+   mock_tcp_listening_socket_callbacks callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket_group group(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   tcp_listening_socket socket(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), callbacks);
+
+   EXPECT_THROW(group.join(socket), std::runtime_error);
+
+   EXPECT_EQ(0u, group.listeners());
+}
+
+// Accepts whatever the listener lets in
+
+class accepting_listener_callbacks : public tcp_listening_socket_callbacks
+{
+   public :
+
+      ~accepting_listener_callbacks() override
+      {
+         for (const reactor_socket accepted : connections)
+         {
+            close_socket(accepted);
+         }
+      }
+
+      void on_incoming_connections(
+         tcp_listening_socket &s) override
+      {
+         ++reports;
+
+         sockaddr_storage address {};
+
+         socket_length address_length = sizeof address;
+
+         reactor_socket accepted;
+
+         while ((accepted = s.accept(reinterpret_cast<sockaddr &>(address), address_length)) != invalid_socket)
+         {
+            connections.push_back(accepted);
+         }
+      }
+
+      void on_connection_reset(
+         tcp_listening_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_listening_socket &) override
+      {
+      }
+
+      size_t reports = 0;
+
+      std::vector<reactor_socket> connections;
+};
+
+static std::vector<int> Connect(
+   const sockaddr_in &address,
+   const size_t count)
+{
+   std::vector<int> clients;
+
+   for (size_t i = 0; i < count; ++i)
+   {
+      clients.push_back(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+
+      EXPECT_EQ(0, ::connect(clients.back(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+   }
+
+   return clients;
+}
+
+TEST(IoUringSocket, TestListeningSocketConnectionLimitStopsAccepting)
+{
+   io_uring_reactor afd;
+
+   accepting_listener_callbacks callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket socket(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), callbacks);
+
+   socket.set_connection_limit(2);
+
+   socket.listen(10);
+
+   const std::vector<int> clients = Connect(address, 3);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(2u, callbacks.connections.size());
+   EXPECT_EQ(2u, socket.open_connections());
+
+   EXPECT_TRUE(socket.accepting_paused());
+
+   EXPECT_EQ(1u, socket.stats().paused);
+
+   // the third connection waits in the accept queue, and isn't reported
+
+   EXPECT_EQ(0u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   socket.connection_closed();
+
+   EXPECT_FALSE(socket.accepting_paused());
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(3u, callbacks.connections.size());
+   EXPECT_EQ(2u, socket.open_connections());
+
+   EXPECT_EQ(3u, socket.stats().accepted);
+   EXPECT_EQ(0u, socket.stats().shed);
+
+   for (const int client : clients)
+   {
+      Close(client);
+   }
+}
+
+TEST(IoUringSocket, TestListeningSocketAcceptAndResetShedsOverTheLimit)
+{
+   io_uring_reactor afd;
+
+   accepting_listener_callbacks callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket socket(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), callbacks);
+
+   socket.set_connection_limit(1);
+
+   socket.set_overload_policy(tcp_listening_socket::overload_policy::accept_and_reset);
+
+   socket.listen(10);
+
+   const std::vector<int> clients = Connect(address, 3);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(1u, callbacks.connections.size());
+
+   EXPECT_FALSE(socket.accepting_paused());
+
+   EXPECT_EQ(1u, socket.stats().accepted);
+   EXPECT_EQ(2u, socket.stats().shed);
+
+   // the clients that were shed are reset
+
+   uint8_t buffer[1];
+
+   EXPECT_EQ(-1, ::recv(clients[1], buffer, sizeof buffer, 0));
+   EXPECT_EQ(ECONNRESET, errno);
+
+   EXPECT_EQ(-1, ::recv(clients[2], buffer, sizeof buffer, 0));
+   EXPECT_EQ(ECONNRESET, errno);
+
+   for (const int client : clients)
+   {
+      Close(client);
+   }
+}
+
+TEST(IoUringSocket, TestListeningSocketAcceptRate)
+{
+   io_uring_reactor afd;
+
+   accepting_listener_callbacks callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket socket(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), callbacks);
+
+   // a burst of 2, and then one every 50ms
+
+   socket.set_accept_rate(20, 2);
+
+   socket.listen(10);
+
+   const std::vector<int> clients = Connect(address, 4);
+
+   const auto start = std::chrono::steady_clock::now();
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(2u, callbacks.connections.size());
+
+   EXPECT_TRUE(socket.accepting_paused());
+
+   for (int i = 0; i < 20 && callbacks.connections.size() < 4; ++i)
+   {
+      afd.run_once(SHORT_TIME_NON_ZERO);
+   }
+
+   EXPECT_EQ(4u, callbacks.connections.size());
+
+   EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(90));
+
+   EXPECT_EQ(4u, socket.stats().accepted);
+
+   EXPECT_LE(2u, socket.stats().paused);
+
+   EXPECT_GE(socket.stats().queue_wait_us, socket.stats().max_queue_wait_us);
+
+   EXPECT_GE(socket.stats().max_queue_wait_us, 90000u);
+
+   for (const int client : clients)
+   {
+      Close(client);
+   }
+}
+
+TEST(IoUringSocket, TestListeningSocketAcceptQueue)
+{
+   io_uring_reactor afd;
+
+   accepting_listener_callbacks callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket socket(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), callbacks);
+
+   socket.listen(10);
+
+   const std::vector<int> clients = Connect(address, 3);
+
+   uint32_t depth = 0;
+
+   uint32_t limit = 0;
+
+   ASSERT_TRUE(socket.accept_queue(depth, limit));
+
+   EXPECT_EQ(3u, depth);
+   EXPECT_EQ(10u, limit);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   ASSERT_TRUE(socket.accept_queue(depth, limit));
+
+   EXPECT_EQ(0u, depth);
+
+   for (const int client : clients)
+   {
+      Close(client);
+   }
+}
+
+static int GetIntOption(
+   const reactor_socket s,
+   const int level,
+   const int name)
+{
+   int value = 0;
+
+   socklen_t length = sizeof value;
+
+   EXPECT_EQ(0, ::getsockopt(static_cast<int>(s), level, name, &value, &length));
+
+   return value;
+}
+
+TEST(IoUringSocket, TestListeningSocketAcceptedOptions)
+{
+   io_uring_reactor afd;
+
+   accepting_listener_callbacks callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket socket(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), callbacks);
+
+   socket_options options;
+
+   options.non_blocking = true;
+   options.receive_buffer = 65536;
+   options.send_buffer = 131072;
+   options.no_delay = true;
+   options.keep_alive = true;
+
+   socket.set_accepted_options(options);
+
+   EXPECT_TRUE(socket.accepts_non_blocking());
+
+   socket.listen(10);
+
+   const std::vector<int> clients = Connect(address, 1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   ASSERT_EQ(1u, callbacks.connections.size());
+
+   const reactor_socket accepted = callbacks.connections[0];
+
+   EXPECT_NE(0, ::fcntl(static_cast<int>(accepted), F_GETFL) & O_NONBLOCK);
+
+   EXPECT_EQ(1, GetIntOption(accepted, IPPROTO_TCP, TCP_NODELAY));
+   EXPECT_EQ(1, GetIntOption(accepted, SOL_SOCKET, SO_KEEPALIVE));
+
+   // Linux doubles the buffer sizes that it's asked for, to allow for its own
+   // overheads
+
+   EXPECT_EQ(2 * 65536, GetIntOption(accepted, SOL_SOCKET, SO_RCVBUF));
+   EXPECT_EQ(2 * 131072, GetIntOption(accepted, SOL_SOCKET, SO_SNDBUF));
+
+   // the options were inherited from the listener, and accept4() made the
+   // socket non-blocking, so nothing was set on the socket itself
+
+   EXPECT_EQ(0u, socket.stats().option_calls);
+
+   for (const int client : clients)
+   {
+      Close(client);
+   }
+}
+
+TEST(IoUringSocket, TestListeningSocketAcceptedOptionsAfterListen)
+{
+   io_uring_reactor afd;
+
+   mock_tcp_listening_socket_callbacks callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket socket(afd_handle(afd, 0), reinterpret_cast<const sockaddr &>(address), sizeof(address), callbacks);
+
+   socket.listen(10);
+
+   socket_options options;
+
+   options.no_delay = true;
+
+   EXPECT_THROW(socket.set_accepted_options(options), std::runtime_error);
+
+   EXPECT_FALSE(socket.accepts_non_blocking());
+}
+
+TEST(IoUringSocket, TestNonBlockingAcceptedSocket)
+{
+   io_uring_reactor afd;
+
+   accepting_listener_callbacks listener_callbacks;
+
+   const sockaddr_in address = LoopbackAddress(GetAvailablePort());
+
+   tcp_listening_socket listener(afd_handle(afd), reinterpret_cast<const sockaddr &>(address), sizeof(address), listener_callbacks);
+
+   socket_options options;
+
+   options.non_blocking = true;
+
+   listener.set_accepted_options(options);
+
+   listener.listen(10);
+
+   const std::vector<int> clients = Connect(address, 1);
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   ASSERT_EQ(1u, listener_callbacks.connections.size());
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(afd_handle(afd), non_blocking_socket{ listener_callbacks.connections[0] }, callbacks);
+
+   listener_callbacks.connections.clear();
+
+   uint8_t buffer[4];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   Write(clients[0], "1234");
+
+   // called again whilst the reads make progress
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).Times(2).WillOnce([&](tcp_socket &readable)
+   {
+      EXPECT_EQ(4, readable.read(buffer, sizeof buffer));
+   }).WillOnce([&](tcp_socket &readable)
+   {
+      EXPECT_EQ(0, readable.read(buffer, sizeof buffer));
+   });
+
+   EXPECT_EQ(1u, afd.run_once(SHORT_TIME_NON_ZERO));
+
+   EXPECT_EQ(0u, listener.stats().option_calls);
+
+   for (const int client : clients)
+   {
+      Close(client);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: test.cpp
+///////////////////////////////////////////////////////////////////////////////
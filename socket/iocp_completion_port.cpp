@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: iocp_completion_port.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#include <WinSock2.h>
+
+#include "iocp_completion_port.h"
+
+#include <exception>
+
+iocp_completion_port::iocp_completion_port(
+   const HANDLE hIOCP)
+   :  hIOCP(hIOCP)
+{
+}
+
+bool iocp_completion_port::get(
+   void *&pContext,
+   const uint32_t timeout_ms)
+{
+   DWORD numberOfBytes = 0;
+
+   ULONG_PTR completionKey = 0;
+
+   OVERLAPPED *pOverlapped = nullptr;
+
+   const DWORD timeout = (timeout_ms == infinite ? INFINITE : timeout_ms);
+
+   if (!GetQueuedCompletionStatus(hIOCP, &numberOfBytes, &completionKey, &pOverlapped, timeout))
+   {
+      // a poll that fails, or is cancelled, still dequeues its OVERLAPPED and
+      // the status is in its status block, so we pass it on as normal
+
+      if (!pOverlapped)
+      {
+         if (GetLastError() == WAIT_TIMEOUT)
+         {
+            return false;
+         }
+
+         throw std::exception("GetQueuedCompletionStatus failed");
+      }
+   }
+
+   pContext = pOverlapped;
+
+   return true;
+}
+
+void iocp_completion_port::post(
+   void *pContext)
+{
+   if (!PostQueuedCompletionStatus(hIOCP, 0, 0, static_cast<OVERLAPPED *>(pContext)))
+   {
+      throw std::exception("PostQueuedCompletionStatus failed");
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: iocp_completion_port.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,67 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: iocp_completion_port.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#include <WinSock2.h>
+
+#include "afd_completion_port.h"
+
+// An afd_completion_port that is an I/O completion port. The context is the
+// OVERLAPPED pointer of the completion, which for an afd_system is the
+// afd_system_events that was passed when the poll was issued.
+
+class iocp_completion_port : public afd_completion_port
+{
+   public :
+
+      explicit iocp_completion_port(
+         HANDLE hIOCP);
+
+      iocp_completion_port(const iocp_completion_port &) = delete;
+      iocp_completion_port(iocp_completion_port &&) = delete;
+
+      iocp_completion_port& operator=(const iocp_completion_port &) = delete;
+      iocp_completion_port& operator=(iocp_completion_port &&) = delete;
+
+      bool get(
+         void *&pContext,
+         uint32_t timeout_ms) override;
+
+      void post(
+         void *pContext) override;
+
+   private :
+
+      const HANDLE hIOCP;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: iocp_completion_port.h
+///////////////////////////////////////////////////////////////////////////////
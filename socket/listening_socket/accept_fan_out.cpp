@@ -0,0 +1,191 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: accept_fan_out.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "accept_fan_out.h"
+
+#include <stdexcept>
+
+accept_fan_out_worker::accept_fan_out_worker(
+   reactor &afd,
+   accept_fan_out_callbacks &callbacks,
+   const size_t queue_capacity)
+   :  afd(afd),
+      callbacks(callbacks),
+      queue(queue_capacity),
+      load(0),
+      wakeup(afd_handle(afd), *this)
+{
+}
+
+accept_fan_out_worker::~accept_fan_out_worker()
+{
+   reactor_socket queued;
+
+   while (queue.pop(queued))
+   {
+      close_socket(queued);
+   }
+}
+
+void accept_fan_out_worker::connection_closed()
+{
+   load.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool accept_fan_out_worker::hand_off(
+   const reactor_socket accepted)
+{
+   // counted first, as the worker may have closed it by the time we're back
+
+   load.fetch_add(1, std::memory_order_relaxed);
+
+   if (!queue.push(accepted))
+   {
+      load.fetch_sub(1, std::memory_order_relaxed);
+
+      return false;
+   }
+
+   wakeup.wake();
+
+   return true;
+}
+
+void accept_fan_out_worker::on_wakeup(
+   reactor_wakeup &)
+{
+   reactor_socket accepted;
+
+   while (queue.pop(accepted))
+   {
+      callbacks.on_connection(*this, accepted);
+   }
+}
+
+accept_fan_out::accept_fan_out(
+   const placement how)
+   :  how(how),
+      next(0),
+      num_shed(0)
+{
+}
+
+void accept_fan_out::add_worker(
+   accept_fan_out_worker &worker)
+{
+   workers.push_back(&worker);
+}
+
+size_t accept_fan_out::choose_worker()
+{
+   // the search for the least loaded starts at the next in turn, so that
+   // workers with the same load take turns
+
+   const size_t first = next.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+   if (how == placement::round_robin)
+   {
+      return first;
+   }
+
+   size_t chosen = first;
+
+   size_t least = workers[first]->connections();
+
+   for (size_t i = 1; i < workers.size() && least; ++i)
+   {
+      const size_t index = (first + i) % workers.size();
+
+      const size_t load = workers[index]->connections();
+
+      if (load < least)
+      {
+         chosen = index;
+
+         least = load;
+      }
+   }
+
+   return chosen;
+}
+
+bool accept_fan_out::hand_off(
+   const reactor_socket accepted)
+{
+   if (workers.empty())
+   {
+      throw std::runtime_error("no workers to hand off to");
+   }
+
+   const size_t chosen = choose_worker();
+
+   for (size_t i = 0; i < workers.size(); ++i)
+   {
+      if (workers[(chosen + i) % workers.size()]->hand_off(accepted))
+      {
+         return true;
+      }
+   }
+
+   num_shed.fetch_add(1, std::memory_order_relaxed);
+
+   return false;
+}
+
+size_t accept_fan_out::accept_from(
+   tcp_listening_socket &listener)
+{
+   size_t handed_off = 0;
+
+   for (;;)
+   {
+      sockaddr_storage address {};
+
+      socket_length address_length = sizeof address;
+
+      const reactor_socket accepted = listener.accept(reinterpret_cast<sockaddr &>(address), address_length);
+
+      if (accepted == invalid_socket)
+      {
+         return handed_off;
+      }
+
+      if (hand_off(accepted))
+      {
+         ++handed_off;
+      }
+      else
+      {
+         close_socket(accepted);
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: accept_fan_out.cpp
+///////////////////////////////////////////////////////////////////////////////
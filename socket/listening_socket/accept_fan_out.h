@@ -0,0 +1,194 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: accept_fan_out.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tcp_listening_socket.h"
+#include "mpsc_queue.h"
+#include "reactor_wakeup.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class accept_fan_out_worker;
+
+class accept_fan_out_callbacks
+{
+   public :
+
+      // Called on the worker's thread for each connection that's handed to it,
+      // the callee owns the socket, which it usually gives to a tcp_socket on
+      // the worker's reactor.
+
+      virtual void on_connection(
+         accept_fan_out_worker &worker,
+         reactor_socket accepted) = 0;
+
+   protected :
+
+      virtual ~accept_fan_out_callbacks() = default;
+};
+
+// A reactor, and the thread that runs it, that an accept_fan_out hands
+// connections to. Sockets are pushed onto the worker's mpsc_queue by whichever
+// thread accepted them, and the worker's reactor_wakeup is woken, so the
+// worker pops them, and calls on_connection() for each, on its own thread.
+//
+// The worker counts the connections that it has been given, and the worker's
+// code calls connection_closed() when one of them goes, so that the fan out
+// can place connections on the least loaded worker.
+//
+// Constructed and destroyed by the thread that runs the reactor, before it's
+// added to a fan out and after the fan out has gone. Sockets that are still
+// queued when it's destroyed are closed.
+
+class accept_fan_out_worker : private reactor_wakeup_callbacks
+{
+   public :
+
+      static constexpr size_t default_queue_capacity = 1024;
+
+      accept_fan_out_worker(
+         reactor &afd,
+         accept_fan_out_callbacks &callbacks,
+         size_t queue_capacity = default_queue_capacity);
+
+      accept_fan_out_worker(const accept_fan_out_worker &) = delete;
+      accept_fan_out_worker(accept_fan_out_worker &&) = delete;
+
+      accept_fan_out_worker& operator=(const accept_fan_out_worker &) = delete;
+      accept_fan_out_worker& operator=(accept_fan_out_worker &&) = delete;
+
+      ~accept_fan_out_worker() override;
+
+      void connection_closed();
+
+      // the connections handed to the worker that haven't closed, including
+      // those still queued
+
+      size_t connections() const
+      {
+         return load.load(std::memory_order_relaxed);
+      }
+
+      uint64_t wakeups() const
+      {
+         return wakeup.signals();
+      }
+
+      reactor &afd;
+
+   private :
+
+      friend class accept_fan_out;
+
+      // Any thread, returns false if the worker's queue is full, the socket is
+      // still the caller's.
+
+      bool hand_off(
+         reactor_socket accepted);
+
+      void on_wakeup(
+         reactor_wakeup &wakeup) override;
+
+      accept_fan_out_callbacks &callbacks;
+
+      mpsc_queue<reactor_socket> queue;
+
+      alignas(slab_allocator::cache_line_size) std::atomic<size_t> load;
+
+      reactor_wakeup wakeup;
+};
+
+// Spreads the connections that one or more acceptors accept across a number
+// of worker reactors, each run by a thread of its own, so that the work of
+// the established connections uses more than the acceptor's core. A
+// connection is placed on the next worker in turn, or on the worker with the
+// fewest connections; if the chosen worker's queue is full the others are
+// tried, and if they're all full the connection is shed.
+//
+// Workers are added before anything is handed off, after which hand_off() and
+// accept_from() can be called by any thread.
+
+class accept_fan_out
+{
+   public :
+
+      enum class placement
+      {
+         round_robin,
+         least_loaded
+      };
+
+      explicit accept_fan_out(
+         placement how);
+
+      accept_fan_out(const accept_fan_out &) = delete;
+      accept_fan_out(accept_fan_out &&) = delete;
+
+      accept_fan_out& operator=(const accept_fan_out &) = delete;
+      accept_fan_out& operator=(accept_fan_out &&) = delete;
+
+      void add_worker(
+         accept_fan_out_worker &worker);
+
+      // Returns false if every worker's queue is full, the socket is still the
+      // caller's.
+
+      bool hand_off(
+         reactor_socket accepted);
+
+      // Accepts what the listener has, within its accept budget, and hands
+      // each connection off, those that no worker has room for are closed.
+      // Returns the number handed off.
+
+      size_t accept_from(
+         tcp_listening_socket &listener);
+
+      uint64_t shed() const
+      {
+         return num_shed.load(std::memory_order_relaxed);
+      }
+
+   private :
+
+      size_t choose_worker();
+
+      const placement how;
+
+      std::vector<accept_fan_out_worker *> workers;
+
+      std::atomic<size_t> next;
+
+      std::atomic<uint64_t> num_shed;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: accept_fan_out.h
+///////////////////////////////////////////////////////////////////////////////
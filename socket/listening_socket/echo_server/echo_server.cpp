@@ -38,6 +38,12 @@
 
 #include "tcp_listening_socket.h"
 
+#include "iocp_completion_port.h"
+#include "afd_worker_pool.h"
+
+#include <atomic>
+#include <cstdlib>
+
 class echo_server : private tcp_listening_socket_callbacks
 {
    public :
@@ -133,7 +139,7 @@ class echo_server : private tcp_listening_socket_callbacks
 
       tcp_listening_socket s;
 
-      bool is_done;
+      std::atomic<bool> is_done;
 
       BYTE recv_buffer[100];
 };
@@ -148,7 +154,7 @@ int main(int argc, char **argv)
 
       multi_connection_afd_system afd(handles.afd);
 
-      afd_handle handle(afd, 0);
+      afd_handle handle(afd);
 
       echo_server server(handle);
 
@@ -162,15 +168,43 @@ int main(int argc, char **argv)
 
       server.listen(reinterpret_cast<const sockaddr &>(address), sizeof address, backlog);
 
+      // echo_server [threads]
+
+      const int num_threads = (argc > 1 ? atoi(argv[1]) : 1);
+
+      if (num_threads > 1)
+      {
+         // the afd system locks, so any of the threads can handle any completion
+
+         iocp_completion_port port(handles.iocp);
+
+         afd_worker_pool pool(port, static_cast<uint32_t>(num_threads), [](void *pContext)
+         {
+            static_cast<afd_system_events *>(pContext)->handle_events();
+         });
+
+         while (!server.done())
+         {
+            Sleep(100);
+         }
+
+         pool.stop();
+      }
+
+      // a poll that is cancelled, so that changed interest can be submitted,
+      // completes with an error and is handled like any other
+
+      iocp_completion_port port(handles.iocp);
+
+      void *pContext = nullptr;
+
       while (!server.done())
       {
          // process events
 
-         auto *pAfd = GetCompletionAs<afd_system_events>(handles.iocp, INFINITE);
-
-         if (pAfd)
+         if (port.get(pContext, iocp_completion_port::infinite))
          {
-            pAfd->handle_events();
+            static_cast<afd_system_events *>(pContext)->handle_events();
          }
          else
          {
@@ -33,42 +33,24 @@
 
 #include "shared/afd.h"
 
-#include "afd_system.h"
+#include "afd_poll_driver.h"
 
-class afd_events;
+// An afd_poll_driver that can be used from any thread, and whose completions
+// can be handled on several threads, one at a time.
 
-class multi_connection_afd_system : public afd_system, afd_system_events
+class multi_connection_afd_system : public afd_poll_driver
 {
    public :
 
       explicit multi_connection_afd_system(
          HANDLE hAfd,
-         int num_slots = 1);
+         int num_slots = 1,
+         afd_poll_set::submission_mode mode = afd_poll_set::submission_mode::all_slots);
 
-      void associate_socket(
-         ULONG slot,
-         SOCKET s,
-         afd_events &events) override;
-
-      void disassociate_socket(
-         ULONG slot) override;
-
-      bool poll(
-         ULONG slot,
-         ULONG events) override;
-
-      void handle_events() override;
-
-   private :
-
-      HANDLE hAfd;
-      const ULONG num_slots;
-      const ULONG poll_info_size;
-      AFD_POLL_INFO *pPollInfoIn;
-      AFD_POLL_INFO *pPollInfoOut;
-      IO_STATUS_BLOCK statusBlock;
-
-      afd_events **ppEvents;
+      multi_connection_afd_system(
+         afd_poll_device &device,
+         int num_slots = 1,
+         afd_poll_set::submission_mode mode = afd_poll_set::submission_mode::all_slots);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
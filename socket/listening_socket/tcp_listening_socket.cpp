@@ -26,39 +26,39 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-#define _WINSOCK_DEPRECATED_NO_WARNINGS
-
-#include <WinSock2.h>
-
-#include "third_party/wepoll_magic.h"
-
-#include <winternl.h>
-
 #include "tcp_listening_socket.h"
 
-#include "shared/afd.h"
-
-#include <exception>
+#include <cmath>
+#include <stdexcept>
 
 tcp_listening_socket::tcp_listening_socket(
    afd_handle afd,
    tcp_listening_socket_callbacks &callbacks)
    :  afd(afd),
-      s(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)),
+      s(open_tcp_socket()),
       events(0),
       callbacks(callbacks),
+      budget(default_accept_budget),
+      accepts_left(not_reporting),
+      max_connections(unlimited),
+      connections(0),
+      accept_rate(unlimited),
+      burst(1),
+      tokens(0),
+      policy(overload_policy::stop_accepting),
+      paused(false),
+      counters{},
+      accept_non_blocking(false),
       connection_state(state::created)
 {
-   if (s == INVALID_SOCKET)
+   if (s == invalid_socket)
    {
-      throw std::exception("failed to create socket");
+      throw std::runtime_error("failed to create socket");
    }
 
-   unsigned long one = 1;
-
-   if (0 != ioctlsocket(s, FIONBIO, &one))
+   if (!set_non_blocking(s))
    {
-      throw std::exception("ioctlsocket - failed to set socket not-blocking");
+      throw std::runtime_error("failed to set socket non-blocking");
    }
 
    afd.associate_socket(s, *this);
@@ -78,11 +78,24 @@ tcp_listening_socket::~tcp_listening_socket()
 {
    afd.disassociate_socket();
 
-   if (s != INVALID_SOCKET)
+   if (s != invalid_socket)
+   {
+      close_socket(s);
+
+      s = invalid_socket;
+   }
+}
+
+void tcp_listening_socket::share_address()
+{
+   if (connection_state != state::created)
    {
-      ::closesocket(s);
+      throw std::runtime_error("too late to share the address");
+   }
 
-      s = INVALID_SOCKET;
+   if (!set_reuse_port(s))
+   {
+      throw std::runtime_error("failed to share the address");
    }
 }
 
@@ -92,80 +105,422 @@ void tcp_listening_socket::bind(
 {
    if (connection_state != state::created)
    {
-      throw std::exception("too late to bind");
+      throw std::runtime_error("too late to bind");
    }
 
-   if (0 != ::bind(s, &address, address_length))
+   if (0 != socket_bind(s, address, address_length))
    {
-      const DWORD lastError = GetLastError();
+      const int lastError = last_socket_error();
 
       (void)lastError;
 
-      throw std::exception("failed to bind");
+      throw std::runtime_error("failed to bind");
    }
 
    connection_state = state::bound;
 }
 
+socket_address tcp_listening_socket::local_address() const
+{
+   socket_address address {};
+
+   address.length = sizeof address.storage;
+
+   if (0 != socket_local_address(s, reinterpret_cast<sockaddr &>(address.storage), address.length))
+   {
+      throw std::runtime_error("failed to get the local address");
+   }
+
+   return address;
+}
+
+void tcp_listening_socket::set_accepted_options(
+   const socket_options &options)
+{
+   if (connection_state != state::created && connection_state != state::bound)
+   {
+      throw std::runtime_error("too late to set the accepted sockets' options");
+   }
+
+   uint64_t calls = 0;
+
+   if (!set_socket_options(s, inherited_socket_options(options), calls))
+   {
+      throw std::runtime_error("failed to set the accepted sockets' options");
+   }
+
+   per_accept = uninherited_socket_options(options);
+
+   accept_non_blocking = options.non_blocking;
+}
+
 void tcp_listening_socket::listen(
    const int backlog)
 {
-   if (SOCKET_ERROR == ::listen(s, backlog))
+   if (socket_error == socket_listen(s, backlog))
    {
-      throw std::exception("failed to listen");
+      throw std::runtime_error("failed to listen");
    }
 
    connection_state = state::listening;
 
-   events = AllEvents;
-   
+   events = reactor_event::accept |            // connections to accept
+            reactor_event::abort |             // closed
+            reactor_event::local_close;        // we have closed
+
    afd.poll(events);
 }
 
-SOCKET tcp_listening_socket::accept(
+void tcp_listening_socket::set_accept_budget(
+   const uint32_t new_budget)
+{
+   if (!new_budget)
+   {
+      throw std::runtime_error("accept budget must allow an accept");
+   }
+
+   budget = new_budget;
+}
+
+void tcp_listening_socket::set_connection_limit(
+   const uint32_t new_max_connections)
+{
+   if (!new_max_connections)
+   {
+      throw std::runtime_error("connection limit must allow a connection");
+   }
+
+   max_connections = new_max_connections;
+
+   resume_when_admitted();
+}
+
+void tcp_listening_socket::set_accept_rate(
+   const uint32_t per_second,
+   const uint32_t new_burst)
+{
+   if (!per_second || !new_burst)
+   {
+      throw std::runtime_error("accept rate must allow an accept");
+   }
+
+   accept_rate = per_second;
+
+   burst = new_burst;
+
+   tokens = burst;
+
+   last_refill = clock::now();
+
+   resume_when_admitted();
+}
+
+void tcp_listening_socket::set_overload_policy(
+   const overload_policy new_policy)
+{
+   policy = new_policy;
+
+   if (policy == overload_policy::accept_and_reset && paused)
+   {
+      // connections are now refused by being reset, rather than left waiting
+
+      paused = false;
+
+      if (events)
+      {
+         afd.poll(interest());
+      }
+   }
+}
+
+void tcp_listening_socket::connection_closed()
+{
+   if (!connections)
+   {
+      throw std::runtime_error("more connections closed than were accepted");
+   }
+
+   --connections;
+
+   resume_when_admitted();
+}
+
+bool tcp_listening_socket::accept_queue(
+   uint32_t &depth,
+   uint32_t &limit) const
+{
+   return socket_accept_queue(s, depth, limit);
+}
+
+reactor_socket tcp_listening_socket::accept(
+   sockaddr &address,
+   socket_length &address_length)
+{
+   if (!accepts_left || paused)
+   {
+      return invalid_socket;
+   }
+
+   const clock::time_point now = clock::now();
+
+   const socket_length available = address_length;
+
+   while (!admit(now))
+   {
+      if (policy == overload_policy::stop_accepting)
+      {
+         pause();
+
+         return invalid_socket;
+      }
+
+      const reactor_socket refused = socket_accept(s, address, address_length);
+
+      address_length = available;
+
+      if (refused == invalid_socket)
+      {
+         waiting_since = clock::time_point{};
+
+         return invalid_socket;
+      }
+
+      abort_socket(refused);
+
+      ++counters.shed;
+
+      record_wait(now);
+
+      if (accepts_left != not_reporting && !--accepts_left)
+      {
+         return invalid_socket;
+      }
+   }
+
+   const reactor_socket accepted = accept_admitted(address, address_length);
+
+   if (accepted == invalid_socket)
+   {
+      // nothing more is waiting, or whatever was has gone
+
+      waiting_since = clock::time_point{};
+
+      return invalid_socket;
+   }
+
+   ++connections;
+
+   ++counters.accepted;
+
+   record_wait(now);
+
+   if (accept_rate != unlimited)
+   {
+      tokens -= 1.0;
+   }
+
+   if (accepts_left != not_reporting)
+   {
+      --accepts_left;
+   }
+
+   return accepted;
+}
+
+reactor_socket tcp_listening_socket::accept_admitted(
    sockaddr &address,
-   int &address_length)
+   socket_length &address_length)
 {
-   const SOCKET accepted = ::accept(s, &address, &address_length);
+   const reactor_socket accepted = accept_non_blocking ?
+      socket_accept_non_blocking(s, address, address_length) :
+      socket_accept(s, address, address_length);
+
+   if (accepted == invalid_socket)
+   {
+      return invalid_socket;
+   }
+
+   if (!set_socket_options(accepted, per_accept, counters.option_calls))
+   {
+      close_socket(accepted);
+
+      throw std::runtime_error("failed to set the accepted socket's options");
+   }
+
+   return accepted;
+}
+
+bool tcp_listening_socket::admit(
+   const clock::time_point now)
+{
+   if (connections >= max_connections)
+   {
+      return false;
+   }
+
+   if (accept_rate == unlimited)
+   {
+      return true;
+   }
+
+   const double elapsed = std::chrono::duration<double>(now - last_refill).count();
+
+   tokens = std::min(static_cast<double>(burst), tokens + elapsed * accept_rate);
+
+   last_refill = now;
+
+   return tokens >= 1.0;
+}
+
+void tcp_listening_socket::record_wait(
+   const clock::time_point now)
+{
+   if (waiting_since == clock::time_point{})
+   {
+      // accepted without having been told that there was anything waiting
+
+      return;
+   }
+
+   const uint64_t waited = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - waiting_since).count());
+
+   counters.queue_wait_us += waited;
+
+   counters.max_queue_wait_us = std::max(counters.max_queue_wait_us, waited);
+}
+
+void tcp_listening_socket::pause()
+{
+   paused = true;
+
+   ++counters.paused;
+
+   // the connections that are waiting have been reported, reactors that only
+   // report changes need to be told to report them again when we resume
+
+   afd.deferred(reactor_event::accept);
+
+   resume_when_admitted();
+}
+
+void tcp_listening_socket::resume_when_admitted()
+{
+   if (!paused || connections >= max_connections)
+   {
+      // connection_closed() resumes
+
+      return;
+   }
+
+   if (!admit(clock::now()))
+   {
+      // the time until the bucket holds a whole token
+
+      const double wait_ms = std::ceil((1.0 - tokens) * 1000.0 / accept_rate);
+
+      if (!afd.set_timer(static_cast<uint32_t>(wait_ms)))
+      {
+         throw std::runtime_error("an accept rate needs a reactor with timers");
+      }
+
+      return;
+   }
+
+   paused = false;
+
+   if (events)
+   {
+      afd.poll(interest());
+   }
+}
+
+uint32_t tcp_listening_socket::interest() const
+{
+   // whilst paused we still want to hear about the listener closing
+
+   return paused ? (events & ~reactor_event::accept) : events;
+}
+
+size_t tcp_listening_socket::accept_sockets(
+   reactor_socket *pSockets,
+   const size_t max_sockets)
+{
+   size_t accepted = 0;
+
+   while (accepted < max_sockets)
+   {
+      sockaddr_storage address {};
+
+      socket_length address_length = sizeof address;
+
+      const reactor_socket socket = accept(reinterpret_cast<sockaddr &>(address), address_length);
+
+      if (socket == invalid_socket)
+      {
+         break;
+      }
+
+      pSockets[accepted++] = socket;
+   }
 
    return accepted;
 }
 
 void tcp_listening_socket::close()
 {
-   if (s != INVALID_SOCKET)
+   if (s != invalid_socket)
    {
       const bool triggerCallback = (events == 0);
 
-      if (SOCKET_ERROR == closesocket(s))
+      // if there's a poll pending it reports the close
+
+      afd.closing_socket(!triggerCallback);
+
+      if (socket_error == close_socket(s))
       {
-         throw std::exception("failed to close");
+         throw std::runtime_error("failed to close");
       }
 
-      s = INVALID_SOCKET;
+      s = invalid_socket;
 
       if (triggerCallback)
       {
-         handle_events(AFD_POLL_LOCAL_CLOSE, 0);
+         handle_events(reactor_event::local_close, 0);
       }
    }
 }
 
-ULONG tcp_listening_socket::handle_events(
-   const ULONG eventsToHandle,
-   const NTSTATUS status)
+uint32_t tcp_listening_socket::handle_events(
+   const uint32_t eventsToHandle,
+   const int32_t status)
 {
    (void)status;
 
    if (connection_state == state::listening)
    {
-      if (AFD_POLL_ACCEPT & eventsToHandle)
+      if ((reactor_event::accept & eventsToHandle) && !paused)
       {
+         if (waiting_since == clock::time_point{})
+         {
+            waiting_since = clock::now();
+         }
+
+         accepts_left = budget;
+
          callbacks.on_incoming_connections(*this);
+
+         if (!accepts_left && !paused && s != invalid_socket)
+         {
+            // there may well be more to accept, but others have been waiting
+
+            afd.deferred(reactor_event::accept);
+         }
+
+         accepts_left = not_reporting;
       }
    }
 
-   if (AFD_POLL_ABORT & eventsToHandle)
+   if (reactor_event::abort & eventsToHandle)
    {
       connection_state = state::disconnected;
 
@@ -174,7 +529,7 @@ ULONG tcp_listening_socket::handle_events(
       events = 0;
    }
 
-   if (AFD_POLL_LOCAL_CLOSE & eventsToHandle)
+   if (reactor_event::local_close & eventsToHandle)
    {
       connection_state = state::disconnected;
 
@@ -185,10 +540,15 @@ ULONG tcp_listening_socket::handle_events(
 
    if(events)
    {
-      afd.poll(events);
+      afd.poll(interest());
    }
 
-   return events;
+   return interest();
+}
+
+void tcp_listening_socket::timer_expired()
+{
+   resume_when_admitted();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
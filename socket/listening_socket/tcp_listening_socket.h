@@ -28,7 +28,13 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "afd_handle.h"
-#include "afd_events.h"
+#include "socket_api.h"
+#include "socket_options.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <utility>
 
 class tcp_listening_socket;
 
@@ -50,10 +56,47 @@ class tcp_listening_socket_callbacks
       virtual ~tcp_listening_socket_callbacks() = default;
 };
 
-class tcp_listening_socket : private afd_events
+// Whilst on_incoming_connections() runs, the listener accepts no more than
+// its accept budget; accept() then returns invalid_socket, as if there were
+// nothing more to accept, and the listener is reported again once the other
+// sockets on the thread have had a turn, so that a storm of connections can't
+// starve those that are already established. Accepts made outside of the
+// callback aren't limited.
+//
+// Admission control limits the connections that the listener lets in, however
+// they're accepted: the number that are open at once, which needs the
+// application to call connection_closed() as each one that it accepted goes,
+// and the rate at which they're accepted, a token bucket that allows a burst
+// and then refills at so many a second. When a limit is reached accept()
+// either returns invalid_socket and the listener stops polling for accepts,
+// leaving the connections in the kernel's accept queue until there's room
+// again, or the connections are accepted and reset, so that their clients know
+// at once, and accept() goes on to the next one, which may be let in.
+
+class tcp_listening_socket : private reactor_events
 {
    public:
 
+      static constexpr uint32_t default_accept_budget = 64;
+
+      static constexpr uint32_t unlimited = UINT32_MAX;
+
+      enum class overload_policy
+      {
+         stop_accepting,
+         accept_and_reset
+      };
+
+      struct statistics
+      {
+         uint64_t accepted;                  // connections let in
+         uint64_t shed;                      // accepted and reset by admission control
+         uint64_t paused;                    // times that accepting stopped at a limit
+         uint64_t queue_wait_us;             // the total, and the longest, time that
+         uint64_t max_queue_wait_us;         // connections waited, see below
+         uint64_t option_calls;              // made to set the options of accepted sockets
+      };
+
       tcp_listening_socket(
          afd_handle afd,
          tcp_listening_socket_callbacks &callbacks);
@@ -66,33 +109,252 @@ class tcp_listening_socket : private afd_events
 
       ~tcp_listening_socket() override;
 
+      // Must be called before bind(), see tcp_listening_socket_group
+
+      void share_address();
+
       void bind(
          const sockaddr &address,
          int address_length);
 
+      // the address that the listener is bound to, with the port that was
+      // chosen if it was bound to port 0
+
+      socket_address local_address() const;
+
       void listen(
          int backlog);
 
-      SOCKET accept(
+      reactor_socket accept(
          sockaddr &address,
-         int &address_length);
+         socket_length &address_length);
+
+      // Accepts a connection and hands the socket to from.acquire(), along with
+      // the arguments given, so that the connection object comes from wherever
+      // the caller keeps them, a connection_pool or one of its thread caches,
+      // rather than being allocated for each connection. The connection owns
+      // the socket once it's constructed. If from.acquire() throws, whether the
+      // slot or the connection failed, the socket is still ours, it's closed
+      // and the exception is thrown. Returns null when there's nothing to
+      // accept.
+
+      template <typename allocator, typename... args>
+      auto accept_into(
+         allocator &from,
+         args &&...constructor_args) -> decltype(from.acquire(invalid_socket, std::forward<args>(constructor_args)...))
+      {
+         sockaddr_storage address {};
+
+         socket_length address_length = sizeof address;
+
+         const reactor_socket accepted = accept(reinterpret_cast<sockaddr &>(address), address_length);
+
+         if (accepted == invalid_socket)
+         {
+            return nullptr;
+         }
+
+         try
+         {
+            return from.acquire(accepted, std::forward<args>(constructor_args)...);
+         }
+         catch (...)
+         {
+            close_socket(accepted);
+
+            throw;
+         }
+      }
+
+      static constexpr size_t max_accept_batch = 64;
+
+      // Accepts as many connections as are waiting, up to the size of the
+      // array and what's left of the budget, and then hands each socket to
+      // from.acquire(), as accept_into() does, so that the accepts aren't held
+      // up by the connections being set up. The connections are constructed
+      // with the same arguments, and whatever their constructors do, such as
+      // reading so that their polls are issued, is done before this returns.
+      // Returns the number of connections placed in the array. If a connection
+      // fails to be acquired its socket, and those that haven't been handed on
+      // yet, are closed and the exception is thrown, the connections that were
+      // constructed are the caller's, and the array says which they are.
+
+      template <typename allocator, typename connection, typename... args>
+      size_t accept_batch(
+         allocator &from,
+         connection **ppConnections,
+         const size_t max_connections,
+         args &&...constructor_args)
+      {
+         reactor_socket sockets[max_accept_batch];
+
+         const size_t accepted = accept_sockets(sockets, std::min(max_connections, max_accept_batch));
+
+         size_t constructed = 0;
+
+         try
+         {
+            for (; constructed < accepted; ++constructed)
+            {
+               ppConnections[constructed] = from.acquire(sockets[constructed], constructor_args...);
+            }
+         }
+         catch (...)
+         {
+            // acquire() leaves the socket that it failed with to us
+
+            for (size_t i = constructed; i < accepted; ++i)
+            {
+               close_socket(sockets[i]);
+            }
+
+            throw;
+         }
+
+         return accepted;
+      }
+
+      void set_accept_budget(
+         uint32_t budget);
+
+      void set_connection_limit(
+         uint32_t max_connections);
+
+      // per_second of unlimited removes the limit, burst is how many can be
+      // accepted at once after a quiet spell, at least 1. A listener that's
+      // stopped accepting is resumed by its timer, so this needs a reactor
+      // with timers.
+
+      void set_accept_rate(
+         uint32_t per_second,
+         uint32_t burst);
+
+      void set_overload_policy(
+         overload_policy policy);
+
+      // Called by the application, on the reactor's thread, as a connection
+      // that the listener accepted closes.
+
+      void connection_closed();
+
+      size_t open_connections() const
+      {
+         return connections;
+      }
+
+      bool accepting_paused() const
+      {
+         return paused;
+      }
+
+      // A connection's wait is measured from when the listener was told that
+      // there were connections waiting, and includes any time that accepting
+      // was paused, until it's accepted or shed; how long it had been in the
+      // kernel's queue before the reactor reported it isn't known.
+
+      const statistics &stats() const
+      {
+         return counters;
+      }
+
+      // See socket_accept_queue(), false where the platform doesn't say.
+
+      bool accept_queue(
+         uint32_t &depth,
+         uint32_t &limit) const;
+
+      // The options that accepted sockets are given, set before listen() so
+      // that the buffer sizes are those that the connections are set up with.
+      // What the sockets would inherit is set on the listener now, the rest on
+      // each socket as it's accepted, see socket_options.h. A socket that
+      // can't be given its options is closed and accept() throws.
+
+      void set_accepted_options(
+         const socket_options &options);
+
+      // If so, the sockets that accept() returns can be given to a tcp_socket
+      // as non_blocking_socket.
+
+      bool accepts_non_blocking() const
+      {
+         return accept_non_blocking;
+      }
 
       void close();
 
    private :
 
-      ULONG handle_events(
-         ULONG eventsToHandle,
-         NTSTATUS status) override;
+      reactor_socket accept_admitted(
+         sockaddr &address,
+         socket_length &address_length);
+
+      size_t accept_sockets(
+         reactor_socket *pSockets,
+         size_t max_sockets);
+
+      using clock = std::chrono::steady_clock;
+
+      bool admit(
+         clock::time_point now);
+
+      void record_wait(
+         clock::time_point now);
+
+      void pause();
+
+      void resume_when_admitted();
+
+      uint32_t interest() const;
+
+      uint32_t handle_events(
+         uint32_t eventsToHandle,
+         int32_t status) override;
+
+      void timer_expired() override;
 
       const afd_handle afd;
 
-      SOCKET s;
+      reactor_socket s;
 
-      ULONG events;
+      uint32_t events;
 
       tcp_listening_socket_callbacks &callbacks;
 
+      uint32_t budget;
+
+      // accepts are only counted whilst on_incoming_connections() runs
+
+      static constexpr uint32_t not_reporting = UINT32_MAX;
+
+      uint32_t accepts_left;
+
+      uint32_t max_connections;
+
+      size_t connections;
+
+      uint32_t accept_rate;
+
+      uint32_t burst;
+
+      double tokens;
+
+      clock::time_point last_refill;
+
+      overload_policy policy;
+
+      bool paused;
+
+      // when the listener was first told that connections were waiting, since
+      // it last found that there were none, zero when there are none
+
+      clock::time_point waiting_since;
+
+      statistics counters;
+
+      bool accept_non_blocking;
+
+      socket_options per_accept;
+
       enum class state
       {
          created,
@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: tcp_listening_socket_group.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tcp_listening_socket_group.h"
+
+static bool has_port(
+   const socket_address &address)
+{
+   if (address.family() == AF_INET6)
+   {
+      return 0 != reinterpret_cast<const sockaddr_in6 &>(address.storage).sin6_port;
+   }
+
+   return 0 != reinterpret_cast<const sockaddr_in &>(address.storage).sin_port;
+}
+
+tcp_listening_socket_group::tcp_listening_socket_group(
+   const sockaddr &address,
+   const socket_length address_length)
+   :  shared_address(make_socket_address(address, address_length)),
+      port_chosen(has_port(shared_address)),
+      num_listeners(0)
+{
+}
+
+void tcp_listening_socket_group::join(
+   tcp_listening_socket &listener)
+{
+   // held whilst binding, so that the first listener's choice of port is
+   // known before the next binds
+
+   std::lock_guard<std::mutex> guard(lock);
+
+   listener.share_address();
+
+   listener.bind(shared_address.address(), shared_address.length);
+
+   if (!port_chosen)
+   {
+      shared_address = listener.local_address();
+
+      port_chosen = true;
+   }
+
+   ++num_listeners;
+}
+
+socket_address tcp_listening_socket_group::address() const
+{
+   std::lock_guard<std::mutex> guard(lock);
+
+   return shared_address;
+}
+
+size_t tcp_listening_socket_group::listeners() const
+{
+   std::lock_guard<std::mutex> guard(lock);
+
+   return num_listeners;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: tcp_listening_socket_group.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,86 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: tcp_listening_socket_group.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tcp_listening_socket.h"
+
+#include <cstddef>
+#include <mutex>
+
+// A number of listening sockets bound to the same address, each owned by a
+// reactor thread of its own, so that the kernel spreads the incoming
+// connections across them and each thread accepts, and serves, its own; there
+// is no acceptor to become the bottleneck and nothing is handed from one
+// thread to another. Needs SO_REUSEPORT, which is to say Linux.
+//
+// Each thread creates its listener on its own reactor, joins it to the group
+// and then listens. If the group's address has port 0 the first listener to
+// join picks the port and the others are bound to the same one.
+//
+// The kernel places a connection when it arrives, by a hash of its addresses,
+// so a listener that is slow to accept isn't passed over, and the connections
+// waiting for a listener that closes are reset; the listeners should live for
+// as long as the group is listening.
+
+class tcp_listening_socket_group
+{
+   public :
+
+      tcp_listening_socket_group(
+         const sockaddr &address,
+         socket_length address_length);
+
+      tcp_listening_socket_group(const tcp_listening_socket_group &) = delete;
+      tcp_listening_socket_group(tcp_listening_socket_group &&) = delete;
+
+      tcp_listening_socket_group& operator=(const tcp_listening_socket_group &) = delete;
+      tcp_listening_socket_group& operator=(tcp_listening_socket_group &&) = delete;
+
+      // Any thread, binds a listener that hasn't been bound yet
+
+      void join(
+         tcp_listening_socket &listener);
+
+      socket_address address() const;
+
+      size_t listeners() const;
+
+   private :
+
+      mutable std::mutex lock;
+
+      socket_address shared_address;
+
+      bool port_chosen;
+
+      size_t num_listeners;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: tcp_listening_socket_group.h
+///////////////////////////////////////////////////////////////////////////////
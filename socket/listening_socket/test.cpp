@@ -40,6 +40,9 @@
 #include "tcp_socket.h"
 #include "single_connection_afd_system.h"
 
+#include <chrono>
+#include <vector>
+
 #pragma comment(lib, "ntdll.lib")
 
 int main(int argc, char **argv) {
@@ -317,6 +320,117 @@ TEST(AFDListeningSocket, TestAccept)
    ::closesocket(client_socket);
 }
 
+class accepting_listener_callbacks : public tcp_listening_socket_callbacks
+{
+   public :
+
+      ~accepting_listener_callbacks() override
+      {
+         for (const reactor_socket accepted : connections)
+         {
+            ::closesocket(accepted);
+         }
+      }
+
+      void on_incoming_connections(
+         tcp_listening_socket &s) override
+      {
+         sockaddr_in address {};
+
+         socket_length address_length = sizeof address;
+
+         reactor_socket accepted;
+
+         while ((accepted = s.accept(reinterpret_cast<sockaddr &>(address), address_length)) != invalid_socket)
+         {
+            connections.push_back(accepted);
+
+            address_length = sizeof address;
+         }
+      }
+
+      void on_connection_reset(
+         tcp_listening_socket &) override
+      {
+      }
+
+      void on_disconnected(
+         tcp_listening_socket &) override
+      {
+      }
+
+      std::vector<reactor_socket> connections;
+};
+
+TEST(AFDListeningSocket, TestAcceptRate)
+{
+   const auto port = GetAvailablePort();
+
+   const auto handles = CreateAfdAndIOCP();
+
+   single_connection_afd_system afd(handles.afd);
+
+   afd_handle handle(afd, 0);
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   address.sin_port = htons(port);
+
+   accepting_listener_callbacks callbacks;
+
+   tcp_listening_socket socket(handle, reinterpret_cast<const sockaddr &>(address), sizeof(address), callbacks);
+
+   // a burst of 2, and then one every 50ms, resumed by the listener's timer
+
+   socket.set_accept_rate(20, 2);
+
+   socket.listen(10);
+
+   std::vector<SOCKET> clients;
+
+   for (int i = 0; i < 4; ++i)
+   {
+      clients.push_back(CreateTCPSocket());
+
+      ::connect(clients.back(), &reinterpret_cast<const sockaddr &>(address), sizeof(address));
+   }
+
+   const auto start = std::chrono::steady_clock::now();
+
+   auto *pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO);
+
+   pAfd->handle_events();
+
+   EXPECT_EQ(2u, callbacks.connections.size());
+
+   EXPECT_TRUE(socket.accepting_paused());
+
+   // whilst paused the poll times out when the timer is due, so there's
+   // always a completion
+
+   for (int i = 0; i < 20 && callbacks.connections.size() < 4; ++i)
+   {
+      pAfd = GetCompletionAs<afd_system_events>(handles.iocp, 200);
+
+      pAfd->handle_events();
+   }
+
+   EXPECT_EQ(4u, callbacks.connections.size());
+
+   EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(90));
+
+   EXPECT_EQ(4u, socket.stats().accepted);
+
+   EXPECT_LE(2u, socket.stats().paused);
+
+   for (const SOCKET client : clients)
+   {
+      ::closesocket(client);
+   }
+}
+
 TEST(AFDListeningSocket, TestClose)
 {
    const auto port = GetAvailablePort();
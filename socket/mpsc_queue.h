@@ -0,0 +1,181 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: mpsc_queue.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "slab_allocator.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+// A bounded queue that any number of threads push to and one thread pops
+// from, without locks. As in Dmitry Vyukov's bounded queue, each cell has a
+// sequence number that says whether it's free for the push that has claimed
+// it, or holds a value for the pop; a push claims a cell by advancing the
+// tail, and only one thread pops, so the head is a plain counter. The tail
+// and the head are on cache lines of their own. The capacity is rounded up to
+// a power of two, of at least two, as a cell that's full and a cell that's
+// free for the next lap would otherwise have the same sequence, and push()
+// fails rather than waiting when the queue is full.
+//
+// The values are copied in and out, so they're small and trivially copyable,
+// such as sockets or pointers.
+
+template <typename T>
+class mpsc_queue
+{
+   static_assert(std::is_trivially_copyable_v<T>, "queued values are copied in and out");
+
+   public :
+
+      explicit mpsc_queue(
+         const size_t capacity)
+         :  mask(round_up(capacity) - 1),
+            cells(std::make_unique<cell[]>(mask + 1)),
+            tail(0),
+            head(0)
+      {
+         for (size_t i = 0; i <= mask; ++i)
+         {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+         }
+      }
+
+      mpsc_queue(const mpsc_queue &) = delete;
+      mpsc_queue(mpsc_queue &&) = delete;
+
+      mpsc_queue& operator=(const mpsc_queue &) = delete;
+      mpsc_queue& operator=(mpsc_queue &&) = delete;
+
+      // Any thread, returns false if the queue is full
+
+      bool push(
+         const T &value)
+      {
+         size_t position = tail.load(std::memory_order_relaxed);
+
+         for (;;)
+         {
+            cell &claiming = cells[position & mask];
+
+            const size_t sequence = claiming.sequence.load(std::memory_order_acquire);
+
+            if (sequence == position)
+            {
+               if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+               {
+                  claiming.value = value;
+
+                  claiming.sequence.store(position + 1, std::memory_order_release);
+
+                  return true;
+               }
+
+               // another push claimed it, position is now the tail that it left
+            }
+            else if (sequence < position)
+            {
+               // the cell still holds the value from a lap ago
+
+               return false;
+            }
+            else
+            {
+               position = tail.load(std::memory_order_relaxed);
+            }
+         }
+      }
+
+      // The consuming thread only, returns false if there's nothing to pop, or
+      // if the next value is still being pushed
+
+      bool pop(
+         T &value)
+      {
+         cell &popping = cells[head & mask];
+
+         if (popping.sequence.load(std::memory_order_acquire) != head + 1)
+         {
+            return false;
+         }
+
+         value = popping.value;
+
+         popping.sequence.store(head + mask + 1, std::memory_order_release);
+
+         ++head;
+
+         return true;
+      }
+
+      size_t capacity() const
+      {
+         return mask + 1;
+      }
+
+   private :
+
+      static size_t round_up(
+         const size_t capacity)
+      {
+         if (!capacity)
+         {
+            throw std::runtime_error("a queue needs room for a value");
+         }
+
+         size_t rounded = 2;
+
+         while (rounded < capacity)
+         {
+            rounded <<= 1;
+         }
+
+         return rounded;
+      }
+
+      struct cell
+      {
+         std::atomic<size_t> sequence;
+
+         T value;
+      };
+
+      const size_t mask;
+
+      const std::unique_ptr<cell[]> cells;
+
+      alignas(slab_allocator::cache_line_size) std::atomic<size_t> tail;
+
+      alignas(slab_allocator::cache_line_size) size_t head;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: mpsc_queue.h
+///////////////////////////////////////////////////////////////////////////////
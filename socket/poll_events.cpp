@@ -0,0 +1,176 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: poll_events.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "poll_events.h"
+
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <cerrno>
+
+static int32_t pending_error(
+   const int fd)
+{
+   int error = 0;
+
+   socklen_t length = sizeof error;
+
+   if (0 != ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length))
+   {
+      return errno;
+   }
+
+   return error;
+}
+
+static bool connection_was_reset(
+   const int fd)
+{
+   // a hang up is either both sides having closed or a reset, a reset takes
+   // the connection straight to closed
+
+   tcp_info info {};
+
+   socklen_t length = sizeof info;
+
+   if (0 != ::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length))
+   {
+      return true;
+   }
+
+   return info.tcpi_state == TCP_CLOSE;
+}
+
+static bool has_data(
+   const int fd)
+{
+   int available = 0;
+
+   return 0 == ::ioctl(fd, FIONREAD, &available) && available > 0;
+}
+
+uint32_t to_poll_events(
+   const uint32_t interest)
+{
+   uint32_t events = 0;
+
+   if (interest & (reactor_event::receive | reactor_event::accept))
+   {
+      events |= POLLIN;
+   }
+
+   if (interest & reactor_event::receive_expedited)
+   {
+      events |= POLLPRI;
+   }
+
+   if (interest & reactor_event::send)
+   {
+      events |= POLLOUT;
+   }
+
+   if (interest & reactor_event::disconnect)
+   {
+      events |= POLLRDHUP;
+   }
+
+   return events;
+}
+
+uint32_t from_poll_events(
+   const int fd,
+   const uint32_t interest,
+   const uint32_t poll_events,
+   int32_t &status)
+{
+   status = 0;
+
+   uint32_t events = 0;
+
+   if (poll_events & (POLLERR | POLLHUP))
+   {
+      if (interest & reactor_event::connect_fail)
+      {
+         // still connecting, the connection was refused or timed out
+
+         status = pending_error(fd);
+
+         return reactor_event::connect_fail;
+      }
+
+      if (poll_events & POLLERR)
+      {
+         status = pending_error(fd);
+
+         events |= reactor_event::abort;
+      }
+      else
+      {
+         events |= connection_was_reset(fd) ? reactor_event::abort : reactor_event::disconnect;
+      }
+   }
+
+   if (!(events & reactor_event::abort))
+   {
+      if (poll_events & POLLRDHUP)
+      {
+         events |= reactor_event::disconnect;
+      }
+
+      if (poll_events & POLLIN)
+      {
+         events |= (interest & reactor_event::accept) ? reactor_event::accept : reactor_event::receive;
+      }
+
+      if (poll_events & POLLPRI)
+      {
+         events |= reactor_event::receive_expedited;
+      }
+
+      if ((events & reactor_event::disconnect) && !has_data(fd))
+      {
+         // POLLIN is set for the end of the stream, which isn't data
+
+         events &= ~reactor_event::receive;
+      }
+   }
+
+   if (poll_events & POLLOUT)
+   {
+      events |= reactor_event::send;
+   }
+
+   return events;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: poll_events.cpp
+///////////////////////////////////////////////////////////////////////////////
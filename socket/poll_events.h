@@ -0,0 +1,62 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: poll_events.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "reactor.h"
+
+#include <cstdint>
+
+// Maps reactor events onto the poll(2) conditions that the Linux reactors wait
+// for, and what those conditions report back onto reactor events:
+//
+//    POLLIN                  receive, or accept if that's the interest
+//    POLLPRI                 receive_expedited
+//    POLLOUT                 send
+//    POLLRDHUP               disconnect, receive only if data remains
+//    POLLHUP                 abort if the connection was reset, else disconnect
+//    POLLERR                 abort, or connect_fail whilst connecting
+//
+// POLLERR and POLLHUP are always reported, they cover abort, local_close and
+// connect_fail. The epoll and io_uring values of these conditions are the same.
+
+uint32_t to_poll_events(
+   uint32_t interest);
+
+// The interest decides between receive and accept, and whether the socket is
+// still connecting. The events are not masked by it, that's up to the caller.
+// status is set to the socket's pending error for abort and connect_fail.
+
+uint32_t from_poll_events(
+   int fd,
+   uint32_t interest,
+   uint32_t poll_events,
+   int32_t &status);
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: poll_events.h
+///////////////////////////////////////////////////////////////////////////////
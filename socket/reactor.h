@@ -0,0 +1,176 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: reactor.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+
+// The platform neutral contract between a socket and whatever tells it when it
+// can make progress. On Windows that's an afd_system, which polls \Device\Afd,
+// elsewhere it's a native readiness API such as epoll.
+// Polls are one-shot; once a socket's events have been handled the value that
+// handle_events() returns is the socket's new interest, zero means that the
+// socket isn't polled until poll() is called again.
+
+using reactor_socket = uintptr_t;         // a SOCKET on Windows, a file descriptor elsewhere
+
+// The event values are those of the AFD_POLL_xxx flags, so that the AFD
+// implementations can pass them straight through; other implementations map
+// their own notifications onto them.
+
+struct reactor_event
+{
+   static constexpr uint32_t receive            = 0x0001;
+   static constexpr uint32_t receive_expedited  = 0x0002;
+   static constexpr uint32_t send               = 0x0004;
+   static constexpr uint32_t disconnect         = 0x0008;      // client close
+   static constexpr uint32_t abort              = 0x0010;      // reset
+   static constexpr uint32_t local_close        = 0x0020;      // we have closed
+   static constexpr uint32_t accept             = 0x0080;
+   static constexpr uint32_t connect_fail       = 0x0100;
+};
+
+class reactor_events
+{
+   public :
+
+      // status is the platform's error code for the socket, if there is one
+
+      virtual uint32_t handle_events(
+         uint32_t events,
+         int32_t status) = 0;
+
+      // Called once the reactor has dispatched everything that it was
+      // reporting, for a socket that asked to be with after_dispatch().
+
+      virtual void dispatch_complete()
+      {
+      }
+
+      // Called when the socket's timer, see reactor::set_timer(), expires.
+
+      virtual void timer_expired()
+      {
+      }
+
+   protected :
+
+      virtual ~reactor_events() = default;
+};
+
+class reactor
+{
+   public :
+
+      // Hands out a slot that is not in use, the slot is returned to the reactor
+      // when the socket is disassociated.
+
+      virtual uint32_t allocate_slot() = 0;
+
+      virtual void associate_socket(
+         uint32_t slot,
+         reactor_socket s,
+         reactor_events &events) = 0;
+
+      virtual void disassociate_socket(
+         uint32_t slot) = 0;
+
+      virtual bool poll(
+         uint32_t slot,
+         uint32_t events) = 0;
+
+      // Called just before a socket is closed, poll_pending says whether the
+      // socket expects its poll to report the close. AFD reports the close to
+      // the pending poll itself, reactors that lose track of a socket when it's
+      // closed use this to report local_close, and to forget the socket whilst
+      // its descriptor still refers to it.
+
+      virtual void closing_socket(
+         uint32_t slot,
+         bool poll_pending)
+      {
+         (void)slot;
+         (void)poll_pending;
+      }
+
+      // Called by a socket that stops handling events before it has dealt with
+      // all of them, so that other sockets get a turn, the events are polled
+      // for again. AFD and epoll polls complete as soon as the condition holds,
+      // so the socket is told again, reactors that only report changes keep the
+      // events and report them when the socket next polls for them.
+
+      virtual void deferred(
+         uint32_t slot,
+         uint32_t events)
+      {
+         (void)slot;
+         (void)events;
+      }
+
+      // Called by a socket whilst the reactor is dispatching, when it has
+      // something to do once every handler has run, such as sending all that
+      // they wrote to it in one go, dispatch_complete() is called when they
+      // have. Returns false if the reactor isn't dispatching, or doesn't do
+      // this, and the socket should do it now.
+
+      virtual bool after_dispatch(
+         uint32_t slot)
+      {
+         (void)slot;
+
+         return false;
+      }
+
+      // Each socket has one timer, timer_expired() is called once timeout_ms
+      // have passed, from the thread that runs the reactor. Setting the timer
+      // again replaces it, and it's cancelled when the socket is
+      // disassociated. Returns false if the reactor doesn't have timers.
+
+      virtual bool set_timer(
+         uint32_t slot,
+         uint32_t timeout_ms)
+      {
+         (void)slot;
+         (void)timeout_ms;
+
+         return false;
+      }
+
+      virtual void cancel_timer(
+         uint32_t slot)
+      {
+         (void)slot;
+      }
+
+   protected :
+
+      virtual ~reactor() = default;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: reactor.h
+///////////////////////////////////////////////////////////////////////////////
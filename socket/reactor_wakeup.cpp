@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: reactor_wakeup.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "reactor_wakeup.h"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include <stdexcept>
+
+static reactor_socket open_wakeup_socket()
+{
+#ifdef __linux__
+
+   const int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+   return fd == -1 ? invalid_socket : static_cast<reactor_socket>(fd);
+
+#else
+
+   const auto datagrams = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+#ifdef _WIN32
+   const reactor_socket s = datagrams;
+#else
+   const reactor_socket s = datagrams == -1 ? invalid_socket : static_cast<reactor_socket>(datagrams);
+#endif
+
+   if (s == invalid_socket)
+   {
+      return invalid_socket;
+   }
+
+   // bound to a port on loopback and connected to it, so that what it sends
+   // it receives
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   socket_length address_length = sizeof address;
+
+   if (0 != socket_bind(s, reinterpret_cast<const sockaddr &>(address), sizeof address) ||
+       0 != ::getsockname(native_socket(s), reinterpret_cast<sockaddr *>(&address), &address_length) ||
+       0 != socket_connect(s, reinterpret_cast<const sockaddr &>(address), address_length) ||
+       !set_non_blocking(s))
+   {
+      close_socket(s);
+
+      return invalid_socket;
+   }
+
+   return s;
+
+#endif
+}
+
+reactor_wakeup::reactor_wakeup(
+   afd_handle afd,
+   reactor_wakeup_callbacks &callbacks)
+   :  afd(afd),
+      s(open_wakeup_socket()),
+      callbacks(callbacks),
+      signalled(false),
+      num_signals(0)
+{
+   if (s == invalid_socket)
+   {
+      throw std::runtime_error("failed to create wakeup");
+   }
+
+   try
+   {
+      afd.associate_socket(s, *this);
+   }
+   catch (...)
+   {
+      close_socket(s);
+
+      throw;
+   }
+
+   afd.poll(reactor_event::receive);
+}
+
+reactor_wakeup::~reactor_wakeup()
+{
+   afd.disassociate_socket();
+
+   close_socket(s);
+}
+
+void reactor_wakeup::wake()
+{
+   if (signalled.exchange(true, std::memory_order_acq_rel))
+   {
+      // the reactor's thread hasn't seen the last wake yet
+
+      return;
+   }
+
+   num_signals.fetch_add(1, std::memory_order_relaxed);
+
+#ifdef __linux__
+   const uint64_t one = 1;
+
+   const ssize_t written = ::write(native_socket(s), &one, sizeof one);
+
+   (void)written;
+#else
+   const uint8_t one = 1;
+
+   socket_send(s, &one, sizeof one);
+#endif
+}
+
+uint32_t reactor_wakeup::handle_events(
+   const uint32_t events,
+   const int32_t status)
+{
+   (void)status;
+
+   if (events & reactor_event::receive)
+   {
+#ifdef __linux__
+      uint64_t count = 0;
+
+      const ssize_t bytes = ::read(native_socket(s), &count, sizeof count);
+
+      (void)bytes;
+#else
+      uint8_t buffer[16];
+
+      while (socket_recv(s, buffer, sizeof buffer) > 0)
+      {
+      }
+#endif
+
+      // cleared after draining, as a wake that saw the flag clear makes a write
+      // that must not be consumed here, and before the callback, so that a wake
+      // from here on calls it again; the exchange sees whatever was done before
+      // any wake that was coalesced with the one that was drained
+
+      signalled.exchange(false, std::memory_order_acq_rel);
+
+      callbacks.on_wakeup(*this);
+   }
+
+   return reactor_event::receive;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: reactor_wakeup.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,106 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: reactor_wakeup.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "afd_handle.h"
+#include "socket_api.h"
+
+#include <atomic>
+#include <cstdint>
+
+class reactor_wakeup;
+
+class reactor_wakeup_callbacks
+{
+   public :
+
+      virtual void on_wakeup(
+         reactor_wakeup &wakeup) = 0;
+
+   protected :
+
+      virtual ~reactor_wakeup_callbacks() = default;
+};
+
+// Lets any thread wake the thread that runs a reactor, which then calls
+// on_wakeup() from that thread. wake() makes a descriptor that the reactor is
+// polling readable, an eventfd on Linux and, elsewhere, a loopback UDP socket
+// that's connected to itself, which the reactor polls as it would any other
+// socket. Wakes that arrive before on_wakeup() has been called are coalesced,
+// so only the first makes a system call; a wake that arrives whilst
+// on_wakeup() runs calls it again, so whatever the waking thread left for the
+// reactor's thread before waking it is always seen.
+//
+// Constructed and destroyed by the thread that runs the reactor, wake() can be
+// called by any thread.
+
+class reactor_wakeup : private reactor_events
+{
+   public :
+
+      reactor_wakeup(
+         afd_handle afd,
+         reactor_wakeup_callbacks &callbacks);
+
+      reactor_wakeup(const reactor_wakeup &) = delete;
+      reactor_wakeup(reactor_wakeup &&) = delete;
+
+      reactor_wakeup& operator=(const reactor_wakeup &) = delete;
+      reactor_wakeup& operator=(reactor_wakeup &&) = delete;
+
+      ~reactor_wakeup() override;
+
+      void wake();
+
+      // the wakes that made a system call, rather than being coalesced
+
+      uint64_t signals() const
+      {
+         return num_signals.load(std::memory_order_relaxed);
+      }
+
+   private :
+
+      uint32_t handle_events(
+         uint32_t events,
+         int32_t status) override;
+
+      const afd_handle afd;
+
+      reactor_socket s;
+
+      reactor_wakeup_callbacks &callbacks;
+
+      std::atomic<bool> signalled;
+
+      std::atomic<uint64_t> num_signals;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: reactor_wakeup.h
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,332 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: receive_ring.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "receive_ring.h"
+
+#ifdef _WIN32
+
+#include <Windows.h>
+
+#pragma comment(lib, "onecore.lib")
+
+#else
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#endif
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+static size_t mapping_granularity()
+{
+#ifdef _WIN32
+   SYSTEM_INFO info {};
+
+   GetSystemInfo(&info);
+
+   return info.dwAllocationGranularity;
+#else
+   return static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+}
+
+receive_ring::receive_ring(
+   const size_t capacity,
+   const mapping how)
+   :  pBuffer(nullptr),
+      mask(0),
+      is_mirrored(false),
+      head(0),
+      tail(0)
+{
+   if (!capacity)
+   {
+      throw std::runtime_error("receive ring capacity must not be zero");
+   }
+
+   size_t size = std::bit_ceil(capacity);
+
+   if (how == mapping::mirrored)
+   {
+      // the granularity is always a power of two
+
+      size = std::max(size, mapping_granularity());
+   }
+
+   mask = size - 1;
+
+   if (how != mapping::mirrored || !allocate_mirrored())
+   {
+      allocate_plain();
+   }
+}
+
+receive_ring::~receive_ring()
+{
+   release();
+}
+
+void receive_ring::allocate_plain()
+{
+   pBuffer = new uint8_t[capacity()];
+
+   is_mirrored = false;
+}
+
+#ifdef _WIN32
+
+bool receive_ring::allocate_mirrored()
+{
+   // reserve twice the size as a placeholder, split it in two and map a view
+   // of the same section into each half
+
+   const size_t size = capacity();
+
+   const HANDLE hSection = CreateFileMappingW(
+      INVALID_HANDLE_VALUE,
+      nullptr,
+      PAGE_READWRITE,
+      static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+      static_cast<DWORD>(size),
+      nullptr);
+
+   if (!hSection)
+   {
+      return false;
+   }
+
+   uint8_t *pPlaceholder = static_cast<uint8_t *>(VirtualAlloc2(
+      nullptr,
+      nullptr,
+      2 * size,
+      MEM_RESERVE | MEM_RESERVE_PLACEHOLDER,
+      PAGE_NOACCESS,
+      nullptr,
+      0));
+
+   if (!pPlaceholder)
+   {
+      CloseHandle(hSection);
+
+      return false;
+   }
+
+   if (!VirtualFree(pPlaceholder, size, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER))
+   {
+      VirtualFree(pPlaceholder, 0, MEM_RELEASE);
+
+      CloseHandle(hSection);
+
+      return false;
+   }
+
+   void *pView1 = MapViewOfFile3(hSection, nullptr, pPlaceholder, 0, size, MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, nullptr, 0);
+
+   void *pView2 = pView1 ?
+      MapViewOfFile3(hSection, nullptr, pPlaceholder + size, 0, size, MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, nullptr, 0) :
+      nullptr;
+
+   // the views keep the section alive
+
+   CloseHandle(hSection);
+
+   if (!pView2)
+   {
+      if (pView1)
+      {
+         UnmapViewOfFile(pView1);
+      }
+      else
+      {
+         VirtualFree(pPlaceholder, 0, MEM_RELEASE);
+      }
+
+      VirtualFree(pPlaceholder + size, 0, MEM_RELEASE);
+
+      return false;
+   }
+
+   pBuffer = pPlaceholder;
+
+   is_mirrored = true;
+
+   return true;
+}
+
+void receive_ring::release()
+{
+   if (is_mirrored)
+   {
+      UnmapViewOfFile(pBuffer);
+      UnmapViewOfFile(pBuffer + capacity());
+   }
+   else
+   {
+      delete [] pBuffer;
+   }
+
+   pBuffer = nullptr;
+}
+
+#else
+
+bool receive_ring::allocate_mirrored()
+{
+   // reserve twice the size and map the same memory file into each half
+
+   const size_t size = capacity();
+
+   const int fd = ::memfd_create("receive_ring", MFD_CLOEXEC);
+
+   if (fd == -1)
+   {
+      return false;
+   }
+
+   bool mapped = false;
+
+   if (0 == ::ftruncate(fd, static_cast<off_t>(size)))
+   {
+      void *pReserved = ::mmap(nullptr, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+      if (pReserved != MAP_FAILED)
+      {
+         uint8_t *pBase = static_cast<uint8_t *>(pReserved);
+
+         mapped =
+            MAP_FAILED != ::mmap(pBase, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) &&
+            MAP_FAILED != ::mmap(pBase + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+
+         if (mapped)
+         {
+            pBuffer = pBase;
+
+            is_mirrored = true;
+         }
+         else
+         {
+            ::munmap(pReserved, 2 * size);
+         }
+      }
+   }
+
+   // the mappings keep the memory alive
+
+   ::close(fd);
+
+   return mapped;
+}
+
+void receive_ring::release()
+{
+   if (is_mirrored)
+   {
+      ::munmap(pBuffer, 2 * capacity());
+   }
+   else
+   {
+      delete [] pBuffer;
+   }
+
+   pBuffer = nullptr;
+}
+
+#endif
+
+std::span<const uint8_t> receive_ring::readable_span() const
+{
+   const size_t offset = static_cast<size_t>(head) & mask;
+
+   const size_t readable = is_mirrored ? size() : std::min(size(), capacity() - offset);
+
+   return std::span<const uint8_t>(pBuffer + offset, readable);
+}
+
+void receive_ring::consume(
+   const size_t bytes)
+{
+   if (bytes > size())
+   {
+      throw std::runtime_error("consumed more than is readable");
+   }
+
+   head += bytes;
+
+   if (head == tail)
+   {
+      // start again at the beginning, so that a plain ring has as much
+      // contiguous space as it can
+
+      head = 0;
+      tail = 0;
+   }
+}
+
+uint32_t receive_ring::writable_spans(
+   std::span<uint8_t> (&spans)[2]) const
+{
+   const size_t free = space();
+
+   if (!free)
+   {
+      return 0;
+   }
+
+   const size_t offset = static_cast<size_t>(tail) & mask;
+
+   const size_t first = is_mirrored ? free : std::min(free, capacity() - offset);
+
+   spans[0] = std::span<uint8_t>(pBuffer + offset, first);
+
+   if (first == free)
+   {
+      return 1;
+   }
+
+   spans[1] = std::span<uint8_t>(pBuffer, free - first);
+
+   return 2;
+}
+
+void receive_ring::commit(
+   const size_t bytes)
+{
+   if (bytes > space())
+   {
+      throw std::runtime_error("committed more than there is space for");
+   }
+
+   tail += bytes;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: receive_ring.cpp
+///////////////////////////////////////////////////////////////////////////////
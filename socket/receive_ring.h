@@ -0,0 +1,137 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: receive_ring.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// A power of two sized ring that a socket receives into and that the data is
+// then parsed from in place; readable_span() is the data that has arrived and
+// consume() gives the space back once it has been dealt with, nothing is moved.
+//
+// A plain ring's data wraps, so readable_span() only goes up to the end of the
+// buffer and a message that spans the wrap has to be read in two parts. A
+// mirrored ring maps the same memory twice, back to back, so that everything
+// that is readable is always one contiguous span. Mirroring needs the size to
+// be a multiple of the page size, or of the allocation granularity on Windows,
+// 64KB, and falls back to a plain ring if the mapping can't be created, use
+// mirrored() to see which you got.
+
+class receive_ring
+{
+   public :
+
+      enum class mapping
+      {
+         plain,
+         mirrored
+      };
+
+      explicit receive_ring(
+         size_t capacity,
+         mapping how = mapping::plain);
+
+      receive_ring(const receive_ring &) = delete;
+      receive_ring(receive_ring &&) = delete;
+
+      receive_ring& operator=(const receive_ring &) = delete;
+      receive_ring& operator=(receive_ring &&) = delete;
+
+      ~receive_ring();
+
+      size_t capacity() const
+      {
+         return mask + 1;
+      }
+
+      bool mirrored() const
+      {
+         return is_mirrored;
+      }
+
+      size_t size() const
+      {
+         return static_cast<size_t>(tail - head);
+      }
+
+      size_t space() const
+      {
+         return capacity() - size();
+      }
+
+      bool empty() const
+      {
+         return head == tail;
+      }
+
+      bool full() const
+      {
+         return space() == 0;
+      }
+
+      // The oldest data, all of it if the ring is mirrored, otherwise up to
+      // the end of the buffer.
+
+      std::span<const uint8_t> readable_span() const;
+
+      void consume(
+         size_t bytes);
+
+      // The free space, as one span if the ring is mirrored or the space
+      // doesn't wrap, otherwise two. Returns the number of spans, commit()
+      // what has been written into them.
+
+      uint32_t writable_spans(
+         std::span<uint8_t> (&spans)[2]) const;
+
+      void commit(
+         size_t bytes);
+
+   private :
+
+      void allocate_plain();
+
+      bool allocate_mirrored();
+
+      void release();
+
+      uint8_t *pBuffer;
+
+      size_t mask;
+
+      bool is_mirrored;
+
+      uint64_t head;
+
+      uint64_t tail;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: receive_ring.h
+///////////////////////////////////////////////////////////////////////////////
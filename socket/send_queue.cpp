@@ -0,0 +1,160 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: send_queue.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "send_queue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+send_queue::send_queue(
+   const size_t limit,
+   const size_t block_size)
+   :  max_queued(limit),
+      block_size(block_size),
+      queued(0),
+      allocated(0)
+{
+   if (!block_size)
+   {
+      throw std::runtime_error("block size must not be zero");
+   }
+}
+
+size_t send_queue::append(
+   const uint8_t *pData,
+   const size_t data_length)
+{
+   const size_t accepted = std::min(data_length, space());
+
+   size_t copied = 0;
+
+   while (copied < accepted)
+   {
+      if (blocks.empty() || blocks.back().end == block_size)
+      {
+         add_block();
+      }
+
+      block &b = blocks.back();
+
+      const size_t bytes = std::min(accepted - copied, block_size - b.end);
+
+      memcpy(b.pData.get() + b.end, pData + copied, bytes);
+
+      b.end += bytes;
+
+      copied += bytes;
+   }
+
+   queued += accepted;
+
+   return accepted;
+}
+
+void send_queue::consume(
+   size_t bytes)
+{
+   if (bytes > queued)
+   {
+      throw std::runtime_error("consumed more than is queued");
+   }
+
+   queued -= bytes;
+
+   while (bytes)
+   {
+      block &b = blocks.front();
+
+      const size_t used = std::min(bytes, b.end - b.begin);
+
+      b.begin += used;
+
+      bytes -= used;
+
+      if (b.begin == b.end)
+      {
+         if (blocks.size() == 1)
+         {
+            // the last block is kept, and starts again, so that small writes
+            // to a queue that keeps draining all share it
+
+            b.begin = 0;
+            b.end = 0;
+         }
+         else
+         {
+            release_front();
+         }
+      }
+   }
+}
+
+void send_queue::clear()
+{
+   while (!blocks.empty())
+   {
+      release_front();
+   }
+
+   queued = 0;
+}
+
+void send_queue::add_block()
+{
+   if (spare.empty())
+   {
+      blocks.push_back(block{ std::make_unique<uint8_t[]>(block_size), 0, 0 });
+
+      ++allocated;
+   }
+   else
+   {
+      blocks.push_back(block{ std::move(spare.back()), 0, 0 });
+
+      spare.pop_back();
+   }
+}
+
+void send_queue::release_front()
+{
+   if (spare.size() < max_spare_blocks)
+   {
+      spare.push_back(std::move(blocks.front().pData));
+   }
+   else
+   {
+      --allocated;
+   }
+
+   blocks.erase(blocks.begin());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: send_queue.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,173 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: send_queue.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// The data that a socket has accepted from its user but that the socket itself
+// couldn't take yet. It's a chain of fixed size blocks, so appending never
+// moves what is already queued, and the blocks can be handed to a single
+// vectored send in the order they were written. Blocks that have been sent are
+// kept for reuse, up to a limit, so a connection that keeps filling and
+// draining its queue doesn't keep allocating. The total queued is capped, a
+// limit of zero means that nothing is ever queued.
+//
+// Nothing here knows about sockets, so it runs and is tested anywhere.
+
+class send_queue
+{
+   public :
+
+      static constexpr size_t default_block_size = 4096;
+
+      static constexpr size_t max_spare_blocks = 4;
+
+      explicit send_queue(
+         size_t limit,
+         size_t block_size = default_block_size);
+
+      send_queue(const send_queue &) = delete;
+      send_queue(send_queue &&) = delete;
+
+      send_queue& operator=(const send_queue &) = delete;
+      send_queue& operator=(send_queue &&) = delete;
+
+      // Copies as much of the data as the limit allows onto the end of the
+      // queue and returns how much that was.
+
+      size_t append(
+         const uint8_t *pData,
+         size_t data_length);
+
+      // Calls visit(pData, length) for each run of queued data, oldest first,
+      // up to max_buffers of them. Returns the number of bytes visited.
+
+      template <typename visitor>
+      size_t gather(
+         const size_t max_buffers,
+         visitor &&visit) const
+      {
+         size_t bytes = 0;
+
+         size_t buffers = 0;
+
+         for (const block &b : blocks)
+         {
+            if (buffers == max_buffers)
+            {
+               break;
+            }
+
+            if (b.end != b.begin)
+            {
+               visit(b.pData.get() + b.begin, b.end - b.begin);
+
+               bytes += b.end - b.begin;
+
+               ++buffers;
+            }
+         }
+
+         return bytes;
+      }
+
+      // Removes bytes from the front of the queue, once they've been sent.
+
+      void consume(
+         size_t bytes);
+
+      void clear();
+
+      size_t size() const
+      {
+         return queued;
+      }
+
+      bool empty() const
+      {
+         return queued == 0;
+      }
+
+      size_t limit() const
+      {
+         return max_queued;
+      }
+
+      size_t space() const
+      {
+         return max_queued - queued;
+      }
+
+      size_t blocks_in_use() const
+      {
+         return blocks.size();
+      }
+
+      size_t blocks_allocated() const
+      {
+         return allocated;
+      }
+
+   private :
+
+      struct block
+      {
+         std::unique_ptr<uint8_t[]> pData;
+
+         size_t begin;
+
+         size_t end;
+      };
+
+      void add_block();
+
+      void release_front();
+
+      const size_t max_queued;
+
+      const size_t block_size;
+
+      size_t queued;
+
+      size_t allocated;
+
+      // a vector rather than a deque as an empty deque still allocates, and
+      // every connection has a send queue whether it queues or not; there
+      // are never more than limit / block_size blocks to shuffle along
+
+      std::vector<block> blocks;
+
+      std::vector<std::unique_ptr<uint8_t[]>> spare;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: send_queue.h
+///////////////////////////////////////////////////////////////////////////////
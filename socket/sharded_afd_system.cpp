@@ -0,0 +1,247 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: sharded_afd_system.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#include <WinSock2.h>
+
+#include "sharded_afd_system.h"
+#include "afd_events.h"
+
+#include "../shared/afd.h"
+
+sharded_afd_system::shard::shard(
+   sharded_afd_system &system,
+   const ULONG index,
+   const HANDLE hIOCP)
+   :  system(system),
+      index(index),
+      hAfd(CreateAfd(hIOCP, L"\\Device\\Afd\\shard")),
+      device(hAfd),
+      completions{ { *this, 0 } }
+{
+}
+
+sharded_afd_system::shard::~shard()
+{
+   CloseHandle(hAfd);
+}
+
+void sharded_afd_system::shard::handle_events(
+   const ULONG buffer)
+{
+   system.handle_events(index, buffer);
+}
+
+sharded_afd_system::sharded_afd_system(
+   const HANDLE hIOCP,
+   const ULONG max_shard_size)
+   :  hIOCP(hIOCP),
+      shard_set(
+         max_shard_size,
+         [this](const uint32_t index) { return create_shard(index); },
+         afd_poll_set::submission_mode::active_slots,
+         []() { return static_cast<uint64_t>(GetTickCount64()); })
+{
+}
+
+sharded_afd_system::~sharded_afd_system() = default;
+
+afd_shard_binding sharded_afd_system::create_shard(
+   const ULONG index)
+{
+   shard_list.push_back(std::make_unique<shard>(*this, index, hIOCP));
+
+   shard &created = *shard_list.back();
+
+   return afd_shard_binding{ created.get_device(), { created.get_context(0) } };
+}
+
+uint32_t sharded_afd_system::allocate_slot()
+{
+   const uint32_t slot = shard_set.allocate_slot();
+
+   std::lock_guard<std::mutex> lock(slot_events_lock);
+
+   if (slot >= slot_events.size())
+   {
+      slot_events.resize(slot + 1, nullptr);
+   }
+
+   return slot;
+}
+
+void sharded_afd_system::associate_socket(
+   const uint32_t slot,
+   const reactor_socket s,
+   reactor_events &events)
+{
+   shard_set.associate(slot, static_cast<uintptr_t>(GetBaseSocket(s)));
+
+   std::lock_guard<std::mutex> lock(slot_events_lock);
+
+   slot_events[slot] = &events;
+}
+
+void sharded_afd_system::disassociate_socket(
+   const uint32_t slot)
+{
+   {
+      std::lock_guard<std::mutex> lock(slot_events_lock);
+
+      slot_events[slot] = nullptr;
+   }
+
+   shard_set.disassociate(slot);
+}
+
+bool sharded_afd_system::poll(
+   const uint32_t slot,
+   const uint32_t events)
+{
+   return shard_set.poll(slot, events);
+}
+
+bool sharded_afd_system::set_timer(
+   const uint32_t slot,
+   const uint32_t timeout_ms)
+{
+   shard_set.set_timer(slot, timeout_ms);
+
+   return true;
+}
+
+void sharded_afd_system::cancel_timer(
+   const uint32_t slot)
+{
+   shard_set.cancel_timer(slot);
+}
+
+bool sharded_afd_system::after_dispatch(
+   const uint32_t slot)
+{
+   return shard_set.after_dispatch(slot);
+}
+
+ULONG sharded_afd_system::timer_wait_timeout() const
+{
+   const uint32_t timeout = shard_set.timer_wait_timeout();
+
+   return timeout == afd_poll_timers::infinite ? INFINITE : timeout;
+}
+
+ULONG sharded_afd_system::expire_timers()
+{
+   return shard_set.expire_timers([this](const uint32_t slot)
+   {
+      reactor_events *pEvents = events_for(slot);
+
+      if (pEvents)
+      {
+         pEvents->timer_expired();
+      }
+   },
+   [this](const uint32_t slot)
+   {
+      dispatch_complete(slot);
+   });
+}
+
+ULONG sharded_afd_system::shards() const
+{
+   return shard_set.shards();
+}
+
+ULONG sharded_afd_system::rebalance(
+   const ULONG max_moves)
+{
+   return shard_set.rebalance(max_moves);
+}
+
+afd_poll_set::statistics sharded_afd_system::stats() const
+{
+   return shard_set.stats();
+}
+
+void sharded_afd_system::handle_events(
+   const ULONG index,
+   const ULONG buffer)
+{
+   // the shard is locked whilst it dispatches, so completions for different
+   // shards can be handled on different threads at the same time
+
+   shard_set.dispatch(index, buffer, [this](const uint32_t slot, const uint32_t events, const int32_t status) -> uint32_t
+   {
+      reactor_events *pEvents = events_for(slot);
+
+      if (!pEvents)
+      {
+         return 0;
+      }
+
+      return pEvents->handle_events(events, RtlNtStatusToDosError(status));
+   },
+   [this](const uint32_t slot)
+   {
+      // the poll may have completed because it timed out
+
+      reactor_events *pEvents = events_for(slot);
+
+      if (pEvents)
+      {
+         pEvents->timer_expired();
+      }
+   },
+   [this](const uint32_t slot)
+   {
+      dispatch_complete(slot);
+   });
+}
+
+void sharded_afd_system::dispatch_complete(
+   const uint32_t slot)
+{
+   reactor_events *pEvents = events_for(slot);
+
+   if (pEvents)
+   {
+      pEvents->dispatch_complete();
+   }
+}
+
+reactor_events *sharded_afd_system::events_for(
+   const uint32_t slot) const
+{
+   std::lock_guard<std::mutex> lock(slot_events_lock);
+
+   return slot < slot_events.size() ? slot_events[slot] : nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: sharded_afd_system.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,185 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: sharded_afd_system.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#include <WinSock2.h>
+
+#include "shared/afd.h"
+
+#include "afd_system.h"
+#include "afd_shard_set.h"
+#include "afd_device.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+// An afd_system that spreads its sockets across several \Device\Afd handles,
+// each with no more than max_shard_size sockets, so that re-arming the poll for
+// one socket only resubmits the sockets that share its handle. All of the
+// handles are associated with the same IOCP, the completion key for a poll is
+// the shard that issued it.
+
+class sharded_afd_system : public afd_system
+{
+   public :
+
+      sharded_afd_system(
+         HANDLE hIOCP,
+         ULONG max_shard_size);
+
+      sharded_afd_system(const sharded_afd_system &) = delete;
+      sharded_afd_system(sharded_afd_system &&) = delete;
+
+      sharded_afd_system& operator=(const sharded_afd_system &) = delete;
+      sharded_afd_system& operator=(sharded_afd_system &&) = delete;
+
+      ~sharded_afd_system() override;
+
+      uint32_t allocate_slot() override;
+
+      void associate_socket(
+         uint32_t slot,
+         reactor_socket s,
+         reactor_events &events) override;
+
+      void disassociate_socket(
+         uint32_t slot) override;
+
+      bool poll(
+         uint32_t slot,
+         uint32_t events) override;
+
+      // Each socket's timer lives in its shard and is expired by the thread
+      // that handles that shard's completions, the shard's polls time out when
+      // its next timer is due.
+
+      bool set_timer(
+         uint32_t slot,
+         uint32_t timeout_ms) override;
+
+      void cancel_timer(
+         uint32_t slot) override;
+
+      // A socket that asks whilst its shard is being dispatched has
+      // dispatch_complete() called once the shard's events and timers have
+      // been, its polls are part of the shard's poll at the end of the pass.
+
+      bool after_dispatch(
+         uint32_t slot) override;
+
+      // If a shard has no sockets to poll then nothing wakes us for its timers,
+      // wait for completions for no longer than this and then expire them.
+
+      ULONG timer_wait_timeout() const;
+
+      ULONG expire_timers();
+
+      ULONG shards() const;
+
+      ULONG rebalance(
+         ULONG max_moves);
+
+      afd_poll_set::statistics stats() const;
+
+   private :
+
+      class shard
+      {
+         public :
+
+            shard(
+               sharded_afd_system &system,
+               ULONG index,
+               HANDLE hIOCP);
+
+            shard(const shard &) = delete;
+            shard(shard &&) = delete;
+
+            shard& operator=(const shard &) = delete;
+            shard& operator=(shard &&) = delete;
+
+            ~shard();
+
+            void handle_events(
+               ULONG buffer);
+
+            afd_device &get_device()
+            {
+               return device;
+            }
+
+            void *get_context(
+               ULONG buffer)
+            {
+               return static_cast<afd_system_events *>(&completions[buffer]);
+            }
+
+         private :
+
+            sharded_afd_system &system;
+
+            const ULONG index;
+
+            const HANDLE hAfd;
+
+            afd_device device;
+
+            afd_buffer_events<shard> completions[afd_poll_set::poll_buffers];
+      };
+
+      afd_shard_binding create_shard(
+         ULONG index);
+
+      void handle_events(
+         ULONG index,
+         ULONG buffer);
+
+      void dispatch_complete(
+         uint32_t slot);
+
+      reactor_events *events_for(
+         uint32_t slot) const;
+
+      const HANDLE hIOCP;
+
+      std::vector<std::unique_ptr<shard>> shard_list;
+
+      afd_shard_set shard_set;
+
+      mutable std::mutex slot_events_lock;
+
+      std::vector<reactor_events *> slot_events;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: sharded_afd_system.h
+///////////////////////////////////////////////////////////////////////////////
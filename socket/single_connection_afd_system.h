@@ -33,42 +33,18 @@
 
 #include "shared/afd.h"
 
-#include "afd_system.h"
+#include "afd_poll_driver.h"
 
-class afd_events;
+// An afd_poll_driver for sockets that are only used from one thread, so
+// nothing is locked.
 
-class single_connection_afd_system : public afd_system, afd_system_events
+class single_connection_afd_system : public afd_poll_driver
 {
    public :
 
       explicit single_connection_afd_system(
          HANDLE hAfd,
          int num_slots = 1);
-
-      void associate_socket(
-         ULONG slot,
-         SOCKET s,
-         afd_events &events) override;
-
-      void disassociate_socket(
-         ULONG slot) override;
-
-      bool poll(
-         ULONG slot,
-         ULONG events) override;
-
-      void handle_events() override;
-
-   private :
-
-      HANDLE hAfd;
-      const ULONG num_slots;
-      const ULONG poll_info_size;
-      AFD_POLL_INFO *pPollInfoIn;
-      AFD_POLL_INFO *pPollInfoOut;
-      IO_STATUS_BLOCK statusBlock;
-
-      afd_events **ppEvents;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
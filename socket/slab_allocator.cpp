@@ -0,0 +1,253 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: slab_allocator.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "slab_allocator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+
+// A free slot holds the address of the next free slot.
+
+static void *&next_slot(
+   void *p)
+{
+   return *static_cast<void **>(p);
+}
+
+slab_allocator::slab_allocator(
+   const size_t object_size,
+   const size_t object_alignment,
+   const size_t objects_per_slab)
+   :  alignment(std::max(object_alignment, cache_line_size)),
+      size(((std::max(object_size, sizeof(void *)) + alignment - 1) / alignment) * alignment),
+      objects_per_slab(objects_per_slab),
+      pFree(nullptr),
+      free_count(0)
+{
+   if (!objects_per_slab)
+   {
+      throw std::runtime_error("a slab must hold at least one object");
+   }
+
+   if (alignment & (alignment - 1))
+   {
+      throw std::runtime_error("alignment must be a power of two");
+   }
+}
+
+slab_allocator::~slab_allocator()
+{
+   for (void *pSlab : slab_memory)
+   {
+      ::operator delete(pSlab, std::align_val_t{ alignment });
+   }
+}
+
+void *slab_allocator::allocate()
+{
+   void *p = nullptr;
+
+   take(p, 1);
+
+   return p;
+}
+
+void slab_allocator::deallocate(
+   void *p)
+{
+   std::lock_guard<std::mutex> guard(lock);
+
+   next_slot(p) = pFree;
+
+   pFree = p;
+
+   ++free_count;
+}
+
+size_t slab_allocator::take(
+   void *&pList,
+   const size_t count)
+{
+   std::lock_guard<std::mutex> guard(lock);
+
+   if (!free_count)
+   {
+      add_slab();
+   }
+
+   const size_t moved = std::min(count, free_count);
+
+   for (size_t i = 0; i < moved; ++i)
+   {
+      void *p = pFree;
+
+      pFree = next_slot(p);
+
+      next_slot(p) = pList;
+
+      pList = p;
+   }
+
+   free_count -= moved;
+
+   return moved;
+}
+
+void slab_allocator::give(
+   void *&pList,
+   const size_t count)
+{
+   if (!count)
+   {
+      return;
+   }
+
+   // find the end of the run without holding the lock, then splice it on
+
+   void *pFirst = pList;
+
+   void *pLast = pFirst;
+
+   for (size_t i = 1; i < count; ++i)
+   {
+      pLast = next_slot(pLast);
+   }
+
+   pList = next_slot(pLast);
+
+   std::lock_guard<std::mutex> guard(lock);
+
+   next_slot(pLast) = pFree;
+
+   pFree = pFirst;
+
+   free_count += count;
+}
+
+size_t slab_allocator::slot_size() const
+{
+   return size;
+}
+
+size_t slab_allocator::slabs() const
+{
+   std::lock_guard<std::mutex> guard(lock);
+
+   return slab_memory.size();
+}
+
+size_t slab_allocator::capacity() const
+{
+   std::lock_guard<std::mutex> guard(lock);
+
+   return slab_memory.size() * objects_per_slab;
+}
+
+size_t slab_allocator::available() const
+{
+   std::lock_guard<std::mutex> guard(lock);
+
+   return free_count;
+}
+
+void slab_allocator::add_slab()
+{
+   uint8_t *pSlab = static_cast<uint8_t *>(::operator new(size * objects_per_slab, std::align_val_t{ alignment }));
+
+   slab_memory.push_back(pSlab);
+
+   // chained so that the slots are handed out in address order
+
+   for (size_t i = objects_per_slab; i > 0; --i)
+   {
+      void *p = pSlab + (i - 1) * size;
+
+      next_slot(p) = pFree;
+
+      pFree = p;
+   }
+
+   free_count += objects_per_slab;
+}
+
+slab_cache::slab_cache(
+   slab_allocator &allocator,
+   const size_t capacity)
+   :  allocator(allocator),
+      capacity(std::max<size_t>(capacity, 2)),
+      pFree(nullptr),
+      count(0)
+{
+}
+
+slab_cache::~slab_cache()
+{
+   allocator.give(pFree, count);
+}
+
+void *slab_cache::allocate()
+{
+   if (!count)
+   {
+      count = allocator.take(pFree, capacity / 2);
+   }
+
+   void *p = pFree;
+
+   pFree = next_slot(p);
+
+   --count;
+
+   return p;
+}
+
+void slab_cache::deallocate(
+   void *p)
+{
+   next_slot(p) = pFree;
+
+   pFree = p;
+
+   if (++count == capacity)
+   {
+      allocator.give(pFree, capacity / 2);
+
+      count -= capacity / 2;
+   }
+}
+
+size_t slab_cache::cached() const
+{
+   return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: slab_allocator.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,152 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: slab_allocator.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Fixed size slots carved out of large slabs, for objects that come and go
+// often enough for the general purpose allocator to show up in a profile,
+// such as connections. Each slot is a whole number of cache lines and starts
+// on a cache line, so objects that are in use by different threads never
+// share one. Free slots are kept on a free list, threaded through the slots
+// themselves, and slabs are only released when the allocator is destroyed.
+//
+// The allocator locks, so any thread can allocate and free. A slab_cache
+// keeps some free slots for the one thread that uses it and only takes the
+// lock to move a batch of them to or from the allocator.
+
+class slab_allocator
+{
+   public :
+
+      static constexpr size_t cache_line_size = 64;
+
+      slab_allocator(
+         size_t object_size,
+         size_t object_alignment,
+         size_t objects_per_slab);
+
+      slab_allocator(const slab_allocator &) = delete;
+      slab_allocator(slab_allocator &&) = delete;
+
+      slab_allocator& operator=(const slab_allocator &) = delete;
+      slab_allocator& operator=(slab_allocator &&) = delete;
+
+      // Every slot must have been freed.
+
+      ~slab_allocator();
+
+      void *allocate();
+
+      void deallocate(
+         void *p);
+
+      // Moves up to count free slots onto the front of the list, adding a slab
+      // if there are none, and returns how many were moved.
+
+      size_t take(
+         void *&pList,
+         size_t count);
+
+      // Takes back the first count slots of the list.
+
+      void give(
+         void *&pList,
+         size_t count);
+
+      size_t slot_size() const;
+
+      size_t slabs() const;
+
+      size_t capacity() const;
+
+      // free slots that aren't held by a cache
+
+      size_t available() const;
+
+   private :
+
+      void add_slab();
+
+      const size_t alignment;
+
+      const size_t size;
+
+      const size_t objects_per_slab;
+
+      mutable std::mutex lock;
+
+      void *pFree;
+
+      size_t free_count;
+
+      std::vector<void *> slab_memory;
+};
+
+class slab_cache
+{
+   public :
+
+      // Holds up to capacity free slots, it takes half that from the allocator
+      // when it's empty and gives back half when it's full.
+
+      slab_cache(
+         slab_allocator &allocator,
+         size_t capacity);
+
+      slab_cache(const slab_cache &) = delete;
+      slab_cache(slab_cache &&) = delete;
+
+      slab_cache& operator=(const slab_cache &) = delete;
+      slab_cache& operator=(slab_cache &&) = delete;
+
+      ~slab_cache();
+
+      void *allocate();
+
+      void deallocate(
+         void *p);
+
+      size_t cached() const;
+
+   private :
+
+      slab_allocator &allocator;
+
+      const size_t capacity;
+
+      void *pFree;
+
+      size_t count;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: slab_allocator.h
+///////////////////////////////////////////////////////////////////////////////
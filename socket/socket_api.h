@@ -0,0 +1,512 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: socket_api.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// The handful of socket calls that the sockets make, so that the same socket
+// code builds against WinSock and against BSD sockets. Failures are reported
+// the way the underlying API reports them, socket_error and an error code
+// from last_socket_error(), and the callers decide what is fatal.
+
+#ifdef _WIN32
+
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+#else
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#endif
+
+#include "reactor.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#ifdef _WIN32
+
+using socket_length = int;
+
+static constexpr reactor_socket invalid_socket = INVALID_SOCKET;
+
+inline SOCKET native_socket(
+   const reactor_socket s)
+{
+   return static_cast<SOCKET>(s);
+}
+
+#else
+
+using socket_length = socklen_t;
+
+static constexpr reactor_socket invalid_socket = ~reactor_socket{ 0 };
+
+inline int native_socket(
+   const reactor_socket s)
+{
+   return static_cast<int>(s);
+}
+
+#endif
+
+static constexpr int socket_error = -1;
+
+// One of the buffers passed to socket_send_buffers(), a WSABUF or an iovec.
+
+#ifdef _WIN32
+
+using socket_buffer = WSABUF;
+
+inline socket_buffer make_socket_buffer(
+   const uint8_t *pData,
+   const size_t length)
+{
+   return socket_buffer{ static_cast<ULONG>(length), reinterpret_cast<CHAR *>(const_cast<uint8_t *>(pData)) };
+}
+
+#else
+
+using socket_buffer = iovec;
+
+inline socket_buffer make_socket_buffer(
+   const uint8_t *pData,
+   const size_t length)
+{
+   return socket_buffer{ const_cast<uint8_t *>(pData), length };
+}
+
+#endif
+
+inline int last_socket_error()
+{
+#ifdef _WIN32
+   return WSAGetLastError();
+#else
+   return errno;
+#endif
+}
+
+inline bool is_would_block(
+   const int error)
+{
+#ifdef _WIN32
+   return error == WSAEWOULDBLOCK;
+#else
+   return error == EAGAIN || error == EWOULDBLOCK;
+#endif
+}
+
+// a non-blocking connect that hasn't completed yet
+
+inline bool is_connect_pending(
+   const int error)
+{
+#ifdef _WIN32
+   return error == WSAEWOULDBLOCK;
+#else
+   return error == EINPROGRESS;
+#endif
+}
+
+inline bool is_connection_reset(
+   const int error)
+{
+#ifdef _WIN32
+   return error == WSAECONNRESET ||
+          error == WSAECONNABORTED ||
+          error == WSAENETRESET;
+#else
+   return error == ECONNRESET ||
+          error == ECONNABORTED ||
+          error == ENETRESET ||
+          error == EPIPE;
+#endif
+}
+
+// what the non-throwing socket calls report for a socket that isn't
+// connected, because it never was or because the connection has gone
+
+#ifdef _WIN32
+static constexpr int socket_not_connected = WSAENOTCONN;
+#else
+static constexpr int socket_not_connected = ENOTCONN;
+#endif
+
+// what a connect that has a deadline reports when it passes
+
+#ifdef _WIN32
+static constexpr int socket_timed_out = WSAETIMEDOUT;
+#else
+static constexpr int socket_timed_out = ETIMEDOUT;
+#endif
+
+// An address of either family, held by value so that a list of them can be
+// kept whilst they're connected to.
+
+struct socket_address
+{
+   sockaddr_storage storage;
+
+   socket_length length;
+
+   const sockaddr &address() const
+   {
+      return reinterpret_cast<const sockaddr &>(storage);
+   }
+
+   int family() const
+   {
+      return storage.ss_family;
+   }
+};
+
+inline socket_address make_socket_address(
+   const sockaddr &address,
+   const socket_length address_length)
+{
+   socket_address result {};
+
+   const size_t length = std::min(static_cast<size_t>(address_length), sizeof result.storage);
+
+   memcpy(&result.storage, &address, length);
+
+   result.length = static_cast<socket_length>(length);
+
+   return result;
+}
+
+inline reactor_socket open_tcp_socket(
+   const int family = AF_INET)
+{
+   const auto s = ::socket(family, SOCK_STREAM, IPPROTO_TCP);
+
+#ifdef _WIN32
+   return s;
+#else
+   return s == -1 ? invalid_socket : static_cast<reactor_socket>(s);
+#endif
+}
+
+// One call on both platforms, rather than the two that fcntl() would take to
+// read the flags and write them back.
+
+inline bool set_non_blocking(
+   const reactor_socket s)
+{
+#ifdef _WIN32
+   unsigned long one = 1;
+
+   return 0 == ioctlsocket(native_socket(s), FIONBIO, &one);
+#else
+   int one = 1;
+
+   return 0 == ::ioctl(native_socket(s), FIONBIO, &one);
+#endif
+}
+
+// A socket that's known to be non-blocking already, such as those that a
+// listener accepts when it's been asked to, see socket_options.h, so that
+// whatever takes it on needn't make it so again.
+
+struct non_blocking_socket
+{
+   reactor_socket s;
+};
+
+inline int close_socket(
+   const reactor_socket s)
+{
+#ifdef _WIN32
+   return ::closesocket(native_socket(s));
+#else
+   return ::close(native_socket(s));
+#endif
+}
+
+inline int socket_connect(
+   const reactor_socket s,
+   const sockaddr &address,
+   const socket_length address_length)
+{
+   return ::connect(native_socket(s), &address, address_length);
+}
+
+inline int socket_bind(
+   const reactor_socket s,
+   const sockaddr &address,
+   const socket_length address_length)
+{
+   return ::bind(native_socket(s), &address, address_length);
+}
+
+inline int socket_listen(
+   const reactor_socket s,
+   const int backlog)
+{
+   return ::listen(native_socket(s), backlog);
+}
+
+// Lets listeners, each on a thread of its own, bind to the same address, so
+// that the kernel spreads the incoming connections across them. Every
+// listener must ask before it binds. Linux's SO_REUSEPORT does this, WinSock
+// has nothing like it, its SO_REUSEADDR lets a second socket take the address
+// over rather than share it, so this fails there.
+
+inline bool set_reuse_port(
+   const reactor_socket s)
+{
+#ifdef _WIN32
+   (void)s;
+
+   ::WSASetLastError(WSAEOPNOTSUPP);
+
+   return false;
+#else
+   const int one = 1;
+
+   return 0 == ::setsockopt(native_socket(s), SOL_SOCKET, SO_REUSEPORT, &one, sizeof one);
+#endif
+}
+
+inline int socket_local_address(
+   const reactor_socket s,
+   sockaddr &address,
+   socket_length &address_length)
+{
+   return ::getsockname(native_socket(s), &address, &address_length);
+}
+
+inline reactor_socket socket_accept(
+   const reactor_socket s,
+   sockaddr &address,
+   socket_length &address_length)
+{
+   const auto accepted = ::accept(native_socket(s), &address, &address_length);
+
+#ifdef _WIN32
+   return accepted;
+#else
+   return accepted == -1 ? invalid_socket : static_cast<reactor_socket>(accepted);
+#endif
+}
+
+// Closes the socket with a reset rather than a FIN, so that the peer knows at
+// once that the connection has gone, and it's left in no TIME_WAIT here.
+
+inline int abort_socket(
+   const reactor_socket s)
+{
+   linger abortive {};
+
+   abortive.l_onoff = 1;
+   abortive.l_linger = 0;
+
+   ::setsockopt(native_socket(s), SOL_SOCKET, SO_LINGER, reinterpret_cast<const char *>(&abortive), sizeof abortive);
+
+   return close_socket(s);
+}
+
+// The connections waiting in a listener's accept queue, and the most that the
+// queue holds, the backlog as the kernel applied it. Linux reports them through
+// TCP_INFO, WinSock doesn't report them at all, so this fails there.
+
+inline bool socket_accept_queue(
+   const reactor_socket s,
+   uint32_t &depth,
+   uint32_t &limit)
+{
+#ifdef __linux__
+   tcp_info info {};
+
+   socklen_t length = sizeof info;
+
+   if (0 != ::getsockopt(native_socket(s), IPPROTO_TCP, TCP_INFO, &info, &length))
+   {
+      return false;
+   }
+
+   // for a listener these are the accept queue's length and its limit
+
+   depth = info.tcpi_unacked;
+   limit = info.tcpi_sacked;
+
+   return true;
+#else
+   (void)s;
+   (void)depth;
+   (void)limit;
+
+#ifdef _WIN32
+   ::WSASetLastError(WSAEOPNOTSUPP);
+#else
+   errno = EOPNOTSUPP;
+#endif
+
+   return false;
+#endif
+}
+
+// Accepts a socket that's non-blocking, in one call where the platform can.
+// Linux's accept4() makes it so as it's accepted, a WinSock socket inherits it
+// from the listener, which is non-blocking, elsewhere it takes another call.
+
+inline reactor_socket socket_accept_non_blocking(
+   const reactor_socket s,
+   sockaddr &address,
+   socket_length &address_length)
+{
+#if defined(_WIN32)
+   return socket_accept(s, address, address_length);
+#elif defined(__linux__)
+   const int accepted = ::accept4(native_socket(s), &address, &address_length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+   return accepted == -1 ? invalid_socket : static_cast<reactor_socket>(accepted);
+#else
+   const reactor_socket accepted = socket_accept(s, address, address_length);
+
+   if (accepted != invalid_socket && !set_non_blocking(accepted))
+   {
+      const int error = last_socket_error();
+
+      close_socket(accepted);
+
+      errno = error;
+
+      return invalid_socket;
+   }
+
+   return accepted;
+#endif
+}
+
+// Writes never raise SIGPIPE, a write to a reset connection fails with an
+// error that is_connection_reset() recognises.
+
+inline int socket_send(
+   const reactor_socket s,
+   const uint8_t *pData,
+   const int data_length)
+{
+#ifdef _WIN32
+   return ::send(native_socket(s), reinterpret_cast<const char *>(pData), data_length, 0);
+#else
+   return static_cast<int>(::send(native_socket(s), pData, static_cast<size_t>(data_length), MSG_NOSIGNAL));
+#endif
+}
+
+// A gathering send, the buffers are sent in order with a single call. On Linux
+// this is sendmsg() rather than writev() so that it can't raise SIGPIPE either.
+
+inline int socket_send_buffers(
+   const reactor_socket s,
+   socket_buffer *pBuffers,
+   const uint32_t buffer_count)
+{
+#ifdef _WIN32
+   DWORD bytes = 0;
+
+   if (SOCKET_ERROR == ::WSASend(native_socket(s), pBuffers, buffer_count, &bytes, 0, nullptr, nullptr))
+   {
+      return socket_error;
+   }
+
+   return static_cast<int>(bytes);
+#else
+   msghdr message {};
+
+   message.msg_iov = pBuffers;
+   message.msg_iovlen = buffer_count;
+
+   return static_cast<int>(::sendmsg(native_socket(s), &message, MSG_NOSIGNAL));
+#endif
+}
+
+inline int socket_recv(
+   const reactor_socket s,
+   uint8_t *pBuffer,
+   const int buffer_length)
+{
+#ifdef _WIN32
+   return ::recv(native_socket(s), reinterpret_cast<char *>(pBuffer), buffer_length, 0);
+#else
+   return static_cast<int>(::recv(native_socket(s), pBuffer, static_cast<size_t>(buffer_length), 0));
+#endif
+}
+
+// A scattering receive, filling the buffers in order with a single call.
+
+inline int socket_recv_buffers(
+   const reactor_socket s,
+   socket_buffer *pBuffers,
+   const uint32_t buffer_count)
+{
+#ifdef _WIN32
+   DWORD bytes = 0;
+
+   DWORD flags = 0;
+
+   if (SOCKET_ERROR == ::WSARecv(native_socket(s), pBuffers, buffer_count, &bytes, &flags, nullptr, nullptr))
+   {
+      return socket_error;
+   }
+
+   return static_cast<int>(bytes);
+#else
+   msghdr message {};
+
+   message.msg_iov = pBuffers;
+   message.msg_iovlen = buffer_count;
+
+   return static_cast<int>(::recvmsg(native_socket(s), &message, 0));
+#endif
+}
+
+// how is 0 for receive, 1 for send and 2 for both on both platforms
+
+inline int socket_shutdown(
+   const reactor_socket s,
+   const int how)
+{
+   return ::shutdown(native_socket(s), how);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: socket_api.h
+///////////////////////////////////////////////////////////////////////////////
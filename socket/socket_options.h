@@ -0,0 +1,162 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: socket_options.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "socket_api.h"
+
+#include <cstdint>
+
+// The options that a listener gives the sockets that it accepts. Those that an
+// accepted socket inherits from its listener are set once, on the listener,
+// rather than on each socket, and non-blocking is set as the socket's
+// accepted, where the platform can, so that on Linux and Windows a socket with
+// the whole profile costs no more than the accept.
+
+struct socket_options
+{
+   bool non_blocking = false;
+   int receive_buffer = 0;          // SO_RCVBUF, 0 leaves the system's default
+   int send_buffer = 0;             // SO_SNDBUF, 0 leaves the system's default
+   bool no_delay = false;           // TCP_NODELAY
+   bool keep_alive = false;         // SO_KEEPALIVE
+};
+
+// The options that accepted sockets inherit from their listener; Linux copies
+// the buffer sizes, TCP_NODELAY and SO_KEEPALIVE from the listener when it
+// creates the socket, and WinSock gives an accepted socket all of the
+// listener's properties, elsewhere we don't rely on either. Non-blocking is
+// left to socket_accept_non_blocking().
+
+inline socket_options inherited_socket_options(
+   const socket_options &options)
+{
+#if defined(_WIN32) || defined(__linux__)
+   socket_options inherited = options;
+
+   inherited.non_blocking = false;
+
+   return inherited;
+#else
+   (void)options;
+
+   return socket_options{};
+#endif
+}
+
+// What's left to set on each accepted socket.
+
+inline socket_options uninherited_socket_options(
+   const socket_options &options)
+{
+#if defined(_WIN32) || defined(__linux__)
+   (void)options;
+
+   return socket_options{};
+#else
+   socket_options uninherited = options;
+
+   uninherited.non_blocking = false;
+
+   return uninherited;
+#endif
+}
+
+inline bool set_int_option(
+   const reactor_socket s,
+   const int level,
+   const int name,
+   const int value)
+{
+   return 0 == ::setsockopt(native_socket(s), level, name, reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+// Sets those of the options that ask for something, adding the calls that it
+// makes to calls. Returns false if one fails, the error is in
+// last_socket_error().
+
+inline bool set_socket_options(
+   const reactor_socket s,
+   const socket_options &options,
+   uint64_t &calls)
+{
+   if (options.non_blocking)
+   {
+      ++calls;
+
+      if (!set_non_blocking(s))
+      {
+         return false;
+      }
+   }
+
+   if (options.receive_buffer)
+   {
+      ++calls;
+
+      if (!set_int_option(s, SOL_SOCKET, SO_RCVBUF, options.receive_buffer))
+      {
+         return false;
+      }
+   }
+
+   if (options.send_buffer)
+   {
+      ++calls;
+
+      if (!set_int_option(s, SOL_SOCKET, SO_SNDBUF, options.send_buffer))
+      {
+         return false;
+      }
+   }
+
+   if (options.no_delay)
+   {
+      ++calls;
+
+      if (!set_int_option(s, IPPROTO_TCP, TCP_NODELAY, 1))
+      {
+         return false;
+      }
+   }
+
+   if (options.keep_alive)
+   {
+      ++calls;
+
+      if (!set_int_option(s, SOL_SOCKET, SO_KEEPALIVE, 1))
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: socket_options.h
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,160 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: socket_result.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdexcept>
+
+// What one of the non-throwing socket calls did: either a value, or the error
+// code that the call failed with, as last_socket_error() reported it. Along
+// the lines of std::expected, which isn't available to us until C++23. Asking
+// for the value of a result that failed throws, so code that doesn't look at
+// the error is no worse off than it would have been with the throwing calls.
+
+template <typename T>
+class socket_result
+{
+   public :
+
+      static socket_result success(
+         T value)
+      {
+         return socket_result(value, 0);
+      }
+
+      static socket_result failure(
+         const int error)
+      {
+         return socket_result(T{}, error);
+      }
+
+      bool has_value() const
+      {
+         return last_error == 0;
+      }
+
+      explicit operator bool() const
+      {
+         return has_value();
+      }
+
+      T value() const
+      {
+         if (!has_value())
+         {
+            throw std::runtime_error("socket call failed");
+         }
+
+         return result;
+      }
+
+      T operator*() const
+      {
+         return value();
+      }
+
+      T value_or(
+         T alternative) const
+      {
+         return has_value() ? result : alternative;
+      }
+
+      int error() const
+      {
+         return last_error;
+      }
+
+   private :
+
+      socket_result(
+         T value,
+         const int error)
+         :  result(value),
+            last_error(error)
+      {
+      }
+
+      T result;
+
+      int last_error;
+};
+
+// For the calls that have nothing to return but whether they worked.
+
+template <>
+class socket_result<void>
+{
+   public :
+
+      static socket_result success()
+      {
+         return socket_result(0);
+      }
+
+      static socket_result failure(
+         const int error)
+      {
+         return socket_result(error);
+      }
+
+      bool has_value() const
+      {
+         return last_error == 0;
+      }
+
+      explicit operator bool() const
+      {
+         return has_value();
+      }
+
+      void value() const
+      {
+         if (!has_value())
+         {
+            throw std::runtime_error("socket call failed");
+         }
+      }
+
+      int error() const
+      {
+         return last_error;
+      }
+
+   private :
+
+      explicit socket_result(
+         const int error)
+         :  last_error(error)
+      {
+      }
+
+      int last_error;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: socket_result.h
+///////////////////////////////////////////////////////////////////////////////
@@ -28,9 +28,23 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "afd_handle.h"
-#include "afd_events.h"
+#include "connect_race.h"
+#include "receive_ring.h"
+#include "send_queue.h"
+#include "socket_api.h"
+#include "socket_result.h"
 
-class tcp_socket;
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+template <typename handler>
+class basic_tcp_socket;
+
+class tcp_socket_callbacks;
+
+using tcp_socket = basic_tcp_socket<tcp_socket_callbacks>;
 
 class tcp_socket_callbacks
 {
@@ -41,7 +55,7 @@ class tcp_socket_callbacks
 
       virtual void on_connection_failed(
          tcp_socket &s,
-         DWORD error) = 0;
+         uint32_t error) = 0;
 
       virtual void on_readable(
          tcp_socket &s) = 0;
@@ -61,33 +75,202 @@ class tcp_socket_callbacks
       virtual void on_disconnected(
          tcp_socket &s) = 0;
 
+      // Only called for a socket that has send watermarks, so these aren't
+      // pure, handlers that don't use them needn't have them.
+
+      virtual void on_send_queue_high(
+         tcp_socket &s)
+      {
+         (void)s;
+      }
+
+      virtual void on_send_queue_drained(
+         tcp_socket &s)
+      {
+         (void)s;
+      }
+
    protected :
 
       virtual ~tcp_socket_callbacks() = default;
 };
 
-class tcp_socket : private afd_events
+// A non-blocking TCP socket whose readiness comes from a reactor. By default
+// write() sends what it can and returns how much that was, the caller keeps
+// the rest. With a send queue limit, write() queues whatever the socket won't
+// take, up to the limit, and the queue is flushed with one vectored send each
+// time the socket becomes writable; on_writable() is called once the queue
+// has drained. Data that is still queued when the socket is closed is lost.
+//
+// With a receive ring, receive() reads straight into the ring, as much as it
+// has space for, and the data can be parsed, or written, from readable_span()
+// without copying it anywhere else; consume() frees what's been dealt with.
+//
+// connect(), write(), read(), receive() and shutdown() throw when the socket
+// API fails with anything other than a reset. Each has a try_ variant that
+// doesn't throw, and returns the value or the socket's error code instead,
+// and socket_not_connected once the connection has gone. Either way, a reset
+// that a call runs into is reported to on_connection_reset() there and then,
+// and not again by the poll; the throwing calls then return 0. Calls that
+// are a mistake whatever the network does, connecting twice or receiving
+// without a ring, throw in both variants.
+//
+// Send watermarks give a socket with a send queue back-pressure. Once the
+// queue reaches the high watermark on_send_queue_high() is called, and once a
+// flush takes it down to the low watermark on_send_queue_drained() is. The
+// socket can also stop reading whilst the queue is high, it stops polling for
+// data and calling on_readable() until the queue drains, so that a peer that
+// sends faster than the other end of a proxy reads is held back by TCP
+// rather than by the memory of the proxy.
+//
+// A corked socket doesn't send what its handlers write whilst the reactor is
+// dispatching, it queues it, and sends everything queued with one vectored
+// send once the reactor has dispatched all that it was reporting, so many
+// small writes in a pass make one segment, without waiting for Nagle. It
+// needs a send queue, which has to be large enough for what's written in a
+// pass; writes beyond the limit are partial, as they are behind queued data.
+// Writes made outside of a pass, or with a reactor that doesn't support it,
+// are sent as they would be uncorked.
+//
+// connect() can also be given a list of addresses and a deadline, attempts are
+// raced, see connect_race.h, and the socket is connected with whichever
+// address accepts first, or on_connection_failed() is called with
+// socket_timed_out when the deadline passes. This needs a reactor with timers.
+//
+// Whilst there's data to read on_readable() is called again each time that it
+// reads something, without reading until the read would block, up to the read
+// budget; the socket then polls again so that the other sockets on the thread
+// get a turn before it's called again. Once the peer has closed the budget
+// doesn't apply, what's left is read before the close is reported.
+//
+// The socket calls its handler directly, tcp_socket is the socket for the
+// abstract tcp_socket_callbacks, and every callback is a virtual call. A
+// handler that isn't polymorphic has its callbacks inlined into
+// handle_events(); apart from on_readable(), and the connection callbacks if
+// it connects, it only needs the callbacks that it cares about, those that it
+// doesn't have aren't called, and if it has no on_readable_oob() the socket
+// doesn't poll for expedited data. The callbacks are passed a
+// basic_tcp_socket<handler> &.
+
+template <typename handler>
+class basic_tcp_socket : private reactor_events
 {
    public:
 
-      tcp_socket(
+      // Enough buffers to fill any socket send buffer with the default block
+      // size, without making the array too large to keep on the stack.
+
+      static constexpr uint32_t max_flush_buffers = 64;
+
+      // The most that one report of readability can deliver before the socket
+      // goes to the back of the queue, whichever limit is reached first.
+
+      struct read_budget
+      {
+         uint32_t callbacks;
+         size_t bytes;
+      };
+
+      static constexpr read_budget default_read_budget { 16, 256 * 1024 };
+
+      // Queued byte counts that the flow control callbacks are called at, the
+      // high watermark is at most the send queue limit.
+
+      struct send_watermarks
+      {
+         size_t high;
+         size_t low;
+         bool pause_reading;
+      };
+
+      basic_tcp_socket(
+         afd_handle afd,
+         handler &callbacks,
+         size_t send_queue_limit = 0,
+         size_t receive_ring_size = 0,
+         receive_ring::mapping ring_mapping = receive_ring::mapping::plain);
+
+      // Takes ownership of a socket that a listening socket has accepted, the
+      // socket is already connected, so on_connected() isn't called. If the
+      // constructor throws the socket is still the caller's.
+
+      basic_tcp_socket(
+         afd_handle afd,
+         reactor_socket accepted,
+         handler &callbacks,
+         size_t send_queue_limit = 0,
+         size_t receive_ring_size = 0,
+         receive_ring::mapping ring_mapping = receive_ring::mapping::plain);
+
+      // As above, for a socket that's already non-blocking, which saves a call.
+
+      basic_tcp_socket(
          afd_handle afd,
-         tcp_socket_callbacks &callbacks);
+         non_blocking_socket accepted,
+         handler &callbacks,
+         size_t send_queue_limit = 0,
+         size_t receive_ring_size = 0,
+         receive_ring::mapping ring_mapping = receive_ring::mapping::plain);
 
-      ~tcp_socket() override;
+      ~basic_tcp_socket() override;
 
       void connect(
          const sockaddr &address,
          int address_length);
 
+      void connect(
+         std::span<const socket_address> addresses,
+         uint32_t timeout_ms,
+         uint32_t stagger_ms = connect_race::default_stagger_ms);
+
       int write(
-         const BYTE *pData,
+         const uint8_t *pData,
          int data_length);
 
       int read(
-         BYTE *pBuffer,
+         uint8_t *pBuffer,
          int buffer_length);
 
+      size_t queued_bytes() const
+      {
+         return sends.size();
+      }
+
+      void set_read_budget(
+         const read_budget &budget);
+
+      void set_send_watermarks(
+         const send_watermarks &new_watermarks);
+
+      bool reading_paused() const
+      {
+         return reads_paused;
+      }
+
+      void set_cork(
+         bool cork);
+
+      bool is_corked() const
+      {
+         return corked;
+      }
+
+      // Reads into the receive ring, the return value is as for read(), with
+      // the exception that a full ring returns 0 without polling, consume some
+      // of the data and call it again.
+
+      int receive();
+
+      std::span<const uint8_t> readable_span() const;
+
+      void consume(
+         size_t bytes);
+
+      const receive_ring *get_receive_ring() const
+      {
+         return ring.get();
+      }
+
       void close();
 
       enum class shutdown_how
@@ -100,31 +283,1065 @@ class tcp_socket : private afd_events
       void shutdown(
          shutdown_how how);
 
+      socket_result<void> try_connect(
+         const sockaddr &address,
+         int address_length);
+
+      socket_result<void> try_connect(
+         std::span<const socket_address> addresses,
+         uint32_t timeout_ms,
+         uint32_t stagger_ms = connect_race::default_stagger_ms);
+
+      socket_result<int> try_write(
+         const uint8_t *pData,
+         int data_length);
+
+      socket_result<int> try_read(
+         uint8_t *pBuffer,
+         int buffer_length);
+
+      socket_result<int> try_receive();
+
+      socket_result<void> try_shutdown(
+         shutdown_how how);
+
    private :
 
-      ULONG handle_events(
-         ULONG eventsToHandle,
-         NTSTATUS status) override;
+      basic_tcp_socket(
+         afd_handle afd,
+         reactor_socket s,
+         bool connected,
+         bool non_blocking,
+         handler &callbacks,
+         size_t send_queue_limit,
+         size_t receive_ring_size,
+         receive_ring::mapping ring_mapping);
+
+      // tcp_socket_callbacks has every callback, whether or not the application
+      // cares about it, so tcp_socket polls as it always has
+
+      static constexpr bool polls_for_oob =
+         !std::is_abstract_v<handler> &&
+         requires (handler &h, basic_tcp_socket &s) { h.on_readable_oob(s); };
+
+      // what we poll for when waiting to be able to write
+
+      static constexpr uint32_t send_events =
+         reactor_event::send |
+         reactor_event::disconnect |         // client close
+         reactor_event::abort |              // closed
+         reactor_event::local_close;         // we have closed
+
+      // and when waiting to be able to read
+
+      static constexpr uint32_t receive_events =
+         reactor_event::receive |
+         (polls_for_oob ? reactor_event::receive_expedited : 0) |
+         reactor_event::disconnect |         // client close
+         reactor_event::abort |              // closed
+         reactor_event::local_close;         // we have closed
+
+      uint32_t handle_events(
+         uint32_t eventsToHandle,
+         int32_t status) override;
+
+      void dispatch_complete() override;
+
+      void timer_expired() override;
+
+      void adopt(
+         reactor_socket connected);
+
+      bool flush();
+
+      socket_result<int> read_complete(
+         int bytes);
+
+      int value_or_throw(
+         const socket_result<int> &result,
+         const char *pWhat);
+
+      void connection_reset();
+
+      void drain(
+         bool peer_closed);
+
+      void poll_for_send();
+
+      void check_high_watermark();
+
+      void check_low_watermark();
+
+      uint32_t interest() const;
 
       const afd_handle afd;
 
-      SOCKET s;
+      reactor_socket s;
+
+      uint32_t events;
+
+      handler &callbacks;
+
+      send_queue sends;
+
+      std::unique_ptr<receive_ring> ring;
+
+      std::unique_ptr<connect_race> race;
 
-      ULONG events;
+      read_budget budget;
 
-      tcp_socket_callbacks &callbacks;
+      uint64_t bytes_read;
+
+      send_watermarks watermarks;
+
+      bool above_high_watermark;
+
+      bool reads_paused;
+
+      bool corked;
+
+      bool cork_pending;                  // the reactor calls dispatch_complete()
 
       enum class state
       {
          created,
          pending_connect,
          connected,
+         reset,               // reported, the poll doesn't report it again
          disconnected
       };
 
       state connection_state;
 };
 
+template <typename handler>
+basic_tcp_socket<handler>::basic_tcp_socket(
+   afd_handle afd,
+   handler &callbacks,
+   const size_t send_queue_limit,
+   const size_t receive_ring_size,
+   const receive_ring::mapping ring_mapping)
+   :  basic_tcp_socket(afd, open_tcp_socket(), false, false, callbacks, send_queue_limit, receive_ring_size, ring_mapping)
+{
+}
+
+template <typename handler>
+basic_tcp_socket<handler>::basic_tcp_socket(
+   afd_handle afd,
+   const reactor_socket accepted,
+   handler &callbacks,
+   const size_t send_queue_limit,
+   const size_t receive_ring_size,
+   const receive_ring::mapping ring_mapping)
+   :  basic_tcp_socket(afd, accepted, true, false, callbacks, send_queue_limit, receive_ring_size, ring_mapping)
+{
+}
+
+template <typename handler>
+basic_tcp_socket<handler>::basic_tcp_socket(
+   afd_handle afd,
+   const non_blocking_socket accepted,
+   handler &callbacks,
+   const size_t send_queue_limit,
+   const size_t receive_ring_size,
+   const receive_ring::mapping ring_mapping)
+   :  basic_tcp_socket(afd, accepted.s, true, true, callbacks, send_queue_limit, receive_ring_size, ring_mapping)
+{
+}
+
+template <typename handler>
+basic_tcp_socket<handler>::basic_tcp_socket(
+   afd_handle afd,
+   const reactor_socket s,
+   const bool connected,
+   const bool non_blocking,
+   handler &callbacks,
+   const size_t send_queue_limit,
+   const size_t receive_ring_size,
+   const receive_ring::mapping ring_mapping)
+   :  afd(afd),
+      s(s),
+      events(0),
+      callbacks(callbacks),
+      sends(send_queue_limit),
+      ring(receive_ring_size ? std::make_unique<receive_ring>(receive_ring_size, ring_mapping) : nullptr),
+      budget(default_read_budget),
+      bytes_read(0),
+      watermarks{ 0, 0, false },
+      above_high_watermark(false),
+      reads_paused(false),
+      corked(false),
+      cork_pending(false),
+      connection_state(connected ? state::connected : state::created)
+{
+   // a handler that's passed the wrong type of socket would otherwise never
+   // be called at all
+
+   static_assert(requires { callbacks.on_readable(*this); },
+      "the handler must have on_readable() for this type of socket");
+
+   if (s == invalid_socket)
+   {
+      throw std::runtime_error("failed to create socket");
+   }
+
+   // a socket that we opened is closed if we fail to take it on, one that
+   // we were given stays with the caller
+
+   try
+   {
+      if (!non_blocking && !set_non_blocking(s))
+      {
+         throw std::runtime_error("failed to set socket non-blocking");
+      }
+
+      afd.associate_socket(s, *this);
+   }
+   catch (...)
+   {
+      if (!connected)
+      {
+         close_socket(s);
+      }
+
+      throw;
+   }
+}
+
+template <typename handler>
+basic_tcp_socket<handler>::~basic_tcp_socket()
+{
+   // attempts that are still running have slots of their own, and the race
+   // uses our timer
+
+   race.reset();
+
+   afd.disassociate_socket();
+
+   if (s != invalid_socket)
+   {
+      close_socket(s);
+
+      s = invalid_socket;
+   }
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::connect(
+   const sockaddr &address,
+   const int address_length)
+{
+   if (!try_connect(address, address_length))
+   {
+      throw std::runtime_error("failed to connect");
+   }
+}
+
+template <typename handler>
+socket_result<void> basic_tcp_socket<handler>::try_connect(
+   const sockaddr &address,
+   const int address_length)
+{
+   static_assert(requires { callbacks.on_connected(*this); callbacks.on_connection_failed(*this, 0u); },
+      "a socket that connects must be told whether it did");
+
+   if (connection_state != state::created)
+   {
+      throw std::runtime_error("already connected");
+   }
+
+   const int result = socket_connect(s, address, address_length);
+
+   if (result == socket_error)
+   {
+      const int lastError = last_socket_error();
+
+      if (!is_connect_pending(lastError))
+      {
+         return socket_result<void>::failure(lastError);
+      }
+   }
+
+   connection_state = state::pending_connect;
+
+   events = reactor_event::send |               // writable which also means "connected"
+            reactor_event::disconnect |         // client close
+            reactor_event::abort |              // closed
+            reactor_event::local_close |        // we have closed
+            reactor_event::connect_fail;        // outbound connection failed
+
+   afd.poll(events);
+
+   return socket_result<void>::success();
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::connect(
+   const std::span<const socket_address> addresses,
+   const uint32_t timeout_ms,
+   const uint32_t stagger_ms)
+{
+   if (!try_connect(addresses, timeout_ms, stagger_ms))
+   {
+      throw std::runtime_error("failed to connect");
+   }
+}
+
+template <typename handler>
+socket_result<void> basic_tcp_socket<handler>::try_connect(
+   const std::span<const socket_address> addresses,
+   const uint32_t timeout_ms,
+   const uint32_t stagger_ms)
+{
+   static_assert(requires { callbacks.on_connected(*this); callbacks.on_connection_failed(*this, 0u); },
+      "a socket that connects must be told whether it did");
+
+   if (connection_state != state::created)
+   {
+      throw std::runtime_error("already connected");
+   }
+
+   // the socket that we were created with isn't used, the race reports
+   // through handle_events() as its poll would have done
+
+   race = std::make_unique<connect_race>(afd, static_cast<reactor_events &>(*this), addresses, timeout_ms, stagger_ms);
+
+   const socket_result<void> result = race->start();
+
+   if (result)
+   {
+      connection_state = state::pending_connect;
+   }
+
+   return result;
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::timer_expired()
+{
+   if (race)
+   {
+      race->timer_expired();
+   }
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::adopt(
+   const reactor_socket connected)
+{
+   // the winner of a race replaces the socket that we were created with, in
+   // our slot
+
+   afd.closing_socket(false);
+
+   close_socket(s);
+
+   afd.disassociate_socket();
+
+   s = connected;
+
+   afd.associate_socket(s, *this);
+}
+
+template <typename handler>
+int basic_tcp_socket<handler>::write(
+   const uint8_t *pData,
+   const int data_length)
+{
+   return value_or_throw(try_write(pData, data_length), "failed to write");
+}
+
+template <typename handler>
+socket_result<int> basic_tcp_socket<handler>::try_write(
+   const uint8_t *pData,
+   const int data_length)
+{
+   if (connection_state != state::connected)
+   {
+      return socket_result<int>::failure(socket_not_connected);
+   }
+
+   if (corked && !cork_pending)
+   {
+      cork_pending = afd.after_dispatch();
+   }
+
+   // anything written whilst there's data queued goes behind it, the pending
+   // poll for writability, or the end of the reactor's pass, flushes it all
+
+   if (!sends.empty() || cork_pending)
+   {
+      const size_t queued = sends.append(pData, static_cast<size_t>(data_length));
+
+      check_high_watermark();
+
+      return socket_result<int>::success(static_cast<int>(queued));
+   }
+
+   int bytes = socket_send(s, pData, data_length);
+
+   if (bytes == socket_error)
+   {
+      const int lastError = last_socket_error();
+
+      if (!is_would_block(lastError))
+      {
+         if (is_connection_reset(lastError))
+         {
+            connection_reset();
+         }
+
+         return socket_result<int>::failure(lastError);
+      }
+
+      bytes = 0;
+   }
+
+   if (bytes != data_length)
+   {
+      // without a send queue nothing is queued and the caller keeps the rest
+
+      bytes += static_cast<int>(sends.append(pData + bytes, static_cast<size_t>(data_length - bytes)));
+
+      check_high_watermark();
+
+      poll_for_send();
+   }
+
+   return socket_result<int>::success(bytes);
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::poll_for_send()
+{
+   events |= send_events;
+
+   afd.poll(interest());
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::set_send_watermarks(
+   const send_watermarks &new_watermarks)
+{
+   if (!new_watermarks.high ||
+       new_watermarks.low >= new_watermarks.high ||
+       new_watermarks.high > sends.limit())
+   {
+      throw std::runtime_error("send watermarks must be low < high <= send queue limit");
+   }
+
+   watermarks = new_watermarks;
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::set_cork(
+   const bool cork)
+{
+   if (cork && !sends.limit())
+   {
+      throw std::runtime_error("a corked socket needs a send queue");
+   }
+
+   // anything already corked is still sent when the reactor's pass ends
+
+   corked = cork;
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::dispatch_complete()
+{
+   cork_pending = false;
+
+   // if we're already waiting to be able to send then what was written joins
+   // the queue that's flushed when we can
+
+   if (sends.empty() ||
+       (events & reactor_event::send) ||
+       connection_state != state::connected)
+   {
+      return;
+   }
+
+   const uint32_t polling = interest();
+
+   if (!flush() && connection_state == state::connected)
+   {
+      events |= send_events;
+   }
+
+   check_low_watermark();
+
+   // there's no return to the reactor to issue the poll
+
+   if (interest() != polling && s != invalid_socket)
+   {
+      afd.poll(interest());
+   }
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::check_high_watermark()
+{
+   if (!watermarks.high || above_high_watermark || sends.size() < watermarks.high)
+   {
+      return;
+   }
+
+   above_high_watermark = true;
+
+   if (watermarks.pause_reading)
+   {
+      // a read poll that's already pending may still report data, that's
+      // left where it is until we resume
+
+      reads_paused = true;
+   }
+
+   if constexpr (requires { callbacks.on_send_queue_high(*this); })
+   {
+      callbacks.on_send_queue_high(*this);
+   }
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::check_low_watermark()
+{
+   if (!above_high_watermark || sends.size() > watermarks.low)
+   {
+      return;
+   }
+
+   above_high_watermark = false;
+
+   if (reads_paused)
+   {
+      // whatever arrived whilst we weren't reading is still there, the poll is
+      // issued when we return
+
+      reads_paused = false;
+
+      events |= receive_events;
+   }
+
+   if constexpr (requires { callbacks.on_send_queue_drained(*this); })
+   {
+      callbacks.on_send_queue_drained(*this);
+   }
+}
+
+template <typename handler>
+uint32_t basic_tcp_socket<handler>::interest() const
+{
+   // whilst reads are paused we still want to hear about the connection
+   // closing
+
+   static constexpr uint32_t read_events = reactor_event::receive | reactor_event::receive_expedited;
+
+   return reads_paused ? (events & ~read_events) : events;
+}
+
+template <typename handler>
+bool basic_tcp_socket<handler>::flush()
+{
+   // as much of the queue as the socket will take, in as few calls as we can;
+   // a send that takes less than it was given means that the socket is full
+   // and there's no point trying again until it's writable
+
+   while (!sends.empty())
+   {
+      socket_buffer buffers[max_flush_buffers];
+
+      uint32_t count = 0;
+
+      const size_t gathered = sends.gather(max_flush_buffers, [&](const uint8_t *pData, const size_t length)
+      {
+         buffers[count++] = make_socket_buffer(pData, length);
+      });
+
+      const int bytes = socket_send_buffers(s, buffers, count);
+
+      if (bytes == socket_error)
+      {
+         const int lastError = last_socket_error();
+
+         if (is_connection_reset(lastError))
+         {
+            // there's nobody to send the rest to
+
+            connection_reset();
+
+            return false;
+         }
+
+         if (!is_would_block(lastError))
+         {
+            throw std::runtime_error("failed to write");
+         }
+
+         break;
+      }
+
+      sends.consume(static_cast<size_t>(bytes));
+
+      if (static_cast<size_t>(bytes) != gathered)
+      {
+         break;
+      }
+   }
+
+   return sends.empty();
+}
+
+template <typename handler>
+int basic_tcp_socket<handler>::read(
+   uint8_t *pBuffer,
+   const int buffer_length)
+{
+   return value_or_throw(try_read(pBuffer, buffer_length), "failed to read");
+}
+
+template <typename handler>
+socket_result<int> basic_tcp_socket<handler>::try_read(
+   uint8_t *pBuffer,
+   const int buffer_length)
+{
+   if (connection_state != state::connected)
+   {
+      return socket_result<int>::failure(socket_not_connected);
+   }
+
+   // try and read data into the buffer supplied
+   // if we read anything then return the amount
+   // if we read zero we have client closed
+   // if we block, poll for readability and return 0
+
+   // this breaks everything anybody expects about a socket read call returning 0 on client close...
+
+   return read_complete(socket_recv(s, pBuffer, buffer_length));
+}
+
+template <typename handler>
+int basic_tcp_socket<handler>::receive()
+{
+   return value_or_throw(try_receive(), "failed to read");
+}
+
+template <typename handler>
+socket_result<int> basic_tcp_socket<handler>::try_receive()
+{
+   if (!ring)
+   {
+      throw std::runtime_error("no receive ring");
+   }
+
+   if (connection_state != state::connected)
+   {
+      return socket_result<int>::failure(socket_not_connected);
+   }
+
+   std::span<uint8_t> spans[2];
+
+   const uint32_t count = ring->writable_spans(spans);
+
+   if (!count)
+   {
+      return socket_result<int>::success(0);
+   }
+
+   socket_buffer buffers[2];
+
+   for (uint32_t i = 0; i < count; ++i)
+   {
+      buffers[i] = make_socket_buffer(spans[i].data(), spans[i].size());
+   }
+
+   const socket_result<int> result = read_complete(socket_recv_buffers(s, buffers, count));
+
+   if (result)
+   {
+      ring->commit(static_cast<size_t>(*result));
+   }
+
+   return result;
+}
+
+template <typename handler>
+std::span<const uint8_t> basic_tcp_socket<handler>::readable_span() const
+{
+   if (!ring)
+   {
+      throw std::runtime_error("no receive ring");
+   }
+
+   return ring->readable_span();
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::consume(
+   const size_t bytes)
+{
+   if (!ring)
+   {
+      throw std::runtime_error("no receive ring");
+   }
+
+   ring->consume(bytes);
+}
+
+template <typename handler>
+socket_result<int> basic_tcp_socket<handler>::read_complete(
+   int bytes)
+{
+   if (bytes == 0)
+   {
+      //handle_events(reactor_event::disconnect, 0);
+   }
+
+   if (bytes == socket_error)
+   {
+      const int lastError = last_socket_error();
+
+      if (!is_would_block(lastError))
+      {
+         if (is_connection_reset(lastError))
+         {
+            connection_reset();
+         }
+
+         return socket_result<int>::failure(lastError);
+      }
+
+      bytes = 0;
+   }
+
+   if (bytes == 0)
+   {
+      events |= receive_events;
+
+      afd.poll(interest());
+   }
+
+   bytes_read += static_cast<uint64_t>(bytes);
+
+   return socket_result<int>::success(bytes);
+}
+
+template <typename handler>
+int basic_tcp_socket<handler>::value_or_throw(
+   const socket_result<int> &result,
+   const char *pWhat)
+{
+   if (result)
+   {
+      return *result;
+   }
+
+   if (result.error() == socket_not_connected)
+   {
+      throw std::runtime_error("not connected");
+   }
+
+   if (!is_connection_reset(result.error()))
+   {
+      throw std::runtime_error(pWhat);
+   }
+
+   // on_connection_reset() has been told
+
+   return 0;
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::connection_reset()
+{
+   // reported now, rather than by a poll when we next issue one, or by the one
+   // that's pending, which won't report it again
+
+   connection_state = state::reset;
+
+   sends.clear();
+
+   if constexpr (requires { callbacks.on_connection_reset(*this); })
+   {
+      callbacks.on_connection_reset(*this);
+   }
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::set_read_budget(
+   const read_budget &new_budget)
+{
+   if (!new_budget.callbacks || !new_budget.bytes)
+   {
+      throw std::runtime_error("read budget must allow a read");
+   }
+
+   budget = new_budget;
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::drain(
+   const bool peer_closed)
+{
+   // rather than the callback polling for more when it has read something,
+   // which would bring us straight back here through the reactor, we loop for
+   // as long as it keeps reading; a callback that doesn't read, or that reads
+   // until the read would block, and so polls, ends the loop
+
+   // once the peer has closed nothing more arrives, and the close is reported
+   // when we return, so what's left is read now rather than being dropped
+
+   const uint64_t start = bytes_read;
+
+   for (uint32_t i = 0; peer_closed || i < budget.callbacks; ++i)
+   {
+      const uint64_t before = bytes_read;
+
+      if constexpr (requires { callbacks.on_readable(*this); })
+      {
+         callbacks.on_readable(*this);
+      }
+
+      if (bytes_read == before ||
+          (events & reactor_event::receive) ||
+          connection_state != state::connected ||
+          s == invalid_socket)
+      {
+         return;
+      }
+
+      if (reads_paused)
+      {
+         // there may be more, it's reported again when we resume
+
+         afd.deferred(reactor_event::receive);
+
+         return;
+      }
+
+      if (!peer_closed && bytes_read - start >= budget.bytes)
+      {
+         break;
+      }
+   }
+
+   // there may well be more to read, but others have been waiting; the poll
+   // is issued when we return
+
+   events |= receive_events;
+
+   afd.deferred(reactor_event::receive);
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::close()
+{
+   // two options here, one is to always have a poll pending for close/reset events
+   // the second is to only report those if we have a read or write poll pending
+   // only polling when we need to is likely more efficient but makes the reporting
+   // of closure dependent on reading/writing - much as with normal sockets, this
+   // means that for long lived connections with little activity we would fail to
+   // see closure unless we have a read pending, but, chances are we would have a
+   // read pending...
+   // for now, allow polling only for read/write and deal with closure callbacks
+   // here if we don't have a poll pending...
+
+   // this may complicate matters as we now have callbacks occurring from calls to
+   // the socket api on the same thread, which we don't get from the polled
+   // situation
+
+   if (race)
+   {
+      race->cancel();
+   }
+
+   if (s != invalid_socket)
+   {
+      const bool triggerCallback = (events == 0);
+
+      // if there's a poll pending it reports the close
+
+      afd.closing_socket(!triggerCallback);
+
+      sends.clear();
+
+      if (socket_error == close_socket(s))
+      {
+         throw std::runtime_error("failed to close");
+      }
+
+      s = invalid_socket;
+
+      if (triggerCallback)
+      {
+         handle_events(reactor_event::local_close, 0);
+      }
+   }
+}
+
+template <typename handler>
+void basic_tcp_socket<handler>::shutdown(
+   const shutdown_how how)
+{
+   const socket_result<void> result = try_shutdown(how);
+
+   if (!result)
+   {
+      throw std::runtime_error(result.error() == socket_not_connected ? "not connected" : "failed to shutdown");
+   }
+}
+
+template <typename handler>
+socket_result<void> basic_tcp_socket<handler>::try_shutdown(
+   const shutdown_how how)
+{
+   if (connection_state != state::connected)
+   {
+      return socket_result<void>::failure(socket_not_connected);
+   }
+
+   // there are no callbacks for local operations, we assume the caller
+   // can track the fact that we've shutdown if it's interesting in remembering
+   // this detail...
+
+   if (socket_error == socket_shutdown(s, static_cast<int>(how)))
+   {
+      return socket_result<void>::failure(last_socket_error());
+   }
+
+   return socket_result<void>::success();
+}
+
+template <typename handler>
+uint32_t basic_tcp_socket<handler>::handle_events(
+   const uint32_t eventsToHandle,
+   const int32_t status)
+{
+   // need to know what state we're in as we would do one thing for connect and other things when
+   // connected?
+
+   events = 0;
+
+   if (connection_state == state::pending_connect)
+   {
+      if (reactor_event::connect_fail & eventsToHandle)
+      {
+         connection_state = state::disconnected;
+
+         if constexpr (requires { callbacks.on_connection_failed(*this, 0u); })
+         {
+            callbacks.on_connection_failed(*this, static_cast<uint32_t>(status));
+         }
+      }
+      else if (reactor_event::send & eventsToHandle)
+      {
+         if (race)
+         {
+            adopt(race->take_winner());
+         }
+
+         connection_state = state::connected;
+
+         if constexpr (requires { callbacks.on_connected(*this); })
+         {
+            callbacks.on_connected(*this);
+         }
+      }
+   }
+   else if (reactor_event::send & eventsToHandle)
+   {
+      const bool flushed = flush();
+
+      check_low_watermark();
+
+      if (flushed)
+      {
+         if constexpr (requires { callbacks.on_writable(*this); })
+         {
+            callbacks.on_writable(*this);
+         }
+      }
+      else if (connection_state == state::connected)
+      {
+         // the poll is issued when we return
+
+         events |= send_events;
+      }
+   }
+   else if (!sends.empty())
+   {
+      // something else has been reported, we're still waiting to be able to
+      // send what's queued
+
+      events |= send_events;
+   }
+
+   // a reset that the flush ran into has been reported, there's nothing to
+   // read from a connection that's gone, and a read would throw
+
+   if ((reactor_event::receive & eventsToHandle) && connection_state == state::connected)
+   {
+      if (reads_paused)
+      {
+         afd.deferred(reactor_event::receive);
+      }
+      else
+      {
+         drain((eventsToHandle & (reactor_event::disconnect | reactor_event::abort)) != 0);
+      }
+   }
+
+   if ((reactor_event::receive_expedited & eventsToHandle) && connection_state == state::connected)
+   {
+      if constexpr (requires { callbacks.on_readable_oob(*this); })
+      {
+         callbacks.on_readable_oob(*this);
+      }
+   }
+
+   // a reset that a read or write ran into has already been reported, perhaps
+   // by the on_readable() call above, as has a close that an earlier poll
+   // reported
+
+   const bool reported = (connection_state == state::reset || connection_state == state::disconnected);
+
+   if ((reactor_event::abort & eventsToHandle) && !reported)
+   {
+      connection_state = state::disconnected;
+
+      if constexpr (requires { callbacks.on_connection_reset(*this); })
+      {
+         callbacks.on_connection_reset(*this);
+      }
+   }
+
+   if ((reactor_event::disconnect & eventsToHandle) && !reported)
+   {
+      connection_state = state::disconnected;
+
+      if constexpr (requires { callbacks.on_client_close(*this); })
+      {
+         callbacks.on_client_close(*this);
+      }
+   }
+
+   if (reactor_event::local_close & eventsToHandle)
+   {
+      connection_state = state::disconnected;
+
+      if constexpr (requires { callbacks.on_disconnected(*this); })
+      {
+         callbacks.on_disconnected(*this);
+      }
+   }
+
+   return interest();
+}
+
+// tcp_socket is built once, in tcp_socket.cpp
+
+extern template class basic_tcp_socket<tcp_socket_callbacks>;
+
 ///////////////////////////////////////////////////////////////////////////////
 // End of file: tcp_socket.h
 ///////////////////////////////////////////////////////////////////////////////
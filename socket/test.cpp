@@ -38,6 +38,7 @@
 
 #include "tcp_socket.h"
 #include "single_connection_afd_system.h"
+#include "sharded_afd_system.h"
 
 #pragma comment(lib, "ntdll.lib")
 
@@ -54,7 +55,7 @@ class mock_tcp_socket_callbacks : public tcp_socket_callbacks
    public :
 
    MOCK_METHOD(void, on_connected, (tcp_socket &), (override));
-   MOCK_METHOD(void, on_connection_failed, (tcp_socket &, DWORD), (override));
+   MOCK_METHOD(void, on_connection_failed, (tcp_socket &, uint32_t), (override));
    MOCK_METHOD(void, on_readable, (tcp_socket &), (override));
    MOCK_METHOD(void, on_readable_oob, (tcp_socket &), (override));
    MOCK_METHOD(void, on_writable, (tcp_socket &), (override));
@@ -861,15 +862,17 @@ TEST(AFDSocket, TestConnectAndRemoteResetWithNoPollPendingDetectsOnNextRead)
 
    int buffer_length = sizeof buffer;
 
+   // the read reports the reset, there's nothing left for a poll to report
+
+   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+
    int available = socket.read(buffer, buffer_length);
 
    EXPECT_EQ(available, 0);
 
-   pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO);
-
-   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+   pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO, WAIT_TIMEOUT);
 
-   pAfd->handle_events();
+   EXPECT_EQ(pAfd, nullptr);
 }
 
 TEST(AFDSocket, TestConnectAndRemoteResetWithNoPollPendingDetectsOnNextWrite)
@@ -910,16 +913,18 @@ TEST(AFDSocket, TestConnectAndRemoteResetWithNoPollPendingDetectsOnNextWrite)
 
    static const BYTE data[] = { 1, 2, 3, 4 };
 
+   // the write reports the reset, and doesn't poll to be told when it can
+   // write the rest
+
+   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+
    const int sent = socket.write(data, sizeof data);
 
    EXPECT_EQ(sent, 0);
 
-   pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO);
-
-   EXPECT_CALL(callbacks, on_writable(::testing::_)).Times(1);
-   EXPECT_CALL(callbacks, on_connection_reset(::testing::_)).Times(1);
+   pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO, WAIT_TIMEOUT);
 
-   pAfd->handle_events();
+   EXPECT_EQ(pAfd, nullptr);
 }
 
 TEST(AFDSocket, TestConnectAndRemoteShutdownSendNoPollPending)
@@ -1193,7 +1198,10 @@ TEST(AFDSocket, TestConnectNoContiguousHandleArray)
 
    const auto handles = CreateAfdAndIOCP();
 
-   single_connection_afd_system afd(handles.afd);
+   single_connection_afd_system afd(handles.afd, 2);
+
+   // only slot 1 is used, every slot up to it is submitted, so slot 0 is a gap
+   // in the handle array, with no handle
 
    afd_handle handle(afd, 1);
 
@@ -1207,16 +1215,33 @@ TEST(AFDSocket, TestConnectNoContiguousHandleArray)
    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
    address.sin_port = htons(listeningSocket.port);
 
+   // AFD rejects a poll with a gap in its handle array
+
    EXPECT_THROW(socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address)), std::exception);
 }
 
+TEST(AFDSocket, TestSlotOutsideOfTheSystem)
+{
+   const auto handles = CreateAfdAndIOCP();
+
+   single_connection_afd_system afd(handles.afd);
+
+   afd_handle handle(afd, 1);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   // slot 1 is outside of the single slot that we have
+
+   EXPECT_THROW(tcp_socket socket(handle, callbacks), std::exception);
+}
+
 TEST(AFDSocket, TestConnectMultipleSocketsOnSingleAfdObject)
 {
    const auto listeningSocket = CreateListeningSocket();
 
    const auto handles = CreateAfdAndIOCP();
 
-   single_connection_afd_system afd(handles.afd);
+   single_connection_afd_system afd(handles.afd, 2);
 
    mock_tcp_socket_callbacks callbacks;
 
@@ -1242,17 +1267,372 @@ TEST(AFDSocket, TestConnectMultipleSocketsOnSingleAfdObject)
 
    pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO);
 
-   GTEST_SKIP();
-   // This fails until we adjust the afd_object to correctly map input handles to the output structure
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   pAfd->handle_events();
+}
+
+TEST(AFDSocket, TestConnectMultipleSocketsWithAllocatedSlots)
+{
+   const auto listeningSocket = CreateListeningSocket();
+
+   const auto handles = CreateAfdAndIOCP();
+
+   single_connection_afd_system afd(handles.afd);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   const afd_handle handle1(afd);
+
+   const afd_handle handle2(afd);
+
+   EXPECT_NE(handle1.slot, handle2.slot);
+
+   tcp_socket socket1(handle1, callbacks);
+
+   tcp_socket socket2(handle2, callbacks);
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   address.sin_port = htons(listeningSocket.port);
+
+   socket1.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   auto *pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO);
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   pAfd->handle_events();
+
+   socket2.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO);
 
    EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
 
    pAfd->handle_events();
 }
 
-// multiple sockets on a single afd object
 // multiple afd objects on a single iocp
 
+TEST(AFDSocket, TestConnectMultipleSocketsOnShardedAfdSystem)
+{
+   const auto listeningSocket = CreateListeningSocket();
+
+   const HANDLE iocp = CreateIOCP();
+
+   {
+      sharded_afd_system afd(iocp, 1);
+
+      mock_tcp_socket_callbacks callbacks;
+
+      const afd_handle handle1(afd);
+
+      const afd_handle handle2(afd);
+
+      EXPECT_EQ(2, afd.shards());
+
+      tcp_socket socket1(handle1, callbacks);
+
+      tcp_socket socket2(handle2, callbacks);
+
+      sockaddr_in address {};
+
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      address.sin_port = htons(listeningSocket.port);
+
+      socket1.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+      socket2.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+      // each shard has its own poll pending, so we get a completion for each
+
+      auto *pAfd1 = GetCompletionAs<afd_system_events>(iocp, SHORT_TIME_NON_ZERO);
+
+      auto *pAfd2 = GetCompletionAs<afd_system_events>(iocp, SHORT_TIME_NON_ZERO);
+
+      EXPECT_NE(pAfd1, pAfd2);
+
+      EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(2);
+
+      pAfd1->handle_events();
+
+      pAfd2->handle_events();
+   }
+
+   CloseHandle(iocp);
+}
+
+TEST(AFDSocket, TestCorkedWritesAreSentWhenTheSystemHasDispatched)
+{
+   const auto listeningSocket = CreateListeningSocket();
+
+   const auto handles = CreateAfdAndIOCP();
+
+   single_connection_afd_system afd(handles.afd);
+
+   afd_handle handle(afd, 0);
+
+   mock_tcp_socket_callbacks callbacks;
+
+   tcp_socket socket(handle, callbacks, 64 * 1024);
+
+   socket.set_cork(true);
+
+   sockaddr_in address {};
+
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   address.sin_port = htons(listeningSocket.port);
+
+   socket.connect(reinterpret_cast<const sockaddr &>(address), sizeof(address));
+
+   auto *pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO);
+
+   EXPECT_CALL(callbacks, on_connected(::testing::_)).Times(1);
+
+   pAfd->handle_events();
+
+   BYTE buffer[100];
+
+   EXPECT_EQ(0, socket.read(buffer, sizeof buffer));
+
+   const SOCKET s = listeningSocket.Accept();
+
+   Write(s, "test");
+
+   // the replies are queued whilst the system is dispatching
+
+   size_t queued = 0;
+
+   EXPECT_CALL(callbacks, on_readable(::testing::_)).WillRepeatedly([&](tcp_socket &reading)
+   {
+      if (reading.read(buffer, sizeof buffer) > 0)
+      {
+         for (const char *pReply : { "one", "two", "three" })
+         {
+            EXPECT_EQ(static_cast<int>(strlen(pReply)), reading.write(reinterpret_cast<const uint8_t *>(pReply), static_cast<int>(strlen(pReply))));
+         }
+
+         queued = reading.queued_bytes();
+      }
+   });
+
+   pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO);
+
+   pAfd->handle_events();
+
+   EXPECT_EQ(11u, queued);
+
+   // and sent with one send once it has, so they arrive together
+
+   EXPECT_EQ(0u, socket.queued_bytes());
+
+   char received[100];
+
+   const int bytes = recv(s, received, sizeof received, 0);
+
+   EXPECT_EQ("onetwothree", std::string(received, bytes > 0 ? bytes : 0));
+
+   // outside of a pass a write is sent there and then
+
+   EXPECT_EQ(4, socket.write(reinterpret_cast<const uint8_t *>("four"), 4));
+
+   EXPECT_EQ(0u, socket.queued_bytes());
+
+   closesocket(s);
+}
+
+class counting_timer_events : public reactor_events
+{
+   public :
+
+      uint32_t handle_events(
+         uint32_t,
+         int32_t) override
+      {
+         return 0;
+      }
+
+      void timer_expired() override
+      {
+         ++expired;
+      }
+
+      int expired = 0;
+};
+
+TEST(AFDSocket, TestTimerExpiresWhenThePollTimesOut)
+{
+   const auto listeningSocket = CreateListeningSocket();
+
+   const auto handles = CreateAfdAndIOCP();
+
+   single_connection_afd_system afd(handles.afd);
+
+   counting_timer_events events;
+
+   const SOCKET s = CreateNonBlockingTCPSocket();
+
+   ConnectNonBlocking(s, listeningSocket.port);
+
+   const uint32_t slot = afd.allocate_slot();
+
+   afd.associate_socket(slot, s, events);
+
+   // the timer is set first so that the poll is issued with its timeout, and
+   // as nothing arrives only the timeout completes the poll
+
+   EXPECT_TRUE(afd.set_timer(slot, 100));
+
+   const ULONGLONG start = GetTickCount64();
+
+   afd.poll(slot, AFD_POLL_RECEIVE);
+
+   auto *pAfd = GetCompletionAs<afd_system_events>(handles.iocp, 1000);
+
+   ASSERT_NE(nullptr, pAfd);
+
+   pAfd->handle_events();
+
+   EXPECT_EQ(1, events.expired);
+
+   // the tick count only moves every 10 to 16ms
+
+   EXPECT_GE(GetTickCount64() - start, 80u);
+
+   // and the poll is issued again without a timeout
+
+   pAfd = GetCompletionAs<afd_system_events>(handles.iocp, 200, WAIT_TIMEOUT);
+
+   EXPECT_EQ(nullptr, pAfd);
+
+   afd.disassociate_socket(slot);
+
+   closesocket(s);
+}
+
+TEST(AFDSocket, TestTimerExpiresWhenTheShardsPollTimesOut)
+{
+   const auto listeningSocket = CreateListeningSocket();
+
+   const HANDLE iocp = CreateIOCP();
+
+   {
+      sharded_afd_system afd(iocp, 1);
+
+      counting_timer_events events;
+
+      const SOCKET s = CreateNonBlockingTCPSocket();
+
+      ConnectNonBlocking(s, listeningSocket.port);
+
+      const uint32_t slot = afd.allocate_slot();
+
+      afd.associate_socket(slot, s, events);
+
+      EXPECT_TRUE(afd.set_timer(slot, 100));
+
+      const ULONGLONG start = GetTickCount64();
+
+      afd.poll(slot, AFD_POLL_RECEIVE);
+
+      auto *pAfd = GetCompletionAs<afd_system_events>(iocp, 1000);
+
+      ASSERT_NE(nullptr, pAfd);
+
+      pAfd->handle_events();
+
+      EXPECT_EQ(1, events.expired);
+
+      EXPECT_GE(GetTickCount64() - start, 80u);
+
+      afd.disassociate_socket(slot);
+
+      closesocket(s);
+   }
+
+   CloseHandle(iocp);
+}
+
+class recording_events : public reactor_events
+{
+   public :
+
+      uint32_t handle_events(
+         const uint32_t events,
+         int32_t) override
+      {
+         reported.push_back(events);
+
+         return 0;
+      }
+
+      std::vector<uint32_t> reported;
+};
+
+TEST(AFDSocket, TestAddingInterestCancelsThePendingPoll)
+{
+   const auto listeningSocket = CreateListeningSocket();
+
+   const auto handles = CreateAfdAndIOCP();
+
+   single_connection_afd_system afd(handles.afd);
+
+   recording_events events;
+
+   const SOCKET s = CreateNonBlockingTCPSocket();
+
+   ConnectNonBlocking(s, listeningSocket.port);
+
+   const uint32_t slot = afd.allocate_slot();
+
+   afd.associate_socket(slot, s, events);
+
+   // nothing arrives, so the poll stays pending
+
+   EXPECT_FALSE(afd.poll(slot, AFD_POLL_RECEIVE));
+
+   EXPECT_EQ(nullptr, GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO, WAIT_TIMEOUT));
+
+   // AFD doesn't complete a second poll for the socket whilst that one is
+   // pending, so rather than issue one that one is cancelled...
+
+   EXPECT_FALSE(afd.poll(slot, AFD_POLL_RECEIVE | AFD_POLL_SEND));
+
+   auto *pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO, ERROR_OPERATION_ABORTED);
+
+   ASSERT_NE(nullptr, pAfd);
+
+   // and once it has completed, and released its buffer, the new interest is
+   // submitted
+
+   pAfd->handle_events();
+
+   EXPECT_TRUE(events.reported.empty());
+
+   pAfd = GetCompletionAs<afd_system_events>(handles.iocp, SHORT_TIME_NON_ZERO);
+
+   ASSERT_NE(nullptr, pAfd);
+
+   pAfd->handle_events();
+
+   ASSERT_EQ(1u, events.reported.size());
+
+   EXPECT_EQ(static_cast<uint32_t>(AFD_POLL_SEND), events.reported[0]);
+
+   const afd_poll_set::statistics stats = afd.stats();
+
+   EXPECT_EQ(2u, stats.submissions);
+   EXPECT_EQ(1u, stats.cancelled);
+
+   afd.disassociate_socket(slot);
+
+   closesocket(s);
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 // End of file: test.cpp
@@ -0,0 +1,463 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: timer_wheel.cpp
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "timer_wheel.h"
+
+#include <bit>
+#include <stdexcept>
+
+timer_wheel::timer_wheel(
+   const uint64_t now,
+   const uint32_t initial_timers)
+   :  free_list(no_index),
+      occupied{},
+      current(now),
+      time(now),
+      count(0)
+{
+   for (auto &bucket : lists)
+   {
+      bucket = list{ no_index, no_index };
+   }
+
+   timers.reserve(initial_timers);
+}
+
+uint32_t timer_wheel::shift(
+   const uint32_t level)
+{
+   return level ? level_0_bits + ((level - 1) * level_bits) : 0;
+}
+
+uint32_t timer_wheel::first_list(
+   const uint32_t level)
+{
+   return level ? level_0_buckets + ((level - 1) * level_buckets) : 0;
+}
+
+timer_wheel::timer_id timer_wheel::make_id(
+   const uint32_t index) const
+{
+   return (static_cast<timer_id>(timers[index].generation) << 32) | index;
+}
+
+uint32_t timer_wheel::index_of(
+   const timer_id id) const
+{
+   const uint32_t index = static_cast<uint32_t>(id);
+
+   if (index >= timers.size())
+   {
+      return no_index;
+   }
+
+   const timer &entry = timers[index];
+
+   if (entry.list == no_index || entry.generation != static_cast<uint32_t>(id >> 32))
+   {
+      return no_index;
+   }
+
+   return index;
+}
+
+uint32_t timer_wheel::allocate()
+{
+   if (free_list != no_index)
+   {
+      const uint32_t index = free_list;
+
+      free_list = timers[index].next;
+
+      return index;
+   }
+
+   if (timers.size() == no_index)
+   {
+      throw std::runtime_error("too many timers");
+   }
+
+   timers.push_back(timer{ 0, 0, no_index, no_index, no_index, 1 });
+
+   return static_cast<uint32_t>(timers.size() - 1);
+}
+
+void timer_wheel::release(
+   const uint32_t index)
+{
+   timer &entry = timers[index];
+
+   // a new generation so that the old id no longer matches, zero is never
+   // used so that no_timer is never a valid id
+
+   if (++entry.generation == 0)
+   {
+      entry.generation = 1;
+   }
+
+   entry.list = no_index;
+
+   entry.next = free_list;
+
+   free_list = index;
+
+   --count;
+}
+
+timer_wheel::timer_id timer_wheel::arm(
+   const uint64_t deadline,
+   const uintptr_t context)
+{
+   const uint32_t index = allocate();
+
+   timer &entry = timers[index];
+
+   entry.deadline = deadline;
+   entry.context = context;
+
+   ++count;
+
+   place(index);
+
+   return make_id(index);
+}
+
+bool timer_wheel::cancel(
+   const timer_id id)
+{
+   const uint32_t index = index_of(id);
+
+   if (index == no_index)
+   {
+      return false;
+   }
+
+   unlink(index);
+
+   release(index);
+
+   return true;
+}
+
+bool timer_wheel::armed(
+   const timer_id id) const
+{
+   return index_of(id) != no_index;
+}
+
+void timer_wheel::place(
+   const uint32_t index)
+{
+   // the level is chosen by how far away the deadline is, the bucket by the
+   // deadline itself, so that a bucket is cascaded just as its timers are
+   // about to be due
+
+   uint64_t deadline = timers[index].deadline;
+
+   if (deadline < current)
+   {
+      // the time has already been processed, so it expires on the next call
+      // to advance(), or in this one if we're expiring
+
+      link(index, expiring_list);
+
+      return;
+   }
+
+   const uint64_t delta = deadline - current;
+
+   if (delta > max_delta)
+   {
+      deadline = current + max_delta;
+   }
+
+   if (delta < level_0_buckets)
+   {
+      link(index, static_cast<uint32_t>(deadline & (level_0_buckets - 1)));
+
+      return;
+   }
+
+   uint32_t level = 1;
+
+   while (level < levels - 1 && delta >= (uint64_t{ 1 } << shift(level + 1)))
+   {
+      ++level;
+   }
+
+   link(index, first_list(level) + static_cast<uint32_t>((deadline >> shift(level)) & (level_buckets - 1)));
+}
+
+void timer_wheel::link(
+   const uint32_t index,
+   const uint32_t list_index)
+{
+   timer &entry = timers[index];
+
+   list &bucket = lists[list_index];
+
+   // appended, so that timers with the same deadline expire in the order that
+   // they were armed
+
+   entry.list = list_index;
+   entry.next = no_index;
+   entry.prev = bucket.tail;
+
+   if (bucket.tail == no_index)
+   {
+      bucket.head = index;
+
+      if (list_index != expiring_list)
+      {
+         occupied[list_index / 64] |= uint64_t{ 1 } << (list_index % 64);
+      }
+   }
+   else
+   {
+      timers[bucket.tail].next = index;
+   }
+
+   bucket.tail = index;
+}
+
+void timer_wheel::unlink(
+   const uint32_t index)
+{
+   timer &entry = timers[index];
+
+   list &bucket = lists[entry.list];
+
+   if (entry.prev == no_index)
+   {
+      bucket.head = entry.next;
+   }
+   else
+   {
+      timers[entry.prev].next = entry.next;
+   }
+
+   if (entry.next == no_index)
+   {
+      bucket.tail = entry.prev;
+   }
+   else
+   {
+      timers[entry.next].prev = entry.prev;
+   }
+
+   if (bucket.head == no_index && entry.list != expiring_list)
+   {
+      occupied[entry.list / 64] &= ~(uint64_t{ 1 } << (entry.list % 64));
+   }
+}
+
+void timer_wheel::cascade(
+   const uint32_t level)
+{
+   const uint32_t list_index = first_list(level) + static_cast<uint32_t>((current >> shift(level)) & (level_buckets - 1));
+
+   list &bucket = lists[list_index];
+
+   uint32_t index = bucket.head;
+
+   bucket = list{ no_index, no_index };
+
+   occupied[list_index / 64] &= ~(uint64_t{ 1 } << (list_index % 64));
+
+   while (index != no_index)
+   {
+      const uint32_t next = timers[index].next;
+
+      place(index);
+
+      index = next;
+   }
+}
+
+// The distance from start to the first set bit, wrapping around, or 64 if no
+// bits are set.
+
+static uint32_t distance_to_next_bit(
+   const uint64_t bits,
+   const uint32_t start)
+{
+   return bits ? static_cast<uint32_t>(std::countr_zero(std::rotr(bits, static_cast<int>(start)))) : 64;
+}
+
+uint64_t timer_wheel::next_expiry() const
+{
+   if (lists[expiring_list].head != no_index)
+   {
+      return time;
+   }
+
+   if (count == 0)
+   {
+      return no_deadline;
+   }
+
+   uint64_t next = no_deadline;
+
+   // level 0 holds the timers that are due within the next 256 ticks, at most
+   // one revolution away
+
+   const uint32_t position = static_cast<uint32_t>(current & (level_0_buckets - 1));
+
+   const uint32_t words = level_0_buckets / 64;
+
+   // the words from the one that holds the current position, wrapping around
+   // to it again for the buckets before the position
+
+   for (uint32_t i = 0; i <= words && next == no_deadline; ++i)
+   {
+      const uint32_t word = ((position / 64) + i) % words;
+
+      const uint64_t from_position = ~uint64_t{ 0 } << (position % 64);
+
+      uint64_t bits = occupied[word];
+
+      if (i == 0)
+      {
+         bits &= from_position;
+      }
+      else if (i == words)
+      {
+         bits &= ~from_position;
+      }
+
+      if (bits)
+      {
+         const uint32_t bucket = (word * 64) + static_cast<uint32_t>(std::countr_zero(bits));
+
+         next = current + ((bucket - position) & (level_0_buckets - 1));
+      }
+   }
+
+   // the higher levels are cascaded when the time reaches the start of the
+   // range of ticks that the bucket covers. The bucket at the current position
+   // is cascaded now if we're on a boundary, otherwise it's a revolution away
+
+   for (uint32_t level = 1; level < levels; ++level)
+   {
+      const uint64_t bits = occupied[(level_0_buckets / 64) + level - 1];
+
+      if (!bits)
+      {
+         continue;
+      }
+
+      const uint32_t level_shift = shift(level);
+
+      const uint64_t ticks = current >> level_shift;
+
+      const bool boundary = (current & ((uint64_t{ 1 } << level_shift) - 1)) == 0;
+
+      const uint32_t start = static_cast<uint32_t>((ticks + (boundary ? 0 : 1)) & (level_buckets - 1));
+
+      const uint64_t distance = distance_to_next_bit(bits, start) + (boundary ? 0 : 1);
+
+      const uint64_t cascade_at = (ticks + distance) << level_shift;
+
+      if (cascade_at < next)
+      {
+         next = cascade_at;
+      }
+   }
+
+   return next;
+}
+
+bool timer_wheel::collect(
+   const uint64_t now)
+{
+   if (now > time)
+   {
+      time = now;
+   }
+
+   while (current <= now)
+   {
+      const uint64_t next = next_expiry();
+
+      if (next > now)
+      {
+         // nothing is due, or will need cascading, before now; the empty
+         // buckets in between need no work
+
+         current = now + 1;
+
+         return false;
+      }
+
+      current = next;
+
+      // cascade from the lowest level up, a higher level is only cascaded
+      // when the level below has wrapped
+
+      for (uint32_t level = 1; level < levels; ++level)
+      {
+         if (current & ((uint64_t{ 1 } << shift(level)) - 1))
+         {
+            break;
+         }
+
+         cascade(level);
+      }
+
+      const uint32_t list_index = static_cast<uint32_t>(current & (level_0_buckets - 1));
+
+      list &bucket = lists[list_index];
+
+      ++current;
+
+      if (bucket.head != no_index)
+      {
+         // moved to the expiring list, so that handlers can safely arm and
+         // cancel timers, including those in the same bucket
+
+         for (uint32_t index = bucket.head; index != no_index; index = timers[index].next)
+         {
+            timers[index].list = expiring_list;
+         }
+
+         lists[expiring_list] = bucket;
+
+         bucket = list{ no_index, no_index };
+
+         occupied[list_index / 64] &= ~(uint64_t{ 1 } << (list_index % 64));
+
+         return true;
+      }
+   }
+
+   return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: timer_wheel.cpp
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,235 @@
+#pragma once
+///////////////////////////////////////////////////////////////////////////////
+// File: timer_wheel.h
+///////////////////////////////////////////////////////////////////////////////
+//
+// The code in this file is released under the The MIT License (MIT)
+//
+// Copyright (c) 2024 Len Holgate.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A hierarchical timing wheel. Time is measured in ticks, the caller decides
+// what a tick is and tells the wheel what the time is when it calls advance().
+// Arming and cancelling a timer is O(1), expiry is O(1) per timer plus the
+// cost of cascading timers down the levels as time passes; each timer is
+// cascaded at most once per level.
+// The first level has 256 buckets of one tick, the four levels above it have
+// 64 buckets each, so timers up to 2^32 ticks away are held directly; anything
+// further away is held in the last level and re-placed as it gets closer.
+// Timers are stored in a single vector and linked by index so that millions of
+// timers cost 32 bytes each and no allocations once the vector has grown.
+// Not thread safe, the owner locks.
+
+class timer_wheel
+{
+   public :
+
+      using timer_id = uint64_t;
+
+      static constexpr timer_id no_timer = 0;
+
+      static constexpr uint64_t no_deadline = UINT64_MAX;
+
+      explicit timer_wheel(
+         uint64_t now = 0,
+         uint32_t initial_timers = 0);
+
+      timer_wheel(const timer_wheel &) = delete;
+      timer_wheel(timer_wheel &&) = delete;
+
+      timer_wheel& operator=(const timer_wheel &) = delete;
+      timer_wheel& operator=(timer_wheel &&) = delete;
+
+      // A deadline that has already passed expires on the next call to
+      // advance(). The context is passed back when the timer expires.
+
+      timer_id arm(
+         uint64_t deadline,
+         uintptr_t context);
+
+      // Returns false if the timer has already expired or been cancelled, ids
+      // are not reused so a stale id is harmless.
+
+      bool cancel(
+         timer_id id);
+
+      bool armed(
+         timer_id id) const;
+
+      // The earliest tick at which advance() might expire something, or
+      // no_deadline if no timers are armed. This is exact for timers that are
+      // within 256 ticks, further out it's the tick at which the next timers
+      // are cascaded, which may expire nothing; advance() then and ask again.
+
+      uint64_t next_expiry() const;
+
+      // Expires every timer whose deadline is at or before now, calling
+      // handler(id, context) for each one in deadline order. The handler can
+      // arm and cancel timers. Returns the number of timers that expired.
+
+      template <typename handler>
+      size_t advance(
+         const uint64_t now,
+         handler &&on_expiry)
+      {
+         size_t expired = 0;
+
+         while (lists[expiring_list].head != no_index || collect(now))
+         {
+            const uint32_t index = lists[expiring_list].head;
+
+            const timer_id id = make_id(index);
+
+            const uintptr_t context = timers[index].context;
+
+            unlink(index);
+
+            release(index);
+
+            ++expired;
+
+            on_expiry(id, context);
+         }
+
+         return expired;
+      }
+
+      // The time as of the last call to advance(), or construction.
+
+      uint64_t now() const
+      {
+         return time;
+      }
+
+      size_t size() const
+      {
+         return count;
+      }
+
+      size_t capacity() const
+      {
+         return timers.size();
+      }
+
+   private :
+
+      static constexpr uint32_t no_index = UINT32_MAX;
+
+      static constexpr uint32_t level_0_bits = 8;
+      static constexpr uint32_t level_bits = 6;
+      static constexpr uint32_t levels = 5;
+
+      static constexpr uint32_t level_0_buckets = 1 << level_0_bits;
+      static constexpr uint32_t level_buckets = 1 << level_bits;
+
+      static constexpr uint64_t max_delta = (uint64_t{ 1 } << (level_0_bits + ((levels - 1) * level_bits))) - 1;
+
+      // lists are the level 0 buckets, then the buckets of each higher level,
+      // then the list of timers that are being expired
+
+      static constexpr uint32_t num_lists = level_0_buckets + ((levels - 1) * level_buckets) + 1;
+
+      static constexpr uint32_t expiring_list = num_lists - 1;
+
+      struct timer
+      {
+         uint64_t deadline;
+
+         uintptr_t context;
+
+         uint32_t next;
+
+         uint32_t prev;
+
+         uint32_t list;               // no_index when free
+
+         uint32_t generation;
+      };
+
+      struct list
+      {
+         uint32_t head;
+
+         uint32_t tail;
+      };
+
+      static uint32_t shift(
+         uint32_t level);
+
+      static uint32_t first_list(
+         uint32_t level);
+
+      timer_id make_id(
+         uint32_t index) const;
+
+      uint32_t index_of(
+         timer_id id) const;
+
+      uint32_t allocate();
+
+      void release(
+         uint32_t index);
+
+      void place(
+         uint32_t index);
+
+      void link(
+         uint32_t index,
+         uint32_t list_index);
+
+      void unlink(
+         uint32_t index);
+
+      void cascade(
+         uint32_t level);
+
+      bool collect(
+         uint64_t now);
+
+      std::vector<timer> timers;
+
+      uint32_t free_list;
+
+      std::array<list, num_lists> lists;
+
+      // a bit per bucket that has timers, so that the next expiry can be found
+      // without walking empty buckets
+
+      std::array<uint64_t, levels - 1 + (level_0_buckets / 64)> occupied;
+
+      // the next tick to process, and the time we were last given
+
+      uint64_t current;
+
+      uint64_t time;
+
+      size_t count;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// End of file: timer_wheel.h
+///////////////////////////////////////////////////////////////////////////////